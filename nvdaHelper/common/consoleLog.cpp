@@ -0,0 +1,22 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include <iostream>
+#include <common/log.h>
+
+//Code built on its own, such as the vbufcore library used for testing on other platforms, logs to the console rather than to NVDA.
+
+void logMessage(int /*level*/, const wchar_t* msg) {
+	std::wcerr<<msg;
+}
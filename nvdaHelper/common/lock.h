@@ -16,7 +16,36 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #define NVDAHELPER_LOCK_H
 
 #include <cassert>
+#ifdef _WIN32
 #include <windows.h>
+#else
+//Only used to build and test code that does not depend on Windows on other platforms
+#include <pthread.h>
+#endif
+
+/**
+ * Atomically increments a value.
+ * @return the incremented value.
+ */
+inline long lockedIncrement(volatile long* value) {
+#ifdef _WIN32
+	return InterlockedIncrement(value);
+#else
+	return __sync_add_and_fetch(value,1);
+#endif
+}
+
+/**
+ * Atomically decrements a value.
+ * @return the decremented value.
+ */
+inline long lockedDecrement(volatile long* value) {
+#ifdef _WIN32
+	return InterlockedDecrement(value);
+#else
+	return __sync_sub_and_fetch(value,1);
+#endif
+}
 
 /**
  * A class that provides a locking mechonism on objects.
@@ -24,30 +53,171 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
  */
 class LockableObject {
 	private:
+#ifdef _WIN32
 	CRITICAL_SECTION _cs;
+#else
+	pthread_mutex_t _mutex;
+#endif
 
 	public:
 
 	LockableObject() {
+#ifdef _WIN32
 		InitializeCriticalSection(&_cs);
+#else
+		pthread_mutexattr_t attributes;
+		pthread_mutexattr_init(&attributes);
+		pthread_mutexattr_settype(&attributes,PTHREAD_MUTEX_RECURSIVE);
+		pthread_mutex_init(&_mutex,&attributes);
+		pthread_mutexattr_destroy(&attributes);
+#endif
 	}
 
 	virtual ~LockableObject() {
+#ifdef _WIN32
 		DeleteCriticalSection(&_cs);
+#else
+		pthread_mutex_destroy(&_mutex);
+#endif
 	}
 
 /**
  * Acquires access (possibly waighting until its free).
  */
 	void acquire() {
+#ifdef _WIN32
 	EnterCriticalSection(&_cs);
+#else
+	pthread_mutex_lock(&_mutex);
+#endif
 }
 
 /**
  * Releases exclusive access of the object.
  */
 	void release() {
+#ifdef _WIN32
 		LeaveCriticalSection(&_cs);
+#else
+		pthread_mutex_unlock(&_mutex);
+#endif
+	}
+
+};
+
+/**
+ * A lock that is either held exclusively by one thread, or shared by any number of threads, such as readers of a virtual buffer.
+ * Exclusive access is reentrant for the same thread, and the thread holding it may also take shared access.
+ * A thread holding shared access must not take it again or ask for exclusive access, as it could then wait forever for a waiting writer.
+ * A thread waiting for exclusive access keeps other threads from taking shared access, so that writers are not starved by a stream of readers.
+ * Built only on a reentrant lock and an event, so that it works on all supported versions of Windows.
+ */
+class SharedLockableObject {
+	private:
+
+/**
+ * Held by a writer for as long as it has exclusive access, and briefly by a reader while it registers.
+ */
+	LockableObject writerLock;
+
+/**
+ * The number of threads holding shared access.
+ */
+	volatile long readerCount;
+
+/**
+ * The number of times the thread with exclusive access has acquired it, only touched while holding writerLock.
+ */
+	int exclusiveCount;
+
+#ifdef _WIN32
+/**
+ * An auto reset event set when the last reader releases, which a writer waits for.
+ */
+	HANDLE noReadersEvent;
+#else
+	pthread_mutex_t readerMutex;
+	pthread_cond_t noReadersCondition;
+#endif
+
+	public:
+
+	SharedLockableObject(): writerLock(), readerCount(0), exclusiveCount(0) {
+#ifdef _WIN32
+		noReadersEvent=CreateEvent(NULL,FALSE,FALSE,NULL);
+		assert(noReadersEvent);
+#else
+		pthread_mutex_init(&readerMutex,NULL);
+		pthread_cond_init(&noReadersCondition,NULL);
+#endif
+	}
+
+	virtual ~SharedLockableObject() {
+		assert(readerCount==0);
+#ifdef _WIN32
+		CloseHandle(noReadersEvent);
+#else
+		pthread_cond_destroy(&noReadersCondition);
+		pthread_mutex_destroy(&readerMutex);
+#endif
+	}
+
+/**
+ * Acquires exclusive access, waiting until other writers have released and all readers have released.
+ */
+	void acquire() {
+		writerLock.acquire();
+		if(++exclusiveCount>1) return;
+#ifdef _WIN32
+		//The event may have been left set by a reader that released before this check, so always check the count again
+		while(readerCount>0) {
+			WaitForSingleObject(noReadersEvent,INFINITE);
+		}
+#else
+		pthread_mutex_lock(&readerMutex);
+		while(readerCount>0) {
+			pthread_cond_wait(&noReadersCondition,&readerMutex);
+		}
+		pthread_mutex_unlock(&readerMutex);
+#endif
+	}
+
+/**
+ * Releases exclusive access.
+ */
+	void release() {
+		assert(exclusiveCount>0);
+		--exclusiveCount;
+		writerLock.release();
+	}
+
+/**
+ * Acquires shared access, waiting until any writer has released.
+ */
+	void acquireShared() {
+		writerLock.acquire();
+		lockedIncrement(&readerCount);
+		writerLock.release();
+	}
+
+/**
+ * Releases shared access.
+ */
+	void releaseShared() {
+#ifdef _WIN32
+		long count=lockedDecrement(&readerCount);
+		if(count==0) {
+			SetEvent(noReadersEvent);
+		}
+#else
+		pthread_mutex_lock(&readerMutex);
+		long count=lockedDecrement(&readerCount);
+		if(count==0) {
+			pthread_cond_broadcast(&noReadersCondition);
+		}
+		pthread_mutex_unlock(&readerMutex);
+#endif
+		assert(count>=0);
 	}
 
 };
@@ -63,11 +233,11 @@ class LockableAutoFreeObject: private LockableObject {
 	protected:
 
 long incRef() {
-		return InterlockedIncrement(&_refCount);
+		return lockedIncrement(&_refCount);
 	}
 
 	long decRef() {
-		long refCount=InterlockedDecrement(&_refCount);
+		long refCount=lockedDecrement(&_refCount);
 		if(refCount==0) {
 			delete this;
 		}
@@ -19,7 +19,19 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include <sstream>
 #include <common/lock.h>
 
+#ifdef _WIN32
+#include <crtdbg.h>
 #define nhAssert _ASSERTE
+#define _LOG_THREAD_ID GetCurrentThreadId()
+#define _LOG_FUNCTION_NAME _STR2WSTR(__FUNCTION__)
+#else
+//Only used to build and test code that does not depend on Windows on other platforms
+#include <cassert>
+#define nhAssert assert
+#define _LOG_THREAD_ID pthread_self()
+//__FUNCTION__ is not a string literal here, so it can not be made wide, but a wide stream still accepts it
+#define _LOG_FUNCTION_NAME __FUNCTION__
+#endif
 
 void logMessage(int level, const wchar_t* msg);
 
@@ -42,7 +54,7 @@ static LockableObject _logLock;
 #define _LOG_MSG_MACRO(level,message) {\
 	_logLock.acquire();\
 	_logStringStream.str(L"");\
-	_logStringStream<<L"Thread "<<GetCurrentThreadId()<<L", "<<_STR2WSTR(__FILE__)<<L", "<<_STR2WSTR(__FUNCTION__)<<L", "<<__LINE__<<L":"<<std::endl<<message<<std::endl;\
+	_logStringStream<<L"Thread "<<_LOG_THREAD_ID<<L", "<<_STR2WSTR(__FILE__)<<L", "<<_LOG_FUNCTION_NAME<<L", "<<__LINE__<<L":"<<std::endl<<message<<std::endl;\
 	logMessage(level,_logStringStream.str().c_str());\
 	_logLock.release();\
 }
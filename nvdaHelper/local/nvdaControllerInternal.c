@@ -65,6 +65,11 @@ error_status_t __stdcall nvdaControllerInternal_vbufChangeNotify(const int rootD
 	return _nvdaControllerInternal_vbufChangeNotify(rootDocHandle,rootID);
 }
 
+error_status_t(__stdcall *_nvdaControllerInternal_vbufEditsNotify)(const int, const int, const int, const int*);
+error_status_t __stdcall nvdaControllerInternal_vbufEditsNotify(const int rootDocHandle, const int rootID, const int editCount, const int* edits) {
+	return _nvdaControllerInternal_vbufEditsNotify(rootDocHandle,rootID,editCount,edits);
+}
+
 error_status_t(__stdcall *_nvdaControllerInternal_installAddonPackageFromPath)(const wchar_t *);
 error_status_t __stdcall nvdaControllerInternal_installAddonPackageFromPath(const wchar_t *addonPath) {
 	return _nvdaControllerInternal_installAddonPackageFromPath(addonPath);
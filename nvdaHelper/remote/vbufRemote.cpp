@@ -13,14 +13,75 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
 
 #include <map>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iterator>
+#include <algorithm>
 #include "vbufRemote.h"
 #include <vbufBase/backend.h>
+#include <common/xml.h>
+#include <common/log.h>
 #include "dllmain.h"
 
 using namespace std;
 
 map<VBufBackend_t*,HINSTANCE> backendLibHandles;
 
+/**
+ * The amount of characters of text without markup fetched at a time, between which shared access to the buffer is dropped so that updates can go ahead.
+ */
+#define TEXTREAD_CHUNKLENGTH 16384
+
+/**
+ * The amount of times text without markup is read a chunk at a time before giving up on the buffer staying the same, and reading it while holding shared access throughout.
+ */
+#define TEXTREAD_MAXATTEMPTS 3
+
+/**
+ * Fetches text without markup a chunk at a time, so that a long read, such as of the entire document, does not keep the buffer from being updated.
+ * The text is only kept if the buffer's version was the same for every chunk, otherwise it is read again.
+ */
+int getPlainTextInRange(VBufBackend_t* backend, int startOffset, int endOffset, wchar_t** text) {
+	for(int attempt=1;;++attempt) {
+		bool holdAccess=(attempt>=TEXTREAD_MAXATTEMPTS);
+		backend->lock.acquireShared();
+		if(startOffset<0||startOffset>=endOffset||endOffset>backend->getTextLength()) {
+			backend->lock.releaseShared();
+			LOG_DEBUGWARNING(L"Bad offsets of "<<startOffset<<L" and "<<endOffset<<L", returning false");
+			return false;
+		}
+		//Text without markup is exactly as long as the range, so there is no need to measure it first
+		*text=SysAllocStringLen(NULL,static_cast<UINT>(endOffset-startOffset));
+		if(!(*text)) {
+			backend->lock.releaseShared();
+			return false;
+		}
+		unsigned int version=backend->getVersion();
+		bool changed=false;
+		for(int chunkStart=startOffset;chunkStart<endOffset;) {
+			if(chunkStart>startOffset&&!holdAccess) {
+				backend->lock.releaseShared();
+				backend->lock.acquireShared();
+				if(backend->getVersion()!=version) {
+					changed=true;
+					break;
+				}
+			}
+			int chunkEnd=min(chunkStart+TEXTREAD_CHUNKLENGTH,endOffset);
+			VBufStorage_textSink_t sink((*text)+(chunkStart-startOffset),chunkEnd-chunkStart);
+			backend->getTextInRange(chunkStart,chunkEnd,sink,false);
+			nhAssert(sink.getLength()==static_cast<size_t>(chunkEnd-chunkStart));
+			chunkStart=chunkEnd;
+		}
+		backend->lock.releaseShared();
+		if(!changed) return true;
+		LOG_DEBUG(L"Buffer changed while reading text, reading again");
+		SysFreeString(*text);
+		*text=NULL;
+	}
+}
+
 extern "C" {
 
 VBufRemote_bufferHandle_t VBufRemote_createBuffer(handle_t bindingHandle, int docHandle, int ID, const wchar_t* backendName) {
@@ -61,67 +122,102 @@ void VBufRemote_destroyBuffer(VBufRemote_bufferHandle_t* buffer) {
 
 int VBufRemote_getFieldNodeOffsets(VBufRemote_bufferHandle_t buffer, VBufRemote_nodeHandle_t node, int *startOffset, int *endOffset) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	VBufStorage_fieldNode_t* realNode=(VBufStorage_fieldNode_t*)node;
-	backend->lock.acquire();
+	backend->lock.acquireShared();
+	VBufStorage_fieldNode_t* realNode=backend->getNodeForHandle(node);
 	int res=backend->getFieldNodeOffsets(realNode,startOffset,endOffset);
-	backend->lock.release();
+	backend->lock.releaseShared();
 	return res;
 }
 
 int VBufRemote_isFieldNodeAtOffset(VBufRemote_bufferHandle_t buffer, VBufRemote_nodeHandle_t node, int offset) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	VBufStorage_fieldNode_t* realNode=(VBufStorage_fieldNode_t*)node;
-	backend->lock.acquire();
+	backend->lock.acquireShared();
+	VBufStorage_fieldNode_t* realNode=backend->getNodeForHandle(node);
 	int res=backend->isFieldNodeAtOffset(realNode,offset);
-	backend->lock.release();
+	backend->lock.releaseShared();
 	return res;
 }
 
 int VBufRemote_locateTextFieldNodeAtOffset(VBufRemote_bufferHandle_t buffer, int offset, int *nodeStartOffset, int *nodeEndOffset, VBufRemote_nodeHandle_t* foundNode) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
-	*foundNode=(VBufRemote_nodeHandle_t)(backend->locateTextFieldNodeAtOffset(offset,nodeStartOffset,nodeEndOffset));
-	backend->lock.release();
+	backend->lock.acquireShared();
+	*foundNode=backend->getHandleForNode(backend->locateTextFieldNodeAtOffset(offset,nodeStartOffset,nodeEndOffset));
+	backend->lock.releaseShared();
 	return (*foundNode)!=NULL;
 }
 
 int VBufRemote_locateControlFieldNodeAtOffset(VBufRemote_bufferHandle_t buffer, int offset, int *nodeStartOffset, int *nodeEndOffset, int *docHandle, int *ID, VBufRemote_nodeHandle_t* foundNode) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
-	*foundNode=(VBufRemote_nodeHandle_t)(backend->locateControlFieldNodeAtOffset(offset,nodeStartOffset,nodeEndOffset,docHandle,ID));
-	backend->lock.release();
+	backend->lock.acquireShared();
+	*foundNode=backend->getHandleForNode(backend->locateControlFieldNodeAtOffset(offset,nodeStartOffset,nodeEndOffset,docHandle,ID));
+	backend->lock.releaseShared();
 	return (*foundNode)!=0;
 }
 
 int VBufRemote_getControlFieldNodeWithIdentifier(VBufRemote_bufferHandle_t buffer, int docHandle, int ID, VBufRemote_nodeHandle_t* foundNode) { 
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
-	*foundNode=(VBufRemote_nodeHandle_t)(backend->getControlFieldNodeWithIdentifier(docHandle,ID));
-	backend->lock.release();
+	backend->lock.acquireShared();
+	*foundNode=backend->getHandleForNode(backend->getControlFieldNodeWithIdentifier(docHandle,ID));
+	backend->lock.releaseShared();
 	return (*foundNode)!=0;
 }
 
 int VBufRemote_getIdentifierFromControlFieldNode(VBufRemote_bufferHandle_t buffer, VBufRemote_nodeHandle_t node, int* docHandle, int* ID) { 
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
-	int res=backend->getIdentifierFromControlFieldNode((VBufStorage_controlFieldNode_t*)node,docHandle,ID);
-	backend->lock.release();
+	backend->lock.acquireShared();
+	int res=backend->getIdentifierFromControlFieldNode((VBufStorage_controlFieldNode_t*)(backend->getNodeForHandle(node)),docHandle,ID);
+	backend->lock.releaseShared();
 	return res;
 }
 
 int VBufRemote_findNodeByAttributes(VBufRemote_bufferHandle_t buffer, int offset, int direction, const wchar_t* attribs, const wchar_t* regexp, int *startOffset, int *endOffset, VBufRemote_nodeHandle_t* foundNode) { 
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
-	*foundNode=(VBufRemote_nodeHandle_t)(backend->findNodeByAttributes(offset,(VBufStorage_findDirection_t)direction,attribs,regexp,startOffset,endOffset));
-	backend->lock.release();
+	backend->lock.acquireShared();
+	*foundNode=backend->getHandleForNode(backend->findNodeByAttributes(offset,(VBufStorage_findDirection_t)direction,attribs,regexp,startOffset,endOffset));
+	backend->lock.releaseShared();
 	return (*foundNode)!=0;
 }
 
+int VBufRemote_findAllNodesByAttributes(VBufRemote_bufferHandle_t buffer, const wchar_t* attribs, const wchar_t* regexp, const wchar_t* returnAttribs, wchar_t** foundNodes) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	wistringstream returnAttribsStream(returnAttribs);
+	vector<wstring> returnAttribsList((istream_iterator<wstring,wchar_t>(returnAttribsStream)),istream_iterator<wstring,wchar_t>());
+	vector<VBufStorage_foundNode_t> nodes;
+	wstring text;
+	backend->lock.acquireShared();
+	int res=backend->findAllNodesByAttributes(attribs,regexp,nodes);
+	if(res) {
+		//Handles and attribute values must be fetched while the nodes are still sure to exist
+		for(vector<VBufStorage_foundNode_t>::iterator i=nodes.begin();i!=nodes.end();++i) {
+			wostringstream s;
+			s<<L"<node handle=\""<<backend->getHandleForNode(i->node)<<L"\" _startOffset=\""<<i->startOffset<<L"\" _endOffset=\""<<i->endOffset<<L"\" ";
+			text+=s.str();
+			for(vector<wstring>::iterator j=returnAttribsList.begin();j!=returnAttribsList.end();++j) {
+				const wstring* value=i->node->getAttributeValue(*j);
+				if(!value) continue;
+				text+=*j;
+				text+=L"=\"";
+				for(wstring::const_iterator k=value->begin();k!=value->end();++k) {
+					appendCharToXML(*k,text,true);
+				}
+				text+=L"\" ";
+			}
+			text+=L"/>";
+		}
+	}
+	backend->lock.releaseShared();
+	if(!res) {
+		return false;
+	}
+	*foundNodes=SysAllocStringLen(text.c_str(),static_cast<UINT>(text.length()));
+	return true;
+}
+
 int VBufRemote_getSelectionOffsets(VBufRemote_bufferHandle_t buffer, int *startOffset, int *endOffset) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
+	backend->lock.acquireShared();
 	int res=backend->getSelectionOffsets(startOffset,endOffset);
-	backend->lock.release();
+	backend->lock.releaseShared();
 	return res;
 }
 
@@ -135,38 +231,70 @@ int VBufRemote_setSelectionOffsets(VBufRemote_bufferHandle_t buffer, int startOf
 
 int VBufRemote_getTextLength(VBufRemote_bufferHandle_t buffer) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
+	backend->lock.acquireShared();
 	int res=backend->getTextLength();
-	backend->lock.release();
+	backend->lock.releaseShared();
 	return res;
 }
 
 int VBufRemote_getTextInRange(VBufRemote_bufferHandle_t buffer, int startOffset, int endOffset, wchar_t** text, boolean useMarkup) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
-	VBufStorage_textContainer_t* textContainer=backend->getTextInRange(startOffset,endOffset,useMarkup!=false);
-	backend->lock.release();
-	if(textContainer==NULL) {
+	if(!useMarkup) {
+		return getPlainTextInRange(backend,startOffset,endOffset,text);
+	}
+	backend->lock.acquireShared();
+	//Measure the text first, so it can be written straight in to a BSTR of the right size
+	VBufStorage_textSink_t measuringSink;
+	if(!backend->getTextInRange(startOffset,endOffset,measuringSink,useMarkup!=false)) {
+		backend->lock.releaseShared();
 		return false;
 	}
-	*text=SysAllocString(textContainer->getString().c_str());
-	textContainer->destroy();
-	return true;
+	*text=SysAllocStringLen(NULL,static_cast<UINT>(measuringSink.getLength()));
+	if(*text) {
+		VBufStorage_textSink_t sink(*text,measuringSink.getLength());
+		backend->getTextInRange(startOffset,endOffset,sink,useMarkup!=false);
+		nhAssert(sink.getLength()==measuringSink.getLength());
+	}
+	backend->lock.releaseShared();
+	return (*text)!=NULL;
 }
 
 int VBufRemote_getLineOffsets(VBufRemote_bufferHandle_t buffer, int offset, int maxLineLength, boolean useScreenLayout, int *startOffset, int *endOffset) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	backend->lock.acquire();
+	backend->lock.acquireShared();
 	int res=backend->getLineOffsets(offset,maxLineLength,useScreenLayout!=false,startOffset,endOffset);
-	backend->lock.release();
+	backend->lock.releaseShared();
 	return res;
 }
 
+int VBufRemote_getVersion(VBufRemote_bufferHandle_t buffer) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	backend->lock.acquireShared();
+	int version=static_cast<int>(backend->getVersion());
+	backend->lock.releaseShared();
+	return version;
+}
+
+int VBufRemote_getEdits(VBufRemote_bufferHandle_t buffer, wchar_t** edits) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	VBufStorage_textEditList_t editList;
+	backend->lock.acquire();
+	backend->getEdits(editList);
+	backend->lock.release();
+	wostringstream s;
+	for(vector<VBufStorage_textEdit_t>::const_iterator i=editList.getEdits().begin();i!=editList.getEdits().end();++i) {
+		s<<L"<edit _oldStartOffset=\""<<i->oldStart<<L"\" _oldEndOffset=\""<<i->oldEnd<<L"\" _newLength=\""<<i->newLength<<L"\" />";
+	}
+	wstring text=s.str();
+	*edits=SysAllocStringLen(text.c_str(),static_cast<UINT>(text.length()));
+	return (*edits)!=NULL;
+}
+
 int VBufRemote_getNativeHandleForNode(VBufRemote_bufferHandle_t buffer, VBufRemote_nodeHandle_t node) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
-	VBufStorage_controlFieldNode_t* realNode=(VBufStorage_controlFieldNode_t*)node;
 	backend->lock.acquire();
-	int res=backend->getNativeHandleForNode(realNode);
+	VBufStorage_controlFieldNode_t* realNode=(VBufStorage_controlFieldNode_t*)(backend->getNodeForHandle(node));
+	int res=realNode?backend->getNativeHandleForNode(realNode):0;
 	backend->lock.release();
 	return res;
 }
@@ -174,7 +302,7 @@ int VBufRemote_getNativeHandleForNode(VBufRemote_bufferHandle_t buffer, VBufRemo
 int VBufRemote_getNodeForNativeHandle(VBufRemote_bufferHandle_t buffer, int nativeHandle, VBufRemote_nodeHandle_t* node) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
 	backend->lock.acquire();
-	*node=(VBufRemote_nodeHandle_t)(backend->getNodeForNativeHandle(nativeHandle));
+	*node=backend->getHandleForNode(backend->getNodeForNativeHandle(nativeHandle));
 	backend->lock.release();
 	return (*node)!=0;
 }
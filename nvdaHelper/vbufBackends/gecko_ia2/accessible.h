@@ -0,0 +1,231 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef VIRTUALBUFFER_BACKENDS_GECKO_ACCESSIBLE_H
+#define VIRTUALBUFFER_BACKENDS_GECKO_ACCESSIBLE_H
+
+#include <string>
+#include <map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <oleacc.h>
+#include <ia2.h>
+#else
+//The roles and states the gecko renderer checks for, as defined by oleacc.h and IAccessible2, so that it can be built without them
+#define ROLE_SYSTEM_MENUITEM 0xc
+#define ROLE_SYSTEM_APPLICATION 0xe
+#define ROLE_SYSTEM_DOCUMENT 0xf
+#define ROLE_SYSTEM_DIALOG 0x12
+#define ROLE_SYSTEM_SEPARATOR 0x15
+#define ROLE_SYSTEM_TABLE 0x18
+#define ROLE_SYSTEM_COLUMNHEADER 0x19
+#define ROLE_SYSTEM_ROWHEADER 0x1a
+#define ROLE_SYSTEM_CELL 0x1d
+#define ROLE_SYSTEM_LINK 0x1e
+#define ROLE_SYSTEM_LIST 0x21
+#define ROLE_SYSTEM_OUTLINE 0x23
+#define ROLE_SYSTEM_PAGETAB 0x25
+#define ROLE_SYSTEM_GRAPHIC 0x28
+#define ROLE_SYSTEM_TEXT 0x2a
+#define ROLE_SYSTEM_PUSHBUTTON 0x2b
+#define ROLE_SYSTEM_CHECKBUTTON 0x2c
+#define ROLE_SYSTEM_RADIOBUTTON 0x2d
+#define ROLE_SYSTEM_COMBOBOX 0x2e
+#define ROLE_SYSTEM_EQUATION 0x37
+#define ROLE_SYSTEM_BUTTONMENU 0x39
+#define STATE_SYSTEM_UNAVAILABLE 0x1
+#define STATE_SYSTEM_READONLY 0x40
+#define STATE_SYSTEM_INVISIBLE 0x8000
+#define STATE_SYSTEM_FOCUSABLE 0x100000
+#define STATE_SYSTEM_LINKED 0x400000
+#define IA2_ROLE_UNKNOWN 0
+#define IA2_ROLE_EMBEDDED_OBJECT 0x40a
+#define IA2_ROLE_HEADING 0x414
+#define IA2_ROLE_INTERNAL_FRAME 0x418
+#define IA2_ROLE_SECTION 0x424
+#define IA2_ROLE_TEXT_FRAME 0x429
+#define IA2_ROLE_TOGGLE_BUTTON 0x42a
+#define IA2_STATE_EDITABLE 0x8
+#define IA2_STATE_MULTI_LINE 0x200
+#endif
+
+class GeckoVBuf_recordedTree_t;
+
+/**
+ * An accessible object as the gecko renderer sees it: the answers to the questions it asks of an IAccessible2 object.
+ * Each method stands for one or a few calls on the object, and returns false where those calls fail.
+ * The renderer only uses this interface, so that it can render from a live object in the application or from a recording of one.
+ * Accessibles returned by another accessible belong to the caller, which must call release when done with them.
+ */
+class GeckoVBuf_accessible_t {
+	public:
+
+	virtual ~GeckoVBuf_accessible_t() {}
+
+/**
+ * Releases this accessible, which must not be used afterwards.
+ */
+	virtual void release()=0;
+
+/**
+ * @param docHandle memory to place the window holding the object, which is the real Mozilla window rather than any child of it.
+ */
+	virtual bool getDocHandle(int* docHandle)=0;
+
+/**
+ * @param ID memory to place the unique ID of the object within its window.
+ */
+	virtual bool getID(int* ID)=0;
+
+/**
+ * @param role memory to place the IAccessible2 role.
+ */
+	virtual bool getIA2Role(long* role)=0;
+
+/**
+ * Fetches the IAccessible role, which is either a number or a string.
+ * @param role memory to place the role if it is a number.
+ * @param roleString the string to place the role in if it is a string.
+ */
+	virtual bool getRole(long* role, std::wstring& roleString)=0;
+
+	virtual bool getStates(int* states)=0;
+
+	virtual bool getIA2States(int* states)=0;
+
+	virtual bool getKeyboardShortcut(std::wstring& keyboardShortcut)=0;
+
+/**
+ * @param attribs the map to place the IAccessible2 object attributes in.
+ */
+	virtual bool getAttributes(std::map<std::wstring,std::wstring>& attribs)=0;
+
+	virtual bool getName(std::wstring& name)=0;
+
+	virtual bool getDescription(std::wstring& description)=0;
+
+/**
+ * @return true if the object has a value which is not empty.
+ */
+	virtual bool getValue(std::wstring& value)=0;
+
+/**
+ * @param locale the string to place the language and country in, as in "en-US".
+ */
+	virtual bool getLocale(std::wstring& locale)=0;
+
+	virtual bool getLocation(long* left, long* top, long* width, long* height)=0;
+
+/**
+ * @return true if the object is labelled by another object, and that object is not invisible.
+ */
+	virtual bool isLabelVisible()=0;
+
+/**
+ * @param text the string to place the whole IAccessibleText text in.
+ */
+	virtual bool getText(std::wstring& text)=0;
+
+/**
+ * Fetches the text attributes of the run of text at an offset.
+ * @param startOffset memory to place the start of the run.
+ * @param endOffset memory to place the end of the run.
+ * @param attribs the map to place the attributes in.
+ */
+	virtual bool getTextAttributes(long offset, long* startOffset, long* endOffset, std::map<std::wstring,std::wstring>& attribs)=0;
+
+/**
+ * @return true if the object supports IAccessibleHypertext, so that its embedded object characters stand for its children.
+ */
+	virtual bool hasHypertext()=0;
+
+/**
+ * @param offset the offset of an embedded object character in the text.
+ * @return the child the character stands for, or NULL if it can not be fetched.
+ */
+	virtual GeckoVBuf_accessible_t* getEmbeddedObject(long offset)=0;
+
+	virtual bool getChildCount(long* childCount)=0;
+
+/**
+ * @param children the list to place the children that support IAccessible2 in, in order.
+ */
+	virtual void getChildren(std::vector<GeckoVBuf_accessible_t*>& children)=0;
+
+/**
+ * @param actionNames the list to place the name of each action in, in order, with an empty string for an action whose name can not be fetched.
+ */
+	virtual void getActionNames(std::vector<std::wstring>& actionNames)=0;
+
+/**
+ * @return 2 if the object supports IAccessibleTable2, 1 if it only supports IAccessibleTable, or 0 if it is not a table.
+ */
+	virtual int getTableVersion()=0;
+
+/**
+ * Fetches the amount of rows of a table.
+ */
+	virtual bool getRowCount(long* rowCount)=0;
+
+/**
+ * Fetches the amount of columns of a table.
+ */
+	virtual bool getColumnCount(long* columnCount)=0;
+
+/**
+ * Fetches where a cell is from an IAccessibleTable table, by the index of the cell as given by its table-cell-index attribute.
+ */
+	virtual bool getCellExtentsAtIndex(long index, long* row, long* column, long* rowExtents, long* columnExtents)=0;
+
+/**
+ * @return true if the object supports IAccessibleTableCell.
+ */
+	virtual bool isTableCell()=0;
+
+/**
+ * Fetches where a cell supporting IAccessibleTableCell is in its table.
+ */
+	virtual bool getCellExtents(long* row, long* column, long* rowExtents, long* columnExtents)=0;
+
+/**
+ * Fetches the header cells of a cell supporting IAccessibleTableCell.
+ * @param columnHeaders true for the column headers, false for the row headers.
+ * @param headerCells the string to place the doc handle and ID of each header cell in, as in "docHandle,ID;".
+ */
+	virtual bool getHeaderCells(bool columnHeaders, std::wstring& headerCells)=0;
+
+/**
+ * @return the table of a cell supporting IAccessibleTableCell, or NULL if it can not be fetched.
+ */
+	virtual GeckoVBuf_accessible_t* getCellTable()=0;
+
+/**
+ * Fetches the name and version of the toolkit of the application the object is in, such as "Gecko".
+ */
+	virtual bool getToolkit(std::wstring& name, std::wstring& version)=0;
+
+/**
+ * Fetches the answers to all the questions a render may ask of this object and its descendants at once, for providers that can do so with fewer calls than asking each object in turn.
+ * This includes the tables of any cells in the subtree, as a re-rendered cell asks for its table.
+ * The renderer then renders from the tree rather than from this object.
+ * @param tree the empty tree to record the answers in, this object being its first object.
+ * @return true if the subtree was fetched, false if the provider can only answer one question at a time, which is the default.
+ */
+	virtual bool fetchSubtree(GeckoVBuf_recordedTree_t& /*tree*/) { return false; }
+
+};
+
+#endif
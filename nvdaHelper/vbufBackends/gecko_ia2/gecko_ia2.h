@@ -16,22 +16,15 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #define VIRTUALBUFFER_BACKENDS_EXAMPLE_H
 
 #include <vbufBase/backend.h>
+#include "renderer.h"
 
 class GeckoVBufBackend_t: public VBufBackend_t {
 	private:
 
-	VBufStorage_fieldNode_t* fillVBuf(IAccessible2* pacc,
-		VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parentNode, VBufStorage_fieldNode_t* previousNode,
-		IAccessibleTable* paccTable=NULL, IAccessibleTable2* paccTable2=NULL, long tableID=0,
-		bool ignoreInteractiveUnlabelledGraphics=false
-	);
-
-	void versionSpecificInit(IAccessible2* pacc);
-
-	void fillTableCellInfo_IATable2(VBufStorage_controlFieldNode_t* node, IAccessibleTableCell* paccTableCell);
-
-	bool shouldDisableTableHeaders;
-	bool hasEncodedAccDescription;
+/**
+ * Renders the objects of the document, which it knows through GeckoVBuf_IA2Accessible_t.
+ */
+	GeckoVBufRenderer_t renderer;
 
 	protected:
 
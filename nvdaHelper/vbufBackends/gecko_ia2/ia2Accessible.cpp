@@ -0,0 +1,478 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2007-2013 NV Access Limited
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include <windows.h>
+#include <oleacc.h>
+#include <string>
+#include <sstream>
+#include <ia2.h>
+#include <common/ia2utils.h>
+#include <common/log.h>
+#include "ia2Accessible.h"
+
+using namespace std;
+
+#define NAVRELATION_LABELLED_BY 0x1003
+
+HWND findRealMozillaWindow(HWND hwnd) {
+	if(hwnd==0||!IsWindow(hwnd))
+		return (HWND)0;
+
+	wchar_t className[256];
+	bool foundWindow=false;
+	HWND tempWindow=hwnd;
+	do {
+		if(GetClassName(tempWindow,className,256)==0)
+			return hwnd;
+		if(wcscmp(L"MozillaWindowClass",className)!=0)
+			foundWindow=true;
+		else
+			tempWindow=GetAncestor(tempWindow,GA_PARENT);
+	} while(tempWindow&&!foundWindow);
+	if(GetClassName(tempWindow,className,256)!=0&&wcsstr(className,L"Mozilla")==className)
+		hwnd=tempWindow;
+	return hwnd;
+}
+
+/**
+ * Wraps an object in an accessible, taking over the reference to it.
+ * @return the accessible, or NULL if the object does not support IAccessible2.
+ */
+GeckoVBuf_accessible_t* accessibleFromUnknown(IUnknown* punk) {
+	IAccessible2* pacc=NULL;
+	if(punk->QueryInterface(IID_IAccessible2,(void**)&pacc)!=S_OK||!pacc)
+		return NULL;
+	GeckoVBuf_accessible_t* acc=new GeckoVBuf_IA2Accessible_t(pacc);
+	pacc->Release();
+	return acc;
+}
+
+GeckoVBuf_IA2Accessible_t::GeckoVBuf_IA2Accessible_t(IAccessible2* paccArg): pacc(paccArg), paccText(NULL), paccHypertext(NULL), paccTable(NULL), paccTable2(NULL), paccTableCell(NULL), queriedText(false), queriedHypertext(false), queriedTable(false), queriedTableCell(false), childCount(-1) {
+	nhAssert(pacc);
+	pacc->AddRef();
+}
+
+GeckoVBuf_IA2Accessible_t::~GeckoVBuf_IA2Accessible_t() {
+	if(paccText)
+		paccText->Release();
+	if(paccHypertext)
+		paccHypertext->Release();
+	if(paccTable)
+		paccTable->Release();
+	if(paccTable2)
+		paccTable2->Release();
+	if(paccTableCell)
+		paccTableCell->Release();
+	pacc->Release();
+}
+
+void GeckoVBuf_IA2Accessible_t::release() {
+	delete this;
+}
+
+IAccessibleText* GeckoVBuf_IA2Accessible_t::getTextInterface() {
+	if(!queriedText) {
+		pacc->QueryInterface(IID_IAccessibleText,(void**)&paccText);
+		queriedText=true;
+	}
+	return paccText;
+}
+
+IAccessibleHypertext* GeckoVBuf_IA2Accessible_t::getHypertextInterface() {
+	if(!queriedHypertext) {
+		pacc->QueryInterface(IID_IAccessibleHypertext,(void**)&paccHypertext);
+		queriedHypertext=true;
+	}
+	return paccHypertext;
+}
+
+IAccessibleTableCell* GeckoVBuf_IA2Accessible_t::getTableCellInterface() {
+	if(!queriedTableCell) {
+		pacc->QueryInterface(IID_IAccessibleTableCell,(void**)&paccTableCell);
+		queriedTableCell=true;
+	}
+	return paccTableCell;
+}
+
+bool GeckoVBuf_IA2Accessible_t::getDocHandle(int* docHandle) {
+	HWND hwnd;
+	if(pacc->get_windowHandle(&hwnd)!=S_OK)
+		return false;
+	*docHandle=(int)findRealMozillaWindow(hwnd);
+	return true;
+}
+
+bool GeckoVBuf_IA2Accessible_t::getID(int* ID) {
+	return pacc->get_uniqueID((long*)ID)==S_OK;
+}
+
+bool GeckoVBuf_IA2Accessible_t::getIA2Role(long* role) {
+	return pacc->role(role)==S_OK;
+}
+
+bool GeckoVBuf_IA2Accessible_t::getRole(long* role, wstring& roleString) {
+	VARIANT varChild;
+	varChild.vt=VT_I4;
+	varChild.lVal=CHILDID_SELF;
+	VARIANT varRole;
+	VariantInit(&varRole);
+	if(pacc->get_accRole(varChild,&varRole)!=S_OK)
+		return false;
+	if(varRole.vt==VT_I4)
+		*role=varRole.lVal;
+	else if(varRole.vt==VT_BSTR&&varRole.bstrVal)
+		roleString=varRole.bstrVal;
+	VariantClear(&varRole);
+	return true;
+}
+
+bool GeckoVBuf_IA2Accessible_t::getStates(int* states) {
+	VARIANT varChild;
+	varChild.vt=VT_I4;
+	varChild.lVal=CHILDID_SELF;
+	VARIANT varState;
+	VariantInit(&varState);
+	if(pacc->get_accState(varChild,&varState)!=S_OK)
+		return false;
+	*states=varState.lVal;
+	VariantClear(&varState);
+	return true;
+}
+
+bool GeckoVBuf_IA2Accessible_t::getIA2States(int* states) {
+	AccessibleStates IA2States;
+	if(pacc->get_states(&IA2States)!=S_OK)
+		return false;
+	*states=(int)IA2States;
+	return true;
+}
+
+/**
+ * Moves a string returned by a call in to a wstring, freeing it.
+ * @return true if the call succeeded and returned a string.
+ */
+bool takeBSTR(HRESULT res, BSTR str, wstring& result) {
+	if(res!=S_OK||!str) {
+		if(str)
+			SysFreeString(str);
+		return false;
+	}
+	result.assign(str,SysStringLen(str));
+	SysFreeString(str);
+	return true;
+}
+
+bool GeckoVBuf_IA2Accessible_t::getKeyboardShortcut(wstring& keyboardShortcut) {
+	VARIANT varChild;
+	varChild.vt=VT_I4;
+	varChild.lVal=CHILDID_SELF;
+	BSTR str=NULL;
+	return takeBSTR(pacc->get_accKeyboardShortcut(varChild,&str),str,keyboardShortcut);
+}
+
+bool GeckoVBuf_IA2Accessible_t::getAttributes(map<wstring,wstring>& attribs) {
+	BSTR str=NULL;
+	wstring attribsString;
+	if(!takeBSTR(pacc->get_attributes(&str),str,attribsString))
+		return false;
+	IA2AttribsToMap(attribsString,attribs);
+	return true;
+}
+
+bool GeckoVBuf_IA2Accessible_t::getName(wstring& name) {
+	VARIANT varChild;
+	varChild.vt=VT_I4;
+	varChild.lVal=CHILDID_SELF;
+	BSTR str=NULL;
+	return takeBSTR(pacc->get_accName(varChild,&str),str,name);
+}
+
+bool GeckoVBuf_IA2Accessible_t::getDescription(wstring& description) {
+	VARIANT varChild;
+	varChild.vt=VT_I4;
+	varChild.lVal=CHILDID_SELF;
+	BSTR str=NULL;
+	return takeBSTR(pacc->get_accDescription(varChild,&str),str,description);
+}
+
+bool GeckoVBuf_IA2Accessible_t::getValue(wstring& value) {
+	VARIANT varChild;
+	varChild.vt=VT_I4;
+	varChild.lVal=CHILDID_SELF;
+	BSTR str=NULL;
+	return takeBSTR(pacc->get_accValue(varChild,&str),str,value)&&!value.empty();
+}
+
+bool GeckoVBuf_IA2Accessible_t::getLocale(wstring& locale) {
+	IA2Locale ia2Locale={0};
+	if(pacc->get_locale(&ia2Locale)!=S_OK)
+		return false;
+	if(ia2Locale.language) {
+		locale.append(ia2Locale.language);
+		SysFreeString(ia2Locale.language);
+	}
+	if(ia2Locale.country) {
+		if(!locale.empty()) {
+			locale.append(L"-");
+			locale.append(ia2Locale.country);
+		}
+		SysFreeString(ia2Locale.country);
+	}
+	if(ia2Locale.variant) {
+		SysFreeString(ia2Locale.variant);
+	}
+	return true;
+}
+
+bool GeckoVBuf_IA2Accessible_t::getLocation(long* left, long* top, long* width, long* height) {
+	VARIANT varChild;
+	varChild.vt=VT_I4;
+	varChild.lVal=CHILDID_SELF;
+	return pacc->accLocation(left,top,width,height,varChild)==S_OK;
+}
+
+bool GeckoVBuf_IA2Accessible_t::isLabelVisible() {
+	VARIANT child, target;
+	child.vt = VT_I4;
+	child.lVal = 0;
+	if (pacc->accNavigate(NAVRELATION_LABELLED_BY, child, &target) != S_OK)
+		return false;
+	if (target.vt != VT_DISPATCH || !target.pdispVal) {
+		VariantClear(&target);
+		return false;
+	}
+	IAccessible2* targetAcc;
+	HRESULT res;
+	res = target.pdispVal->QueryInterface(IID_IAccessible2, (void**)&targetAcc);
+	VariantClear(&target);
+	if (res != S_OK)
+		return false;
+	VARIANT state;
+	res = targetAcc->get_accState(child, &state);
+	targetAcc->Release();
+	if (res != S_OK)
+		return false;
+	if (state.lVal & STATE_SYSTEM_INVISIBLE)
+		return false;
+	return true;
+}
+
+bool GeckoVBuf_IA2Accessible_t::getText(wstring& text) {
+	IAccessibleText* paccText=getTextInterface();
+	if(!paccText)
+		return false;
+	BSTR str=NULL;
+	return takeBSTR(paccText->get_text(0,IA2_TEXT_OFFSET_LENGTH,&str),str,text);
+}
+
+bool GeckoVBuf_IA2Accessible_t::getTextAttributes(long offset, long* startOffset, long* endOffset, map<wstring,wstring>& attribs) {
+	IAccessibleText* paccText=getTextInterface();
+	if(!paccText)
+		return false;
+	long start=0, end=0;
+	BSTR attribsStr=NULL;
+	if(paccText->get_attributes(offset,&start,&end,&attribsStr)!=S_OK)
+		return false;
+	*startOffset=start;
+	*endOffset=end;
+	if(attribsStr) {
+		IA2AttribsToMap(attribsStr,attribs);
+		SysFreeString(attribsStr);
+	}
+	return true;
+}
+
+bool GeckoVBuf_IA2Accessible_t::hasHypertext() {
+	return getHypertextInterface()!=NULL;
+}
+
+GeckoVBuf_accessible_t* GeckoVBuf_IA2Accessible_t::getEmbeddedObject(long offset) {
+	IAccessibleHypertext* paccHypertext=getHypertextInterface();
+	if(!paccHypertext)
+		return NULL;
+	long hyperlinkIndex;
+	if(paccHypertext->get_hyperlinkIndex(offset,&hyperlinkIndex)!=S_OK)
+		return NULL;
+	IAccessibleHyperlink* paccHyperlink=NULL;
+	if(paccHypertext->get_hyperlink(hyperlinkIndex,&paccHyperlink)!=S_OK)
+		return NULL;
+	GeckoVBuf_accessible_t* acc=accessibleFromUnknown(paccHyperlink);
+	paccHyperlink->Release();
+	return acc;
+}
+
+bool GeckoVBuf_IA2Accessible_t::getChildCount(long* count) {
+	if(childCount<0&&pacc->get_accChildCount(&childCount)!=S_OK) {
+		childCount=-1;
+		return false;
+	}
+	*count=childCount;
+	return true;
+}
+
+void GeckoVBuf_IA2Accessible_t::getChildren(vector<GeckoVBuf_accessible_t*>& children) {
+	long count=0;
+	if(!getChildCount(&count)||count<=0)
+		return;
+	VARIANT* varChildren;
+	if(!(varChildren=(VARIANT*)malloc(sizeof(VARIANT)*count))) {
+		LOG_DEBUG(L"Error allocating varChildren memory");
+		return;
+	}
+	if(AccessibleChildren(pacc,0,count,varChildren,&count)!=S_OK) {
+		LOG_DEBUG(L"AccessibleChildren failed");
+		count=0;
+	}
+	for(long i=0;i<count;++i) {
+		if (varChildren[i].vt == VT_DISPATCH && varChildren[i].pdispVal) {
+			GeckoVBuf_accessible_t* child=accessibleFromUnknown(varChildren[i].pdispVal);
+			if(child)
+				children.push_back(child);
+		}
+		VariantClear(&(varChildren[i]));
+	}
+	free(varChildren);
+}
+
+void GeckoVBuf_IA2Accessible_t::getActionNames(vector<wstring>& actionNames) {
+	IAccessibleAction* paccAction=NULL;
+	if(pacc->QueryInterface(IID_IAccessibleAction,(void**)&paccAction)!=S_OK||!paccAction)
+		return;
+	long nActions=0;
+	paccAction->nActions(&nActions);
+	for(int i=0;i<nActions;++i) {
+		BSTR actionName=NULL;
+		wstring name;
+		takeBSTR(paccAction->get_name(i,&actionName),actionName,name);
+		actionNames.push_back(name);
+	}
+	paccAction->Release();
+}
+
+int GeckoVBuf_IA2Accessible_t::getTableVersion() {
+	if(!queriedTable) {
+		pacc->QueryInterface(IID_IAccessibleTable2,(void**)&paccTable2);
+		if(!paccTable2)
+			pacc->QueryInterface(IID_IAccessibleTable,(void**)&paccTable);
+		queriedTable=true;
+	}
+	return paccTable2?2:(paccTable?1:0);
+}
+
+bool GeckoVBuf_IA2Accessible_t::getRowCount(long* rowCount) {
+	switch(getTableVersion()) {
+		case 2:
+		return paccTable2->get_nRows(rowCount)==S_OK;
+		case 1:
+		return paccTable->get_nRows(rowCount)==S_OK;
+		default:
+		return false;
+	}
+}
+
+bool GeckoVBuf_IA2Accessible_t::getColumnCount(long* columnCount) {
+	switch(getTableVersion()) {
+		case 2:
+		return paccTable2->get_nColumns(columnCount)==S_OK;
+		case 1:
+		return paccTable->get_nColumns(columnCount)==S_OK;
+		default:
+		return false;
+	}
+}
+
+bool GeckoVBuf_IA2Accessible_t::getCellExtentsAtIndex(long index, long* row, long* column, long* rowExtents, long* columnExtents) {
+	if(getTableVersion()!=1)
+		return false;
+	boolean isSelected;
+	return paccTable->get_rowColumnExtentsAtIndex(index,row,column,rowExtents,columnExtents,&isSelected)==S_OK;
+}
+
+bool GeckoVBuf_IA2Accessible_t::isTableCell() {
+	return getTableCellInterface()!=NULL;
+}
+
+bool GeckoVBuf_IA2Accessible_t::getCellExtents(long* row, long* column, long* rowExtents, long* columnExtents) {
+	IAccessibleTableCell* paccTableCell=getTableCellInterface();
+	if(!paccTableCell)
+		return false;
+	boolean isSelected;
+	return paccTableCell->get_rowColumnExtents(row,column,rowExtents,columnExtents,&isSelected)==S_OK;
+}
+
+bool GeckoVBuf_IA2Accessible_t::getHeaderCells(bool columnHeaders, wstring& headerCellsString) {
+	IAccessibleTableCell* paccTableCell=getTableCellInterface();
+	if(!paccTableCell)
+		return false;
+	wostringstream s;
+	IUnknown** headerCells;
+	long nHeaderCells;
+	IAccessible2* headerCellPacc = NULL;
+	int headerCellDocHandle, headerCellID;
+
+	HRESULT res=columnHeaders?paccTableCell->get_columnHeaderCells(&headerCells, &nHeaderCells):paccTableCell->get_rowHeaderCells(&headerCells, &nHeaderCells);
+	if (res != S_OK || !headerCells)
+		return false;
+	for (int hci = 0; hci < nHeaderCells; hci++) {
+		if (headerCells[hci]->QueryInterface(IID_IAccessible2, (void**)&headerCellPacc) != S_OK) {
+			headerCells[hci]->Release();
+			continue;
+		}
+		headerCells[hci]->Release();
+		if (headerCellPacc->get_windowHandle((HWND*)&headerCellDocHandle) != S_OK) {
+			headerCellPacc->Release();
+			continue;
+		}
+		headerCellDocHandle = (int)findRealMozillaWindow((HWND)headerCellDocHandle);
+		if (headerCellPacc->get_uniqueID((long*)&headerCellID) != S_OK) {
+			headerCellPacc->Release();
+			continue;
+		}
+		s << headerCellDocHandle << L"," << headerCellID << L";";
+		headerCellPacc->Release();
+	}
+	CoTaskMemFree(headerCells);
+	headerCellsString=s.str();
+	return true;
+}
+
+GeckoVBuf_accessible_t* GeckoVBuf_IA2Accessible_t::getCellTable() {
+	IAccessibleTableCell* paccTableCell=getTableCellInterface();
+	if(!paccTableCell)
+		return NULL;
+	IUnknown* unk = NULL;
+	if (paccTableCell->get_table(&unk) != S_OK || !unk)
+		return NULL;
+	GeckoVBuf_accessible_t* acc=accessibleFromUnknown(unk);
+	unk->Release();
+	return acc;
+}
+
+bool GeckoVBuf_IA2Accessible_t::getToolkit(wstring& name, wstring& version) {
+	IServiceProvider* serv = NULL;
+	if (pacc->QueryInterface(IID_IServiceProvider, (void**)&serv) != S_OK)
+		return false;
+	IAccessibleApplication* iaApp = NULL;
+	if (serv->QueryService(IID_IAccessibleApplication, IID_IAccessibleApplication, (void**)&iaApp) != S_OK) {
+		serv->Release();
+		return false;
+	}
+	serv->Release();
+	BSTR toolkitName = NULL;
+	BSTR toolkitVersion = NULL;
+	bool succeeded = takeBSTR(iaApp->get_toolkitName(&toolkitName), toolkitName, name)
+		&& takeBSTR(iaApp->get_toolkitVersion(&toolkitVersion), toolkitVersion, version);
+	iaApp->Release();
+	return succeeded;
+}
@@ -0,0 +1,96 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef VIRTUALBUFFER_BACKENDS_GECKO_IA2ACCESSIBLE_H
+#define VIRTUALBUFFER_BACKENDS_GECKO_IA2ACCESSIBLE_H
+
+#include <windows.h>
+#include <ia2.h>
+#include "accessible.h"
+
+HWND findRealMozillaWindow(HWND hwnd);
+
+/**
+ * A live IAccessible2 object in the application, which answers each question with calls on the object.
+ * The other interfaces of the object are queried for the first time they are needed and kept until the accessible is released.
+ */
+class GeckoVBuf_IA2Accessible_t: public GeckoVBuf_accessible_t {
+	private:
+
+	IAccessible2* pacc;
+	IAccessibleText* paccText;
+	IAccessibleHypertext* paccHypertext;
+	IAccessibleTable* paccTable;
+	IAccessibleTable2* paccTable2;
+	IAccessibleTableCell* paccTableCell;
+	bool queriedText;
+	bool queriedHypertext;
+	bool queriedTable;
+	bool queriedTableCell;
+
+/**
+ * The child count fetched by getChildCount, or -1 if it has not been fetched.
+ */
+	long childCount;
+
+	IAccessibleText* getTextInterface();
+
+	IAccessibleHypertext* getHypertextInterface();
+
+	IAccessibleTableCell* getTableCellInterface();
+
+	virtual ~GeckoVBuf_IA2Accessible_t();
+
+	public:
+
+/**
+ * @param paccArg the object, which the accessible takes a reference to.
+ */
+	GeckoVBuf_IA2Accessible_t(IAccessible2* paccArg);
+
+	virtual void release();
+	virtual bool getDocHandle(int* docHandle);
+	virtual bool getID(int* ID);
+	virtual bool getIA2Role(long* role);
+	virtual bool getRole(long* role, std::wstring& roleString);
+	virtual bool getStates(int* states);
+	virtual bool getIA2States(int* states);
+	virtual bool getKeyboardShortcut(std::wstring& keyboardShortcut);
+	virtual bool getAttributes(std::map<std::wstring,std::wstring>& attribs);
+	virtual bool getName(std::wstring& name);
+	virtual bool getDescription(std::wstring& description);
+	virtual bool getValue(std::wstring& value);
+	virtual bool getLocale(std::wstring& locale);
+	virtual bool getLocation(long* left, long* top, long* width, long* height);
+	virtual bool isLabelVisible();
+	virtual bool getText(std::wstring& text);
+	virtual bool getTextAttributes(long offset, long* startOffset, long* endOffset, std::map<std::wstring,std::wstring>& attribs);
+	virtual bool hasHypertext();
+	virtual GeckoVBuf_accessible_t* getEmbeddedObject(long offset);
+	virtual bool getChildCount(long* childCount);
+	virtual void getChildren(std::vector<GeckoVBuf_accessible_t*>& children);
+	virtual void getActionNames(std::vector<std::wstring>& actionNames);
+	virtual int getTableVersion();
+	virtual bool getRowCount(long* rowCount);
+	virtual bool getColumnCount(long* columnCount);
+	virtual bool getCellExtentsAtIndex(long index, long* row, long* column, long* rowExtents, long* columnExtents);
+	virtual bool isTableCell();
+	virtual bool getCellExtents(long* row, long* column, long* rowExtents, long* columnExtents);
+	virtual bool getHeaderCells(bool columnHeaders, std::wstring& headerCells);
+	virtual GeckoVBuf_accessible_t* getCellTable();
+	virtual bool getToolkit(std::wstring& name, std::wstring& version);
+
+};
+
+#endif
@@ -0,0 +1,977 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <map>
+#include <vector>
+#include <common/log.h>
+#include "recording.h"
+
+using namespace std;
+
+#define RECORDING_FORMAT_VERSION 1
+
+#if defined(_MSC_VER)&&_MSC_VER<1900
+//Visual C++ before 2015 only has the underscored name
+#define snprintf _snprintf
+#endif
+
+GeckoVBuf_recordedAccessible_t::GeckoVBuf_recordedAccessible_t(int indexArg): index(indexArg),
+	hasDocHandle(false), docHandle(0), hasID(false), ID(0), hasIA2Role(false), IA2Role(0), hasRole(false), role(0), hasStates(false), states(0), hasIA2States(false), IA2States(0),
+	hasKeyboardShortcut(false), hasAttributes(false), hasName(false), hasDescription(false), hasValue(false), hasLocale(false), hasLocation(false),
+	labelVisible(false), hasText(false), hypertext(false), hasChildCount(false), childCount(0),
+	tableVersion(0), hasRowCount(false), rowCount(0), hasColumnCount(false), columnCount(0), tableCell(false), hasCellExtents(false), cellTable(NULL), hasToolkit(false) {
+	location[0]=location[1]=location[2]=location[3]=0;
+	cellExtents.row=cellExtents.column=cellExtents.rowExtents=cellExtents.columnExtents=0;
+	hasHeaderCells[0]=hasHeaderCells[1]=false;
+}
+
+void GeckoVBuf_recordedAccessible_t::release() {
+}
+
+bool GeckoVBuf_recordedAccessible_t::getDocHandle(int* docHandleArg) {
+	if(!hasDocHandle) return false;
+	*docHandleArg=docHandle;
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getID(int* IDArg) {
+	if(!hasID) return false;
+	*IDArg=ID;
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getIA2Role(long* roleArg) {
+	if(!hasIA2Role) return false;
+	*roleArg=IA2Role;
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getRole(long* roleArg, wstring& roleStringArg) {
+	if(!hasRole) return false;
+	if(roleString.empty())
+		*roleArg=role;
+	else
+		roleStringArg=roleString;
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getStates(int* statesArg) {
+	if(!hasStates) return false;
+	*statesArg=states;
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getIA2States(int* statesArg) {
+	if(!hasIA2States) return false;
+	*statesArg=IA2States;
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getKeyboardShortcut(wstring& keyboardShortcutArg) {
+	if(!hasKeyboardShortcut) return false;
+	keyboardShortcutArg=keyboardShortcut;
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getAttributes(map<wstring,wstring>& attribsArg) {
+	if(!hasAttributes) return false;
+	attribsArg.insert(attribs.begin(),attribs.end());
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getName(wstring& nameArg) {
+	if(!hasName) return false;
+	nameArg=name;
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getDescription(wstring& descriptionArg) {
+	if(!hasDescription) return false;
+	descriptionArg=description;
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getValue(wstring& valueArg) {
+	if(!hasValue) return false;
+	valueArg=value;
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getLocale(wstring& localeArg) {
+	if(!hasLocale) return false;
+	localeArg=locale;
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getLocation(long* left, long* top, long* width, long* height) {
+	if(!hasLocation) return false;
+	*left=location[0];
+	*top=location[1];
+	*width=location[2];
+	*height=location[3];
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::isLabelVisible() {
+	return labelVisible;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getText(wstring& textArg) {
+	if(!hasText) return false;
+	textArg=text;
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getTextAttributes(long offset, long* startOffset, long* endOffset, map<wstring,wstring>& attribsArg) {
+	map<long,GeckoVBuf_textRun_t>::const_iterator i=textRuns.find(offset);
+	if(i==textRuns.end()) return false;
+	*startOffset=i->second.startOffset;
+	*endOffset=i->second.endOffset;
+	attribsArg.insert(i->second.attribs.begin(),i->second.attribs.end());
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::hasHypertext() {
+	return hypertext;
+}
+
+GeckoVBuf_accessible_t* GeckoVBuf_recordedAccessible_t::getEmbeddedObject(long offset) {
+	map<long,GeckoVBuf_recordedAccessible_t*>::const_iterator i=embeddedObjects.find(offset);
+	return (i!=embeddedObjects.end())?i->second:NULL;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getChildCount(long* childCountArg) {
+	if(!hasChildCount) return false;
+	*childCountArg=childCount;
+	return true;
+}
+
+void GeckoVBuf_recordedAccessible_t::getChildren(vector<GeckoVBuf_accessible_t*>& childrenArg) {
+	childrenArg.insert(childrenArg.end(),children.begin(),children.end());
+}
+
+void GeckoVBuf_recordedAccessible_t::getActionNames(vector<wstring>& actionNamesArg) {
+	actionNamesArg.insert(actionNamesArg.end(),actionNames.begin(),actionNames.end());
+}
+
+int GeckoVBuf_recordedAccessible_t::getTableVersion() {
+	return tableVersion;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getRowCount(long* rowCountArg) {
+	if(!hasRowCount) return false;
+	*rowCountArg=rowCount;
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getColumnCount(long* columnCountArg) {
+	if(!hasColumnCount) return false;
+	*columnCountArg=columnCount;
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getCellExtentsAtIndex(long cellIndex, long* row, long* column, long* rowExtents, long* columnExtents) {
+	map<long,GeckoVBuf_cellExtents_t>::const_iterator i=cellExtentsAtIndex.find(cellIndex);
+	if(i==cellExtentsAtIndex.end()) return false;
+	*row=i->second.row;
+	*column=i->second.column;
+	*rowExtents=i->second.rowExtents;
+	*columnExtents=i->second.columnExtents;
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::isTableCell() {
+	return tableCell;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getCellExtents(long* row, long* column, long* rowExtents, long* columnExtents) {
+	if(!hasCellExtents) return false;
+	*row=cellExtents.row;
+	*column=cellExtents.column;
+	*rowExtents=cellExtents.rowExtents;
+	*columnExtents=cellExtents.columnExtents;
+	return true;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getHeaderCells(bool columnHeaders, wstring& headerCellsArg) {
+	int i=columnHeaders?0:1;
+	if(!hasHeaderCells[i]) return false;
+	headerCellsArg=headerCells[i];
+	return true;
+}
+
+GeckoVBuf_accessible_t* GeckoVBuf_recordedAccessible_t::getCellTable() {
+	return cellTable;
+}
+
+bool GeckoVBuf_recordedAccessible_t::getToolkit(wstring& name, wstring& version) {
+	if(!hasToolkit) return false;
+	name=toolkitName;
+	version=toolkitVersion;
+	return true;
+}
+
+/**
+ * Writes a value to a line of a saved recording, preceded by a tab.
+ */
+void writeValue(ostream& stream, const wstring& value) {
+	stream<<'\t';
+	for(wstring::const_iterator i=value.begin();i!=value.end();++i) {
+		unsigned long c=static_cast<unsigned long>(*i);
+		if(c==L'\\') {
+			stream<<"\\\\";
+		} else if(c==L'\t') {
+			stream<<"\\t";
+		} else if(c==L'\n') {
+			stream<<"\\n";
+		} else if(c==L'\r') {
+			stream<<"\\r";
+		} else if(c>=0x20&&c<0x7f) {
+			stream<<static_cast<char>(c);
+		} else {
+			char escape[12];
+			if(c<=0xffff)
+				snprintf(escape,sizeof(escape),"\\u%04x",static_cast<unsigned int>(c));
+			else
+				snprintf(escape,sizeof(escape),"\\U%08x",static_cast<unsigned int>(c));
+			stream<<escape;
+		}
+	}
+}
+
+void writeValue(ostream& stream, long value) {
+	stream<<'\t'<<value;
+}
+
+void writeAttribs(ostream& stream, const map<wstring,wstring>& attribs) {
+	for(map<wstring,wstring>::const_iterator i=attribs.begin();i!=attribs.end();++i) {
+		writeValue(stream,i->first);
+		writeValue(stream,i->second);
+	}
+}
+
+void writeExtents(ostream& stream, const GeckoVBuf_cellExtents_t& extents) {
+	writeValue(stream,extents.row);
+	writeValue(stream,extents.column);
+	writeValue(stream,extents.rowExtents);
+	writeValue(stream,extents.columnExtents);
+}
+
+/**
+ * Reads a value written by writeValue.
+ * @param field the value as it was written, without its tab.
+ * @return the value.
+ */
+wstring readValue(const string& field) {
+	wstring value;
+	value.reserve(field.length());
+	for(size_t i=0;i<field.length();++i) {
+		char c=field[i];
+		if(c!='\\'||i+1>=field.length()) {
+			value+=static_cast<wchar_t>(static_cast<unsigned char>(c));
+			continue;
+		}
+		c=field[++i];
+		if(c=='t') {
+			value+=L'\t';
+		} else if(c=='n') {
+			value+=L'\n';
+		} else if(c=='r') {
+			value+=L'\r';
+		} else if(c=='u'||c=='U') {
+			size_t digitCount=(c=='u')?4:8;
+			value+=static_cast<wchar_t>(strtoul(field.substr(i+1,digitCount).c_str(),NULL,16));
+			i+=digitCount;
+		} else {
+			value+=static_cast<wchar_t>(c);
+		}
+	}
+	return value;
+}
+
+void GeckoVBuf_recordedTree_t::save(ostream& stream) const {
+	stream<<"IA2Tree\t"<<RECORDING_FORMAT_VERSION<<'\n';
+	for(vector<GeckoVBuf_recordedAccessible_t*>::const_iterator n=nodes.begin();n!=nodes.end();++n) {
+		const GeckoVBuf_recordedAccessible_t& node=**n;
+		stream<<"node\t"<<node.index<<'\n';
+		if(node.hasDocHandle) {
+			stream<<"docHandle";
+			writeValue(stream,node.docHandle);
+			stream<<'\n';
+		}
+		if(node.hasID) {
+			stream<<"ID";
+			writeValue(stream,node.ID);
+			stream<<'\n';
+		}
+		if(node.hasIA2Role) {
+			stream<<"IA2Role";
+			writeValue(stream,node.IA2Role);
+			stream<<'\n';
+		}
+		if(node.hasRole) {
+			stream<<"role";
+			writeValue(stream,node.role);
+			writeValue(stream,node.roleString);
+			stream<<'\n';
+		}
+		if(node.hasStates) {
+			stream<<"states";
+			writeValue(stream,node.states);
+			stream<<'\n';
+		}
+		if(node.hasIA2States) {
+			stream<<"IA2States";
+			writeValue(stream,node.IA2States);
+			stream<<'\n';
+		}
+		if(node.hasKeyboardShortcut) {
+			stream<<"keyboardShortcut";
+			writeValue(stream,node.keyboardShortcut);
+			stream<<'\n';
+		}
+		if(node.hasAttributes) {
+			stream<<"attributes";
+			writeAttribs(stream,node.attribs);
+			stream<<'\n';
+		}
+		if(node.hasName) {
+			stream<<"name";
+			writeValue(stream,node.name);
+			stream<<'\n';
+		}
+		if(node.hasDescription) {
+			stream<<"description";
+			writeValue(stream,node.description);
+			stream<<'\n';
+		}
+		if(node.hasValue) {
+			stream<<"value";
+			writeValue(stream,node.value);
+			stream<<'\n';
+		}
+		if(node.hasLocale) {
+			stream<<"locale";
+			writeValue(stream,node.locale);
+			stream<<'\n';
+		}
+		if(node.hasLocation) {
+			stream<<"location";
+			for(int i=0;i<4;++i) writeValue(stream,node.location[i]);
+			stream<<'\n';
+		}
+		if(node.labelVisible) {
+			stream<<"labelVisible\n";
+		}
+		if(node.hasText) {
+			stream<<"text";
+			writeValue(stream,node.text);
+			stream<<'\n';
+		}
+		for(map<long,GeckoVBuf_textRun_t>::const_iterator i=node.textRuns.begin();i!=node.textRuns.end();++i) {
+			stream<<"textAttributes";
+			writeValue(stream,i->first);
+			writeValue(stream,i->second.startOffset);
+			writeValue(stream,i->second.endOffset);
+			writeAttribs(stream,i->second.attribs);
+			stream<<'\n';
+		}
+		if(node.hypertext) {
+			stream<<"hypertext\n";
+		}
+		for(map<long,GeckoVBuf_recordedAccessible_t*>::const_iterator i=node.embeddedObjects.begin();i!=node.embeddedObjects.end();++i) {
+			if(!i->second) continue;
+			stream<<"embeddedObject";
+			writeValue(stream,i->first);
+			writeValue(stream,i->second->index);
+			stream<<'\n';
+		}
+		if(node.hasChildCount) {
+			stream<<"childCount";
+			writeValue(stream,node.childCount);
+			stream<<'\n';
+		}
+		if(!node.children.empty()) {
+			stream<<"children";
+			for(vector<GeckoVBuf_recordedAccessible_t*>::const_iterator i=node.children.begin();i!=node.children.end();++i) writeValue(stream,(*i)->index);
+			stream<<'\n';
+		}
+		if(!node.actionNames.empty()) {
+			stream<<"actionNames";
+			for(vector<wstring>::const_iterator i=node.actionNames.begin();i!=node.actionNames.end();++i) writeValue(stream,*i);
+			stream<<'\n';
+		}
+		if(node.tableVersion!=0) {
+			stream<<"tableVersion";
+			writeValue(stream,node.tableVersion);
+			stream<<'\n';
+		}
+		if(node.hasRowCount) {
+			stream<<"rowCount";
+			writeValue(stream,node.rowCount);
+			stream<<'\n';
+		}
+		if(node.hasColumnCount) {
+			stream<<"columnCount";
+			writeValue(stream,node.columnCount);
+			stream<<'\n';
+		}
+		for(map<long,GeckoVBuf_cellExtents_t>::const_iterator i=node.cellExtentsAtIndex.begin();i!=node.cellExtentsAtIndex.end();++i) {
+			stream<<"cellExtentsAtIndex";
+			writeValue(stream,i->first);
+			writeExtents(stream,i->second);
+			stream<<'\n';
+		}
+		if(node.tableCell) {
+			stream<<"tableCell\n";
+		}
+		if(node.hasCellExtents) {
+			stream<<"cellExtents";
+			writeExtents(stream,node.cellExtents);
+			stream<<'\n';
+		}
+		if(node.hasHeaderCells[0]) {
+			stream<<"columnHeaderCells";
+			writeValue(stream,node.headerCells[0]);
+			stream<<'\n';
+		}
+		if(node.hasHeaderCells[1]) {
+			stream<<"rowHeaderCells";
+			writeValue(stream,node.headerCells[1]);
+			stream<<'\n';
+		}
+		if(node.cellTable) {
+			stream<<"cellTable";
+			writeValue(stream,node.cellTable->index);
+			stream<<'\n';
+		}
+		if(node.hasToolkit) {
+			stream<<"toolkit";
+			writeValue(stream,node.toolkitName);
+			writeValue(stream,node.toolkitVersion);
+			stream<<'\n';
+		}
+	}
+}
+
+/**
+ * The values of a line of a saved recording, read one after the other.
+ */
+class recordingLine_t {
+	private:
+
+	vector<string> fields;
+	size_t next;
+
+	public:
+
+	bool failed;
+
+	recordingLine_t(const string& line): next(1), failed(false) {
+		size_t start=0;
+		for(size_t end=line.find('\t');end!=string::npos;end=line.find('\t',start)) {
+			fields.push_back(line.substr(start,end-start));
+			start=end+1;
+		}
+		fields.push_back(line.substr(start));
+	}
+
+	const string& getName() const {
+		return fields[0];
+	}
+
+	bool atEnd() const {
+		return next>=fields.size();
+	}
+
+	wstring readString() {
+		if(atEnd()) {
+			failed=true;
+			return wstring();
+		}
+		return readValue(fields[next++]);
+	}
+
+	long readLong() {
+		if(atEnd()) {
+			failed=true;
+			return 0;
+		}
+		const string& field=fields[next++];
+		char* end=NULL;
+		long value=strtol(field.c_str(),&end,10);
+		if(field.empty()||*end!='\0') failed=true;
+		return value;
+	}
+
+	void readAttribs(map<wstring,wstring>& attribs) {
+		while(!atEnd()) {
+			wstring name=readString();
+			attribs[name]=readString();
+		}
+	}
+
+	void readExtents(GeckoVBuf_cellExtents_t& extents) {
+		extents.row=readLong();
+		extents.column=readLong();
+		extents.rowExtents=readLong();
+		extents.columnExtents=readLong();
+	}
+
+};
+
+GeckoVBuf_recordedAccessible_t* GeckoVBuf_recordedTree_t::getOrAddNode(int index, int nodeLimit) {
+	if(index<0||index>=nodeLimit) return NULL;
+	while(static_cast<int>(nodes.size())<=index) addNode();
+	return nodes[index];
+}
+
+bool GeckoVBuf_recordedTree_t::load(istream& stream) {
+	clear();
+	string line;
+	if(!getline(stream,line)) {
+		LOG_DEBUGWARNING(L"Recording is empty");
+		return false;
+	}
+	if(!line.empty()&&line[line.length()-1]=='\r') line.erase(line.length()-1);
+	recordingLine_t header(line);
+	if(header.getName()!="IA2Tree"||header.readLong()!=RECORDING_FORMAT_VERSION||header.failed) {
+		LOG_DEBUGWARNING(L"Not a recording of a supported format");
+		return false;
+	}
+	//Each object has its own line, so the lines are read first to know how many objects there can be before any are added
+	vector<string> lines;
+	while(getline(stream,line)) lines.push_back(line);
+	const int nodeLimit=lines.size()<INT_MAX?static_cast<int>(lines.size()):INT_MAX;
+	GeckoVBuf_recordedAccessible_t* node=NULL;
+	int lineNumber=1;
+	for(vector<string>::iterator i=lines.begin();i!=lines.end();++i) {
+		++lineNumber;
+		line.swap(*i);
+		if(!line.empty()&&line[line.length()-1]=='\r') line.erase(line.length()-1);
+		if(line.empty()) continue;
+		recordingLine_t l(line);
+		const string& name=l.getName();
+		if(name=="node") {
+			node=getOrAddNode(l.readLong(),nodeLimit);
+			if(!node) l.failed=true;
+		} else if(!node) {
+			l.failed=true;
+		} else if(name=="docHandle") {
+			node->hasDocHandle=true;
+			node->docHandle=l.readLong();
+		} else if(name=="ID") {
+			node->hasID=true;
+			node->ID=l.readLong();
+		} else if(name=="IA2Role") {
+			node->hasIA2Role=true;
+			node->IA2Role=l.readLong();
+		} else if(name=="role") {
+			node->hasRole=true;
+			node->role=l.readLong();
+			node->roleString=l.readString();
+		} else if(name=="states") {
+			node->hasStates=true;
+			node->states=l.readLong();
+		} else if(name=="IA2States") {
+			node->hasIA2States=true;
+			node->IA2States=l.readLong();
+		} else if(name=="keyboardShortcut") {
+			node->hasKeyboardShortcut=true;
+			node->keyboardShortcut=l.readString();
+		} else if(name=="attributes") {
+			node->hasAttributes=true;
+			l.readAttribs(node->attribs);
+		} else if(name=="name") {
+			node->hasName=true;
+			node->name=l.readString();
+		} else if(name=="description") {
+			node->hasDescription=true;
+			node->description=l.readString();
+		} else if(name=="value") {
+			node->hasValue=true;
+			node->value=l.readString();
+		} else if(name=="locale") {
+			node->hasLocale=true;
+			node->locale=l.readString();
+		} else if(name=="location") {
+			node->hasLocation=true;
+			for(int i=0;i<4;++i) node->location[i]=l.readLong();
+		} else if(name=="labelVisible") {
+			node->labelVisible=true;
+		} else if(name=="text") {
+			node->hasText=true;
+			node->text=l.readString();
+		} else if(name=="textAttributes") {
+			long offset=l.readLong();
+			GeckoVBuf_textRun_t& run=node->textRuns[offset];
+			run.startOffset=l.readLong();
+			run.endOffset=l.readLong();
+			l.readAttribs(run.attribs);
+		} else if(name=="hypertext") {
+			node->hypertext=true;
+		} else if(name=="embeddedObject") {
+			long offset=l.readLong();
+			if(!(node->embeddedObjects[offset]=getOrAddNode(l.readLong(),nodeLimit))) l.failed=true;
+		} else if(name=="childCount") {
+			node->hasChildCount=true;
+			node->childCount=l.readLong();
+		} else if(name=="children") {
+			while(!l.atEnd()) {
+				GeckoVBuf_recordedAccessible_t* child=getOrAddNode(l.readLong(),nodeLimit);
+				if(!child) {
+					l.failed=true;
+					break;
+				}
+				//Adding nodes may have moved the vector holding this one, but not the node itself
+				node->children.push_back(child);
+			}
+		} else if(name=="actionNames") {
+			while(!l.atEnd()) node->actionNames.push_back(l.readString());
+		} else if(name=="tableVersion") {
+			node->tableVersion=l.readLong();
+		} else if(name=="rowCount") {
+			node->hasRowCount=true;
+			node->rowCount=l.readLong();
+		} else if(name=="columnCount") {
+			node->hasColumnCount=true;
+			node->columnCount=l.readLong();
+		} else if(name=="cellExtentsAtIndex") {
+			long cellIndex=l.readLong();
+			l.readExtents(node->cellExtentsAtIndex[cellIndex]);
+		} else if(name=="tableCell") {
+			node->tableCell=true;
+		} else if(name=="cellExtents") {
+			node->hasCellExtents=true;
+			l.readExtents(node->cellExtents);
+		} else if(name=="columnHeaderCells") {
+			node->hasHeaderCells[0]=true;
+			node->headerCells[0]=l.readString();
+		} else if(name=="rowHeaderCells") {
+			node->hasHeaderCells[1]=true;
+			node->headerCells[1]=l.readString();
+		} else if(name=="cellTable") {
+			if(!(node->cellTable=getOrAddNode(l.readLong(),nodeLimit))) l.failed=true;
+		} else if(name=="toolkit") {
+			node->hasToolkit=true;
+			node->toolkitName=l.readString();
+			node->toolkitVersion=l.readString();
+		} else {
+			//Answers to questions added by later versions of the format are not needed to replay
+			LOG_DEBUG(L"Unknown line "<<lineNumber<<L" in recording");
+		}
+		if(l.failed) {
+			LOG_DEBUGWARNING(L"Bad line "<<lineNumber<<L" in recording");
+			clear();
+			return false;
+		}
+	}
+	return true;
+}
+
+GeckoVBuf_recordedTree_t::GeckoVBuf_recordedTree_t(): nodes(), identifierMap(), identifierMapIsValid(false) {
+}
+
+GeckoVBuf_recordedTree_t::~GeckoVBuf_recordedTree_t() {
+	clear();
+}
+
+GeckoVBuf_recordedAccessible_t* GeckoVBuf_recordedTree_t::addNode() {
+	GeckoVBuf_recordedAccessible_t* node=new GeckoVBuf_recordedAccessible_t(static_cast<int>(nodes.size()));
+	nodes.push_back(node);
+	identifierMapIsValid=false;
+	return node;
+}
+
+GeckoVBuf_recordedAccessible_t* GeckoVBuf_recordedTree_t::getRoot() {
+	return nodes.empty()?NULL:nodes[0];
+}
+
+int GeckoVBuf_recordedTree_t::getNodeCount() const {
+	return static_cast<int>(nodes.size());
+}
+
+GeckoVBuf_recordedAccessible_t* GeckoVBuf_recordedTree_t::getNodeWithIdentifier(int docHandle, int ID) {
+	if(!identifierMapIsValid) {
+		identifierMap.clear();
+		for(vector<GeckoVBuf_recordedAccessible_t*>::const_iterator i=nodes.begin();i!=nodes.end();++i) {
+			if((*i)->hasDocHandle&&(*i)->hasID) identifierMap.insert(make_pair(make_pair((*i)->docHandle,(*i)->ID),*i));
+		}
+		identifierMapIsValid=true;
+	}
+	map<pair<int,int>,GeckoVBuf_recordedAccessible_t*>::const_iterator i=identifierMap.find(make_pair(docHandle,ID));
+	return (i!=identifierMap.end())?i->second:NULL;
+}
+
+void GeckoVBuf_recordedTree_t::clear() {
+	for(vector<GeckoVBuf_recordedAccessible_t*>::iterator i=nodes.begin();i!=nodes.end();++i) {
+		delete *i;
+	}
+	nodes.clear();
+	identifierMap.clear();
+	identifierMapIsValid=false;
+}
+
+GeckoVBuf_recordingAccessible_t::GeckoVBuf_recordingAccessible_t(GeckoVBuf_accessible_t* accArg, GeckoVBuf_recordedAccessible_t* recordArg, GeckoVBuf_recordedTree_t* treeArg): acc(accArg), record(recordArg), tree(treeArg) {
+	nhAssert(acc);
+	nhAssert(record);
+	nhAssert(tree);
+}
+
+GeckoVBuf_recordingAccessible_t::~GeckoVBuf_recordingAccessible_t() {
+	acc->release();
+}
+
+void GeckoVBuf_recordingAccessible_t::release() {
+	delete this;
+}
+
+GeckoVBuf_accessible_t* GeckoVBuf_recordingAccessible_t::wrap(GeckoVBuf_accessible_t* child, GeckoVBuf_recordedAccessible_t* childRecord, GeckoVBuf_recordedAccessible_t** childRecordOut) {
+	if(!child) {
+		*childRecordOut=NULL;
+		return NULL;
+	}
+	if(!childRecord) childRecord=tree->addNode();
+	*childRecordOut=childRecord;
+	return new GeckoVBuf_recordingAccessible_t(child,childRecord,tree);
+}
+
+bool GeckoVBuf_recordingAccessible_t::getDocHandle(int* docHandle) {
+	if(!acc->getDocHandle(docHandle)) return false;
+	record->hasDocHandle=true;
+	record->docHandle=*docHandle;
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getID(int* ID) {
+	if(!acc->getID(ID)) return false;
+	record->hasID=true;
+	record->ID=*ID;
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getIA2Role(long* role) {
+	if(!acc->getIA2Role(role)) return false;
+	record->hasIA2Role=true;
+	record->IA2Role=*role;
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getRole(long* role, wstring& roleString) {
+	wstring newRoleString;
+	if(!acc->getRole(role,newRoleString)) return false;
+	record->hasRole=true;
+	record->role=*role;
+	record->roleString=newRoleString;
+	roleString=newRoleString;
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getStates(int* states) {
+	if(!acc->getStates(states)) return false;
+	record->hasStates=true;
+	record->states=*states;
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getIA2States(int* states) {
+	if(!acc->getIA2States(states)) return false;
+	record->hasIA2States=true;
+	record->IA2States=*states;
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getKeyboardShortcut(wstring& keyboardShortcut) {
+	if(!acc->getKeyboardShortcut(keyboardShortcut)) return false;
+	record->hasKeyboardShortcut=true;
+	record->keyboardShortcut=keyboardShortcut;
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getAttributes(map<wstring,wstring>& attribs) {
+	map<wstring,wstring> newAttribs;
+	if(!acc->getAttributes(newAttribs)) return false;
+	record->hasAttributes=true;
+	record->attribs=newAttribs;
+	attribs.insert(newAttribs.begin(),newAttribs.end());
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getName(wstring& name) {
+	if(!acc->getName(name)) return false;
+	record->hasName=true;
+	record->name=name;
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getDescription(wstring& description) {
+	if(!acc->getDescription(description)) return false;
+	record->hasDescription=true;
+	record->description=description;
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getValue(wstring& value) {
+	if(!acc->getValue(value)) return false;
+	record->hasValue=true;
+	record->value=value;
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getLocale(wstring& locale) {
+	if(!acc->getLocale(locale)) return false;
+	record->hasLocale=true;
+	record->locale=locale;
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getLocation(long* left, long* top, long* width, long* height) {
+	if(!acc->getLocation(left,top,width,height)) return false;
+	record->hasLocation=true;
+	record->location[0]=*left;
+	record->location[1]=*top;
+	record->location[2]=*width;
+	record->location[3]=*height;
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::isLabelVisible() {
+	return (record->labelVisible=acc->isLabelVisible());
+}
+
+bool GeckoVBuf_recordingAccessible_t::getText(wstring& text) {
+	if(!acc->getText(text)) return false;
+	record->hasText=true;
+	record->text=text;
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getTextAttributes(long offset, long* startOffset, long* endOffset, map<wstring,wstring>& attribs) {
+	map<wstring,wstring> newAttribs;
+	if(!acc->getTextAttributes(offset,startOffset,endOffset,newAttribs)) return false;
+	GeckoVBuf_textRun_t& run=record->textRuns[offset];
+	run.startOffset=*startOffset;
+	run.endOffset=*endOffset;
+	run.attribs=newAttribs;
+	attribs.insert(newAttribs.begin(),newAttribs.end());
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::hasHypertext() {
+	return (record->hypertext=acc->hasHypertext());
+}
+
+GeckoVBuf_accessible_t* GeckoVBuf_recordingAccessible_t::getEmbeddedObject(long offset) {
+	map<long,GeckoVBuf_recordedAccessible_t*>::const_iterator i=record->embeddedObjects.find(offset);
+	GeckoVBuf_recordedAccessible_t* childRecord=(i!=record->embeddedObjects.end())?i->second:NULL;
+	GeckoVBuf_accessible_t* child=wrap(acc->getEmbeddedObject(offset),childRecord,&childRecord);
+	if(childRecord) record->embeddedObjects[offset]=childRecord;
+	return child;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getChildCount(long* childCount) {
+	if(!acc->getChildCount(childCount)) return false;
+	record->hasChildCount=true;
+	record->childCount=*childCount;
+	return true;
+}
+
+void GeckoVBuf_recordingAccessible_t::getChildren(vector<GeckoVBuf_accessible_t*>& children) {
+	vector<GeckoVBuf_accessible_t*> newChildren;
+	acc->getChildren(newChildren);
+	vector<GeckoVBuf_recordedAccessible_t*> childRecords;
+	for(size_t i=0;i<newChildren.size();++i) {
+		GeckoVBuf_recordedAccessible_t* childRecord=(i<record->children.size())?record->children[i]:NULL;
+		children.push_back(wrap(newChildren[i],childRecord,&childRecord));
+		childRecords.push_back(childRecord);
+	}
+	record->children.swap(childRecords);
+}
+
+void GeckoVBuf_recordingAccessible_t::getActionNames(vector<wstring>& actionNames) {
+	vector<wstring> newActionNames;
+	acc->getActionNames(newActionNames);
+	record->actionNames=newActionNames;
+	actionNames.insert(actionNames.end(),newActionNames.begin(),newActionNames.end());
+}
+
+int GeckoVBuf_recordingAccessible_t::getTableVersion() {
+	return (record->tableVersion=acc->getTableVersion());
+}
+
+bool GeckoVBuf_recordingAccessible_t::getRowCount(long* rowCount) {
+	if(!acc->getRowCount(rowCount)) return false;
+	record->hasRowCount=true;
+	record->rowCount=*rowCount;
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getColumnCount(long* columnCount) {
+	if(!acc->getColumnCount(columnCount)) return false;
+	record->hasColumnCount=true;
+	record->columnCount=*columnCount;
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getCellExtentsAtIndex(long cellIndex, long* row, long* column, long* rowExtents, long* columnExtents) {
+	if(!acc->getCellExtentsAtIndex(cellIndex,row,column,rowExtents,columnExtents)) return false;
+	GeckoVBuf_cellExtents_t& extents=record->cellExtentsAtIndex[cellIndex];
+	extents.row=*row;
+	extents.column=*column;
+	extents.rowExtents=*rowExtents;
+	extents.columnExtents=*columnExtents;
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::isTableCell() {
+	return (record->tableCell=acc->isTableCell());
+}
+
+bool GeckoVBuf_recordingAccessible_t::getCellExtents(long* row, long* column, long* rowExtents, long* columnExtents) {
+	if(!acc->getCellExtents(row,column,rowExtents,columnExtents)) return false;
+	record->hasCellExtents=true;
+	record->cellExtents.row=*row;
+	record->cellExtents.column=*column;
+	record->cellExtents.rowExtents=*rowExtents;
+	record->cellExtents.columnExtents=*columnExtents;
+	return true;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getHeaderCells(bool columnHeaders, wstring& headerCells) {
+	if(!acc->getHeaderCells(columnHeaders,headerCells)) return false;
+	int i=columnHeaders?0:1;
+	record->hasHeaderCells[i]=true;
+	record->headerCells[i]=headerCells;
+	return true;
+}
+
+GeckoVBuf_accessible_t* GeckoVBuf_recordingAccessible_t::getCellTable() {
+	GeckoVBuf_recordedAccessible_t* childRecord=record->cellTable;
+	GeckoVBuf_accessible_t* table=wrap(acc->getCellTable(),childRecord,&childRecord);
+	if(childRecord) record->cellTable=childRecord;
+	return table;
+}
+
+bool GeckoVBuf_recordingAccessible_t::getToolkit(wstring& name, wstring& version) {
+	if(!acc->getToolkit(name,version)) return false;
+	record->hasToolkit=true;
+	record->toolkitName=name;
+	record->toolkitVersion=version;
+	return true;
+}
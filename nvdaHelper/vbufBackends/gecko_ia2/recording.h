@@ -0,0 +1,290 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef VIRTUALBUFFER_BACKENDS_GECKO_RECORDING_H
+#define VIRTUALBUFFER_BACKENDS_GECKO_RECORDING_H
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <vector>
+#include "accessible.h"
+
+class GeckoVBuf_recordedTree_t;
+
+/**
+ * Where a table cell is in its table.
+ */
+typedef struct {
+	long row;
+	long column;
+	long rowExtents;
+	long columnExtents;
+} GeckoVBuf_cellExtents_t;
+
+/**
+ * A run of text with the same text attributes.
+ */
+typedef struct {
+	long startOffset;
+	long endOffset;
+	std::map<std::wstring,std::wstring> attribs;
+} GeckoVBuf_textRun_t;
+
+/**
+ * An object of a recorded tree, which answers each question with what the live object answered when it was recorded.
+ * Questions that were not asked when it was recorded fail, as do those that failed.
+ * It belongs to its tree, so releasing it does nothing.
+ */
+class GeckoVBuf_recordedAccessible_t: public GeckoVBuf_accessible_t {
+	private:
+
+	friend class GeckoVBuf_recordedTree_t;
+	friend class GeckoVBuf_recordingAccessible_t;
+
+/**
+ * The position of the object in its tree.
+ */
+	const int index;
+
+	bool hasDocHandle;
+	int docHandle;
+	bool hasID;
+	int ID;
+	bool hasIA2Role;
+	long IA2Role;
+	bool hasRole;
+	long role;
+	std::wstring roleString;
+	bool hasStates;
+	int states;
+	bool hasIA2States;
+	int IA2States;
+	bool hasKeyboardShortcut;
+	std::wstring keyboardShortcut;
+	bool hasAttributes;
+	std::map<std::wstring,std::wstring> attribs;
+	bool hasName;
+	std::wstring name;
+	bool hasDescription;
+	std::wstring description;
+	bool hasValue;
+	std::wstring value;
+	bool hasLocale;
+	std::wstring locale;
+	bool hasLocation;
+	long location[4];
+	bool labelVisible;
+	bool hasText;
+	std::wstring text;
+	std::map<long,GeckoVBuf_textRun_t> textRuns;
+	bool hypertext;
+	std::map<long,GeckoVBuf_recordedAccessible_t*> embeddedObjects;
+	bool hasChildCount;
+	long childCount;
+	std::vector<GeckoVBuf_recordedAccessible_t*> children;
+	std::vector<std::wstring> actionNames;
+	int tableVersion;
+	bool hasRowCount;
+	long rowCount;
+	bool hasColumnCount;
+	long columnCount;
+	std::map<long,GeckoVBuf_cellExtents_t> cellExtentsAtIndex;
+	bool tableCell;
+	bool hasCellExtents;
+	GeckoVBuf_cellExtents_t cellExtents;
+	bool hasHeaderCells[2];
+	std::wstring headerCells[2];
+	GeckoVBuf_recordedAccessible_t* cellTable;
+	bool hasToolkit;
+	std::wstring toolkitName;
+	std::wstring toolkitVersion;
+
+	GeckoVBuf_recordedAccessible_t(int indexArg);
+
+	public:
+
+	virtual void release();
+	virtual bool getDocHandle(int* docHandle);
+	virtual bool getID(int* ID);
+	virtual bool getIA2Role(long* role);
+	virtual bool getRole(long* role, std::wstring& roleString);
+	virtual bool getStates(int* states);
+	virtual bool getIA2States(int* states);
+	virtual bool getKeyboardShortcut(std::wstring& keyboardShortcut);
+	virtual bool getAttributes(std::map<std::wstring,std::wstring>& attribs);
+	virtual bool getName(std::wstring& name);
+	virtual bool getDescription(std::wstring& description);
+	virtual bool getValue(std::wstring& value);
+	virtual bool getLocale(std::wstring& locale);
+	virtual bool getLocation(long* left, long* top, long* width, long* height);
+	virtual bool isLabelVisible();
+	virtual bool getText(std::wstring& text);
+	virtual bool getTextAttributes(long offset, long* startOffset, long* endOffset, std::map<std::wstring,std::wstring>& attribs);
+	virtual bool hasHypertext();
+	virtual GeckoVBuf_accessible_t* getEmbeddedObject(long offset);
+	virtual bool getChildCount(long* childCount);
+	virtual void getChildren(std::vector<GeckoVBuf_accessible_t*>& children);
+	virtual void getActionNames(std::vector<std::wstring>& actionNames);
+	virtual int getTableVersion();
+	virtual bool getRowCount(long* rowCount);
+	virtual bool getColumnCount(long* columnCount);
+	virtual bool getCellExtentsAtIndex(long index, long* row, long* column, long* rowExtents, long* columnExtents);
+	virtual bool isTableCell();
+	virtual bool getCellExtents(long* row, long* column, long* rowExtents, long* columnExtents);
+	virtual bool getHeaderCells(bool columnHeaders, std::wstring& headerCells);
+	virtual GeckoVBuf_accessible_t* getCellTable();
+	virtual bool getToolkit(std::wstring& name, std::wstring& version);
+
+};
+
+/**
+ * A recording of the objects of a document, as rendering found them, which can be saved and loaded so that the render can be replayed elsewhere.
+ * The first object is the one rendering started from.
+ * A recording is saved as lines of text, each a name followed by tab separated values:
+ * a header line "IA2Tree" and the format version, then for each object a line "node" and its index followed by a line for each question it answered.
+ * Objects returned by other objects are given by their index.
+ * Tabs, line breaks, backslashes and characters outside of ASCII in values are escaped with a backslash, as in "\t" and "\u00e9".
+ */
+class GeckoVBuf_recordedTree_t {
+	private:
+
+	std::vector<GeckoVBuf_recordedAccessible_t*> nodes;
+
+	std::map<std::pair<int,int>,GeckoVBuf_recordedAccessible_t*> identifierMap;
+
+/**
+ * True if identifierMap holds all the objects, false if it must be built again.
+ */
+	bool identifierMapIsValid;
+
+/**
+ * @param index the index of the object.
+ * @param nodeLimit the number of objects the recording being loaded can hold at most, so that a bad index does not add more.
+ * @return the object at an index in a loaded recording, adding objects up to it if they have not been seen yet, or NULL if the index is negative or not below nodeLimit.
+ */
+	GeckoVBuf_recordedAccessible_t* getOrAddNode(int index, int nodeLimit);
+
+	public:
+
+	GeckoVBuf_recordedTree_t();
+
+	~GeckoVBuf_recordedTree_t();
+
+/**
+ * Adds a new object to the recording, with no answers yet.
+ */
+	GeckoVBuf_recordedAccessible_t* addNode();
+
+/**
+ * @return the object rendering started from, or NULL if the recording is empty.
+ */
+	GeckoVBuf_recordedAccessible_t* getRoot();
+
+/**
+ * @return the amount of objects in the recording.
+ */
+	int getNodeCount() const;
+
+/**
+ * Finds the first object recorded with a particular doc handle and ID, as is needed to render it again.
+ * The objects are indexed the first time this is used after objects are added, so it should not be used while the recording is being made.
+ * @return the object, or NULL if there is none.
+ */
+	GeckoVBuf_recordedAccessible_t* getNodeWithIdentifier(int docHandle, int ID);
+
+/**
+ * Writes the recording to a stream.
+ */
+	void save(std::ostream& stream) const;
+
+/**
+ * Replaces the content of the recording with one read from a stream.
+ * @return true if the stream held a recording that could be read.
+ */
+	bool load(std::istream& stream);
+
+/**
+ * Removes all objects from the recording.
+ */
+	void clear();
+
+};
+
+/**
+ * Wraps an accessible, passing on each question to it and recording the answer in a recorded object.
+ * Accessibles it returns are wrapped in the same way, recording in to objects of the same tree.
+ * Rendering through it records exactly the questions the render needs, so a replay of the recording renders the same content.
+ */
+class GeckoVBuf_recordingAccessible_t: public GeckoVBuf_accessible_t {
+	private:
+
+	GeckoVBuf_accessible_t* const acc;
+	GeckoVBuf_recordedAccessible_t* const record;
+	GeckoVBuf_recordedTree_t* const tree;
+
+/**
+ * Wraps an accessible returned by the wrapped one.
+ * @param child the accessible, or NULL.
+ * @param childRecord the object the accessible was already recorded in, or NULL to record it in a new object.
+ * @param childRecordOut memory to place the object the accessible is recorded in, which is NULL if child was NULL.
+ */
+	GeckoVBuf_accessible_t* wrap(GeckoVBuf_accessible_t* child, GeckoVBuf_recordedAccessible_t* childRecord, GeckoVBuf_recordedAccessible_t** childRecordOut);
+
+	virtual ~GeckoVBuf_recordingAccessible_t();
+
+	public:
+
+/**
+ * @param accArg the accessible to wrap, which is released along with this one.
+ * @param recordArg the object to record in to.
+ * @param treeArg the tree the object belongs to.
+ */
+	GeckoVBuf_recordingAccessible_t(GeckoVBuf_accessible_t* accArg, GeckoVBuf_recordedAccessible_t* recordArg, GeckoVBuf_recordedTree_t* treeArg);
+
+	virtual void release();
+	virtual bool getDocHandle(int* docHandle);
+	virtual bool getID(int* ID);
+	virtual bool getIA2Role(long* role);
+	virtual bool getRole(long* role, std::wstring& roleString);
+	virtual bool getStates(int* states);
+	virtual bool getIA2States(int* states);
+	virtual bool getKeyboardShortcut(std::wstring& keyboardShortcut);
+	virtual bool getAttributes(std::map<std::wstring,std::wstring>& attribs);
+	virtual bool getName(std::wstring& name);
+	virtual bool getDescription(std::wstring& description);
+	virtual bool getValue(std::wstring& value);
+	virtual bool getLocale(std::wstring& locale);
+	virtual bool getLocation(long* left, long* top, long* width, long* height);
+	virtual bool isLabelVisible();
+	virtual bool getText(std::wstring& text);
+	virtual bool getTextAttributes(long offset, long* startOffset, long* endOffset, std::map<std::wstring,std::wstring>& attribs);
+	virtual bool hasHypertext();
+	virtual GeckoVBuf_accessible_t* getEmbeddedObject(long offset);
+	virtual bool getChildCount(long* childCount);
+	virtual void getChildren(std::vector<GeckoVBuf_accessible_t*>& children);
+	virtual void getActionNames(std::vector<std::wstring>& actionNames);
+	virtual int getTableVersion();
+	virtual bool getRowCount(long* rowCount);
+	virtual bool getColumnCount(long* columnCount);
+	virtual bool getCellExtentsAtIndex(long index, long* row, long* column, long* rowExtents, long* columnExtents);
+	virtual bool isTableCell();
+	virtual bool getCellExtents(long* row, long* column, long* rowExtents, long* columnExtents);
+	virtual bool getHeaderCells(bool columnHeaders, std::wstring& headerCells);
+	virtual GeckoVBuf_accessible_t* getCellTable();
+	virtual bool getToolkit(std::wstring& name, std::wstring& version);
+
+};
+
+#endif
@@ -0,0 +1,649 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2007-2013 NV Access Limited
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include <cwchar>
+#include <cwctype>
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <map>
+#include <vector>
+#include <common/log.h>
+#include <vbufBase/storage.h>
+#include <vbufBase/utils.h>
+#include "accessible.h"
+#include "recording.h"
+#include "renderer.h"
+
+using namespace std;
+
+const wchar_t* GeckoVBuf_indexedAttributes[]={
+	L"IAccessible::role",
+	L"IAccessible2::attribute_level",
+	L"IAccessible2::attribute_xml-roles",
+	L"IAccessible2::attribute_tag"
+};
+
+const int GeckoVBuf_indexedAttributeCount=sizeof(GeckoVBuf_indexedAttributes)/sizeof(GeckoVBuf_indexedAttributes[0]);
+
+inline void fillTableCounts(VBufStorage_controlFieldNode_t* node, GeckoVBuf_accessible_t* table) {
+	wostringstream s;
+	long count = 0;
+	if (table->getRowCount(&count)) {
+		s << count;
+		node->addAttribute(L"table-rowcount", s.str());
+		s.str(L"");
+	}
+	if (table->getColumnCount(&count)) {
+		s << count;
+		node->addAttribute(L"table-columncount", s.str());
+	}
+}
+
+inline int updateTableCounts(GeckoVBuf_accessible_t* cell, VBufStorage_buffer_t* tableBuffer) {
+	GeckoVBuf_accessible_t* table = cell->getCellTable();
+	if (!table)
+		return 0;
+	int docHandle, id;
+	if (!table->getDocHandle(&docHandle) || !table->getID(&id)) {
+		table->release();
+		return 0;
+	}
+	VBufStorage_controlFieldNode_t* node = tableBuffer->getControlFieldNodeWithIdentifier(docHandle, id);
+	if (!node || table->getTableVersion() != 2) {
+		table->release();
+		return 0;
+	}
+	fillTableCounts(node, table);
+	table->release();
+	return id;
+}
+
+inline void fillTableCellInfo_IATable(VBufStorage_controlFieldNode_t* node, GeckoVBuf_accessible_t* table, const wstring& cellIndexStr) {
+	wostringstream s;
+	long cellIndex = wcstol(cellIndexStr.c_str(), NULL, 10);
+	long row, column, rowExtents, columnExtents;
+	if (table->getCellExtentsAtIndex(cellIndex, &row, &column, &rowExtents, &columnExtents)) {
+		s << row + 1;
+		node->addAttribute(L"table-rownumber", s.str());
+		s.str(L"");
+		s << column + 1;
+		node->addAttribute(L"table-columnnumber", s.str());
+		if (columnExtents > 1) {
+			s.str(L"");
+			s << columnExtents;
+			node->addAttribute(L"table-columnsspanned", s.str());
+		}
+		if (rowExtents > 1) {
+			s.str(L"");
+			s << rowExtents;
+			node->addAttribute(L"table-rowsspanned", s.str());
+		}
+	}
+}
+
+inline void fillTableHeaders(VBufStorage_controlFieldNode_t* node, GeckoVBuf_accessible_t* cell, bool columnHeaders, const wstring& attribName) {
+	wstring headerCells;
+	if (cell->getHeaderCells(columnHeaders, headerCells) && !headerCells.empty())
+		node->addAttribute(attribName, headerCells);
+}
+
+void GeckoVBufRenderer_t::fillTableCellInfo_IATable2(VBufStorage_controlFieldNode_t* node, GeckoVBuf_accessible_t* cell) {
+	wostringstream s;
+
+	long row, column, rowExtents, columnExtents;
+	if (cell->getCellExtents(&row, &column, &rowExtents, &columnExtents)) {
+		s << row + 1;
+		node->addAttribute(L"table-rownumber", s.str());
+		s.str(L"");
+		s << column + 1;
+		node->addAttribute(L"table-columnnumber", s.str());
+		if (columnExtents > 1) {
+			s.str(L"");
+			s << columnExtents;
+			node->addAttribute(L"table-columnsspanned", s.str());
+		}
+		if (rowExtents > 1) {
+			s.str(L"");
+			s << rowExtents;
+			node->addAttribute(L"table-rowsspanned", s.str());
+		}
+	}
+
+	if (this->shouldDisableTableHeaders)
+		return;
+
+	fillTableHeaders(node, cell, true, L"table-columnheadercells");
+	fillTableHeaders(node, cell, false, L"table-rowheadercells");
+}
+
+void GeckoVBufRenderer_t::versionSpecificInit(GeckoVBuf_accessible_t* acc) {
+	// Defaults.
+	this->shouldDisableTableHeaders = false;
+	this->hasEncodedAccDescription = false;
+
+	wstring toolkitName, toolkitVersion;
+	if (!acc->getToolkit(toolkitName, toolkitVersion))
+		return;
+
+	if (toolkitName == L"Gecko") {
+		if (toolkitVersion.compare(0, 2, L"1.") == 0) {
+			if (toolkitVersion.compare(0, 6, L"1.9.2.") == 0) {
+				// Gecko 1.9.2.x.
+				// Retrieve the digits for the final part of the main version number.
+				wstring verPart;
+				for (size_t i = 6; i < toolkitVersion.length() && iswdigit(toolkitVersion[i]); i++)
+					verPart += toolkitVersion[i];
+				if (wcstol(verPart.c_str(), NULL, 10) <= 10) {
+					// Gecko <= 1.9.2.10 will crash if we try to retrieve headers on some table cells, so disable them.
+					this->shouldDisableTableHeaders = true;
+				}
+			}
+			// Gecko 1.x uses accDescription to encode position info as well as the description.
+			this->hasEncodedAccDescription = true;
+		}
+	}
+}
+
+/**
+ * Checks that a node rendered before was given attributes for exactly the given states.
+ * @param node the node.
+ * @param prefix the start of the name of each state attribute, such as "IAccessible::state_".
+ * @param states the states the object has now.
+ * @return true if the node has an attribute for each of the states and no others.
+ */
+static bool hasSameStates(const VBufStorage_controlFieldNode_t* node, const wchar_t* prefix, int states) {
+	wostringstream s;
+	for(int i=0;i<32;++i) {
+		int state=1<<i;
+		s<<prefix<<state;
+		bool hadState=node->getAttributeValue(s.str())!=NULL;
+		s.str(L"");
+		if(hadState!=((state&states)!=0)) return false;
+	}
+	return true;
+}
+
+const VBufStorage_attributeQuery_t QUERY_PRESENTATION_ROLE(L"IAccessible2::attribute_xml-roles", VBufStorage_attributeMatch_word, vector<wstring>(1, L"presentation"));
+
+VBufStorage_fieldNode_t* GeckoVBufRenderer_t::fillVBuf(GeckoVBuf_accessible_t* acc,
+	VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parentNode, VBufStorage_fieldNode_t* previousNode,
+	GeckoVBuf_accessible_t* table, GeckoVBuf_accessible_t* table2, long tableID,
+	bool ignoreInteractiveUnlabelledGraphics, VBufStorage_controlFieldNode_t* oldParentNode
+) {
+	nhAssert(buffer); //buffer can't be NULL
+	nhAssert(!parentNode||buffer->isNodeInBuffer(parentNode)); //parent node must be in buffer
+	nhAssert(!previousNode||buffer->isNodeInBuffer(previousNode)); //Previous node must be in buffer
+	VBufStorage_fieldNode_t* tempNode;
+	wostringstream s;
+
+	//get docHandle -- IAccessible2 windowHandle
+	int docHandle;
+	if(!acc->getDocHandle(&docHandle)) {
+		LOG_DEBUG(L"acc->getDocHandle failed");
+		return NULL;
+	}
+	if(!docHandle) {
+		LOG_DEBUG(L"bad docHandle");
+		return NULL;
+	}
+	//Get ID -- IAccessible2 uniqueID
+	int ID;
+	if(!acc->getID(&ID)) {
+		LOG_DEBUG(L"acc->getID failed");
+		return NULL;
+	}
+
+	//Make sure that we don't already know about this object -- protect from loops
+	if(buffer->getControlFieldNodeWithIdentifier(docHandle,ID)) {
+		LOG_DEBUG(L"a node with this docHandle and ID already exists, returning NULL");
+		return NULL;
+	}
+
+	//get states -- IAccessible accState
+	int states=0;
+	if(!acc->getStates(&states)) {
+		LOG_DEBUG(L"acc->getStates failed");
+		states=0;
+	}
+	//get IA2States -- IAccessible2 states
+	int IA2States=0;
+	if(!acc->getIA2States(&IA2States)) {
+		LOG_DEBUG(L"acc->getIA2States failed");
+		IA2States=0;
+	}
+
+	//Find the node this object had when it was last rendered, if it was rendered in the same place
+	VBufStorage_controlFieldNode_t* oldNode=NULL;
+	if(oldParentNode) {
+		oldNode=this->tableBuffer->getControlFieldNodeWithIdentifier(docHandle,ID);
+		if(oldNode&&oldNode!=oldParentNode&&oldNode->getParent()!=oldParentNode) {
+			oldNode=NULL;
+		}
+	}
+	//A descendant that nothing was invalidated in and whose states are the same would render as it did, so copy it instead of fetching it again
+	if(oldNode&&oldNode!=oldParentNode&&!oldNode->isStale&&hasSameStates(oldNode,L"IAccessible::state_",states)&&hasSameStates(oldNode,L"IAccessible2::state_",IA2States)) {
+		LOG_DEBUG(L"Reusing unchanged node "<<oldNode->getDebugInfo());
+		return buffer->copySubtree(parentNode,previousNode,oldNode);
+	}
+
+	//Add this node to the buffer
+	parentNode=buffer->addControlFieldNode(parentNode,previousNode,docHandle,ID,true);
+	nhAssert(parentNode); //new node must have been created
+	previousNode=NULL;
+
+	//Get role -- IAccessible2 role
+	long role=0;
+	wstring roleString;
+	if(!acc->getIA2Role(&role))
+		role=IA2_ROLE_UNKNOWN;
+	if(role==0) {
+		if(!acc->getRole(&role,roleString)) {
+			LOG_DEBUG(L"accRole failed");
+		}
+	}
+	//Add role as an attrib
+	if(!roleString.empty())
+		s<<roleString;
+	else
+		s<<role;
+	parentNode->addAttribute(L"IAccessible::role",s.str());
+	s.str(L"");
+
+	//Add each state that is on, as an attrib
+	for(int i=0;i<32;++i) {
+		int state=1<<i;
+		if(state&states) {
+			s<<L"IAccessible::state_"<<state;
+			parentNode->addAttribute(s.str(),L"1");
+			s.str(L"");
+		}
+	}
+	//Add each IA2 state that is on, as an attrib
+	for(int i=0;i<32;++i) {
+		int state=1<<i;
+		if(state&IA2States) {
+			s<<L"IAccessible2::state_"<<state;
+			parentNode->addAttribute(s.str(),L"1");
+			s.str(L"");
+		}
+	}
+
+	//get keyboardShortcut -- IAccessible accKeyboardShortcut;
+	wstring keyboardShortcut;
+	if(acc->getKeyboardShortcut(keyboardShortcut)) {
+		parentNode->addAttribute(L"keyboardShortcut",keyboardShortcut);
+	} else
+		parentNode->addAttribute(L"keyboardShortcut",L"");
+
+	//get IA2Attributes -- IAccessible2 attributes;
+	map<wstring,wstring> IA2AttribsMap;
+	if(acc->getAttributes(IA2AttribsMap)) {
+		// Add each IA2 attribute as an attrib.
+		for(map<wstring,wstring>::const_iterator it=IA2AttribsMap.begin();it!=IA2AttribsMap.end();++it) {
+			s<<L"IAccessible2::attribute_"<<it->first;
+			parentNode->addAttribute(s.str(),it->second);
+			s.str(L"");
+		}
+	} else {
+		LOG_DEBUG(L"acc->getAttributes failed");
+	}
+	map<wstring,wstring>::const_iterator IA2AttribsMapIt;
+
+	//Check IA2Attributes, and or the role etc to work out if this object is a block element
+	bool isBlockElement=true;
+	if(IA2States&IA2_STATE_MULTI_LINE) {
+		// Multiline nodes should always be block.
+		isBlockElement=true;
+	} else if((IA2AttribsMapIt=IA2AttribsMap.find(L"display"))!=IA2AttribsMap.end()) {
+		// If there is a display attribute, we can rely solely on this to determine whether this is a block element or not.
+		isBlockElement=(IA2AttribsMapIt->second!=L"inline"&&IA2AttribsMapIt->second!=L"inline-block");
+	} else if((IA2AttribsMapIt=IA2AttribsMap.find(L"formatting"))!=IA2AttribsMap.end()&&IA2AttribsMapIt->second==L"block") {
+		isBlockElement=true;
+	} else if(role==ROLE_SYSTEM_TABLE||role==ROLE_SYSTEM_CELL||role==IA2_ROLE_SECTION||role==ROLE_SYSTEM_DOCUMENT||role==IA2_ROLE_INTERNAL_FRAME||role==IA2_ROLE_UNKNOWN||role==ROLE_SYSTEM_SEPARATOR) {
+		isBlockElement=true;
+	} else {
+		isBlockElement=false;
+	}
+	parentNode->isBlock=isBlockElement;
+
+	// force   isHidden to True if this has an ARIA role of presentation but its focusble -- Gecko does not hide this itself.
+	if((states&STATE_SYSTEM_FOCUSABLE)&&QUERY_PRESENTATION_ROLE.matches(parentNode)) {
+		parentNode->isHidden=true;
+	}
+	wstring name;
+	bool hasName=acc->getName(name);
+
+	wstring description;
+	wstring rawDesc;
+	if(acc->getDescription(rawDesc)) {
+		if(this->hasEncodedAccDescription) {
+			if(rawDesc.compare(0,13,L"Description: ")==0)
+				description=rawDesc.substr(13);
+		} else
+			description=rawDesc;
+		parentNode->addAttribute(L"description",description);
+	}
+
+	wstring locale;
+	acc->getLocale(locale);
+
+	long left=0, top=0, width=0, height=0;
+	if(!acc->getLocation(&left,&top,&width,&height)) {
+		LOG_DEBUG(L"Error getting accLocation");
+	}
+
+	// Whether this node is editable text.
+	bool isEditable = (role == ROLE_SYSTEM_TEXT && (states & STATE_SYSTEM_FOCUSABLE || states & STATE_SYSTEM_UNAVAILABLE)) || IA2States & IA2_STATE_EDITABLE;
+	// Whether this node is a link or inside a link.
+	int inLink = states & STATE_SYSTEM_LINKED;
+	// Whether this is the root node.
+	bool isRoot = ID == this->rootID;
+	// Whether this is an embedded application.
+		bool isEmbeddedApp = role == IA2_ROLE_EMBEDDED_OBJECT
+			|| (!isRoot && (role == ROLE_SYSTEM_APPLICATION || role == ROLE_SYSTEM_DIALOG));
+	// Whether this node is interactive.
+	// Certain objects are never interactive, even if other checks are true.
+	bool isNeverInteractive = parentNode->isHidden||(!isEditable && (isRoot || role == ROLE_SYSTEM_DOCUMENT || role == IA2_ROLE_INTERNAL_FRAME));
+	bool isInteractive = !isNeverInteractive && (isEditable || inLink || states & STATE_SYSTEM_FOCUSABLE || states & STATE_SYSTEM_UNAVAILABLE || isEmbeddedApp || role == ROLE_SYSTEM_EQUATION);
+	// We aren't finished calculating isInteractive yet; actions are handled below.
+	// Whether the name is the content of this node.
+	bool nameIsContent = isEmbeddedApp
+		|| role == ROLE_SYSTEM_LINK || role == ROLE_SYSTEM_PUSHBUTTON || role == IA2_ROLE_TOGGLE_BUTTON || role == ROLE_SYSTEM_MENUITEM || role == ROLE_SYSTEM_GRAPHIC || (role == ROLE_SYSTEM_TEXT && !isEditable) || role == IA2_ROLE_HEADING || role == ROLE_SYSTEM_PAGETAB || role == ROLE_SYSTEM_BUTTONMENU
+		|| ((role == ROLE_SYSTEM_CHECKBUTTON || role == ROLE_SYSTEM_RADIOBUTTON) && !acc->isLabelVisible());
+
+	//Get the text from the IAccessibleText interface
+	wstring IA2Text;
+	int IA2TextLength=0;
+	if (acc->getText(IA2Text))
+		IA2TextLength=static_cast<int>(IA2Text.length());
+	// Determine whether the text is extraneous whitespace.
+	bool IA2TextIsUnneededSpace=true;
+	// Whitespace isn't extraneous in editable controls.
+	if (IA2TextLength > 0 && !isEditable) {
+		for(int i=0;i<IA2TextLength;++i) {
+			if(IA2Text[i]==L'\n'||IA2Text[i]==L'\xfffc'||!iswspace(IA2Text[i])) {
+				IA2TextIsUnneededSpace=false;
+				break;
+			}
+		}
+	} else
+		IA2TextIsUnneededSpace=false;
+
+	// Whether a node is visible.
+	// An invisible node should not be rendered, but will have a presence in the buffer.
+	bool isVisible = true;
+	// Whether to render children, including text content.
+	// Note that we may still render the name, value, etc. even if we don't render children.
+	bool renderChildren = true;
+	long childCount=0;
+	if ((IA2AttribsMapIt = IA2AttribsMap.find(L"hidden")) != IA2AttribsMap.end() && IA2AttribsMapIt->second == L"true") {
+		// aria-hidden
+		isVisible = false;
+	} else {
+		isVisible = width > 0 && height > 0;
+		if (IA2TextIsUnneededSpace
+			|| role == ROLE_SYSTEM_COMBOBOX
+			|| (role == ROLE_SYSTEM_LIST && !(states & STATE_SYSTEM_READONLY))
+			|| isEmbeddedApp
+			|| role == ROLE_SYSTEM_OUTLINE
+			|| role == ROLE_SYSTEM_EQUATION
+			|| (nameIsContent && (IA2AttribsMapIt = IA2AttribsMap.find(L"explicit-name")) != IA2AttribsMap.end() && IA2AttribsMapIt->second == L"true")
+		)
+			renderChildren = false;
+		if(acc->getChildCount(&childCount)) {
+			if (childCount > 0) {
+				// If a node has children, it's visible.
+				isVisible = true;
+			}
+		} else
+			childCount=0;
+	}
+
+	//Expose all available actions
+	vector<wstring> actionNames;
+	acc->getActionNames(actionNames);
+	for(size_t i=0;i<actionNames.size();++i) {
+		const wstring& actionName=actionNames[i];
+		if(!actionName.empty()) {
+			wstring attribName=L"IAccessibleAction_";
+			attribName+=actionName;
+			s<<i;
+			parentNode->addAttribute(attribName,s.str());
+			s.str(L"");
+			if(!isNeverInteractive&&(actionName==L"click"||actionName==L"showlongdesc")) {
+				isInteractive=true;
+			}
+		}
+	}
+
+	// Handle table cell information.
+	// For IAccessibleTable, we must always be passed the table by the caller.
+	// For IAccessibleTable2, we can always ask the cell,
+	// which allows us to handle updates to table cells.
+	bool isTableCell = acc->isTableCell();
+	if (
+		isTableCell || // IAccessibleTable2
+		(table && (IA2AttribsMapIt = IA2AttribsMap.find(L"table-cell-index")) != IA2AttribsMap.end()) // IAccessibleTable
+	) {
+		if (isTableCell) {
+			// IAccessibleTable2
+			this->fillTableCellInfo_IATable2(parentNode, acc);
+			if (!table2) {
+				// This is an update; we're not rendering the entire table.
+				tableID = updateTableCounts(acc, this->tableBuffer);
+			}
+		} else // IAccessibleTable
+			fillTableCellInfo_IATable(parentNode, table, IA2AttribsMapIt->second);
+		// tableID is the IAccessible2::uniqueID for the table.
+		s << tableID;
+		parentNode->addAttribute(L"table-id", s.str());
+		s.str(L"");
+		// We're now within a cell, so descendant nodes shouldn't refer to this table anymore.
+		table = NULL;
+		table2 = NULL;
+		tableID = 0;
+	}
+	// Handle table information.
+	// If table is not NULL, we're within a table but not yet within a cell, so don't bother to query for table info.
+	if (!table2 && !table) {
+		// Try to get table information.
+		int tableVersion = acc->getTableVersion();
+		if (tableVersion == 2)
+			table2 = acc;
+		else if (tableVersion == 1)
+			table = acc;
+		if (table2||table) {
+			// This is a table, so add its information as attributes.
+			if((IA2AttribsMapIt = IA2AttribsMap.find(L"layout-guess")) != IA2AttribsMap.end())
+				parentNode->addAttribute(L"table-layout",L"1");
+			tableID = ID;
+			s << ID;
+			parentNode->addAttribute(L"table-id", s.str());
+			s.str(L"");
+			fillTableCounts(parentNode, acc);
+			// Add the table summary if one is present and the table is visible.
+			if ((isVisible &&
+				(!description.empty() && (tempNode = buffer->addTextFieldNode(parentNode, previousNode, description)))) ||
+				// If there is no caption, the summary (if any) is the name.
+				// There is no caption if the label isn't visible.
+				(hasName && !acc->isLabelVisible() && (tempNode = buffer->addTextFieldNode(parentNode, previousNode, name)))
+			) {
+				if(!locale.empty()) tempNode->addAttribute(L"language",locale);
+				previousNode = tempNode;
+			}
+		}
+	}
+
+	wstring value;
+	bool hasValue=acc->getValue(value);
+
+	//If the name isn't being rendered as the content, then add the name as a field attribute.
+	if (!nameIsContent && hasName)
+		parentNode->addAttribute(L"name", name);
+
+	// Whether the descendants can be compared with those of the old node, to reuse the ones that have not changed.
+	// Descendants of interactive nodes and of tables outside of cells depend on more than the attributes of this node,
+	// so they are always fetched again.
+	if (oldNode && (isInteractive || table || table2 || parentNode->isBlock != oldNode->isBlock || parentNode->isHidden != oldNode->isHidden || parentNode->getAttributesString() != oldNode->getAttributesString()))
+		oldNode = NULL;
+
+	if (isVisible) {
+		if (role==ROLE_SYSTEM_GRAPHIC&&childCount>0&&hasName) {
+			// This is an image map with a name. Render the name first.
+			previousNode=buffer->addTextFieldNode(parentNode,previousNode,name);
+			if(previousNode&&!locale.empty()) previousNode->addAttribute(L"language",locale);
+		}
+
+		if (isInteractive && !ignoreInteractiveUnlabelledGraphics) {
+			// Don't render interactive unlabelled graphic descendants if this node has a name,
+			// as author supplied names are preferred.
+			ignoreInteractiveUnlabelledGraphics = hasName;
+		}
+
+		if (renderChildren && IA2TextLength > 0) {
+			// Process IAccessibleText.
+			bool hasHypertext=acc->hasHypertext();
+			int chunkStart=0;
+			long attribsStart = 0;
+			long attribsEnd = 0;
+			map<wstring,wstring> textAttribs;
+			for(int i=0;;++i) {
+				if(i!=chunkStart&&(i==IA2TextLength||i==attribsEnd||IA2Text[i]==0xfffc)) {
+					// We've reached the end of the current chunk of text.
+					// (A chunk ends at the end of the text, at the end of an attributes run
+					// or at an embedded object char.)
+					// Add the chunk to the buffer.
+					if((tempNode=buffer->addTextFieldNode(parentNode,previousNode,IA2Text.substr(chunkStart,i-chunkStart)))!=NULL) {
+						previousNode=tempNode;
+						// Add text attributes.
+						for(map<wstring,wstring>::const_iterator it=textAttribs.begin();it!=textAttribs.end();++it)
+							previousNode->addAttribute(it->first,it->second);
+						#define copyObjectAttribute(attr) if ((IA2AttribsMapIt = IA2AttribsMap.find(attr)) != IA2AttribsMap.end()) \
+							previousNode->addAttribute(attr, IA2AttribsMapIt->second);
+						copyObjectAttribute(L"text-align");
+						#undef copyObjectAttribute
+					}
+				}
+				if(i==IA2TextLength)
+					break;
+				if(i==attribsEnd) {
+					// We've hit the end of the last attributes run and thus the start of the next.
+					textAttribs.clear();
+					chunkStart=i;
+					if(!acc->getTextAttributes(attribsEnd,&attribsStart,&attribsEnd,textAttribs)) {
+						// If attributes fails, assume it'll fail for the entire text.
+						attribsEnd=IA2TextLength;
+					}
+				}
+				if(hasHypertext&&IA2Text[i]==0xfffc) {
+					// Embedded object char.
+					// The next chunk of text shouldn't include this char.
+					chunkStart=i+1;
+					GeckoVBuf_accessible_t* childAcc=acc->getEmbeddedObject(i);
+					if(!childAcc)
+						continue;
+					if ((tempNode = this->fillVBuf(childAcc, buffer, parentNode, previousNode, table, table2, tableID, ignoreInteractiveUnlabelledGraphics, oldNode))!=NULL) {
+						previousNode=tempNode;
+					} else {
+						LOG_DEBUG(L"Error in fillVBuf");
+					}
+					childAcc->release();
+				}
+			}
+
+		} else if (renderChildren && childCount > 0) {
+			// The object has no text, but we do want to render its children.
+			vector<GeckoVBuf_accessible_t*> children;
+			acc->getChildren(children);
+			for(vector<GeckoVBuf_accessible_t*>::iterator i=children.begin();i!=children.end();++i) {
+				if ((tempNode = this->fillVBuf(*i, buffer, parentNode, previousNode, table, table2, tableID, ignoreInteractiveUnlabelledGraphics, oldNode))!=NULL)
+					previousNode=tempNode;
+				else {
+					LOG_DEBUG(L"Error in calling fillVBuf");
+				}
+				(*i)->release();
+			}
+
+		} else {
+			// There were no children to render.
+			if(role==ROLE_SYSTEM_GRAPHIC) {
+				if (hasName && !name.empty()) {
+					// The graphic has a label, so use it.
+					previousNode=buffer->addTextFieldNode(parentNode,previousNode,name);
+					if(previousNode&&!locale.empty()) previousNode->addAttribute(L"language",locale);
+				} else if ((hasName && name.empty()) || ignoreInteractiveUnlabelledGraphics) {
+					// alt="" or we've determined that all unlabelled graphics should be ignored,
+					// so don't render the graphic at all.
+					isInteractive = false;
+				} else if (isInteractive) {
+					// The graphic is unlabelled, but we should try to derive a name for it.
+					if (inLink && hasValue) {
+						// derive the label from the link URL.
+						previousNode = buffer->addTextFieldNode(parentNode, previousNode, getNameForURL(value));
+					} else if ((IA2AttribsMapIt = IA2AttribsMap.find(L"src")) != IA2AttribsMap.end()) {
+						// Derive the label from the graphic URL.
+						previousNode = buffer->addTextFieldNode(parentNode, previousNode, getNameForURL(IA2AttribsMap[L"src"]));
+					}
+				}
+			} else if (!nameIsContent && hasValue) {
+				previousNode=buffer->addTextFieldNode(parentNode,previousNode,value);
+				if(previousNode&&!locale.empty()) previousNode->addAttribute(L"language",locale);
+			}
+		}
+
+		if ((nameIsContent || role == IA2_ROLE_SECTION || role == IA2_ROLE_TEXT_FRAME) && !nodeHasUsefulContent(parentNode)) {
+			// If there is no useful content and the name can be the content,
+			// render the name if there is one.
+			if(hasName) {
+				tempNode = buffer->addTextFieldNode(parentNode, NULL, name);
+				if(tempNode && !locale.empty()) tempNode->addAttribute(L"language", locale);
+			} else if(role==ROLE_SYSTEM_LINK&&hasValue) {
+				// If a link has no name, derive it from the URL.
+				buffer->addTextFieldNode(parentNode, NULL, getNameForURL(value));
+			}
+		}
+
+		if ((role == ROLE_SYSTEM_CELL || role == ROLE_SYSTEM_ROWHEADER || role == ROLE_SYSTEM_COLUMNHEADER||role==IA2_ROLE_UNKNOWN) && parentNode->getLength() == 0) {
+			// Always render a space for empty table cells and unknowns.
+			previousNode=buffer->addTextFieldNode(parentNode,previousNode,L" ");
+			if(previousNode&&!locale.empty()) previousNode->addAttribute(L"language",locale);
+			parentNode->isBlock=false;
+		}
+
+		if ((isInteractive || role == ROLE_SYSTEM_SEPARATOR) && parentNode->getLength() == 0) {
+			// If the node is interactive or otherwise relevant even when empty
+			// and it still has no content, render a space so the user can access the node.
+			previousNode=buffer->addTextFieldNode(parentNode,previousNode,L" ");
+			if(previousNode&&!locale.empty()) previousNode->addAttribute(L"language",locale);
+		}
+	}
+
+	return parentNode;
+}
+
+VBufStorage_fieldNode_t* GeckoVBufRenderer_t::render(GeckoVBuf_accessible_t* acc, VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* oldNode) {
+	GeckoVBuf_recordedTree_t fetchedTree;
+	if(acc->fetchSubtree(fetchedTree)&&fetchedTree.getRoot()) {
+		LOG_DEBUG(L"Fetched "<<fetchedTree.getNodeCount()<<L" objects at once");
+		acc=fetchedTree.getRoot();
+	}
+	if(!oldNode) {
+		this->versionSpecificInit(acc);
+	}
+	return this->fillVBuf(acc,buffer,NULL,NULL,NULL,NULL,0,false,oldNode);
+}
+
+GeckoVBufRenderer_t::GeckoVBufRenderer_t(int rootIDArg, VBufStorage_buffer_t* tableBufferArg): rootID(rootIDArg), tableBuffer(tableBufferArg), shouldDisableTableHeaders(false), hasEncodedAccDescription(false) {
+}
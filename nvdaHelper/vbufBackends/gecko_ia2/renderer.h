@@ -0,0 +1,94 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef VIRTUALBUFFER_BACKENDS_GECKO_RENDERER_H
+#define VIRTUALBUFFER_BACKENDS_GECKO_RENDERER_H
+
+#include <vbufBase/storage.h>
+#include "accessible.h"
+
+/**
+ * The attributes quick navigation searches by most, which gecko buffers keep an index of.
+ */
+extern const wchar_t* GeckoVBuf_indexedAttributes[];
+
+extern const int GeckoVBuf_indexedAttributeCount;
+
+/**
+ * Renders IAccessible2 objects as the gecko backend does, whether they are live or recorded.
+ * It only knows objects through GeckoVBuf_accessible_t, so it does not depend on Windows.
+ */
+class GeckoVBufRenderer_t {
+	private:
+
+/**
+ * The ID of the object the backend starts rendering from.
+ */
+	const int rootID;
+
+/**
+ * The buffer holding the whole document, where the table of a re-rendered cell can be found.
+ */
+	VBufStorage_buffer_t* const tableBuffer;
+
+	bool shouldDisableTableHeaders;
+	bool hasEncodedAccDescription;
+
+	void fillTableCellInfo_IATable2(VBufStorage_controlFieldNode_t* node, GeckoVBuf_accessible_t* cell);
+
+	public:
+
+/**
+ * @param rootIDArg the ID of the object the backend starts rendering from.
+ * @param tableBufferArg the buffer holding the whole document.
+ */
+	GeckoVBufRenderer_t(int rootIDArg, VBufStorage_buffer_t* tableBufferArg);
+
+/**
+ * Works around bugs of particular versions of the toolkit the root object is in.
+ */
+	void versionSpecificInit(GeckoVBuf_accessible_t* acc);
+
+/**
+ * Renders an object and its descendants in to a buffer, as the backend does for the root of the document or of an invalid subtree.
+ * If the object's provider can fetch the whole subtree at once, it is rendered from what was fetched, otherwise each question is asked of the objects as they are rendered.
+ * @param acc the object to render.
+ * @param buffer the buffer to render in to.
+ * @param oldNode the object's node in the document buffer if this re-renders an invalid subtree, whose unchanged descendants are reused, or NULL if this is the root of the document, whose toolkit decides which workarounds are needed.
+ * @return the object's node, or NULL if it could not be rendered.
+ */
+	VBufStorage_fieldNode_t* render(GeckoVBuf_accessible_t* acc, VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* oldNode);
+
+/**
+ * Renders an object and its descendants in to a buffer.
+ * @param acc the object to render.
+ * @param buffer the buffer to render in to.
+ * @param parentNode the node to add the object's node to, or NULL to add it as the root.
+ * @param previousNode the node to add the object's node after, or NULL to add it first.
+ * @param table the IAccessibleTable table the object is in, if not yet in one of its cells.
+ * @param table2 the IAccessibleTable2 table the object is in, if not yet in one of its cells.
+ * @param tableID the ID of the table the object is in.
+ * @param oldParentNode the node in the document buffer of the object's parent, if the parent rendered as it did before and so its old children can be reused, or the object's own old node if it is the root of a re-render.
+ * A descendant of that node that was not invalidated and whose states have not changed is copied from the document buffer rather than fetched again.
+ * @return the object's node, or NULL if it could not be rendered.
+ */
+	VBufStorage_fieldNode_t* fillVBuf(GeckoVBuf_accessible_t* acc,
+		VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parentNode, VBufStorage_fieldNode_t* previousNode,
+		GeckoVBuf_accessible_t* table=NULL, GeckoVBuf_accessible_t* table2=NULL, long tableID=0,
+		bool ignoreInteractiveUnlabelledGraphics=false, VBufStorage_controlFieldNode_t* oldParentNode=NULL
+	);
+
+};
+
+#endif
@@ -0,0 +1,100 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include <map>
+#include <vector>
+#include <string>
+#include <common/log.h>
+#include "replay.h"
+
+using namespace std;
+
+/**
+ * @return the doc handle of the root object of a recording, or 0 if it has none.
+ */
+int getRootDocHandle(GeckoVBuf_recordedTree_t* tree) {
+	int docHandle=0;
+	GeckoVBuf_recordedAccessible_t* root=tree->getRoot();
+	if(root) root->getDocHandle(&docHandle);
+	return docHandle;
+}
+
+/**
+ * @return the ID of the root object of a recording, or 0 if it has none.
+ */
+int getRootID(GeckoVBuf_recordedTree_t* tree) {
+	int ID=0;
+	GeckoVBuf_recordedAccessible_t* root=tree->getRoot();
+	if(root) root->getID(&ID);
+	return ID;
+}
+
+GeckoVBufReplayBackend_t::GeckoVBufReplayBackend_t(GeckoVBuf_recordedTree_t* treeArg): VBufStorage_buffer_t(), tree(treeArg), renderer(getRootID(treeArg),this), lock(), invalidSubtreeList(), pendingEdits(), rootDocHandle(getRootDocHandle(treeArg)), rootID(getRootID(treeArg)) {
+	nhAssert(tree);
+	this->setIndexedAttributes(vector<wstring>(GeckoVBuf_indexedAttributes,GeckoVBuf_indexedAttributes+GeckoVBuf_indexedAttributeCount));
+}
+
+void GeckoVBufReplayBackend_t::render(VBufStorage_buffer_t* buffer, int docHandle, int ID, VBufStorage_controlFieldNode_t* oldNode) {
+	GeckoVBuf_recordedAccessible_t* acc=tree->getNodeWithIdentifier(docHandle,ID);
+	if(!acc) {
+		LOG_DEBUG(L"No recorded object with docHandle "<<docHandle<<L" and ID "<<ID);
+		return;
+	}
+	this->renderer.render(acc,buffer,oldNode);
+}
+
+void GeckoVBufReplayBackend_t::update() {
+	if(this->hasContent()) {
+		VBufStorage_controlFieldNodeList_t tempSubtreeList;
+		this->lock.acquire();
+		invalidSubtreeList.take(tempSubtreeList);
+		this->lock.release();
+		LOG_DEBUG(L"Updating "<<tempSubtreeList.size()<<L" subtrees");
+		map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> replacementSubtreeMap;
+		for(VBufStorage_controlFieldNodeList_t::iterator i=tempSubtreeList.begin();i!=tempSubtreeList.end();++i) {
+			VBufStorage_controlFieldNode_t* node=*i;
+			VBufStorage_buffer_t* tempBuf=new VBufStorage_buffer_t();
+			int docHandle=0, ID=0;
+			node->getIdentifier(&docHandle,&ID);
+			this->render(tempBuf,docHandle,ID,node);
+			replacementSubtreeMap.insert(make_pair(node,tempBuf));
+		}
+		VBufStorage_textEditList_t edits;
+		this->lock.acquire();
+		//Gecko nodes hold nothing beyond what rendering produces, so updates keep unchanged nodes as the gecko backend's do
+		if(!this->replaceSubtrees(replacementSubtreeMap,true,&edits)) {
+			LOG_DEBUGWARNING(L"Error replacing one or more subtrees");
+		}
+		this->pendingEdits.add(edits);
+		this->lock.release();
+	} else {
+		LOG_DEBUG(L"Initial render");
+		this->lock.acquire();
+		this->render(this,rootDocHandle,rootID);
+		this->pendingEdits.add(0,0,this->getTextLength());
+		this->lock.release();
+	}
+}
+
+bool GeckoVBufReplayBackend_t::invalidateSubtree(VBufStorage_controlFieldNode_t* node) {
+	this->lock.acquire();
+	bool isInBuffer=invalidSubtreeList.invalidate(this,node);
+	this->lock.release();
+	return isInBuffer;
+}
+
+void GeckoVBufReplayBackend_t::getEdits(VBufStorage_textEditList_t& edits) {
+	edits.clear();
+	edits.swap(this->pendingEdits);
+}
@@ -0,0 +1,91 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef VIRTUALBUFFER_BACKENDS_GECKO_REPLAY_H
+#define VIRTUALBUFFER_BACKENDS_GECKO_REPLAY_H
+
+#include <common/lock.h>
+#include <vbufBase/storage.h>
+#include <vbufBase/invalidSubtreeList.h>
+#include <vbufBase/textEditList.h>
+#include "recording.h"
+#include "renderer.h"
+
+/**
+ * Renders a recorded gecko document with the same renderer as the gecko backend, so that rendering can be tested and timed without the application, and on other platforms.
+ * It updates in the same steps as VBufBackend_t, but in the calling thread and without waiting.
+ */
+class GeckoVBufReplayBackend_t: public VBufStorage_buffer_t {
+	private:
+
+	GeckoVBuf_recordedTree_t* const tree;
+
+	GeckoVBufRenderer_t renderer;
+
+/**
+ * Guards the buffer and the invalid nodes while they change, as the lock of VBufBackend_t does.
+ */
+	LockableObject lock;
+
+/**
+ * The nodes that will be re-rendered by the next update.
+ */
+	VBufStorage_invalidSubtreeList_t invalidSubtreeList;
+
+/**
+ * The edits made to the text by updates since getEdits was last called.
+ */
+	VBufStorage_textEditList_t pendingEdits;
+
+/**
+ * Renders the recorded object with the given identifier, as the gecko backend renders the live one.
+ */
+	void render(VBufStorage_buffer_t* buffer, int docHandle, int ID, VBufStorage_controlFieldNode_t* oldNode=NULL);
+
+	public:
+
+/**
+ * The doc handle of the object rendering starts from.
+ */
+	const int rootDocHandle;
+
+/**
+ * The ID of the object rendering starts from.
+ */
+	const int rootID;
+
+/**
+ * @param treeArg the recording to render, whose first object is the one rendering starts from. It must outlive the backend.
+ */
+	GeckoVBufReplayBackend_t(GeckoVBuf_recordedTree_t* treeArg);
+
+/**
+ * Renders the whole document if there is no content yet, otherwise re-renders the invalid nodes.
+ */
+	void update();
+
+/**
+ * Marks a node as invalid, so that its content is re-rendered by the next update.
+ * @return true if the node is in the buffer.
+ */
+	bool invalidateSubtree(VBufStorage_controlFieldNode_t* node);
+
+/**
+ * Fetches the edits made to the text by updates since this was last called, and forgets them.
+ */
+	void getEdits(VBufStorage_textEditList_t& edits);
+
+};
+
+#endif
@@ -13,6 +13,7 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
 
 #include <list>
+#include <cwchar>
 #include <windows.h>
 #include <objbase.h>
 #include <oleidl.h>
@@ -21,7 +22,6 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include <common/log.h>
 #include "mshtml.h"
 #include <remote/nvdaController.h>
-#include <common/xml.h>
 #include "node.h"
 
 using namespace std;
@@ -404,6 +404,15 @@ bool isNodeInLiveRegion(VBufStorage_fieldNode_t* node) {
 	return true;
 }
 
+/**
+ * @return true if the two text field nodes contain the same text.
+ */
+inline bool isSameText(VBufStorage_textFieldNode_t* node, VBufStorage_textFieldNode_t* other) {
+	VBufStorage_textView_t text=node->getTextView();
+	VBufStorage_textView_t otherText=other->getTextView();
+	return text.length==otherText.length&&wmemcmp(text.text,otherText.text,text.length)==0;
+}
+
 void MshtmlVBufStorage_controlFieldNode_t::reportLiveAddition() {
 	wstring text; //=(this->ariaLiveAtomicNode==this)?L"atomic: ":L"additions: ";
 	this->getTextInRange(0,this->getLength(),text,false,isNodeInLiveRegion);
@@ -428,7 +437,7 @@ void MshtmlVBufStorage_controlFieldNode_t::postProcessLiveRegion(VBufStorage_con
 				oldStart=oldStart->getNext();
 				continue;
 			}
-			if(((VBufStorage_textFieldNode_t*)oldStart)->text.compare(((VBufStorage_textFieldNode_t*)newStart)->text)!=0) {
+			if(!isSameText((VBufStorage_textFieldNode_t*)oldStart,(VBufStorage_textFieldNode_t*)newStart)) {
 				break;
 			}
 			oldStart=oldStart->getNext();
@@ -446,7 +455,7 @@ void MshtmlVBufStorage_controlFieldNode_t::postProcessLiveRegion(VBufStorage_con
 				oldEnd=oldEnd->getPrevious();
 				continue;
 			}
-			if(((VBufStorage_textFieldNode_t*)oldEnd)->text.compare(((VBufStorage_textFieldNode_t*)newEnd)->text)!=0) {
+			if(!isSameText((VBufStorage_textFieldNode_t*)oldEnd,(VBufStorage_textFieldNode_t*)newEnd)) {
 				break;
 			}
 			oldEnd=oldEnd->getPrevious();
@@ -473,10 +482,9 @@ void MshtmlVBufStorage_controlFieldNode_t::postProcessLiveRegion(VBufStorage_con
 	}
 }
 
-void MshtmlVBufStorage_controlFieldNode_t::generateAttributesForMarkupOpeningTag(wstring& text, int startOffset, int endOffset) {
-	VBufStorage_controlFieldNode_t::generateAttributesForMarkupOpeningTag(text, startOffset, endOffset);
-	text += L"language=\"";
-	for (wstring::const_iterator it = language.begin(); it != language.end(); ++it)
-		appendCharToXML(*it, text, true);
-	text += L"\" ";
+void MshtmlVBufStorage_controlFieldNode_t::generateAttributesForMarkupOpeningTag(VBufStorage_textSink_t& sink, int startOffset, int endOffset) {
+	VBufStorage_controlFieldNode_t::generateAttributesForMarkupOpeningTag(sink, startOffset, endOffset);
+	sink.append(L"language=\"");
+	sink.appendEscaped(language, true);
+	sink.append(L"\" ");
 }
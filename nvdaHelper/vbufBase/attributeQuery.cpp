@@ -0,0 +1,240 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include <string>
+#include <vector>
+#include <regex>
+#include <sstream>
+#include <iterator>
+#include <algorithm>
+#include <cwchar>
+#include <cwctype>
+#include <common/log.h>
+#include "storage.h"
+#include "attributeQuery.h"
+
+using namespace std;
+
+/**
+ * The pieces of regular expression NVDA generates for findNodeByAttributes.
+ * A value that is not tested matches any escaped text up to the next unescaped semi colon.
+ */
+#define REGEXP_ANYVALUE L"(?:\\\\;|[^;])*;"
+#define REGEXP_NOTEMPTYVALUE L"(?:\\\\;|[^;])+;"
+#define REGEXP_WORDSTART L"(?:\\\\;|[^;])*\\b(?:"
+#define REGEXP_WORDEND L")\\b(?:\\\\;|[^;])*;"
+#define REGEXP_GROUPSTART L"(?:"
+
+/**
+ * @return true if the given character is one with a special meaning in a regular expression.
+ */
+inline bool isRegexpMetaChar(wchar_t c) {
+	return wcschr(L"^$.*+?()[]{}|\\",c)!=NULL;
+}
+
+/**
+ * Checks if the regular expression continues with the given text at the given position, and if so moves past it.
+ */
+inline bool consumeRegexpText(const wstring& regexpString, size_t& pos, const wchar_t* text) {
+	size_t length=wcslen(text);
+	if(regexpString.compare(pos,length,text)!=0) return false;
+	pos+=length;
+	return true;
+}
+
+/**
+ * Reads a literal attribute name or value from a regular expression.
+ * The text is escaped twice: first as in an attribute string (a backslash before colons, semi colons and backslashes), and then for the regular expression.
+ * @param regexpString the regular expression.
+ * @param pos the position to start reading from, which is moved past what was read.
+ * @param terminator an unescaped character in the attribute string which ends the literal and is consumed, or 0 to end at the next unescaped regular expression meta character.
+ * @param literal where to place the unescaped text.
+ * @return true if a literal was read, false if the regular expression uses constructs that are not literal text.
+ */
+bool readRegexpLiteral(const wstring& regexpString, size_t& pos, wchar_t terminator, wstring& literal) {
+	literal.clear();
+	bool attributeEscape=false;
+	while(pos<regexpString.size()) {
+		wchar_t c=regexpString[pos];
+		if(c==L'\\') {
+			//An escaped meta character is literal, other escapes such as \b or \d are not
+			if(pos+1>=regexpString.size()||iswalnum(regexpString[pos+1])) return false;
+			c=regexpString[pos+1];
+			pos+=2;
+		} else if(isRegexpMetaChar(c)) {
+			break;
+		} else {
+			++pos;
+		}
+		if(attributeEscape) {
+			literal+=c;
+			attributeEscape=false;
+		} else if(c==L'\\') {
+			attributeEscape=true;
+		} else if(terminator&&c==terminator) {
+			return true;
+		} else if(c==L':'||c==L';') {
+			//Unescaped colons and semi colons only appear between attributes in an attribute string
+			return false;
+		} else {
+			literal+=c;
+		}
+	}
+	return !attributeEscape&&terminator==0;
+}
+
+/**
+ * The value of a missing attribute.
+ */
+const wstring emptyValue;
+
+/**
+ * The character class used by \b in a regular expression, so that word matches agree with the regular expressions they are compiled from.
+ */
+const regex_traits<wchar_t> wordCharTraits;
+const regex_traits<wchar_t>::char_class_type wordCharClass=wordCharTraits.lookup_classname(L"w",L"w"+1);
+
+/**
+ * @return true if the character at the given position is a word character, as used by \b in a regular expression.
+ */
+inline bool isRegexpWordChar(const wstring& text, size_t pos) {
+	return pos<text.size()&&wordCharTraits.isctype(text[pos],wordCharClass);
+}
+
+/**
+ * @return true if there is a word boundary at the given position in the text.
+ */
+inline bool isWordBoundary(const wstring& text, size_t pos) {
+	return (pos>0&&isRegexpWordChar(text,pos-1))!=isRegexpWordChar(text,pos);
+}
+
+VBufStorage_attributeQuery_t::VBufStorage_attributeQuery_t(): options(), usesRegexp(false), regexpAttribs(), regexp() {
+}
+
+VBufStorage_attributeQuery_t::VBufStorage_attributeQuery_t(const std::wstring& name, VBufStorage_attributeMatchType_t type, const std::vector<std::wstring>& values): options(), usesRegexp(false), regexpAttribs(), regexp() {
+	this->addCondition(name,type,values);
+}
+
+void VBufStorage_attributeQuery_t::addOption() {
+	this->options.push_back(vector<condition_t>());
+}
+
+void VBufStorage_attributeQuery_t::addCondition(const std::wstring& name, VBufStorage_attributeMatchType_t type, const std::vector<std::wstring>& values) {
+	if(this->options.empty()) this->addOption();
+	condition_t condition;
+	condition.name=name;
+	condition.type=type;
+	if(type!=VBufStorage_attributeMatch_notEmpty) condition.values=values;
+	this->options.back().push_back(condition);
+}
+
+bool VBufStorage_attributeQuery_t::parseRegexp(const std::vector<std::wstring>& attribs, const std::wstring& regexpString) {
+	size_t pos=0;
+	wstring literal;
+	do {
+		this->addOption();
+		for(vector<wstring>::const_iterator name=attribs.begin();name!=attribs.end();++name) {
+			if(!readRegexpLiteral(regexpString,pos,L':',literal)||literal!=*name) return false;
+			vector<wstring> values;
+			if(consumeRegexpText(regexpString,pos,REGEXP_ANYVALUE)) {
+				//Any value matches, so there is nothing to test
+				continue;
+			} else if(consumeRegexpText(regexpString,pos,REGEXP_NOTEMPTYVALUE)) {
+				this->addCondition(*name,VBufStorage_attributeMatch_notEmpty,values);
+			} else if(consumeRegexpText(regexpString,pos,REGEXP_WORDSTART)) {
+				do {
+					if(!readRegexpLiteral(regexpString,pos,0,literal)) return false;
+					values.push_back(literal);
+				} while(consumeRegexpText(regexpString,pos,L"|"));
+				if(!consumeRegexpText(regexpString,pos,REGEXP_WORDEND)) return false;
+				this->addCondition(*name,VBufStorage_attributeMatch_word,values);
+			} else if(consumeRegexpText(regexpString,pos,REGEXP_GROUPSTART)) {
+				do {
+					if(!readRegexpLiteral(regexpString,pos,L';',literal)) return false;
+					values.push_back(literal);
+				} while(consumeRegexpText(regexpString,pos,L"|"));
+				if(!consumeRegexpText(regexpString,pos,L")")) return false;
+				this->addCondition(*name,VBufStorage_attributeMatch_exact,values);
+			} else {
+				return false;
+			}
+		}
+	} while(consumeRegexpText(regexpString,pos,L"|"));
+	return pos==regexpString.size();
+}
+
+bool VBufStorage_attributeQuery_t::compile(const std::wstring& attribs, const std::wstring& regexpString) {
+	this->options.clear();
+	this->usesRegexp=false;
+	this->regexpAttribs.clear();
+	// Split attribs at spaces.
+	vector<wstring> attribsList;
+	wistringstream attribsStream(attribs);
+	copy(istream_iterator<wstring, wchar_t, std::char_traits<wchar_t>>(attribsStream),
+		istream_iterator<wstring, wchar_t, std::char_traits<wchar_t>>(),
+		back_inserter<vector<wstring> >(attribsList));
+	if(this->parseRegexp(attribsList,regexpString)) {
+		LOG_DEBUG(L"Compiled regular expression to "<<this->options.size()<<L" options");
+		return true;
+	}
+	LOG_DEBUG(L"Could not translate regular expression, using it as is");
+	this->options.clear();
+	try {
+		this->regexp=wregex(regexpString);
+	} catch (...) {
+		LOG_ERROR(L"Error in regular expression");
+		return false;
+	}
+	this->regexpAttribs.swap(attribsList);
+	this->usesRegexp=true;
+	return true;
+}
+
+bool VBufStorage_attributeQuery_t::matchValue(const condition_t& condition, const std::wstring& value) {
+	switch(condition.type) {
+		case VBufStorage_attributeMatch_notEmpty:
+		return !value.empty();
+		case VBufStorage_attributeMatch_exact:
+		return find(condition.values.begin(),condition.values.end(),value)!=condition.values.end();
+		case VBufStorage_attributeMatch_prefix:
+		for(vector<wstring>::const_iterator i=condition.values.begin();i!=condition.values.end();++i) {
+			if(value.compare(0,i->size(),*i)==0) return true;
+		}
+		return false;
+		case VBufStorage_attributeMatch_word:
+		for(vector<wstring>::const_iterator i=condition.values.begin();i!=condition.values.end();++i) {
+			for(size_t pos=value.find(*i);pos!=wstring::npos;pos=value.find(*i,pos+1)) {
+				if(isWordBoundary(value,pos)&&isWordBoundary(value,pos+i->size())) return true;
+			}
+		}
+		return false;
+	}
+	return false;
+}
+
+bool VBufStorage_attributeQuery_t::matches(VBufStorage_fieldNode_t* node) const {
+	nhAssert(node);
+	if(this->usesRegexp) {
+		return node->matchAttributes(this->regexpAttribs,this->regexp);
+	}
+	for(vector<vector<condition_t> >::const_iterator option=this->options.begin();option!=this->options.end();++option) {
+		vector<condition_t>::const_iterator condition=option->begin();
+		for(;condition!=option->end();++condition) {
+			const wstring* value=node->getAttributeValue(condition->name);
+			if(!matchValue(*condition,value?*value:emptyValue)) break;
+		}
+		if(condition==option->end()) return true;
+	}
+	return false;
+}
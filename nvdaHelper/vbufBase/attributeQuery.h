@@ -0,0 +1,142 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef VIRTUALBUFFER_ATTRIBUTEQUERY_H
+#define VIRTUALBUFFER_ATTRIBUTEQUERY_H
+
+#include <string>
+#include <vector>
+#include <regex>
+
+class VBufStorage_fieldNode_t;
+
+/**
+ * Ways in which the value of an attribute can be tested by an attribute query.
+ * A missing attribute is treated as having an empty value.
+ */
+typedef enum {
+	VBufStorage_attributeMatch_notEmpty,
+	VBufStorage_attributeMatch_exact,
+	VBufStorage_attributeMatch_prefix,
+	VBufStorage_attributeMatch_word
+} VBufStorage_attributeMatchType_t;
+
+/**
+ * A compiled test of a node's attributes, evaluated directly against the node's attributes.
+ * A query is made up of one or more options, and matches a node if all the conditions of any of its options are true for that node.
+ * Queries can either be built with addOption and addCondition, or compiled from the attribs and regexp strings accepted by findNodeByAttributes.
+ */
+class VBufStorage_attributeQuery_t {
+	public:
+
+/**
+ * A test of one attribute.
+ */
+	typedef struct {
+		std::wstring name;
+		VBufStorage_attributeMatchType_t type;
+		std::vector<std::wstring> values;
+	} condition_t;
+
+	private:
+
+/**
+ * The options of this query, each being a list of conditions that must all be true.
+ */
+	std::vector<std::vector<condition_t> > options;
+
+/**
+ * True if this query was compiled from a regular expression that could not be translated to conditions, and so is evaluated with regexp instead.
+ */
+	bool usesRegexp;
+
+/**
+ * When usesRegexp is true, the attributes and regular expression given to matchAttributes.
+ */
+	std::vector<std::wstring> regexpAttribs;
+	std::wregex regexp;
+
+/**
+ * Parses a regular expression in the form generated for findNodeByAttributes, translating it to options and conditions.
+ * @param attribs the attribute names the regular expression tests, in order.
+ * @param regexpString the regular expression.
+ * @return true if the whole regular expression could be translated, false if it uses any other constructs.
+ */
+	bool parseRegexp(const std::vector<std::wstring>& attribs, const std::wstring& regexpString);
+
+	public:
+
+/**
+ * constructor. Creates a query with no options, which matches nothing until options are added.
+ */
+	VBufStorage_attributeQuery_t();
+
+/**
+ * constructor. Creates a query with a single option holding a single condition.
+ * @param name the name of the attribute to test.
+ * @param type how the attribute's value is tested.
+ * @param values the values to test against, the condition is true if any of them match.
+ */
+	VBufStorage_attributeQuery_t(const std::wstring& name, VBufStorage_attributeMatchType_t type, const std::vector<std::wstring>& values);
+
+/**
+ * Starts a new option, to which following conditions are added.
+ */
+	void addOption();
+
+/**
+ * Adds a condition to the last option, starting the first option if there are none yet.
+ * @param name the name of the attribute to test.
+ * @param type how the attribute's value is tested.
+ * @param values the values to test against, the condition is true if any of them match. Ignored for VBufStorage_attributeMatch_notEmpty.
+ */
+	void addCondition(const std::wstring& name, VBufStorage_attributeMatchType_t type, const std::vector<std::wstring>& values);
+
+/**
+ * Compiles the attribs and regexp strings accepted by findNodeByAttributes, replacing any options this query had.
+ * Regular expressions in the form NVDA generates are translated to conditions, anything else is evaluated as a regular expression against the node's attribute string.
+ * @param attribs a space separated list of the attribute names tested by the regular expression.
+ * @param regexpString a regular expression that the attribute string of a matching node must match.
+ * @return true if successful, false if the regular expression is invalid.
+ */
+	bool compile(const std::wstring& attribs, const std::wstring& regexpString);
+
+/**
+ * @return true if this query could not be translated to conditions and is evaluated as a regular expression.
+ */
+	inline bool isRegexp() const { return usesRegexp; }
+
+/**
+ * @return the options of this query, each being a list of conditions that must all be true. Empty if the query is evaluated as a regular expression.
+ */
+	inline const std::vector<std::vector<condition_t> >& getOptions() const { return options; }
+
+/**
+ * Tests an attribute value against a condition.
+ * @param condition the condition.
+ * @param value the value of the attribute, or an empty string if the attribute is missing.
+ * @return true if the condition is true for this value.
+ */
+	static bool matchValue(const condition_t& condition, const std::wstring& value);
+
+/**
+ * Tests a node against this query.
+ * @param node the node to test.
+ * @return true if the node matches, false otherwise.
+ */
+	bool matches(VBufStorage_fieldNode_t* node) const;
+
+};
+
+#endif
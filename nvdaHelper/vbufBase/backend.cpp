@@ -13,6 +13,7 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
 
 #include <map>
+#include <vector>
 #define WIN32_LEAN_AND_MEAN 
 #include <windows.h>
 #include <remote/nvdaHelperRemote.h>
@@ -28,7 +29,21 @@ const UINT VBufBackend_t::wmRenderThreadTerminate=RegisterWindowMessage(L"VBufBa
 
 VBufBackendSet_t VBufBackend_t::runningBackends;
 
-VBufBackend_t::VBufBackend_t(int docHandleArg, int IDArg): renderThreadID(GetWindowThreadProcessId((HWND)docHandleArg,NULL)), rootDocHandle(docHandleArg), rootID(IDArg), lock(), renderThreadTimerID(0), invalidSubtreeList() {
+/**
+ * A clock giving the system tick count, used to schedule updates.
+ */
+class VBufBackend_tickClock_t: public VBufBackend_clock_t {
+	public:
+
+	unsigned int getTime() {
+		return GetTickCount();
+	}
+
+};
+
+VBufBackend_tickClock_t tickClock;
+
+VBufBackend_t::VBufBackend_t(int docHandleArg, int IDArg): renderThreadID(GetWindowThreadProcessId((HWND)docHandleArg,NULL)), rootDocHandle(docHandleArg), rootID(IDArg), lock(), renderThreadTimerID(0), updateScheduler(&tickClock), invalidSubtreeList(), pendingEdits(), reconcileUpdates(false), renderExecutor(NULL) {
 	LOG_DEBUG(L"Initializing backend with docHandle "<<docHandleArg<<L", ID "<<IDArg);
 }
 
@@ -74,18 +89,19 @@ void CALLBACK VBufBackend_t::renderThread_winEventProcHook(HWINEVENTHOOK hookID,
 	}
 }
 
-void VBufBackend_t::requestUpdate() {
-	if(renderThreadTimerID==0) {
-		renderThreadTimerID=SetTimer(0,0,100,renderThread_timerProc);
-		nhAssert(renderThreadTimerID);
-		LOG_DEBUG(L"Set timer with ID "<<renderThreadTimerID);
-	}
+void VBufBackend_t::requestUpdate(bool urgent) {
+	updateScheduler.invalidated(urgent);
+	//Setting an existing timer again replaces its timeout
+	renderThreadTimerID=SetTimer(0,renderThreadTimerID,updateScheduler.getDelay(),renderThread_timerProc);
+	nhAssert(renderThreadTimerID);
+	LOG_DEBUG(L"Set timer with ID "<<renderThreadTimerID<<L" for "<<updateScheduler.getDelay()<<L" ms");
 }
 
 void VBufBackend_t::cancelPendingUpdate() {
 	if(renderThreadTimerID>0) {
 		KillTimer(0,renderThreadTimerID);
 		renderThreadTimerID=0;
+		updateScheduler.cancel();
 		LOG_DEBUG(L"Killed timer with ID "<<renderThreadTimerID);
 	}
 }
@@ -107,9 +123,18 @@ void CALLBACK VBufBackend_t::renderThread_timerProc(HWND hwnd, UINT msg, UINT_PT
 		// This probably means the timer message was queued before we killed the timer, so just ignore it.
 		return;
 	}
+	int delay=backend->updateScheduler.getDelay();
+	if(delay>0) {
+		// The timer fired before the update was due according to the scheduler's clock, so wait for the rest.
+		backend->renderThreadTimerID=SetTimer(0,0,delay,renderThread_timerProc);
+		nhAssert(backend->renderThreadTimerID);
+		return;
+	}
+	// Clear the timer first, so that invalidations which arrive while updating schedule another update.
+	backend->renderThreadTimerID=0;
+	backend->updateScheduler.updated();
 	LOG_DEBUG(L"Calling update on backend at "<<backend);
 	backend->update();
-	backend->renderThreadTimerID=0;
 }
 
 void VBufBackend_t::renderThread_initialize() {
@@ -130,87 +155,96 @@ void VBufBackend_t::renderThread_terminate() {
 }
 
 bool VBufBackend_t::invalidateSubtree(VBufStorage_controlFieldNode_t* node) {
-	if(node->updateAncestor) node=node->updateAncestor;
-	if(!isNodeInBuffer(node)) {
-		LOG_DEBUGWARNING(L"Node at "<<node<<L" not in buffer at "<<this);
-		return false;
-	}
-	LOG_DEBUG(L"Invalidating node "<<node->getDebugInfo());
 	this->lock.acquire();
-	bool needsInsert=true;
-	for(VBufStorage_controlFieldNodeList_t::iterator i=invalidSubtreeList.begin();i!=invalidSubtreeList.end();) {
-		VBufStorage_fieldNode_t* existingNode=*i;
-		if(node==existingNode) { //Node already invalidated
-			LOG_DEBUG(L"Node already invalidated");
-			needsInsert=false;
-			break;
-		} else if(isDescendantNode(existingNode,node)) { //An ancestor is already invalidated
-			LOG_DEBUG(L"An ancestor is already invalidated, returning");
-			needsInsert=false;
-			break;
-		} else if(isDescendantNode(node,existingNode)) { //A descedndant has been invalidated
-			LOG_DEBUG(L"removing a descendant node from the invalid nodes");
-			//Remove the old descendant
-			invalidSubtreeList.erase(i++);
-			//If no other descendants have been removed yet, insert the real node here
-			//At the place of the first found descendant
-			if(needsInsert) {
-				invalidSubtreeList.insert(i,node);
-				needsInsert=false;
-			}
-		} else { //Unrelated node
-			++i;
-		}
-	}  
-	//If the node still has not been inserted yet, insert it at the end now
-	if(needsInsert) {
-		LOG_DEBUG(L"Adding node to invalid nodes");
-		invalidSubtreeList.insert(invalidSubtreeList.end(),node);
-	}
+	bool containsCaret=false;
+	bool isInBuffer=invalidSubtreeList.invalidate(this,node,&containsCaret);
 	this->lock.release();
-	this->requestUpdate();
+	if(!isInBuffer) return false;
+	this->requestUpdate(containsCaret);
 	return true;
 }
 
+/**
+ * The invalid subtrees being rendered by an update, and the temp buffers they are rendered in to.
+ */
+typedef struct {
+	VBufBackend_t* backend;
+	vector<VBufStorage_controlFieldNode_t*> nodes;
+	vector<VBufStorage_buffer_t*> buffers;
+} VBufBackend_renderJob_t;
+
+void VBufBackend_t::renderSubtreeTask(void* context, int index) {
+	VBufBackend_renderJob_t* job=(VBufBackend_renderJob_t*)context;
+	VBufStorage_controlFieldNode_t* node=job->nodes[index];
+	LOG_DEBUG(L"re-rendering subtree at "<<node);
+	VBufStorage_buffer_t* tempBuf=new VBufStorage_buffer_t();
+	nhAssert(tempBuf); //tempBuf can't be NULL
+	LOG_DEBUG(L"Created temp buffer at "<<tempBuf);
+	int docHandle=0, ID=0;
+	node->getIdentifier(&docHandle,&ID);
+	LOG_DEBUG(L"subtree node has docHandle "<<docHandle<<L" and ID "<<ID);
+	LOG_DEBUG(L"Rendering content");
+	job->backend->render(tempBuf,docHandle,ID,node);
+	LOG_DEBUG(L"Rendered content in temp buffer");
+	job->buffers[index]=tempBuf;
+}
+
 void VBufBackend_t::update() {
 	if(this->hasContent()) {
 		VBufStorage_controlFieldNodeList_t tempSubtreeList;
 		this->lock.acquire();
-		LOG_DEBUG(L"Updating "<<invalidSubtreeList.size()<<L" subtrees");
-		invalidSubtreeList.swap(tempSubtreeList);
+		invalidSubtreeList.take(tempSubtreeList);
+		LOG_DEBUG(L"Updating "<<tempSubtreeList.size()<<L" subtrees");
 		this->lock.release();
-		map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> replacementSubtreeMap;
 		//render all invalid subtrees, storing each subtree in its own buffer
-		for(VBufStorage_controlFieldNodeList_t::iterator i=tempSubtreeList.begin();i!=tempSubtreeList.end();++i) {
-			VBufStorage_controlFieldNode_t* node=*i;
-			LOG_DEBUG(L"re-rendering subtree at "<<node);
-			VBufStorage_buffer_t* tempBuf=new VBufStorage_buffer_t();
-			nhAssert(tempBuf); //tempBuf can't be NULL
-			LOG_DEBUG(L"Created temp buffer at "<<tempBuf);
-			int docHandle=0, ID=0;
-			node->getIdentifier(&docHandle,&ID);
-			LOG_DEBUG(L"subtree node has docHandle "<<docHandle<<L" and ID "<<ID);
-			LOG_DEBUG(L"Rendering content");
-			render(tempBuf,docHandle,ID,node);
-			LOG_DEBUG(L"Rendered content in temp buffer");
-			replacementSubtreeMap.insert(make_pair(node,tempBuf));
+		VBufBackend_renderJob_t job;
+		job.backend=this;
+		job.nodes.assign(tempSubtreeList.begin(),tempSubtreeList.end());
+		job.buffers.assign(job.nodes.size(),NULL);
+		int subtreeCount=static_cast<int>(job.nodes.size());
+		if(this->renderExecutor&&subtreeCount>1) {
+			LOG_DEBUG(L"Rendering subtrees with executor at "<<this->renderExecutor);
+			this->renderExecutor->run(subtreeCount,renderSubtreeTask,&job);
+		} else {
+			for(int i=0;i<subtreeCount;++i) renderSubtreeTask(&job,i);
+		}
+		//Each temp buffer is kept with its own subtree, so the result does not depend on the order they were rendered in
+		map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> replacementSubtreeMap;
+		for(int i=0;i<subtreeCount;++i) {
+			replacementSubtreeMap.insert(make_pair(job.nodes[i],job.buffers[i]));
 		}
 		this->lock.acquire();
 		LOG_DEBUG(L"Replacing nodes with content of temp buffers");
-		if(!this->replaceSubtrees(replacementSubtreeMap)) {
+		VBufStorage_textEditList_t edits;
+		if(!this->replaceSubtrees(replacementSubtreeMap,this->reconcileUpdates,&edits)) {
 			LOG_DEBUGWARNING(L"Error replacing one or more subtrees");
 		}
+		this->pendingEdits.add(edits);
 		this->lock.release();
-		nvdaControllerInternal_vbufChangeNotify(this->rootDocHandle,this->rootID);
+		//Send the edits as a flat list of old start offset, old end offset and new length
+		vector<int> editValues;
+		editValues.reserve(edits.getEdits().size()*3);
+		for(vector<VBufStorage_textEdit_t>::const_iterator i=edits.getEdits().begin();i!=edits.getEdits().end();++i) {
+			editValues.push_back(i->oldStart);
+			editValues.push_back(i->oldEnd);
+			editValues.push_back(i->newLength);
+		}
+		nvdaControllerInternal_vbufEditsNotify(this->rootDocHandle,this->rootID,static_cast<int>(edits.getEdits().size()),editValues.empty()?NULL:&editValues[0]);
 	} else {
 		LOG_DEBUG(L"Initial render");
 		this->lock.acquire();
 		render(this,rootDocHandle,rootID);
+		this->pendingEdits.add(0,0,this->getTextLength());
 		this->lock.release();
 	}
 	LOG_DEBUG(L"Update complete");
 }
 
+void VBufBackend_t::getEdits(VBufStorage_textEditList_t& edits) {
+	edits.clear();
+	edits.swap(this->pendingEdits);
+}
+
 int VBufBackend_t::getNativeHandleForNode(VBufStorage_controlFieldNode_t* node) {
 	return 0;
 }
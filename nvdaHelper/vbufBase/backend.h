@@ -19,6 +19,9 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #define WIN32_LEAN_AND_MEAN 
 #include <windows.h>
 #include "storage.h"
+#include "updateScheduler.h"
+#include "invalidSubtreeList.h"
+#include "renderExecutor.h"
 #include <common/lock.h>
 
 class VBufBackend_t;
@@ -44,6 +47,11 @@ class VBufBackend_t  : public VBufStorage_buffer_t {
  */
 	UINT_PTR renderThreadTimerID;
 
+/**
+ * Decides when the timer should fire after subtrees are invalidated.
+ */
+	VBufBackend_updateScheduler_t updateScheduler;
+
 /**
  * A timer callback that will rerender invalid subtrees
  */
@@ -58,7 +66,19 @@ class VBufBackend_t  : public VBufStorage_buffer_t {
  * the list of control field nodes that should be re-rendered the next time the backend is updated.
  * the list is in the order the invalidations were requested.
  */
-	VBufStorage_controlFieldNodeList_t invalidSubtreeList;
+	VBufStorage_invalidSubtreeList_t invalidSubtreeList;
+
+/**
+ * The edits made to the text by updates since getEdits was last called.
+ */
+	VBufStorage_textEditList_t pendingEdits;
+
+/**
+ * Renders one of the invalid subtrees of an update in to a new temp buffer.
+ * @param context the update's render job.
+ * @param index the index of the subtree in the job.
+ */
+	static void renderSubtreeTask(void* context, int index);
 
 	protected:
 
@@ -72,10 +92,25 @@ class VBufBackend_t  : public VBufStorage_buffer_t {
  */
 	const int renderThreadID;
 
+/**
+ * If true, re-rendered subtrees are reconciled with the existing nodes, so that unchanged nodes and their handles are kept.
+ * Backends should only enable this if their control field nodes hold no state beyond what rendering produces, as a kept node is not the one passed to render.
+ */
+	bool reconcileUpdates;
+
+/**
+ * If not NULL, the executor used to render the invalid subtrees of an update, possibly several at once; otherwise they are rendered one after the other in the render thread.
+ * Backends should only set this if their render method can be called on other threads and at the same time as itself, only reading the old node it is given.
+ * The executor is owned by the backend that sets it.
+ */
+	VBufBackend_renderExecutor_t* renderExecutor;
+
 /**
  * Requests that the backend should update any invalid nodes  when it can in the next little while.
+ * Each request moves the pending update according to the update scheduler, so that a stream of requests is coalesced.
+ * @param urgent true if the update should not be delayed by the backoff, such as when an invalidated subtree contains the caret.
  */
-	void requestUpdate();
+	void requestUpdate(bool urgent=false);
 
 /**
  * Cancels any pending request to update invalid nodes.
@@ -149,6 +184,12 @@ class VBufBackend_t  : public VBufStorage_buffer_t {
  */
 	virtual void forceUpdate();
 
+/**
+ * Fetches the edits made to the text by updates since this was last called, and forgets them.
+ * @param edits the list to place the edits in, replacing anything already in it.
+ */
+	void getEdits(VBufStorage_textEditList_t& edits);
+
 /**
  * Retrieve the native handle for the object underlying a node.
  * This handle is used to retrieve the object out-of-process.
@@ -179,9 +220,10 @@ class VBufBackend_t  : public VBufStorage_buffer_t {
 	virtual void destroy();
 
  /**
- * Useful for cerializing access to the buffer
+ * Useful for cerializing access to the buffer.
+ * Queries that only read the buffer take shared access, so that they can run at the same time, while anything that changes the buffer takes exclusive access.
  */
-	LockableObject lock;
+	SharedLockableObject lock;
 
 };
 
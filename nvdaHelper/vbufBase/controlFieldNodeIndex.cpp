@@ -0,0 +1,139 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include <common/log.h>
+#include "controlFieldNodeIndex.h"
+
+using namespace std;
+
+/**
+ * The amount of slots in a table when the first entry is added.
+ */
+#define CONTROLFIELDNODEINDEX_MINCAPACITY 16
+
+/**
+ * Mixes a docHandle and ID in to a hash value.
+ * IDs are often small sequential numbers, so the bits are mixed well enough that consecutive IDs do not end up in long runs of neighbouring slots.
+ */
+inline size_t hashControlFieldNodeIdentifier(int docHandle, int ID) {
+	unsigned int h=static_cast<unsigned int>(docHandle)*0x9E3779B1u;
+	h^=static_cast<unsigned int>(ID)+0x7F4A7C15u+(h<<6)+(h>>2);
+	h^=h>>16;
+	h*=0x85EBCA6Bu;
+	h^=h>>13;
+	h*=0xC2B2AE35u;
+	h^=h>>16;
+	return h;
+}
+
+/**
+ * @return true if a table with the given amount of slots is too full to hold the given amount of entries, keeping the load at no more than three quarters.
+ */
+inline bool isControlFieldNodeIndexOverloaded(size_t entryCount, size_t capacity) {
+	return entryCount*4>capacity*3;
+}
+
+VBufStorage_controlFieldNodeIndex_t::VBufStorage_controlFieldNodeIndex_t(): slots(), count(0) {
+}
+
+size_t VBufStorage_controlFieldNodeIndex_t::findSlot(int docHandle, int ID) const {
+	nhAssert(!slots.empty());
+	const size_t mask=slots.size()-1;
+	size_t index=hashControlFieldNodeIdentifier(docHandle,ID)&mask;
+	for(;;) {
+		const slot_t& slot=slots[index];
+		if(!slot.node||(slot.ID==ID&&slot.docHandle==docHandle)) return index;
+		index=(index+1)&mask;
+	}
+}
+
+void VBufStorage_controlFieldNodeIndex_t::rehash(size_t capacity) {
+	nhAssert(capacity>0&&(capacity&(capacity-1))==0);
+	nhAssert(!isControlFieldNodeIndexOverloaded(count,capacity));
+	vector<slot_t> oldSlots(capacity);
+	oldSlots.swap(slots);
+	for(vector<slot_t>::const_iterator i=oldSlots.begin();i!=oldSlots.end();++i) {
+		if(!i->node) continue;
+		slots[findSlot(i->docHandle,i->ID)]=*i;
+	}
+}
+
+VBufStorage_controlFieldNode_t* VBufStorage_controlFieldNodeIndex_t::find(int docHandle, int ID) const {
+	if(count==0) return NULL;
+	return slots[findSlot(docHandle,ID)].node;
+}
+
+bool VBufStorage_controlFieldNodeIndex_t::insert(int docHandle, int ID, VBufStorage_controlFieldNode_t* node) {
+	nhAssert(node);
+	if(isControlFieldNodeIndexOverloaded(count+1,slots.size())) {
+		reserve(count+1);
+	}
+	slot_t& slot=slots[findSlot(docHandle,ID)];
+	if(slot.node) return false;
+	slot.docHandle=docHandle;
+	slot.ID=ID;
+	slot.node=node;
+	++count;
+	return true;
+}
+
+VBufStorage_controlFieldNode_t* VBufStorage_controlFieldNodeIndex_t::erase(int docHandle, int ID) {
+	if(count==0) return NULL;
+	const size_t mask=slots.size()-1;
+	size_t gap=findSlot(docHandle,ID);
+	VBufStorage_controlFieldNode_t* node=slots[gap].node;
+	if(!node) return NULL;
+	//Shift back any following entries in the same run that would be found through the gap
+	for(size_t index=(gap+1)&mask;slots[index].node;index=(index+1)&mask) {
+		size_t home=hashControlFieldNodeIdentifier(slots[index].docHandle,slots[index].ID)&mask;
+		if(((index-home)&mask)>=((index-gap)&mask)) {
+			slots[gap]=slots[index];
+			gap=index;
+		}
+	}
+	slots[gap].node=NULL;
+	--count;
+	return node;
+}
+
+size_t VBufStorage_controlFieldNodeIndex_t::merge(const VBufStorage_controlFieldNodeIndex_t& other) {
+	nhAssert(&other!=this);
+	reserve(count+other.count);
+	size_t clashCount=0;
+	for(vector<slot_t>::const_iterator i=other.slots.begin();i!=other.slots.end();++i) {
+		if(!i->node) continue;
+		slot_t& slot=slots[findSlot(i->docHandle,i->ID)];
+		if(slot.node) {
+			++clashCount;
+			continue;
+		}
+		slot=*i;
+		++count;
+	}
+	return clashCount;
+}
+
+void VBufStorage_controlFieldNodeIndex_t::reserve(size_t entryCount) {
+	size_t capacity=slots.empty()?CONTROLFIELDNODEINDEX_MINCAPACITY:slots.size();
+	while(isControlFieldNodeIndexOverloaded(entryCount,capacity)) capacity*=2;
+	if(capacity!=slots.size()) {
+		LOG_DEBUG(L"Growing control field node index from "<<slots.size()<<L" to "<<capacity<<L" slots");
+		rehash(capacity);
+	}
+}
+
+void VBufStorage_controlFieldNodeIndex_t::clear() {
+	vector<slot_t>().swap(slots);
+	count=0;
+}
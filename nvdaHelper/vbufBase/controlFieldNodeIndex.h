@@ -0,0 +1,122 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef VIRTUALBUFFER_CONTROLFIELDNODEINDEX_H
+#define VIRTUALBUFFER_CONTROLFIELDNODEINDEX_H
+
+#include <cstddef>
+#include <vector>
+
+class VBufStorage_controlFieldNode_t;
+
+/**
+ * A hash table mapping the docHandle and ID of a control field to its node.
+ * It uses open addressing with linear probing, so a lookup usually touches only one or two neighbouring slots rather than walking a tree of separately allocated entries.
+ */
+class VBufStorage_controlFieldNodeIndex_t {
+	public:
+
+/**
+ * A slot in the table. A slot with a NULL node is empty.
+ */
+	typedef struct {
+		int docHandle;
+		int ID;
+		VBufStorage_controlFieldNode_t* node;
+	} slot_t;
+
+	private:
+
+/**
+ * The slots of the table. Its size is always 0 or a power of 2.
+ */
+	std::vector<slot_t> slots;
+
+/**
+ * The amount of slots holding a node.
+ */
+	size_t count;
+
+/**
+ * @return the index of the slot holding the given identifier, or of the empty slot where it would be inserted.
+ */
+	size_t findSlot(int docHandle, int ID) const;
+
+/**
+ * Moves all entries in to a new table with the given amount of slots.
+ * @param capacity the new amount of slots, must be a power of 2 large enough to hold all entries.
+ */
+	void rehash(size_t capacity);
+
+	public:
+
+	VBufStorage_controlFieldNodeIndex_t();
+
+/**
+ * Finds the node with the given identifier.
+ * @return the node, or NULL if there is no node with this identifier.
+ */
+	VBufStorage_controlFieldNode_t* find(int docHandle, int ID) const;
+
+/**
+ * Adds a node with the given identifier.
+ * @param node the node to add, must not be NULL.
+ * @return true if the node was added, false if a node with this identifier is already in the index.
+ */
+	bool insert(int docHandle, int ID, VBufStorage_controlFieldNode_t* node);
+
+/**
+ * Removes the node with the given identifier.
+ * Entries after the removed one are shifted back in to the gap, so lookups never have to skip over removed entries.
+ * @return the removed node, or NULL if there was no node with this identifier.
+ */
+	VBufStorage_controlFieldNode_t* erase(int docHandle, int ID);
+
+/**
+ * Adds all entries of another index whose identifiers are not already in this one.
+ * The table is grown once up front for all the new entries, rather than possibly several times while inserting.
+ * @param other the index whose entries should be added.
+ * @return the amount of entries that were not added because their identifier was already in this index.
+ */
+	size_t merge(const VBufStorage_controlFieldNodeIndex_t& other);
+
+/**
+ * Makes sure the index can hold at least the given amount of entries without growing.
+ */
+	void reserve(size_t entryCount);
+
+/**
+ * Removes all entries and frees the table.
+ */
+	void clear();
+
+/**
+ * @return the amount of entries in the index.
+ */
+	inline size_t size() const { return count; }
+
+/**
+ * @return the amount of slots in the table, for iterating over it with getSlot.
+ */
+	inline size_t getSlotCount() const { return slots.size(); }
+
+/**
+ * @param index the index of a slot, less than getSlotCount.
+ * @return the slot, which is empty if its node is NULL.
+ */
+	inline const slot_t& getSlot(size_t index) const { return slots[index]; }
+
+};
+
+#endif
@@ -0,0 +1,96 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include <common/log.h>
+#include "invalidSubtreeList.h"
+
+VBufStorage_invalidSubtreeList_t::VBufStorage_invalidSubtreeList_t(): nodes() {
+}
+
+void VBufStorage_invalidSubtreeList_t::unmarkDescendants(VBufStorage_fieldNode_t* node) {
+	for(VBufStorage_fieldNode_t* child=node->firstChild;child!=NULL;child=child->next) {
+		if(child->isInvalidated) {
+			child->isInvalidated=false;
+			for(VBufStorage_fieldNode_t* ancestor=child->parent;ancestor!=NULL;ancestor=ancestor->parent) {
+				if(ancestor->invalidatedDescendantCount>0) --(ancestor->invalidatedDescendantCount);
+			}
+		} else if(child->invalidatedDescendantCount>0) {
+			unmarkDescendants(child);
+		}
+		//Nothing further down needs to be looked at once the count reaches 0
+		if(node->invalidatedDescendantCount==0) break;
+	}
+	//The count may be out of date if a listed node was moved, so make sure it is not looked at again
+	node->invalidatedDescendantCount=0;
+}
+
+bool VBufStorage_invalidSubtreeList_t::add(VBufStorage_controlFieldNode_t* node) {
+	nhAssert(node);
+	if(node->isInvalidated) {
+		LOG_DEBUG(L"Node already invalidated");
+		return false;
+	}
+	for(VBufStorage_fieldNode_t* ancestor=node->parent;ancestor!=NULL;ancestor=ancestor->parent) {
+		if(ancestor->isInvalidated) {
+			LOG_DEBUG(L"An ancestor is already invalidated");
+			return false;
+		}
+	}
+	if(node->invalidatedDescendantCount>0) {
+		LOG_DEBUG(L"Removing descendants from the invalid nodes");
+		unmarkDescendants(node);
+	}
+	node->isInvalidated=true;
+	for(VBufStorage_fieldNode_t* ancestor=node->parent;ancestor!=NULL;ancestor=ancestor->parent) {
+		++(ancestor->invalidatedDescendantCount);
+	}
+	nodes.push_back(node);
+	return true;
+}
+
+bool VBufStorage_invalidSubtreeList_t::invalidate(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* node, bool* containsCaret) {
+	nhAssert(buffer);
+	nhAssert(node);
+	VBufStorage_controlFieldNode_t* changedNode=node;
+	if(node->updateAncestor) node=node->updateAncestor;
+	if(!buffer->isNodeInBuffer(node)) {
+		LOG_DEBUGWARNING(L"Node at "<<node<<L" not in buffer at "<<buffer);
+		return false;
+	}
+	LOG_DEBUG(L"Invalidating node "<<node->getDebugInfo());
+	for(VBufStorage_fieldNode_t* staleNode=changedNode;staleNode!=NULL;staleNode=staleNode->parent) staleNode->isStale=true;
+	if(containsCaret) {
+		//Changes the user is reading at the caret should not wait for the backoff
+		int selectionStart=0, selectionEnd=0, startOffset=0, endOffset=0;
+		*containsCaret=buffer->getSelectionOffsets(&selectionStart,&selectionEnd)&&buffer->getFieldNodeOffsets(node,&startOffset,&endOffset)&&selectionStart>=startOffset&&selectionStart<endOffset;
+	}
+	if(this->add(node)) {
+		LOG_DEBUG(L"Added node to invalid nodes");
+	}
+	return true;
+}
+
+void VBufStorage_invalidSubtreeList_t::take(VBufStorage_controlFieldNodeList_t& list) {
+	for(VBufStorage_controlFieldNodeList_t::iterator i=nodes.begin();i!=nodes.end();++i) {
+		VBufStorage_controlFieldNode_t* node=*i;
+		//Unmarking the node as it is taken also skips any later entries for the same node
+		if(!node->isInvalidated) continue;
+		node->isInvalidated=false;
+		for(VBufStorage_fieldNode_t* ancestor=node->parent;ancestor!=NULL&&ancestor->invalidatedDescendantCount>0;ancestor=ancestor->parent) {
+			ancestor->invalidatedDescendantCount=0;
+		}
+		list.push_back(node);
+	}
+	nodes.clear();
+}
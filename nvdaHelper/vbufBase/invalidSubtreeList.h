@@ -0,0 +1,78 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef VIRTUALBUFFER_INVALIDSUBTREELIST_H
+#define VIRTUALBUFFER_INVALIDSUBTREELIST_H
+
+#include "storage.h"
+
+/**
+ * The control field nodes of a buffer that should be re-rendered, with no node listed along with any of its ancestors.
+ * Listed nodes are marked, and their ancestors count how many of their descendants are listed, so that adding a node only needs to walk its ancestors, and the paths down to any listed descendants it takes the place of.
+ * A node taken over by an ancestor is not removed from the list straight away, but is no longer marked, and is skipped when the list is taken.
+ */
+class VBufStorage_invalidSubtreeList_t {
+	private:
+
+/**
+ * The listed nodes in the order they were added, including ones that are no longer marked.
+ */
+	VBufStorage_controlFieldNodeList_t nodes;
+
+/**
+ * Unmarks any listed descendants of a node.
+ * @param node the node whose descendants should be unmarked.
+ */
+	void unmarkDescendants(VBufStorage_fieldNode_t* node);
+
+	public:
+
+/**
+ * constructor.
+ */
+	VBufStorage_invalidSubtreeList_t();
+
+/**
+ * Adds a node, unless it or one of its ancestors is already listed. Any listed descendants of the node are dropped, as re-rendering the node re-renders them.
+ * @param node the node to add.
+ * @return true if the node was added, false if it or one of its ancestors is already listed.
+ */
+	bool add(VBufStorage_controlFieldNode_t* node);
+
+/**
+ * Notes that a node of a buffer has changed, by adding it, or the ancestor that should be re-rendered in its place, as add does.
+ * The node and its ancestors are marked stale, so that a re-render of one of its ancestors does not reuse them as they are.
+ * This is what a backend's invalidateSubtree does with the node it is given.
+ * @param buffer the buffer the node is in.
+ * @param node the node that changed.
+ * @param containsCaret memory to place true if the start of the buffer's selection is in the node that should be re-rendered, so that updating it should not wait, or NULL.
+ * @return true if the node is in the buffer, false otherwise.
+ */
+	bool invalidate(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* node, bool* containsCaret=NULL);
+
+/**
+ * Moves the listed nodes, in the order they were added, in to a list, and unmarks them so that this list is empty again.
+ * All the nodes must still be in their buffer.
+ * @param list the list to append the nodes to.
+ */
+	void take(VBufStorage_controlFieldNodeList_t& list);
+
+/**
+ * @return true if no nodes have been added since the list was last taken.
+ */
+	inline bool empty() const { return nodes.empty(); }
+
+};
+
+#endif
@@ -0,0 +1,152 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include <cstdlib>
+#include <common/log.h>
+#include "nodePool.h"
+
+/**
+ * The amount of cells in the first slab of a pool.
+ */
+#define NODEPOOL_MINSLABCAPACITY 16
+
+/**
+ * The most cells a single slab can have.
+ */
+#define NODEPOOL_MAXSLABCAPACITY 1024
+
+/**
+ * A type with the strictest alignment a node could need.
+ */
+typedef union {
+	double d;
+	long long ll;
+	void* p;
+} nodePoolAlignment_t;
+
+inline size_t alignNodePoolSize(size_t size) {
+	const size_t alignment=sizeof(nodePoolAlignment_t);
+	return ((size+alignment-1)/alignment)*alignment;
+}
+
+char* VBufStorage_nodeSlab_t::getCells() {
+	return reinterpret_cast<char*>(this)+alignNodePoolSize(sizeof(VBufStorage_nodeSlab_t));
+}
+
+VBufStorage_nodePool_t::VBufStorage_nodePool_t(size_t size): cellSize(alignNodePoolSize(size<sizeof(void*)?sizeof(void*):size)), firstSlab(NULL), lastSlab(NULL), slabCount(0), nextSlabCapacity(NODEPOOL_MINSLABCAPACITY) {
+}
+
+VBufStorage_nodePool_t::~VBufStorage_nodePool_t() {
+	this->releaseAll();
+}
+
+void VBufStorage_nodePool_t::linkSlab(VBufStorage_nodeSlab_t* slab, bool atFront) {
+	slab->pool=this;
+	if(atFront) {
+		slab->previous=NULL;
+		slab->next=this->firstSlab;
+		if(this->firstSlab) this->firstSlab->previous=slab; else this->lastSlab=slab;
+		this->firstSlab=slab;
+	} else {
+		slab->next=NULL;
+		slab->previous=this->lastSlab;
+		if(this->lastSlab) this->lastSlab->next=slab; else this->firstSlab=slab;
+		this->lastSlab=slab;
+	}
+	++(this->slabCount);
+}
+
+void VBufStorage_nodePool_t::unlinkSlab(VBufStorage_nodeSlab_t* slab) {
+	nhAssert(slab->pool==this);
+	if(slab->previous) slab->previous->next=slab->next; else this->firstSlab=slab->next;
+	if(slab->next) slab->next->previous=slab->previous; else this->lastSlab=slab->previous;
+	slab->previous=slab->next=NULL;
+	--(this->slabCount);
+}
+
+void* VBufStorage_nodePool_t::allocate(VBufStorage_nodeSlab_t** slabPtr) {
+	nhAssert(slabPtr);
+	VBufStorage_nodeSlab_t* slab=this->firstSlab;
+	if(!slab||slab->isFull()) {
+		size_t capacity=this->nextSlabCapacity;
+		slab=static_cast<VBufStorage_nodeSlab_t*>(malloc(alignNodePoolSize(sizeof(VBufStorage_nodeSlab_t))+capacity*this->cellSize));
+		if(!slab) {
+			LOG_ERROR(L"Could not allocate slab of "<<capacity<<L" cells");
+			return NULL;
+		}
+		slab->freeList=NULL;
+		slab->capacity=capacity;
+		slab->used=0;
+		slab->liveCount=0;
+		this->linkSlab(slab,true);
+		if(this->nextSlabCapacity<NODEPOOL_MAXSLABCAPACITY) this->nextSlabCapacity*=2;
+		LOG_DEBUG(L"Allocated new slab with "<<capacity<<L" cells");
+	}
+	void* cell;
+	if(slab->freeList) {
+		cell=slab->freeList;
+		slab->freeList=*static_cast<void**>(cell);
+	} else {
+		cell=slab->getCells()+(slab->used++)*this->cellSize;
+	}
+	++(slab->liveCount);
+	if(slab->isFull()&&slab!=this->lastSlab) {
+		//Keep full slabs at the back
+		this->unlinkSlab(slab);
+		this->linkSlab(slab,false);
+	}
+	*slabPtr=slab;
+	return cell;
+}
+
+void VBufStorage_nodePool_t::release(void* cell, VBufStorage_nodeSlab_t* slab) {
+	nhAssert(cell&&slab);
+	nhAssert(slab->liveCount>0);
+	VBufStorage_nodePool_t* pool=slab->pool;
+	bool wasFull=slab->isFull();
+	*static_cast<void**>(cell)=slab->freeList;
+	slab->freeList=cell;
+	--(slab->liveCount);
+	if(slab->liveCount==0&&slab!=pool->firstSlab) {
+		LOG_DEBUG(L"Freeing empty slab");
+		pool->unlinkSlab(slab);
+		free(slab);
+	} else if(wasFull&&slab!=pool->firstSlab) {
+		//The slab has room again, so move it in front of the full slabs
+		pool->unlinkSlab(slab);
+		pool->linkSlab(slab,true);
+	}
+}
+
+void VBufStorage_nodePool_t::adopt(VBufStorage_nodePool_t& other) {
+	nhAssert(other.cellSize==this->cellSize);
+	if(&other==this) return;
+	while(other.firstSlab) {
+		VBufStorage_nodeSlab_t* slab=other.firstSlab;
+		other.unlinkSlab(slab);
+		this->linkSlab(slab,!slab->isFull());
+	}
+	if(other.nextSlabCapacity>this->nextSlabCapacity) this->nextSlabCapacity=other.nextSlabCapacity;
+}
+
+void VBufStorage_nodePool_t::releaseAll() {
+	while(this->firstSlab) {
+		VBufStorage_nodeSlab_t* slab=this->firstSlab;
+		this->firstSlab=slab->next;
+		free(slab);
+	}
+	this->lastSlab=NULL;
+	this->slabCount=0;
+	this->nextSlabCapacity=NODEPOOL_MINSLABCAPACITY;
+}
@@ -0,0 +1,159 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef VIRTUALBUFFER_NODEPOOL_H
+#define VIRTUALBUFFER_NODEPOOL_H
+
+#include <cstddef>
+
+class VBufStorage_nodePool_t;
+
+/**
+ * A block of memory divided in to equally sized cells, each of which can hold one node.
+ * A slab always belongs to exactly one pool, but can be handed over to another pool without moving the nodes it holds.
+ */
+class VBufStorage_nodeSlab_t {
+	private:
+
+/**
+ * The pool this slab currently belongs to.
+ */
+	VBufStorage_nodePool_t* pool;
+
+/**
+ * The slabs before and after this one in its pool's list of slabs.
+ */
+	VBufStorage_nodeSlab_t* previous;
+	VBufStorage_nodeSlab_t* next;
+
+/**
+ * A linked list of cells in this slab that have been released and can be reused.
+ */
+	void* freeList;
+
+/**
+ * The amount of cells in this slab.
+ */
+	size_t capacity;
+
+/**
+ * The amount of cells at the start of this slab that have been handed out at least once.
+ */
+	size_t used;
+
+/**
+ * The amount of cells in this slab currently holding a node.
+ */
+	size_t liveCount;
+
+/**
+ * @return true if no more cells can be handed out from this slab.
+ */
+	inline bool isFull() const { return !freeList&&used==capacity; }
+
+/**
+ * @return the address of the first cell in this slab.
+ */
+	char* getCells();
+
+	friend class VBufStorage_nodePool_t;
+
+};
+
+/**
+ * Allocates memory for nodes of a particular size from slabs, rather than making a separate heap allocation for every node.
+ * Slabs grow geometrically, so small buffers stay small while large buffers need only a few allocations.
+ * Empty slabs are given back to the heap, and all remaining slabs can be released in one go once the nodes in them have been destroyed.
+ */
+class VBufStorage_nodePool_t {
+	private:
+
+/**
+ * The size of each cell, rounded up so that cells are suitably aligned.
+ */
+	const size_t cellSize;
+
+/**
+ * The list of slabs in this pool.
+ * Slabs with free cells are always kept before full slabs, so that only the first slab needs to be checked when allocating.
+ */
+	VBufStorage_nodeSlab_t* firstSlab;
+	VBufStorage_nodeSlab_t* lastSlab;
+
+/**
+ * The amount of slabs in this pool.
+ */
+	size_t slabCount;
+
+/**
+ * The amount of cells the next new slab will have.
+ */
+	size_t nextSlabCapacity;
+
+	void linkSlab(VBufStorage_nodeSlab_t* slab, bool atFront);
+
+	void unlinkSlab(VBufStorage_nodeSlab_t* slab);
+
+	VBufStorage_nodePool_t(const VBufStorage_nodePool_t&);
+	VBufStorage_nodePool_t& operator=(const VBufStorage_nodePool_t&);
+
+	public:
+
+/**
+ * constructor.
+ * @param size the size in bytes of the objects this pool will allocate.
+ */
+	VBufStorage_nodePool_t(size_t size);
+
+/**
+ * Destructor. Releases all slabs, the nodes in them must have been destroyed already.
+ */
+	~VBufStorage_nodePool_t();
+
+/**
+ * Allocates memory for one node.
+ * @param slab memory where the slab the memory was allocated from will be placed, this must be passed back to release.
+ * @return the allocated memory, or NULL if no memory could be allocated.
+ */
+	void* allocate(VBufStorage_nodeSlab_t** slab);
+
+/**
+ * Gives memory previously returned by allocate back to the slab it came from, which may belong to a different pool by now.
+ * The slab is freed if it no longer holds any nodes.
+ * @param cell the memory to release.
+ * @param slab the slab the memory was allocated from.
+ */
+	static void release(void* cell, VBufStorage_nodeSlab_t* slab);
+
+/**
+ * Takes over all the slabs of another pool with the same cell size, leaving the other pool empty.
+ * Nodes in the adopted slabs stay where they are, they are just released in to this pool from now on.
+ * @param other the pool to take the slabs from.
+ */
+	void adopt(VBufStorage_nodePool_t& other);
+
+/**
+ * Frees all slabs in this pool at once, without releasing each cell individually.
+ * Any nodes in the slabs must have been destroyed already.
+ */
+	void releaseAll();
+
+/**
+ * @return the amount of slabs in this pool.
+ */
+	inline size_t getSlabCount() const { return slabCount; }
+
+};
+
+#endif
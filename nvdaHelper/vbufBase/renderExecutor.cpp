@@ -0,0 +1,78 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <vector>
+#include <common/log.h>
+#include "renderExecutor.h"
+
+using namespace std;
+
+/**
+ * The state shared by the threads of one run.
+ */
+typedef struct {
+	void(*task)(void*,int);
+	void* context;
+	long count;
+	/**
+	 * The number of indexes handed out so far, which may go past count.
+	 */
+	volatile long started;
+} renderExecutorRun_t;
+
+/**
+ * Calls the task for each index that has not been handed out yet, until there are none left.
+ */
+DWORD WINAPI renderExecutor_threadProc(LPVOID param) {
+	renderExecutorRun_t* run=(renderExecutorRun_t*)param;
+	for(long index=InterlockedIncrement(&(run->started))-1;index<run->count;index=InterlockedIncrement(&(run->started))-1) {
+		run->task(run->context,index);
+	}
+	return 0;
+}
+
+VBufBackend_threadRenderExecutor_t::VBufBackend_threadRenderExecutor_t(int maxThreadCountArg): maxThreadCount(maxThreadCountArg) {
+	if(maxThreadCount<=0) {
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		maxThreadCount=static_cast<int>(systemInfo.dwNumberOfProcessors);
+	}
+	//WaitForMultipleObjects can wait for no more than this many threads
+	if(maxThreadCount>MAXIMUM_WAIT_OBJECTS) maxThreadCount=MAXIMUM_WAIT_OBJECTS;
+	if(maxThreadCount<1) maxThreadCount=1;
+}
+
+void VBufBackend_threadRenderExecutor_t::run(int count, void(*task)(void* context, int index), void* context) {
+	if(count<=0) return;
+	renderExecutorRun_t run={task,context,count,0};
+	vector<HANDLE> threads;
+	int threadCount=(count<maxThreadCount)?count:maxThreadCount;
+	for(int i=1;i<threadCount;++i) {
+		HANDLE thread=CreateThread(NULL,0,renderExecutor_threadProc,&run,0,NULL);
+		if(!thread) {
+			//The threads that did start, and this one, still get through all the tasks
+			LOG_DEBUGWARNING(L"Could not create render thread, error "<<GetLastError());
+			break;
+		}
+		threads.push_back(thread);
+	}
+	LOG_DEBUG(L"Running "<<count<<L" tasks on "<<(threads.size()+1)<<L" threads");
+	renderExecutor_threadProc(&run);
+	if(!threads.empty()) {
+		WaitForMultipleObjects(static_cast<DWORD>(threads.size()),&threads[0],TRUE,INFINITE);
+		for(vector<HANDLE>::iterator i=threads.begin();i!=threads.end();++i) CloseHandle(*i);
+	}
+}
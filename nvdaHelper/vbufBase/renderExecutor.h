@@ -0,0 +1,61 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef VIRTUALBUFFER_RENDEREXECUTOR_H
+#define VIRTUALBUFFER_RENDEREXECUTOR_H
+
+/**
+ * Runs a number of independent tasks, such as rendering a backend's invalid subtrees, possibly several at once.
+ */
+class VBufBackend_renderExecutor_t {
+	public:
+
+	virtual ~VBufBackend_renderExecutor_t() {}
+
+/**
+ * Calls a task once for each index from 0 to count-1, and returns once all the calls have returned.
+ * The calls may be made at the same time on different threads, and in any order.
+ * @param count the number of calls to make.
+ * @param task the function to call with the context and an index.
+ * @param context passed to each call.
+ */
+	virtual void run(int count, void(*task)(void* context, int index), void* context)=0;
+
+};
+
+/**
+ * Runs tasks on up to a given number of threads, one of which is the calling thread.
+ * The other threads are started for each run and have no COM apartment, so tasks must not need one.
+ */
+class VBufBackend_threadRenderExecutor_t: public VBufBackend_renderExecutor_t {
+	private:
+
+/**
+ * The most threads used at once, including the calling thread.
+ */
+	int maxThreadCount;
+
+	public:
+
+/**
+ * constructor.
+ * @param maxThreadCountArg the most threads to use at once, including the calling thread, or 0 to use as many as there are processors.
+ */
+	VBufBackend_threadRenderExecutor_t(int maxThreadCountArg=0);
+
+	virtual void run(int count, void(*task)(void* context, int index), void* context);
+
+};
+
+#endif
@@ -23,7 +23,8 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include <vector>
 #include <sstream>
 #include <algorithm>
-#include <common/xml.h>
+#include <new>
+#include <cwchar>
 #include <common/log.h>
 #include "utils.h"
 #include "storage.h"
@@ -141,6 +142,7 @@ inline void outputEscapedAttribute(wostringstream& out, const wstring& text) {
 			case L';':
 			case L'\\':
 			out << L"\\";
+			// Fall through - the character itself follows the backslash.
 			default:
 			out << *it;
 		}
@@ -152,52 +154,204 @@ bool VBufStorage_fieldNode_t::matchAttributes(const std::vector<std::wstring>& a
 	for (vector<wstring>::const_iterator attribName = attribs.begin(); attribName != attribs.end(); ++attribName) {
 		outputEscapedAttribute(test, *attribName);
 		test << L":";
-		VBufStorage_attributeMap_t::const_iterator foundAttrib = attributes.find(*attribName);
-		if (foundAttrib != attributes.end())
-			outputEscapedAttribute(test, foundAttrib->second);
+		const wstring* foundValue = getAttributeValue(*attribName);
+		if (foundValue)
+			outputEscapedAttribute(test, *foundValue);
 		test << L";";
 	}
 	return regex_match(test.str(), regexp);
 }
 
+void VBufStorage_fieldNode_t::freeChildOffsetIndexBlocks(childOffsetIndexBlock_t* block) {
+	while(block) {
+		childOffsetIndexBlock_t* retired=block->retired;
+		delete block;
+		block=retired;
+	}
+}
+
+void VBufStorage_fieldNode_t::invalidateChildOffsetIndexAfter(VBufStorage_fieldNode_t* child) {
+	childOffsetIndexBlock_t* block=this->childOffsetIndex.load(memory_order_relaxed);
+	if(block&&block->retired) {
+		freeChildOffsetIndexBlocks(block->retired);
+		block->retired=NULL;
+	}
+	if(child==NULL) {
+		this->childOffsetIndexValidCount.store(0,memory_order_relaxed);
+		return;
+	}
+	nhAssert(child->parent==this); //child must be one of our children
+	if(this->lookUpChildIndex(child)>=0) {
+		this->childOffsetIndexValidCount.store(child->indexInParent.load(memory_order_relaxed)+1,memory_order_relaxed);
+	}
+	//If the child was not indexed then it is already past the valid part of the index.
+}
+
+int VBufStorage_fieldNode_t::lookUpChildIndex(const VBufStorage_fieldNode_t* child) const {
+	nhAssert(child&&child->parent==this); //child must be one of our children
+	//The valid count is read first, so that the entries it covers were written before the block holding them was published
+	int validCount=this->childOffsetIndexValidCount.load(memory_order_acquire);
+	int index=child->indexInParent.load(memory_order_relaxed);
+	if(index<0||index>=validCount) return -1;
+	return (this->childOffsetIndex.load(memory_order_acquire)->entries[index].node==child)?index:-1;
+}
+
+int VBufStorage_fieldNode_t::getChildIndex(const VBufStorage_fieldNode_t* child) const {
+	int index=this->lookUpChildIndex(child);
+	if(index>=0) return index;
+	if(!this->owner) return this->extendChildOffsetIndex(child);
+	this->owner->cacheLock.acquire();
+	index=this->extendChildOffsetIndex(child);
+	this->owner->cacheLock.release();
+	return index;
+}
+
+int VBufStorage_fieldNode_t::extendChildOffsetIndex(const VBufStorage_fieldNode_t* child) const {
+	//Another reader may have extended the index while this one waited for the lock
+	int index=this->lookUpChildIndex(child);
+	if(index>=0) return index;
+	int validCount=this->childOffsetIndexValidCount.load(memory_order_relaxed);
+	childOffsetIndexBlock_t* block=this->childOffsetIndex.load(memory_order_relaxed);
+	LOG_DEBUG(L"Extending child offset index from "<<validCount<<L" entries");
+	VBufStorage_fieldNode_t* node=this->firstChild;
+	int offset=0;
+	if(validCount>0) {
+		const childOffsetEntry_t& last=block->entries[validCount-1];
+		node=last.node->next;
+		offset=last.offset+last.node->length;
+	}
+	for(;node!=NULL;node=node->next) {
+		if(!block||validCount==static_cast<int>(block->entries.size())) {
+			//Readers may still be using the entries of the old block, so copy them to a larger one rather than growing it
+			childOffsetIndexBlock_t* newBlock=new childOffsetIndexBlock_t;
+			newBlock->entries.resize(block?block->entries.size()*2:4);
+			if(block) copy(block->entries.begin(),block->entries.begin()+validCount,newBlock->entries.begin());
+			newBlock->retired=block;
+			block=newBlock;
+			this->childOffsetIndex.store(block,memory_order_release);
+		}
+		childOffsetEntry_t& entry=block->entries[validCount];
+		entry.node=node;
+		entry.offset=offset;
+		node->indexInParent.store(validCount++,memory_order_relaxed);
+		if(node==child) break;
+		offset+=node->length;
+	}
+	nhAssert(node); //child must have been found
+	this->childOffsetIndexValidCount.store(validCount,memory_order_release);
+	return node?validCount-1:-1;
+}
+
+int VBufStorage_fieldNode_t::getChildCount() const {
+	return (this->lastChild)?this->getChildIndex(this->lastChild)+1:0;
+}
+
+int VBufStorage_fieldNode_t::getChildStartOffset(const VBufStorage_fieldNode_t* child) const {
+	int index=this->getChildIndex(child);
+	return this->childOffsetIndex.load(memory_order_acquire)->entries[index].offset;
+}
+
+/**
+ * The amount of children a node can have before locateChildAtOffset stops scanning them and uses the child offset index instead.
+ */
+#define CHILDOFFSETINDEX_SCANLIMIT 16
+
+VBufStorage_fieldNode_t* VBufStorage_fieldNode_t::locateChildAtOffset(int offset, int* childStartOffset) const {
+	int tempOffset=0;
+	int scanCount=0;
+	VBufStorage_fieldNode_t* child=this->firstChild;
+	for(;child!=NULL&&scanCount<CHILDOFFSETINDEX_SCANLIMIT;child=child->next,++scanCount) {
+		if(offset<tempOffset+child->length) {
+			*childStartOffset=tempOffset;
+			return child;
+		}
+		tempOffset+=child->length;
+	}
+	if(child==NULL) {
+		LOG_DEBUG(L"No child at offset "<<offset);
+		return NULL;
+	}
+	LOG_DEBUG(L"Many children, searching child offset index");
+	int childCount=this->getChildCount();
+	vector<childOffsetEntry_t>::const_iterator begin=this->childOffsetIndex.load(memory_order_acquire)->entries.begin();
+	//Find the last child starting at or before the offset
+	vector<childOffsetEntry_t>::const_iterator i=upper_bound(begin,begin+childCount,offset,[](int offset, const childOffsetEntry_t& entry) {
+		return offset<entry.offset;
+	});
+	child=NULL;
+	if(i!=begin&&offset<(i-1)->offset+(i-1)->node->length) {
+		--i;
+		*childStartOffset=i->offset;
+		child=i->node;
+	}
+	if(!child) {
+		LOG_DEBUG(L"No child at offset "<<offset);
+	}
+	return child;
+}
+
 int VBufStorage_fieldNode_t::calculateOffsetInTree() const {
 	int startOffset=0;
-	for(VBufStorage_fieldNode_t* previous=this->previous;previous!=NULL;previous=previous->previous) {
-		startOffset+=previous->length;
-	}
-	LOG_DEBUG(L"node has local offset of "<<startOffset);
-	if(this->parent) {
-		startOffset+=this->parent->calculateOffsetInTree();
-	LOG_DEBUG(L"With parents offset is now "<<startOffset);
+	for(const VBufStorage_fieldNode_t* node=this;node->parent!=NULL;node=node->parent) {
+		startOffset+=node->parent->getChildStartOffset(node);
 	}
 	LOG_DEBUG(L"Returning node start offset of "<<startOffset);
 	return startOffset;
 }
 
+bool VBufStorage_fieldNode_t::isBefore(const VBufStorage_fieldNode_t* other) const {
+	nhAssert(other);
+	if(other==this) return false;
+	int depth=0, otherDepth=0;
+	for(const VBufStorage_fieldNode_t* node=this->parent;node!=NULL;node=node->parent) ++depth;
+	for(const VBufStorage_fieldNode_t* node=other->parent;node!=NULL;node=node->parent) ++otherDepth;
+	//Bring both nodes up to the same depth
+	const VBufStorage_fieldNode_t* node=this;
+	for(;depth>otherDepth;--depth) node=node->parent;
+	for(;otherDepth>depth;--otherDepth) other=other->parent;
+	if(node==other) {
+		//One node is an ancestor of the other, and ancestors come first
+		return node==this;
+	}
+	//Climb until both nodes are siblings, and compare their positions among their parent's children
+	while(node->parent!=other->parent) {
+		node=node->parent;
+		other=other->parent;
+	}
+	nhAssert(node->parent); //Both nodes must be in the same tree
+	if(!node->parent) return false;
+	return node->parent->getChildIndex(node)<node->parent->getChildIndex(other);
+}
+
 VBufStorage_textFieldNode_t* VBufStorage_fieldNode_t::locateTextFieldNodeAtOffset(int offset, int *relativeOffset) {
 	LOG_DEBUG(L"Searching through children to reach offset "<<offset);
 	int tempOffset=0;
 	nhAssert(this->firstChild!=NULL||this->length==0); //Length of a node with out children can not be greater than 0
-	for(VBufStorage_fieldNode_t* child=this->firstChild;child!=NULL;child=child->next) {
-		if(offset<tempOffset+child->length) {
-			LOG_DEBUG(L"found child at offset "<<tempOffset);
-			VBufStorage_textFieldNode_t* textFieldNode=child->locateTextFieldNodeAtOffset(offset-tempOffset, relativeOffset);
-			nhAssert(textFieldNode); //textFieldNode can't be NULL
-			return textFieldNode;
-		} else {
-			tempOffset+=child->length;
-		}
+	VBufStorage_fieldNode_t* child=this->locateChildAtOffset(offset,&tempOffset);
+	if(child==NULL) {
+		LOG_DEBUG(L"No textFieldNode found, returning NULL");
+		return NULL;
 	}
-	LOG_DEBUG(L"No textFieldNode found, returning NULL");
+	LOG_DEBUG(L"found child at offset "<<tempOffset);
+	VBufStorage_textFieldNode_t* textFieldNode=child->locateTextFieldNodeAtOffset(offset-tempOffset, relativeOffset);
+	nhAssert(textFieldNode); //textFieldNode can't be NULL
+	return textFieldNode;
+}
+
+VBufStorage_controlFieldNode_t* VBufStorage_fieldNode_t::asControlFieldNode() {
 	return NULL;
 }
 
-void VBufStorage_fieldNode_t::generateAttributesForMarkupOpeningTag(std::wstring& text, int startOffset, int endOffset) {
-	wostringstream s;
-	s<<L"_startOfNode=\""<<(startOffset==0?1:0)<<L"\" ";
-	s<<L"_endOfNode=\""<<(endOffset>=this->length?1:0)<<L"\" ";
-	s<<L"isBlock=\""<<this->isBlock<<L"\" ";
-	s<<L"isHidden=\""<<this->isHidden<<L"\" ";
+void VBufStorage_fieldNode_t::generateAttributesForMarkupOpeningTag(VBufStorage_textSink_t& sink, int startOffset, int endOffset) {
+	sink.append(L"_startOfNode=\"");
+	sink.append((startOffset==0)?L'1':L'0');
+	sink.append(L"\" _endOfNode=\"");
+	sink.append((endOffset>=this->length)?L'1':L'0');
+	sink.append(L"\" isBlock=\"");
+	sink.append(this->isBlock?L'1':L'0');
+	sink.append(L"\" isHidden=\"");
+	sink.append(this->isHidden?L'1':L'0');
+	sink.append(L"\" ");
 	int childCount=0;
 	int childControlCount=0;
 	for(VBufStorage_fieldNode_t* child=this->firstChild;child!=NULL;child=child->next) {
@@ -206,40 +360,53 @@ void VBufStorage_fieldNode_t::generateAttributesForMarkupOpeningTag(std::wstring
 	}
 	int parentChildCount=1;
 	int indexInParent=0;
-	for(VBufStorage_fieldNode_t* prev=this->previous;prev!=NULL;prev=prev->previous) {
-		++indexInParent;
-		++parentChildCount;
-	}
-	for(VBufStorage_fieldNode_t* next=this->next;next!=NULL;next=next->next) {
-		++parentChildCount;
-	}
-	s<<L"_childcount=\""<<childCount<<L"\" _childcontrolcount=\""<<childControlCount<<L"\" _indexInParent=\""<<indexInParent<<L"\" _parentChildCount=\""<<parentChildCount<<L"\" ";
-	text+=s.str();
-	for(VBufStorage_attributeMap_t::iterator i=this->attributes.begin();i!=this->attributes.end();++i) {
-		text+=i->first;
-		text+=L"=\"";
-		for(std::wstring::iterator j=i->second.begin();j!=i->second.end();++j) {
-			appendCharToXML(*j,text,true);
-		}
-		text+=L"\" ";
+	if(this->parent) {
+		indexInParent=this->parent->getChildIndex(this);
+		parentChildCount=this->parent->getChildCount();
+	}
+	sink.append(L"_childcount=\"");
+	sink.appendNumber(childCount);
+	sink.append(L"\" _childcontrolcount=\"");
+	sink.appendNumber(childControlCount);
+	sink.append(L"\" _indexInParent=\"");
+	sink.appendNumber(indexInParent);
+	sink.append(L"\" _parentChildCount=\"");
+	sink.appendNumber(parentChildCount);
+	sink.append(L"\" ");
+	for(vector<attribute_t>::iterator i=this->attributes.begin();i!=this->attributes.end();++i) {
+		sink.append(*(i->name));
+		sink.append(L"=\"");
+		sink.appendEscaped(i->value,true);
+		sink.append(L"\" ");
 	}
 }
 
-void VBufStorage_fieldNode_t::generateMarkupOpeningTag(std::wstring& text, int startOffset, int endOffset) {
-	text+=L"<";
-	this->generateMarkupTagName(text);
-	text+=L" ";
-	this->generateAttributesForMarkupOpeningTag(text,startOffset,endOffset);
-	text+=L">";
+void VBufStorage_fieldNode_t::generateMarkupOpeningTag(VBufStorage_textSink_t& sink, int startOffset, int endOffset) {
+	sink.append(L'<');
+	this->generateMarkupTagName(sink);
+	sink.append(L' ');
+	this->generateAttributesForMarkupOpeningTag(sink,startOffset,endOffset);
+	sink.append(L'>');
 }
 
-void VBufStorage_fieldNode_t::generateMarkupClosingTag(std::wstring& text) {
-	text+=L"</";
-	this->generateMarkupTagName(text);
-	text+=L">";
+void VBufStorage_fieldNode_t::generateMarkupClosingTag(VBufStorage_textSink_t& sink) {
+	sink.append(L"</");
+	this->generateMarkupTagName(sink);
+	sink.append(L'>');
 }
 
 void VBufStorage_fieldNode_t::getTextInRange(int startOffset, int endOffset, std::wstring& text, bool useMarkup, bool(*filter)(VBufStorage_fieldNode_t*)) {
+	VBufStorage_textSink_t measuringSink;
+	this->getTextInRange(startOffset,endOffset,measuringSink,useMarkup,filter);
+	size_t oldLength=text.length();
+	if(measuringSink.getLength()==0) return;
+	text.resize(oldLength+measuringSink.getLength());
+	VBufStorage_textSink_t sink(&text[oldLength],measuringSink.getLength());
+	this->getTextInRange(startOffset,endOffset,sink,useMarkup,filter);
+	nhAssert(sink.getLength()==measuringSink.getLength()); //the text must not change between passes
+}
+
+void VBufStorage_fieldNode_t::getTextInRange(int startOffset, int endOffset, VBufStorage_textSink_t& sink, bool useMarkup, bool(*filter)(VBufStorage_fieldNode_t*)) {
 	if(this->length==0) {
 		LOG_DEBUG(L"node has 0 length, not collecting text");
 		return;
@@ -249,55 +416,111 @@ void VBufStorage_fieldNode_t::getTextInRange(int startOffset, int endOffset, std
 	nhAssert(startOffset<endOffset); //startOffset must be before endOffset
 	nhAssert(endOffset<=this->length); //endOffset can't be bigger than node length
 	if(useMarkup) {
-		this->generateMarkupOpeningTag(text,startOffset,endOffset);
+		this->generateMarkupOpeningTag(sink,startOffset,endOffset);
 	}
 	nhAssert(this->firstChild!=NULL||this->length==0); //Length of a node with out children can not be greater than 0
 	int childStart=0;
 	int childEnd=0;
 	int childLength=0;
-	for(VBufStorage_fieldNode_t* child=this->firstChild;child!=NULL;child=child->next) {
+	//Skip straight to the child at the start offset, any children before it can not overlap the range.
+	VBufStorage_fieldNode_t* firstChildInRange=this->locateChildAtOffset(startOffset,&childStart);
+	nhAssert(firstChildInRange); //startOffset is within this node so there must be a child there
+	childEnd=childStart;
+	for(VBufStorage_fieldNode_t* child=firstChildInRange;child!=NULL&&childStart<endOffset;child=child->next) {
 		childLength=child->length;
 		nhAssert(childLength>=0); //length can't be negative
 		childEnd+=childLength;
 		LOG_DEBUG(L"child with offsets of "<<childStart<<L" and "<<childEnd); 
 		if(childEnd>startOffset&&endOffset>childStart&&(!filter||filter(child))) {
 			LOG_DEBUG(L"child offsets overlap requested offsets");
-			child->getTextInRange(max(startOffset,childStart)-childStart,min(endOffset-childStart,childLength),text,useMarkup,filter);
+			child->getTextInRange(max(startOffset,childStart)-childStart,min(endOffset-childStart,childLength),sink,useMarkup,filter);
 		}
 		childStart+=childLength;
 		LOG_DEBUG(L"childStart is now "<<childStart);
 	}
 	if(useMarkup) {
-		this->generateMarkupClosingTag(text);
+		this->generateMarkupClosingTag(sink);
 	}
-	LOG_DEBUG(L"Generated, text string is now "<<text.length());
+	LOG_DEBUG(L"Generated, text is now "<<sink.getLength());
 }
 
 void VBufStorage_fieldNode_t::disassociateFromBuffer(VBufStorage_buffer_t* buffer) {
 	nhAssert(buffer); //Buffer can't be NULL
+	(void)buffer; //Only used by the assertion
 	LOG_DEBUG(L"Disassociating fieldNode from buffer");
 }
 
-VBufStorage_fieldNode_t::VBufStorage_fieldNode_t(int lengthArg, bool isBlockArg): parent(NULL), previous(NULL), next(NULL), firstChild(NULL), lastChild(NULL), length(lengthArg), isBlock(isBlockArg), isHidden(false), updateAncestor(NULL), attributes() {
+VBufStorage_fieldNode_t::VBufStorage_fieldNode_t(int lengthArg, bool isBlockArg): parent(NULL), previous(NULL), next(NULL), firstChild(NULL), lastChild(NULL), length(lengthArg), attributes(), ownsAttributeNames(false), childOffsetIndex(NULL), childOffsetIndexValidCount(0), indexInParent(-1), slab(NULL), owner(NULL), handleSlot(-1), isInvalidated(false), invalidatedDescendantCount(0), isBlock(isBlockArg), isHidden(false), updateAncestor(NULL), isStale(false) {
 	LOG_DEBUG(L"field node initialization at "<<this<<L"length is "<<length);
 }
 
 VBufStorage_fieldNode_t::~VBufStorage_fieldNode_t() {
 	LOG_DEBUG(L"fieldNode being destroied");
+	freeChildOffsetIndexBlocks(this->childOffsetIndex.load(memory_order_relaxed));
+	if(this->ownsAttributeNames) {
+		for(vector<attribute_t>::iterator i=this->attributes.begin();i!=this->attributes.end();++i) {
+			delete i->name;
+		}
+	}
+}
+
+bool VBufStorage_fieldNode_t::isAttributeNameLess(const attribute_t& attribute, const std::wstring& name) {
+	return *(attribute.name)<name;
+}
+
+const std::wstring* VBufStorage_fieldNode_t::getAttributeValue(const std::wstring& name) const {
+	vector<attribute_t>::const_iterator i=lower_bound(this->attributes.begin(),this->attributes.end(),name,isAttributeNameLess);
+	if(i==this->attributes.end()||*(i->name)!=name) return NULL;
+	return &(i->value);
+}
+
+void VBufStorage_fieldNode_t::internAttributeNames(VBufStorage_buffer_t* buffer) {
+	nhAssert(buffer);
+	for(vector<attribute_t>::iterator i=this->attributes.begin();i!=this->attributes.end();++i) {
+		const wstring* name=buffer->internAttributeName(*(i->name));
+		if(this->ownsAttributeNames) delete i->name;
+		i->name=name;
+	}
+	this->ownsAttributeNames=false;
 }
 
 bool VBufStorage_fieldNode_t::addAttribute(const std::wstring& name, const std::wstring& value) {
 	LOG_DEBUG(L"Adding attribute "<<name<<L" with value "<<value);
-	this->attributes[name]=value;
+	vector<attribute_t>::iterator i=lower_bound(this->attributes.begin(),this->attributes.end(),name,isAttributeNameLess);
+	if(i!=this->attributes.end()&&*(i->name)==name) {
+		if(i->value==value) return true;
+		if(this->owner) {
+			this->owner->unindexAttribute(this,i->name,i->value);
+			++(this->owner->version);
+		}
+		i->value=value;
+		if(this->owner) this->owner->indexAttribute(this,i->name,i->value);
+		return true;
+	}
+	attribute_t attribute;
+	if(this->owner) {
+		attribute.name=this->owner->internAttributeName(name);
+	} else {
+		//Not in a buffer yet, so keep a private copy of the name until the node is inserted
+		nhAssert(this->attributes.empty()||this->ownsAttributeNames);
+		attribute.name=new wstring(name);
+		this->ownsAttributeNames=true;
+	}
+	attribute.value=value;
+	this->attributes.insert(i,attribute);
+	if(this->owner) {
+		this->owner->indexAttribute(this,attribute.name,value);
+		++(this->owner->version);
+	}
 	return true;
 }
 
 std::wstring VBufStorage_fieldNode_t::getAttributesString() const {
 	std::wstring attributesString;
-	for(std::map<std::wstring,std::wstring>::const_iterator i=attributes.begin();i!=attributes.end();++i) {
-		attributesString+=i->first;
+	for(vector<attribute_t>::const_iterator i=attributes.begin();i!=attributes.end();++i) {
+		attributesString+=*(i->name);
 		attributesString+=L':';
-		attributesString+=i->second;
+		attributesString+=i->value;
 		attributesString+=L';';
 	}
 	return attributesString;
@@ -311,15 +534,17 @@ std::wstring VBufStorage_fieldNode_t::getDebugInfo() const {
 
 //controlFieldNode implementation
 
-void VBufStorage_controlFieldNode_t::generateMarkupTagName(std::wstring& text) {
-	text+=L"control";
+void VBufStorage_controlFieldNode_t::generateMarkupTagName(VBufStorage_textSink_t& sink) {
+	sink.append(L"control");
 }
 
-void VBufStorage_controlFieldNode_t::generateAttributesForMarkupOpeningTag(std::wstring& text, int startOffset, int endOffset) {
-	std::wostringstream s;
-	s<<L"controlIdentifier_docHandle=\""<<identifier.docHandle<<L"\" controlIdentifier_ID=\""<<identifier.ID<<L"\" ";
-	text+=s.str();
-	this->VBufStorage_fieldNode_t::generateAttributesForMarkupOpeningTag(text,startOffset,endOffset);
+void VBufStorage_controlFieldNode_t::generateAttributesForMarkupOpeningTag(VBufStorage_textSink_t& sink, int startOffset, int endOffset) {
+	sink.append(L"controlIdentifier_docHandle=\"");
+	sink.appendNumber(identifier.docHandle);
+	sink.append(L"\" controlIdentifier_ID=\"");
+	sink.appendNumber(identifier.ID);
+	sink.append(L"\" ");
+	this->VBufStorage_fieldNode_t::generateAttributesForMarkupOpeningTag(sink,startOffset,endOffset);
 }
 
 void VBufStorage_controlFieldNode_t::disassociateFromBuffer(VBufStorage_buffer_t* buffer) {
@@ -329,6 +554,10 @@ void VBufStorage_controlFieldNode_t::disassociateFromBuffer(VBufStorage_buffer_t
 	this->VBufStorage_fieldNode_t::disassociateFromBuffer(buffer);
 }
 
+VBufStorage_controlFieldNode_t* VBufStorage_controlFieldNode_t::asControlFieldNode() {
+	return this;
+}
+
 VBufStorage_controlFieldNode_t::VBufStorage_controlFieldNode_t(int docHandle, int ID, bool isBlockArg): VBufStorage_fieldNode_t(0,isBlockArg), identifier(docHandle,ID) {  
 	LOG_DEBUG(L"controlFieldNode initialization at "<<this<<L", with docHandle of "<<identifier.docHandle<<L" and ID of "<<identifier.ID); 
 }
@@ -354,37 +583,78 @@ VBufStorage_textFieldNode_t* VBufStorage_textFieldNode_t::locateTextFieldNodeAtO
 	return this;
 }
 
-void VBufStorage_textFieldNode_t::generateMarkupTagName(std::wstring& text) {
-	text+=L"text";
+VBufStorage_textRangeIterator_t::VBufStorage_textRangeIterator_t(VBufStorage_fieldNode_t* subtreeRootArg, int startOffset, int endOffsetArg): subtreeRoot(subtreeRootArg), node(NULL), nodeStartOffset(0), endOffset(endOffsetArg), view(), viewStartOffset(0) {
+	nhAssert(subtreeRoot);
+	if(endOffset<0||endOffset>subtreeRoot->length) endOffset=subtreeRoot->length;
+	if(startOffset<0) startOffset=0;
+	if(startOffset>=endOffset) return;
+	int relativeOffset;
+	node=subtreeRoot->locateTextFieldNodeAtOffset(startOffset,&relativeOffset);
+	nhAssert(node); //There is always a text field node at an offset within the subtree
+	nodeStartOffset=startOffset-relativeOffset;
+	updateView(relativeOffset);
+}
+
+void VBufStorage_textRangeIterator_t::updateView(int relativeOffset) {
+	view=node->getTextView();
+	if(nodeStartOffset+view.length>endOffset) view.length=endOffset-nodeStartOffset;
+	view.text+=relativeOffset;
+	view.length-=relativeOffset;
+	viewStartOffset=nodeStartOffset+relativeOffset;
 }
 
-void VBufStorage_textFieldNode_t::getTextInRange(int startOffset, int endOffset, std::wstring& text, bool useMarkup, bool(*filter)(VBufStorage_fieldNode_t*)) {
+void VBufStorage_textRangeIterator_t::next() {
+	if(!node) return;
+	if(node==subtreeRoot||nodeStartOffset+node->length>=endOffset) {
+		node=NULL;
+		return;
+	}
+	VBufStorage_fieldNode_t* tempNode=node;
+	int tempRelativeStart;
+	do {
+		tempNode=tempNode->nextNodeInTree(TREEDIRECTION_FORWARD,subtreeRoot,&tempRelativeStart);
+		if(!tempNode) {
+			node=NULL;
+			return;
+		}
+		nodeStartOffset+=tempRelativeStart;
+	} while(tempNode->firstChild||tempNode->length==0);
+	//A node with no children but some length is always a text field node
+	node=static_cast<VBufStorage_textFieldNode_t*>(tempNode);
+	updateView(0);
+}
+
+void VBufStorage_textFieldNode_t::generateMarkupTagName(VBufStorage_textSink_t& sink) {
+	sink.append(L"text");
+}
+
+void VBufStorage_textFieldNode_t::getTextInRange(int startOffset, int endOffset, VBufStorage_textSink_t& sink, bool useMarkup, bool(* /*filter*/)(VBufStorage_fieldNode_t*)) {
 	LOG_DEBUG(L"getting text between offsets "<<startOffset<<L" and "<<endOffset);
 	if(useMarkup) {
-		this->generateMarkupOpeningTag(text,startOffset,endOffset);
+		this->generateMarkupOpeningTag(sink,startOffset,endOffset);
 	}
 	nhAssert(startOffset>=0); //StartOffset must be not negative
 	nhAssert(startOffset<endOffset); //StartOffset must be less than endOffset
 	nhAssert(endOffset<=this->length); //endOffset can't be greater than node length
 	if(useMarkup) {
-		wchar_t c;
-		for(int offset=startOffset;offset<endOffset;++offset) {
-			c=this->text[offset];
-			appendCharToXML(c,text);
-		}
+		sink.appendEscaped(this->text+startOffset,endOffset-startOffset);
 	} else {
-		text.append(this->text,startOffset,endOffset-startOffset);
+		sink.append(this->text+startOffset,endOffset-startOffset);
 	}
 	if(useMarkup) {
-		this->generateMarkupClosingTag(text);
+		this->generateMarkupClosingTag(sink);
 	}
-	LOG_DEBUG(L"generated, text string is now of length "<<text.length());
+	LOG_DEBUG(L"generated, text is now of length "<<sink.getLength());
 }
 
-VBufStorage_textFieldNode_t::VBufStorage_textFieldNode_t(const std::wstring& textArg): VBufStorage_fieldNode_t(static_cast<int>(textArg.length()),false), text(textArg) {
+VBufStorage_textFieldNode_t::VBufStorage_textFieldNode_t(const wchar_t* textArg, int lengthArg, VBufStorage_textBlock_t* textBlockArg): VBufStorage_fieldNode_t(lengthArg,false), text(textArg), textBlock(textBlockArg) {
 	LOG_DEBUG(L"textFieldNode initialization, with text of length "<<length);
 }
 
+VBufStorage_textFieldNode_t::~VBufStorage_textFieldNode_t() {
+	if(textBlock) textBlock->release();
+}
+
 std::wstring VBufStorage_textFieldNode_t::getDebugInfo() const {
 	std::wostringstream s;
 	s<<L"text "<<this->VBufStorage_fieldNode_t::getDebugInfo();
@@ -393,12 +663,50 @@ std::wstring VBufStorage_textFieldNode_t::getDebugInfo() const {
 
 //buffer implementation
 
+/**
+ * The most compiled attribute queries a buffer keeps. NVDA only uses a few distinct queries, so the cache is simply emptied the next time the buffer changes if it ever grows this large.
+ */
+#define ATTRIBUTEQUERYCACHE_MAXSIZE 64
+
+/**
+ * The most lines a buffer caches for getLineOffsets. A user reads only a small part of a document at a time, so the cache is simply emptied if it ever grows this large.
+ */
+#define LINECACHE_MAXSIZE 1024
+
+/**
+ * Orders nodes in document order, for searching the lists in an attribute index.
+ */
+inline bool isNodeBefore(const VBufStorage_fieldNode_t* node, const VBufStorage_fieldNode_t* other) {
+	return node->isBefore(other);
+}
+
+void VBufStorage_buffer_t::forgetCachedLines(VBufStorage_fieldNode_t* node, bool includeAncestors) {
+	if(this->lineCache.empty()) return;
+	//No reader can be using a cached line while the buffer changes
+	if(this->lineCacheSize>=LINECACHE_MAXSIZE) {
+		LOG_DEBUG(L"Line cache full, clearing");
+		this->lineCache.clear();
+		this->lineCacheSize=0;
+		return;
+	}
+	//The lines of any block the node is in, and of the parts of the buffer in no block, are affected
+	for(VBufStorage_fieldNode_t* ancestor=node;;ancestor=ancestor->parent) {
+		for(int useScreenLayout=0;useScreenLayout<2;++useScreenLayout) {
+			map<pair<VBufStorage_fieldNode_t*,bool>,cachedLines_t>::iterator i=this->lineCache.find(make_pair(ancestor,useScreenLayout!=0));
+			if(i!=this->lineCache.end()) {
+				this->lineCacheSize-=static_cast<int>(i->second.size());
+				this->lineCache.erase(i);
+			}
+		}
+		if(!ancestor||!includeAncestors) break;
+	}
+}
+
 void VBufStorage_buffer_t::forgetControlFieldNode(VBufStorage_controlFieldNode_t* node) {
 	nhAssert(node); //Node can't be NULL
-	map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>::iterator i=controlFieldNodesByIdentifier.find(node->identifier);
-	nhAssert(i!=controlFieldNodesByIdentifier.end());
-	nhAssert(i->second==node);
-	controlFieldNodesByIdentifier.erase(i);
+	VBufStorage_controlFieldNode_t* forgottenNode=controlFieldNodesByIdentifier.erase(node->identifier.docHandle,node->identifier.ID);
+	nhAssert(forgottenNode==node);
+	(void)forgottenNode; //Only used by the assertion
 }
 
 bool VBufStorage_buffer_t::insertNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, VBufStorage_fieldNode_t* node) {
@@ -446,6 +754,9 @@ bool VBufStorage_buffer_t::insertNode(VBufStorage_controlFieldNode_t* parent, VB
 			parent->lastChild=node;
 		}
 	}
+	if(parent) {
+		parent->invalidateChildOffsetIndexAfter(previous);
+	}
 	if(previous) {
 		LOG_DEBUG(L"Making node previous's next");
 		previous->next=node;
@@ -464,22 +775,47 @@ bool VBufStorage_buffer_t::insertNode(VBufStorage_controlFieldNode_t* parent, VB
 			LOG_DEBUG(L"Ancestor: "<<ancestor->getDebugInfo());
 			ancestor->length+=node->length;
 			nhAssert(ancestor->length>=0); //length must never be negative
+			if(ancestor->parent) ancestor->parent->invalidateChildOffsetIndexAfter(ancestor);
 			LOG_DEBUG(L"Ancestor length now"<<ancestor->length);
 		}
 	}
 	LOG_DEBUG(L"Inserted subtree");
-	nhAssert(this->nodes.count(node)==0);
-	this->nodes.insert(node);
+	this->forgetCachedLines(parent);
+	++(this->version);
+	nhAssert(node->owner!=this);
+	node->owner=this;
+	if(node->ownsAttributeNames) node->internAttributeNames(this);
+	//A node inserted with descendants is a subtree from another buffer, which replaceSubtrees indexes once all its nodes are claimed
+	if(!node->firstChild&&!this->indexedAttributeNames.empty()) {
+		for(vector<VBufStorage_fieldNode_t::attribute_t>::iterator i=node->attributes.begin();i!=node->attributes.end();++i) {
+			this->indexAttribute(node,i->name,i->value);
+		}
+	}
 	return true;
 }
 
 void VBufStorage_buffer_t::deleteNode(VBufStorage_fieldNode_t* node) {
 	nhAssert(node);
+	//The node's memory may be reused for another node, which must not pick up its cached lines
+	this->forgetCachedLines(node,false);
+	++(this->version);
 	node->disassociateFromBuffer(this);
-	nhAssert(this->nodes.count(node)==1);
-	this->nodes.erase(node);
+	nhAssert(node->owner==this);
+	this->releaseNodeHandle(node);
+	node->owner=NULL;
 	LOG_DEBUG(L"deleting node at "<<node);
-	delete node;
+	freeNode(node);
+}
+
+void VBufStorage_buffer_t::freeNode(VBufStorage_fieldNode_t* node) {
+	nhAssert(node);
+	VBufStorage_nodeSlab_t* slab=node->slab;
+	if(!slab) {
+		delete node;
+		return;
+	}
+	node->~VBufStorage_fieldNode_t();
+	VBufStorage_nodePool_t::release(node,slab);
 }
 
 void VBufStorage_buffer_t::deleteSubtree(VBufStorage_fieldNode_t* node) {
@@ -495,7 +831,36 @@ void VBufStorage_buffer_t::deleteSubtree(VBufStorage_fieldNode_t* node) {
 	LOG_DEBUG(L"Deleted subtree");
 }
 
-VBufStorage_buffer_t::VBufStorage_buffer_t(): rootNode(NULL), nodes(), controlFieldNodesByIdentifier(), selectionStart(0), selectionLength(0) {
+bool VBufStorage_buffer_t::moveTextToPool(VBufStorage_textFieldNode_t* textFieldNode) {
+	VBufStorage_textBlock_t* textBlock=NULL;
+	const wchar_t* storedText=this->textPool.add(textFieldNode->text,textFieldNode->length,&textBlock);
+	if(!storedText) return false;
+	if(textFieldNode->textBlock) textFieldNode->textBlock->release();
+	textFieldNode->text=storedText;
+	textFieldNode->textBlock=textBlock;
+	return true;
+}
+
+void VBufStorage_buffer_t::compactText() {
+	LOG_DEBUG(L"Compacting text, pool capacity "<<this->textPool.getCapacity()<<L", text length "<<(this->rootNode?this->rootNode->length:0));
+	this->textPool.reset(this->rootNode?this->rootNode->length:0);
+	for(VBufStorage_fieldNode_t* node=this->rootNode;node!=NULL;) {
+		if(node->firstChild) {
+			node=node->firstChild;
+			continue;
+		}
+		//A node with no children but some length is always a text field node
+		if(node->length>0&&!this->moveTextToPool(static_cast<VBufStorage_textFieldNode_t*>(node))) {
+			LOG_DEBUGWARNING(L"Could not allocate memory for text. Leaving the rest of the text where it is");
+			return;
+		}
+		while(node!=this->rootNode&&node->next==NULL) node=node->parent;
+		node=(node!=this->rootNode)?node->next:NULL;
+	}
+	LOG_DEBUG(L"Compacted text, pool capacity now "<<this->textPool.getCapacity());
+}
+
+VBufStorage_buffer_t::VBufStorage_buffer_t(): rootNode(NULL), nodeHandleSlots(), freeNodeHandleSlots(), controlFieldNodesByIdentifier(), attributeNames(), attributeQueryCache(), indexedAttributeNames(), attributeIndex(), lineCache(), lineCacheSize(0), controlFieldNodePool(sizeof(VBufStorage_controlFieldNode_t)), textFieldNodePool(sizeof(VBufStorage_textFieldNode_t)), textPool(), selectionStart(0), selectionLength(0), version(0) {
 	LOG_DEBUG(L"buffer initializing");
 }
 
@@ -506,12 +871,18 @@ VBufStorage_buffer_t::~VBufStorage_buffer_t() {
 
 VBufStorage_controlFieldNode_t*  VBufStorage_buffer_t::addControlFieldNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int docHandle, int ID, bool isBlock) {
 	LOG_DEBUG(L"Adding control field node to buffer with parent at "<<parent<<L", previous at "<<previous<<L", docHandle "<<docHandle<<L", ID "<<ID);
-	VBufStorage_controlFieldNode_t* controlFieldNode=new VBufStorage_controlFieldNode_t(docHandle,ID,isBlock);
-	nhAssert(controlFieldNode); //controlFieldNode must have been allocated
+	VBufStorage_nodeSlab_t* slab=NULL;
+	void* cell=this->controlFieldNodePool.allocate(&slab);
+	if(!cell) {
+		LOG_DEBUGWARNING(L"Could not allocate memory for controlFieldNode. Returning NULL");
+		return NULL;
+	}
+	VBufStorage_controlFieldNode_t* controlFieldNode=new(cell) VBufStorage_controlFieldNode_t(docHandle,ID,isBlock);
+	controlFieldNode->slab=slab;
 	LOG_DEBUG(L"Created controlFieldNode: "<<controlFieldNode->getDebugInfo());
 	if(addControlFieldNode(parent,previous,controlFieldNode)!=controlFieldNode) {
 		LOG_DEBUGWARNING(L"Error adding control field node to buffer");
-		delete controlFieldNode;
+		freeNode(controlFieldNode);
 		return NULL;
 	}
 	return controlFieldNode;
@@ -523,7 +894,7 @@ VBufStorage_controlFieldNode_t*  VBufStorage_buffer_t::addControlFieldNode(VBufS
 		return NULL;
 	}
 	LOG_DEBUG(L"Add controlFieldNode using parent at "<<parent<<L", previous at "<<previous<<L", node at "<<controlFieldNode);
-	if(controlFieldNodesByIdentifier.count(controlFieldNode->identifier)>0) {
+	if(controlFieldNodesByIdentifier.find(controlFieldNode->identifier.docHandle,controlFieldNode->identifier.ID)) {
 		LOG_DEBUGWARNING(L"Buffer at "<<this<<L" already has a node with the same identifier as node "<<controlFieldNode->getDebugInfo()<<L". Returning NULL"); 
 		return NULL;
 	}
@@ -532,7 +903,7 @@ VBufStorage_controlFieldNode_t*  VBufStorage_buffer_t::addControlFieldNode(VBufS
 		LOG_DEBUGWARNING(L"Error inserting node at "<<controlFieldNode<<L". Returning NULL");
 		return NULL;
 	}
-	controlFieldNodesByIdentifier[controlFieldNode->identifier]=controlFieldNode;
+	controlFieldNodesByIdentifier.insert(controlFieldNode->identifier.docHandle,controlFieldNode->identifier.ID,controlFieldNode);
 	LOG_DEBUG(L"Added new controlFieldNode, returning node");
 	return controlFieldNode;
 }
@@ -557,12 +928,25 @@ VBufStorage_textFieldNode_t*  VBufStorage_buffer_t::addTextFieldNode(VBufStorage
 		needsStrip=true;
 	}
 	size_t subLength=max(textLength-i,subStart)-subStart;
-	VBufStorage_textFieldNode_t* textFieldNode=new VBufStorage_textFieldNode_t(needsStrip?text.substr(subStart,subLength):text);
-	nhAssert(textFieldNode); //controlFieldNode must have been allocated
+	VBufStorage_textBlock_t* textBlock=NULL;
+	const wchar_t* storedText=this->textPool.add(text.data()+(needsStrip?subStart:0),needsStrip?subLength:textLength,&textBlock);
+	if(!storedText) {
+		LOG_DEBUGWARNING(L"Could not allocate memory for text. Returning NULL");
+		return NULL;
+	}
+	VBufStorage_nodeSlab_t* slab=NULL;
+	void* cell=this->textFieldNodePool.allocate(&slab);
+	if(!cell) {
+		LOG_DEBUGWARNING(L"Could not allocate memory for textFieldNode. Returning NULL");
+		if(textBlock) textBlock->release();
+		return NULL;
+	}
+	VBufStorage_textFieldNode_t* textFieldNode=new(cell) VBufStorage_textFieldNode_t(storedText,static_cast<int>(needsStrip?subLength:textLength),textBlock);
+	textFieldNode->slab=slab;
 	LOG_DEBUG(L"Created textFieldNode: "<<textFieldNode->getDebugInfo());
 	if(addTextFieldNode(parent,previous,textFieldNode)!=textFieldNode) {
 		LOG_DEBUGWARNING(L"Error adding textFieldNode to buffer");
-		delete textFieldNode;
+		freeNode(textFieldNode);
 		return NULL;
 	}
 	return textFieldNode;
@@ -587,25 +971,286 @@ VBufStorage_textFieldNode_t*  VBufStorage_buffer_t::addTextFieldNode(VBufStorage
 	return textFieldNode;
 }
 
-bool VBufStorage_buffer_t::replaceSubtrees(map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>& m) {
+VBufStorage_fieldNode_t* VBufStorage_buffer_t::copySubtree(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, VBufStorage_fieldNode_t* node) {
+	nhAssert(node);
+	nhAssert(node->owner!=this); //node must be in another buffer
+	LOG_DEBUG(L"Copying subtree at "<<node<<L" using parent at "<<parent<<L", previous at "<<previous);
+	VBufStorage_fieldNode_t* copy=NULL;
+	VBufStorage_controlFieldNode_t* controlFieldNode=node->asControlFieldNode();
+	if(controlFieldNode) {
+		VBufStorage_controlFieldNode_t* controlFieldCopy=this->addControlFieldNode(parent,previous,controlFieldNode->identifier.docHandle,controlFieldNode->identifier.ID,node->isBlock);
+		if(!controlFieldCopy) {
+			LOG_DEBUGWARNING(L"Could not copy control field node "<<node->getDebugInfo()<<L". Returning NULL");
+			return NULL;
+		}
+		VBufStorage_fieldNode_t* previousCopy=NULL;
+		for(VBufStorage_fieldNode_t* child=node->firstChild;child!=NULL;child=child->next) {
+			VBufStorage_fieldNode_t* childCopy=this->copySubtree(controlFieldCopy,previousCopy,child);
+			if(childCopy) previousCopy=childCopy;
+		}
+		copy=controlFieldCopy;
+	} else {
+		VBufStorage_textView_t view=static_cast<VBufStorage_textFieldNode_t*>(node)->getTextView();
+		copy=this->addTextFieldNode(parent,previous,wstring(view.text,view.length));
+		if(!copy) {
+			LOG_DEBUGWARNING(L"Could not copy text field node "<<node->getDebugInfo()<<L". Returning NULL");
+			return NULL;
+		}
+	}
+	copy->isHidden=node->isHidden;
+	for(vector<VBufStorage_fieldNode_t::attribute_t>::const_iterator i=node->attributes.begin();i!=node->attributes.end();++i) {
+		copy->addAttribute(*(i->name),i->value);
+	}
+	//An ancestor to update instead must be one that was copied along with this node
+	if(node->updateAncestor) {
+		copy->updateAncestor=this->controlFieldNodesByIdentifier.find(node->updateAncestor->identifier.docHandle,node->updateAncestor->identifier.ID);
+	}
+	return copy;
+}
+
+void VBufStorage_buffer_t::claimSubtree(VBufStorage_fieldNode_t* subtreeRoot, VBufStorage_buffer_t* buffer, bool copyText) {
+	for(VBufStorage_fieldNode_t* node=subtreeRoot;node!=NULL;) {
+		node->owner=this;
+		node->handleSlot=-1;
+		node->internAttributeNames(this);
+		if(node->updateAncestor) node->updateAncestor=this->translateUpdateAncestor(node->updateAncestor,buffer);
+		if(node->firstChild) {
+			node=node->firstChild;
+			continue;
+		}
+		//If copying fails the text stays in the other buffer's block, which is adopted along with the node's memory
+		if(copyText&&node->length>0&&!this->moveTextToPool(static_cast<VBufStorage_textFieldNode_t*>(node))) {
+			LOG_DEBUGWARNING(L"Could not allocate memory to copy text, leaving it where it is");
+		}
+		while(node!=subtreeRoot&&node->next==NULL) node=node->parent;
+		node=(node!=subtreeRoot)?node->next:NULL;
+	}
+	if(!this->indexedAttributeNames.empty()) this->indexSubtree(subtreeRoot);
+}
+
+VBufStorage_controlFieldNode_t* VBufStorage_buffer_t::translateUpdateAncestor(VBufStorage_controlFieldNode_t* ancestor, VBufStorage_buffer_t* buffer) {
+	//Ancestors already moved in to this buffer, or that were already here, stay as they are.
+	//An ancestor still in the other buffer was matched with the node here with the same identifier
+	if(ancestor->owner!=buffer) return ancestor;
+	return this->controlFieldNodesByIdentifier.find(ancestor->identifier.docHandle,ancestor->identifier.ID);
+}
+
+bool VBufStorage_buffer_t::hasSameAttributes(const VBufStorage_fieldNode_t* node, const VBufStorage_fieldNode_t* otherNode) {
+	if(node->attributes.size()!=otherNode->attributes.size()) return false;
+	for(size_t i=0;i<node->attributes.size();++i) {
+		//Names are interned in each node's own buffer, so compare the names themselves
+		if(node->attributes[i].value!=otherNode->attributes[i].value||*(node->attributes[i].name)!=*(otherNode->attributes[i].name)) return false;
+	}
+	return true;
+}
+
+bool VBufStorage_buffer_t::isSameTextFieldNode(VBufStorage_fieldNode_t* node, VBufStorage_fieldNode_t* otherNode) {
+	if(node->asControlFieldNode()||otherNode->asControlFieldNode()) return false;
+	if(node->length!=otherNode->length||node->isBlock!=otherNode->isBlock||node->isHidden!=otherNode->isHidden) return false;
+	VBufStorage_textView_t view=static_cast<VBufStorage_textFieldNode_t*>(node)->getTextView();
+	VBufStorage_textView_t otherView=static_cast<VBufStorage_textFieldNode_t*>(otherNode)->getTextView();
+	if(wmemcmp(view.text,otherView.text,view.length)!=0) return false;
+	return hasSameAttributes(node,otherNode);
+}
+
+bool VBufStorage_buffer_t::takeNodeProperties(VBufStorage_fieldNode_t* node, VBufStorage_fieldNode_t* newNode, VBufStorage_buffer_t* buffer) {
+	node->updateAncestor=newNode->updateAncestor?this->translateUpdateAncestor(newNode->updateAncestor,buffer):NULL;
+	//The node has just been rendered again
+	node->isStale=false;
+	bool changed=false;
+	if(node->isBlock!=newNode->isBlock) {
+		node->isBlock=newNode->isBlock;
+		this->forgetCachedLines(node);
+		changed=true;
+	}
+	if(node->isHidden!=newNode->isHidden) {
+		node->isHidden=newNode->isHidden;
+		changed=true;
+	}
+	if(!hasSameAttributes(node,newNode)) {
+		for(vector<VBufStorage_fieldNode_t::attribute_t>::iterator i=node->attributes.begin();i!=node->attributes.end();++i) {
+			this->unindexAttribute(node,i->name,i->value);
+		}
+		node->attributes.resize(newNode->attributes.size());
+		//Both lists are sorted by name, so the new list can be copied as is
+		for(size_t i=0;i<newNode->attributes.size();++i) {
+			node->attributes[i].name=this->internAttributeName(*(newNode->attributes[i].name));
+			node->attributes[i].value=newNode->attributes[i].value;
+			this->indexAttribute(node,node->attributes[i].name,node->attributes[i].value);
+		}
+		changed=true;
+	}
+	return changed;
+}
+
+/**
+ * Picks the longest list of matched children that are in the same order in both the old and new lists of children, so that as few children as possible are replaced.
+ * @param matches pairs of indexes of matching children in the old and new lists, in order of their old index.
+ * @param anchors memory where the picked pairs will be placed, in order.
+ */
+void findOrderedMatches(const vector<pair<size_t,size_t> >& matches, vector<pair<size_t,size_t> >& anchors) {
+	//For each length of run found so far, the match ending the run of that length with the smallest new index
+	vector<size_t> runEnds;
+	vector<size_t> previousInRun(matches.size());
+	for(size_t i=0;i<matches.size();++i) {
+		size_t low=0, high=runEnds.size();
+		while(low<high) {
+			size_t middle=(low+high)/2;
+			if(matches[runEnds[middle]].second<matches[i].second) low=middle+1; else high=middle;
+		}
+		previousInRun[i]=(low>0)?runEnds[low-1]:0;
+		if(low==runEnds.size()) runEnds.push_back(i); else runEnds[low]=i;
+	}
+	anchors.resize(runEnds.size());
+	size_t i=runEnds.empty()?0:runEnds.back();
+	for(size_t j=runEnds.size();j>0;--j) {
+		anchors[j-1]=matches[i];
+		i=previousInRun[i];
+	}
+}
+
+bool VBufStorage_buffer_t::reconcileSubtree(VBufStorage_controlFieldNode_t* node, VBufStorage_controlFieldNode_t* newNode, VBufStorage_buffer_t* buffer, VBufStorage_textEditList_t& edits) {
+	nhAssert(node&&node->owner==this);
+	nhAssert(newNode&&newNode->owner==buffer&&newNode->identifier==node->identifier);
+	if(this->takeNodeProperties(node,newNode,buffer)) {
+		LOG_DEBUG(L"Properties of node changed: "<<node->getDebugInfo());
+		//The text is the same, but the fields around it are not
+		int startOffset=0, endOffset=0;
+		this->getFieldNodeOffsets(node,&startOffset,&endOffset);
+		edits.add(startOffset,endOffset,endOffset-startOffset);
+	}
+	//Usually the children are still the same in the same order, in which case only the control field children need reconciling
+	VBufStorage_fieldNode_t* child=node->firstChild;
+	VBufStorage_fieldNode_t* newChild=newNode->firstChild;
+	for(;child!=NULL&&newChild!=NULL;child=child->next,newChild=newChild->next) {
+		VBufStorage_controlFieldNode_t* controlChild=child->asControlFieldNode();
+		VBufStorage_controlFieldNode_t* newControlChild=newChild->asControlFieldNode();
+		if(controlChild?(!newControlChild||newControlChild->identifier!=controlChild->identifier):!isSameTextFieldNode(child,newChild)) break;
+	}
+	if(child==NULL&&newChild==NULL) {
+		for(child=node->firstChild,newChild=newNode->firstChild;child!=NULL;child=child->next,newChild=newChild->next) {
+			VBufStorage_controlFieldNode_t* controlChild=child->asControlFieldNode();
+			if(controlChild&&!this->reconcileSubtree(controlChild,static_cast<VBufStorage_controlFieldNode_t*>(newChild),buffer,edits)) return false;
+		}
+		return true;
+	}
+	vector<VBufStorage_fieldNode_t*> children;
+	for(child=node->firstChild;child!=NULL;child=child->next) children.push_back(child);
+	vector<VBufStorage_fieldNode_t*> newChildren;
+	for(newChild=newNode->firstChild;newChild!=NULL;newChild=newChild->next) newChildren.push_back(newChild);
+	//Match control field children by identifier
+	vector<pair<size_t,size_t> > matches;
+	for(size_t i=0;i<children.size();++i) {
+		VBufStorage_controlFieldNode_t* controlChild=children[i]->asControlFieldNode();
+		if(!controlChild) continue;
+		VBufStorage_controlFieldNode_t* newControlChild=buffer->controlFieldNodesByIdentifier.find(controlChild->identifier.docHandle,controlChild->identifier.ID);
+		if(!newControlChild||newControlChild->parent!=newNode) continue;
+		matches.push_back(make_pair(i,static_cast<size_t>(newNode->getChildIndex(newControlChild))));
+	}
+	vector<pair<size_t,size_t> > anchors;
+	findOrderedMatches(matches,anchors);
+	//Replace the runs of children before, between and after the matched children
+	size_t start=0, newStart=0;
+	for(size_t i=0;i<=anchors.size();++i) {
+		size_t end=(i<anchors.size())?anchors[i].first:children.size();
+		size_t newEnd=(i<anchors.size())?anchors[i].second:newChildren.size();
+		//Text that is the same at either end of a run is kept
+		while(start<end&&newStart<newEnd&&isSameTextFieldNode(children[start],newChildren[newStart])) {
+			++start;
+			++newStart;
+		}
+		while(end>start&&newEnd>newStart&&isSameTextFieldNode(children[end-1],newChildren[newEnd-1])) {
+			--end;
+			--newEnd;
+		}
+		if(start<end||newStart<newEnd) {
+			LOG_DEBUG(L"Replacing "<<(end-start)<<L" children with "<<(newEnd-newStart)<<L" new children");
+			VBufStorage_fieldNode_t* previous=(start>0)?children[start-1]:NULL;
+			//Where the run starts in the text as it is now
+			int runStart=0, nodeEnd=0;
+			this->getFieldNodeOffsets(node,&runStart,&nodeEnd);
+			if(previous) runStart+=node->getChildStartOffset(previous)+previous->length;
+			int removedLength=0, insertedLength=0;
+			bool replaced=true;
+			for(size_t j=start;replaced&&j<end;++j) {
+				int length=children[j]->length;
+				if(!this->removeFieldNode(children[j])) {
+					LOG_DEBUGWARNING(L"Error removing node");
+					replaced=false;
+					break;
+				}
+				removedLength+=length;
+			}
+			for(size_t j=newStart;replaced&&j<newEnd;++j) {
+				newChild=newChildren[j];
+				//Unlink the child from the new content, the rest of which is deleted once reconciled
+				if(newChild->previous) newChild->previous->next=newChild->next; else newNode->firstChild=newChild->next;
+				if(newChild->next) newChild->next->previous=newChild->previous; else newNode->lastChild=newChild->previous;
+				newChild->parent=NULL;
+				newChild->previous=newChild->next=NULL;
+				if(!this->insertNode(node,previous,newChild)) {
+					LOG_DEBUGWARNING(L"Error inserting node");
+					buffer->deleteSubtree(newChild);
+					replaced=false;
+					break;
+				}
+				//Only a little of the new content is usually kept, so copy its text rather than keeping the other buffer's text blocks alive for it
+				this->claimSubtree(newChild,buffer,true);
+				insertedLength+=newChild->length;
+				previous=newChild;
+			}
+			//Record whatever was done, even if the run could only partly be replaced
+			edits.add(runStart,runStart+removedLength,insertedLength);
+			if(!replaced) return false;
+		}
+		if(i<anchors.size()) {
+			if(!this->reconcileSubtree(static_cast<VBufStorage_controlFieldNode_t*>(children[anchors[i].first]),static_cast<VBufStorage_controlFieldNode_t*>(newChildren[anchors[i].second]),buffer,edits)) return false;
+			start=anchors[i].first+1;
+			newStart=anchors[i].second+1;
+		}
+	}
+	return true;
+}
+
+void VBufStorage_buffer_t::clearStaleAncestors(VBufStorage_fieldNode_t* node) {
+	for(VBufStorage_fieldNode_t* ancestor=node->parent;ancestor!=NULL&&ancestor->isStale;ancestor=ancestor->parent) {
+		//A stale node's ancestors are all stale, so an ancestor holds other stale content only if one of its children is stale
+		for(VBufStorage_fieldNode_t* child=ancestor->firstChild;child!=NULL;child=child->next) {
+			if(child->isStale) return;
+		}
+		ancestor->isStale=false;
+	}
+}
+
+bool VBufStorage_buffer_t::replaceSubtrees(map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>& m, bool reconcile, VBufStorage_textEditList_t* edits) {
 	VBufStorage_controlFieldNode_t* parent=NULL;
 	VBufStorage_fieldNode_t* previous=NULL;
 	//Using the current selection start, record a list of ancestor fields by their identifier, 
 	//and a relative offset of the selection start to those fields, so that the selection can be corrected after the replacement.
 	list<pair<VBufStorage_controlFieldNodeIdentifier_t,int>> identifierList;
+	//Reconciling may only change nodes in place, which still changes the content
+	++(this->version);
+	//No reader can be using a cached query while the buffer changes
+	if(this->attributeQueryCache.size()>=ATTRIBUTEQUERYCACHE_MAXSIZE) {
+		LOG_DEBUG(L"Attribute query cache full, clearing");
+		this->attributeQueryCache.clear();
+	}
 	if(this->getTextLength()>0) {
 		int controlDocHandle, controlID, controlNodeStart, controlNodeEnd;
 		parent=this->locateControlFieldNodeAtOffset(this->selectionStart,&controlNodeStart,&controlNodeEnd,&controlDocHandle,&controlID);
 		int relativeSelectionStart=this->selectionStart-controlNodeStart;
 		for(;parent!=NULL;parent=parent->parent) {
 			identifierList.push_front(pair<VBufStorage_controlFieldNodeIdentifier_t,int>(parent->identifier,relativeSelectionStart));
-			for(previous=parent->previous;previous!=NULL;relativeSelectionStart+=previous->length,previous=previous->previous);
+			if(parent->parent) relativeSelectionStart+=parent->parent->getChildStartOffset(parent);
 		}
 	}
 	//For each node in the map,
 	//Replace the node on this buffer, with the content of the buffer in the map for that node
 	//Note that controlField info will automatically be removed, but not added again
 	bool failedBuffers=false;
+	//Edits are recorded even if the caller does not want them, as reconciling records them as it goes
+	VBufStorage_textEditList_t ignoredEdits;
+	VBufStorage_textEditList_t& recordedEdits=edits?*edits:ignoredEdits;
 	for(map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>::iterator i=m.begin();i!=m.end();) {
 		VBufStorage_fieldNode_t* node=i->first;
 		VBufStorage_buffer_t* buffer=i->second;
@@ -615,9 +1260,29 @@ bool VBufStorage_buffer_t::replaceSubtrees(map<VBufStorage_fieldNode_t*,VBufStor
 			m.erase(i++);
 			continue;
 		}
+		VBufStorage_controlFieldNode_t* controlFieldNode=reconcile?node->asControlFieldNode():NULL;
+		VBufStorage_controlFieldNode_t* newControlFieldNode=(controlFieldNode&&buffer->rootNode)?buffer->rootNode->asControlFieldNode():NULL;
+		if(newControlFieldNode&&newControlFieldNode->identifier==controlFieldNode->identifier&&this->isNodeInBuffer(controlFieldNode)) {
+			LOG_DEBUG(L"Reconciling subtree at "<<node);
+			if(!this->reconcileSubtree(controlFieldNode,newControlFieldNode,buffer,recordedEdits)) {
+				LOG_DEBUGWARNING(L"Error reconciling subtree");
+				failedBuffers=true;
+			}
+			this->clearStaleAncestors(controlFieldNode);
+			//What is left of the new content was matched with nodes that were kept
+			buffer->removeFieldNode(buffer->rootNode);
+			//The nodes moved in to this buffer still live in the other buffer's memory.
+			//Their text was copied, so only blocks whose text could not be copied are left to adopt
+			this->controlFieldNodePool.adopt(buffer->controlFieldNodePool);
+			this->textFieldNodePool.adopt(buffer->textFieldNodePool);
+			this->textPool.adopt(buffer->textPool);
+			++i;
+			continue;
+		}
 		parent=node->parent;
 		previous=node->previous;
-		if(!this->removeFieldNode(node)) {
+		int startOffset=0, endOffset=0;
+		if(!this->getFieldNodeOffsets(node,&startOffset,&endOffset)||!this->removeFieldNode(node)) {
 			LOG_DEBUGWARNING(L"Error removing node. Skipping");
 			failedBuffers=true;
 			buffer->clearBuffer();
@@ -628,35 +1293,55 @@ bool VBufStorage_buffer_t::replaceSubtrees(map<VBufStorage_fieldNode_t*,VBufStor
 		if(!this->insertNode(parent,previous,buffer->rootNode)) {
 			LOG_DEBUGWARNING(L"Error inserting node. Skipping");
 			failedBuffers=true;
+			recordedEdits.add(startOffset,endOffset,0);
 			buffer->clearBuffer();
 			delete buffer;
 			m.erase(i++);
 			continue;
 		}
-		buffer->nodes.erase(buffer->rootNode);
-		this->nodes.insert(buffer->nodes.begin(),buffer->nodes.end());
-		buffer->nodes.clear();
+		//Claim all the nodes in the new subtree, handles from the temp buffer are not valid in this one
+		VBufStorage_fieldNode_t* subtreeRoot=buffer->rootNode;
+		this->claimSubtree(subtreeRoot,buffer);
+		this->clearStaleAncestors(subtreeRoot);
+		recordedEdits.add(startOffset,endOffset,subtreeRoot->length);
 		buffer->rootNode=NULL;
+		//The nodes now belong to us, so take over the memory they live in as well
+		this->controlFieldNodePool.adopt(buffer->controlFieldNodePool);
+		this->textFieldNodePool.adopt(buffer->textFieldNodePool);
+		this->textPool.adopt(buffer->textPool);
 		++i;
 	}
 	//Update the controlField info on this buffer using all the buffers in the map
 	//We do this all in one go instead of for each replacement in case there are issues with ordering
 	//e.g. an identifier appears in one place before its removed in another
+	size_t mergedIDCount=this->controlFieldNodesByIdentifier.size();
+	for(map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>::iterator i=m.begin();i!=m.end();++i) {
+		mergedIDCount+=i->second->controlFieldNodesByIdentifier.size();
+	}
+	this->controlFieldNodesByIdentifier.reserve(mergedIDCount);
 	for(map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>::iterator i=m.begin();i!=m.end();++i) {
 		VBufStorage_buffer_t* buffer=i->second;
 		int failedIDs=0;
-		for(map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>::iterator j=buffer->controlFieldNodesByIdentifier.begin();j!=buffer->controlFieldNodesByIdentifier.end();++j) {
-			map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>::iterator existing=this->controlFieldNodesByIdentifier.find(j->first);
-			if(existing!=this->controlFieldNodesByIdentifier.end()) {
+		//First remove any old nodes whose identifiers clash with nodes from this buffer,
+		//then add all the identifiers from this buffer in one go.
+		//Identifiers whose old node could not be removed keep pointing at the old node.
+		for(size_t j=0;j<buffer->controlFieldNodesByIdentifier.getSlotCount();++j) {
+			const VBufStorage_controlFieldNodeIndex_t::slot_t& slot=buffer->controlFieldNodesByIdentifier.getSlot(j);
+			if(!slot.node) continue;
+			VBufStorage_controlFieldNode_t* existing=this->controlFieldNodesByIdentifier.find(slot.docHandle,slot.ID);
+			if(existing) {
 				++failedIDs;
-				if(!removeFieldNode(existing->second,false)) {
+				//Only the node goes, its descendants take its place, so the text stays the same
+				int startOffset=0, endOffset=0;
+				if(!this->getFieldNodeOffsets(existing,&startOffset,&endOffset)||!removeFieldNode(existing,false)) {
 					LOG_DEBUGWARNING(L"Error removing old node to make when handling ID clash");
 					continue;
 				}
-				nhAssert(this->controlFieldNodesByIdentifier.count(j->first)==0);
+				recordedEdits.add(startOffset,endOffset,endOffset-startOffset);
+				nhAssert(!this->controlFieldNodesByIdentifier.find(slot.docHandle,slot.ID));
 			}
-			this->controlFieldNodesByIdentifier.insert(make_pair(j->first,j->second));
 		}
+		this->controlFieldNodesByIdentifier.merge(buffer->controlFieldNodesByIdentifier);
 		buffer->controlFieldNodesByIdentifier.clear();
 		delete buffer;
 		if(failedIDs>0) {
@@ -665,6 +1350,8 @@ bool VBufStorage_buffer_t::replaceSubtrees(map<VBufStorage_fieldNode_t*,VBufStor
 		}
 	}
 	m.clear();
+	//Text of replaced nodes stays in its blocks until every node in the block is gone, so repack it once too much of it is unused
+	if(this->rootNode&&this->textPool.needsCompacting(this->rootNode->length)) this->compactText();
 	//Find the deepest field the selection started in that still exists, 
 	//and correct the selection so its still positioned accurately relative to that field. 
 	if(!identifierList.empty()) {
@@ -698,16 +1385,30 @@ bool VBufStorage_buffer_t::removeFieldNode(VBufStorage_fieldNode_t* node,bool re
 		LOG_DEBUGWARNING(L"Cannot remove the rootNode without removing its descedants. Returnning false");
 		return false;
 	}
+	this->forgetCachedLines(node);
+	if(!this->indexedAttributeNames.empty()) {
+		if(removeDescendants) {
+			this->unindexSubtree(node);
+		} else {
+			for(vector<VBufStorage_fieldNode_t::attribute_t>::iterator i=node->attributes.begin();i!=node->attributes.end();++i) {
+				this->unindexAttribute(node,i->name,i->value);
+			}
+		}
+	}
 	if((removeDescendants||!node->firstChild)&&node->length>0) {
 		LOG_DEBUG(L"collapsing length of ancestors by "<<node->length);
 		for(VBufStorage_fieldNode_t* ancestor=node->parent;ancestor!=NULL;ancestor=ancestor->parent) {
 			LOG_DEBUG(L"Ancestor: "<<ancestor->getDebugInfo());
 			ancestor->length-=node->length;
 			nhAssert(ancestor->length>=0); //ancestor length can't be negative
+			if(ancestor->parent) ancestor->parent->invalidateChildOffsetIndexAfter(ancestor);
 			LOG_DEBUG(L"Ancestor length now"<<ancestor->length);
 		}
 	}
 	LOG_DEBUG(L"Disconnecting node from its siblings and or parent");
+	if(node->parent) {
+		node->parent->invalidateChildOffsetIndexAfter(node->previous);
+	}
 	if(node->next!=NULL) {
 		node->next->previous=(!removeDescendants&&node->lastChild)?node->lastChild:node->previous;
 	} else if(node->parent) {
@@ -736,12 +1437,53 @@ bool VBufStorage_buffer_t::removeFieldNode(VBufStorage_fieldNode_t* node,bool re
 }
 
 void VBufStorage_buffer_t::clearBuffer() {
-	for(set<VBufStorage_fieldNode_t*>::iterator i=nodes.begin();i!=nodes.end();++i) {
-		nhAssert(*i);
-		delete *i;
+	//Walk the tree destroying each node after its children.
+	//Only destroy pooled nodes here, their memory is released a slab at a time below
+	for(VBufStorage_fieldNode_t* node=this->rootNode;node!=NULL;) {
+		if(node->firstChild) {
+			node=node->firstChild;
+			continue;
+		}
+		VBufStorage_fieldNode_t* next=node->next;
+		VBufStorage_fieldNode_t* parent=node->parent;
+		nhAssert(node->owner==this);
+		if(node->slab) {
+			node->~VBufStorage_fieldNode_t();
+		} else {
+			delete node;
+		}
+		if(next) {
+			node=next;
+		} else {
+			if(parent) parent->firstChild=NULL;
+			node=parent;
+		}
 	}
-	nodes.clear();
+	//Invalidate all handles
+	freeNodeHandleSlots.clear();
+	for(int i=0;i<static_cast<int>(nodeHandleSlots.size());++i) {
+		nodeHandleSlots[i].node=NULL;
+		++(nodeHandleSlots[i].generation);
+		freeNodeHandleSlots.push_back(i);
+	}
+	controlFieldNodePool.releaseAll();
+	textFieldNodePool.releaseAll();
+	textPool.reset();
 	controlFieldNodesByIdentifier.clear();
+	attributeIndex.clear();
+	attributeQueryCache.clear();
+	lineCache.clear();
+	lineCacheSize=0;
+	++version;
+	//The indexed names are interned, so intern them again once the old names are gone
+	vector<wstring> indexedNames;
+	for(vector<const wstring*>::iterator i=indexedAttributeNames.begin();i!=indexedAttributeNames.end();++i) {
+		indexedNames.push_back(**i);
+	}
+	attributeNames.clear();
+	for(vector<wstring>::size_type i=0;i<indexedNames.size();++i) {
+		indexedAttributeNames[i]=internAttributeName(indexedNames[i]);
+	}
 	selectionStart=selectionLength=0;
 	this->rootNode=NULL;
 }
@@ -809,9 +1551,7 @@ VBufStorage_controlFieldNode_t* VBufStorage_buffer_t::locateControlFieldNodeAtOf
 		return NULL;
 	}
 	nhAssert(node->parent);
-	for(VBufStorage_fieldNode_t* previous=node->previous;previous!=NULL;previous=previous->previous) {
-		startOffset-=previous->length;
-	}
+	startOffset-=node->parent->getChildStartOffset(node);
 	endOffset=startOffset+node->parent->length;
 	nhAssert(startOffset>=0&&endOffset>=startOffset); //Offsets must not be negative
 	VBufStorage_controlFieldNode_t* controlFieldNode = node->parent;
@@ -824,14 +1564,11 @@ VBufStorage_controlFieldNode_t* VBufStorage_buffer_t::locateControlFieldNodeAtOf
 	}
 
 VBufStorage_controlFieldNode_t* VBufStorage_buffer_t::getControlFieldNodeWithIdentifier(int docHandle, int ID) {
-	VBufStorage_controlFieldNodeIdentifier_t identifier(docHandle, ID);
-	std::map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>::iterator i=this->controlFieldNodesByIdentifier.find(identifier);
-	if(i==this->controlFieldNodesByIdentifier.end()) {
+	VBufStorage_controlFieldNode_t* node=this->controlFieldNodesByIdentifier.find(docHandle,ID);
+	if(!node) {
 		LOG_DEBUG(L"No controlFieldNode with identifier, returning NULL");
 		return NULL;
 	}
-	VBufStorage_controlFieldNode_t* node=i->second;
-	nhAssert(node); //Node can not be NULL
 	LOG_DEBUG(L"returning node at "<<node);
 	return node;
 }
@@ -888,7 +1625,31 @@ VBufStorage_textContainer_t*  VBufStorage_buffer_t::getTextInRange(int startOffs
 	return new VBufStorage_textContainer_t(text);
 }
 
+bool VBufStorage_buffer_t::getTextInRange(int startOffset, int endOffset, VBufStorage_textSink_t& sink, bool useMarkup) {
+	if(this->rootNode==NULL) {
+		LOG_DEBUGWARNING(L"buffer is empty, returning false");
+		return false;
+	}
+	if(startOffset<0||startOffset>=endOffset||endOffset>this->rootNode->length) {
+		LOG_DEBUGWARNING(L"Bad offsets of "<<startOffset<<L" and "<<endOffset<<L", returning false");
+		return false;
+	}
+	this->rootNode->getTextInRange(startOffset,endOffset,sink,useMarkup);
+	LOG_DEBUG(L"Got text between offsets "<<startOffset<<L" and "<<endOffset<<L", returning true");
+	return true;
+}
+
 VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset, VBufStorage_findDirection_t direction, const std::wstring& attribs, const std::wstring &regexp, int *startOffset, int *endOffset) {
+	LOG_DEBUG(L"find node with attributes: "<<attribs);
+	const VBufStorage_attributeQuery_t* query=this->getAttributeQuery(attribs,regexp);
+	if(!query) {
+		LOG_DEBUGWARNING(L"Invalid query, returning NULL");
+		return NULL;
+	}
+	return this->findNodeByAttributes(offset,direction,*query,startOffset,endOffset);
+}
+
+VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset, VBufStorage_findDirection_t direction, const VBufStorage_attributeQuery_t& query, int *startOffset, int *endOffset) {
 	if(this->rootNode==NULL) {
 		LOG_DEBUGWARNING(L"buffer empty, returning NULL");
 		return NULL;
@@ -897,7 +1658,7 @@ VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset,
 		LOG_DEBUGWARNING(L" offset "<<offset<<L" is past end of buffer, returning NULL");
 		return NULL;
 	}
-	LOG_DEBUG(L"find node starting at offset "<<offset<<L", with attributes: "<<attribsString);
+	LOG_DEBUG(L"find node starting at offset "<<offset);
 	int bufferStart, bufferEnd, tempRelativeStart=0;
 	VBufStorage_fieldNode_t* node=NULL;
 	if(offset==-1) {
@@ -914,20 +1675,13 @@ VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset,
 		LOG_DEBUGWARNING(L"Could not find node at offset "<<offset<<L", returning NULL");
 		return NULL;
 	}
-	// Split attribs at spaces.
-	vector<wstring> attribsList;
-	copy(istream_iterator<wstring, wchar_t, std::char_traits<wchar_t>>(wistringstream(attribs)),
-		istream_iterator<wstring, wchar_t, std::char_traits<wchar_t>>(),
-		back_inserter<vector<wstring> >(attribsList));
-	wregex regexObj;
-	try {
-		regexObj=wregex(regexp);
-	} catch (...) {
-		LOG_ERROR(L"Error in regular expression");
-		return NULL;
-	}
 	LOG_DEBUG(L"starting from node "<<node->getDebugInfo());
 	LOG_DEBUG(L"initial start is "<<bufferStart<<L" and initial end is "<<bufferEnd);
+	vector<const attributeIndexList_t*> indexLists;
+	if(direction!=VBufStorage_findDirection_up&&this->getAttributeIndexLists(query,indexLists)) {
+		LOG_DEBUG(L"searching attribute index");
+		return this->findNodeInAttributeIndex(node,offset,direction,query,indexLists,startOffset,endOffset);
+	}
 	if(direction==VBufStorage_findDirection_forward) {
 		LOG_DEBUG(L"searching forward");
 		for(node=node->nextNodeInTree(TREEDIRECTION_FORWARD,NULL,&tempRelativeStart);node!=NULL;node=node->nextNodeInTree(TREEDIRECTION_FORWARD,NULL,&tempRelativeStart)) {
@@ -935,7 +1689,7 @@ VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset,
 			bufferEnd=bufferStart+node->length;
 			LOG_DEBUG(L"start is now "<<bufferStart<<L" and end is now "<<bufferEnd);
 			LOG_DEBUG(L"Checking node "<<node->getDebugInfo());
-			if(node->length>0&&!(node->isHidden)&&node->matchAttributes(attribsList,regexObj)) {
+			if(node->length>0&&!(node->isHidden)&&query.matches(node)) {
 				LOG_DEBUG(L"found a match");
 				break;
 			}
@@ -947,7 +1701,7 @@ VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset,
 			bufferStart+=tempRelativeStart;
 			bufferEnd=bufferStart+node->length;
 			LOG_DEBUG(L"start is now "<<bufferStart<<L" and end is now "<<bufferEnd);
-			if(node->length>0&&!(node->isHidden)&&node->matchAttributes(attribsList,regexObj)) {
+			if(node->length>0&&!(node->isHidden)&&query.matches(node)) {
 				//Skip first containing parent match or parent match where offset hasn't changed 
 				if((bufferStart==offset)||(!skippedFirstMatch&&bufferStart<offset&&bufferEnd>offset)) {
 					LOG_DEBUG(L"skipping initial parent");
@@ -961,13 +1715,13 @@ VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset,
 	} else if(direction==VBufStorage_findDirection_up) {
 		LOG_DEBUG(L"searching up");
 		do {
-			for(;node->previous!=NULL;node=node->previous,bufferStart-=node->length);
+			if(node->parent) bufferStart-=node->parent->getChildStartOffset(node);
 			LOG_DEBUG(L"start is now "<<bufferStart);
 			node=node->parent;
 			if(node) {
 				bufferEnd=bufferStart+node->length;
 			}
-		} while(node!=NULL&&(node->isHidden||!node->matchAttributes(attribsList,regexObj)));
+		} while(node!=NULL&&(node->isHidden||!query.matches(node)));
 		LOG_DEBUG(L"end is now "<<bufferEnd);
 	}
 	if(node==NULL) {
@@ -980,16 +1734,65 @@ VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset,
 	return node;
 }
 
-bool VBufStorage_buffer_t::getLineOffsets(int offset, int maxLineLength, bool useScreenLayout, int *startOffset, int *endOffset) {
-	if(this->rootNode==NULL||offset>=this->rootNode->length) {
-		LOG_DEBUGWARNING(L"Offset of "<<offset<<L" too big for buffer, returning false");
+bool VBufStorage_buffer_t::findAllNodesByAttributes(const std::wstring& attribs, const std::wstring& regexp, std::vector<VBufStorage_foundNode_t>& foundNodes) {
+	LOG_DEBUG(L"find all nodes with attributes: "<<attribs);
+	const VBufStorage_attributeQuery_t* query=this->getAttributeQuery(attribs,regexp);
+	if(!query) {
+		LOG_DEBUGWARNING(L"Invalid query, returning false");
 		return false;
 	}
-	LOG_DEBUG(L"Calculating line offsets, using offset "<<offset<<L", with max line length of "<<maxLineLength<<L", useing screen layout "<<useScreenLayout);
+	return this->findAllNodesByAttributes(*query,foundNodes);
+}
+
+bool VBufStorage_buffer_t::findAllNodesByAttributes(const VBufStorage_attributeQuery_t& query, std::vector<VBufStorage_foundNode_t>& foundNodes) {
+	foundNodes.clear();
+	if(this->rootNode==NULL) {
+		LOG_DEBUG(L"buffer empty, returning no nodes");
+		return true;
+	}
+	vector<const attributeIndexList_t*> indexLists;
+	if(this->getAttributeIndexLists(query,indexLists)) {
+		LOG_DEBUG(L"searching attribute index");
+		//Merge the lists in document order, only visiting nodes that have the indexed attributes
+		vector<attributeIndexList_t::const_iterator> positions;
+		for(vector<const attributeIndexList_t*>::const_iterator i=indexLists.begin();i!=indexLists.end();++i) {
+			positions.push_back((*i)->begin());
+		}
+		for(;;) {
+			VBufStorage_fieldNode_t* node=NULL;
+			for(size_t i=0;i<indexLists.size();++i) {
+				if(positions[i]==indexLists[i]->end()) continue;
+				if(!node||isNodeBefore(*(positions[i]),node)) node=*(positions[i]);
+			}
+			if(!node) break;
+			for(size_t i=0;i<indexLists.size();++i) {
+				if(positions[i]!=indexLists[i]->end()&&*(positions[i])==node) ++positions[i];
+			}
+			if(node->length>0&&!(node->isHidden)&&query.matches(node)) {
+				VBufStorage_foundNode_t foundNode={node,node->calculateOffsetInTree(),0};
+				foundNode.endOffset=foundNode.startOffset+node->length;
+				foundNodes.push_back(foundNode);
+			}
+		}
+	} else {
+		LOG_DEBUG(L"searching whole tree");
+		int bufferStart=0, tempRelativeStart=0;
+		for(VBufStorage_fieldNode_t* node=this->rootNode;node!=NULL;node=node->nextNodeInTree(TREEDIRECTION_FORWARD,NULL,&tempRelativeStart)) {
+			bufferStart+=tempRelativeStart;
+			if(node->length>0&&!(node->isHidden)&&query.matches(node)) {
+				VBufStorage_foundNode_t foundNode={node,bufferStart,bufferStart+node->length};
+				foundNodes.push_back(foundNode);
+			}
+		}
+	}
+	LOG_DEBUG(L"found "<<foundNodes.size()<<L" nodes");
+	return true;
+}
+
+int VBufStorage_buffer_t::findLine(int offset, bool useScreenLayout, cachedLine_t& line) {
 	int initBufferStart, initBufferEnd;
 	VBufStorage_fieldNode_t* initNode=locateTextFieldNodeAtOffset(offset,&initBufferStart,&initBufferEnd);
 	LOG_DEBUG(L"Starting at node "<<initNode->getDebugInfo());
-	std::set<int> possibleBreaks;
 	//Find the node at which to limit the search for line endings.
 	VBufStorage_fieldNode_t* limitBlockNode=NULL;
 	for(limitBlockNode=initNode->parent;limitBlockNode!=NULL&&!limitBlockNode->isBlock;limitBlockNode=limitBlockNode->parent);
@@ -997,83 +1800,71 @@ bool VBufStorage_buffer_t::getLineOffsets(int offset, int maxLineLength, bool us
 	VBufStorage_fieldNode_t* node=NULL;
 	int relative, bufferStart, bufferEnd, tempRelativeStart;
 	bool foundHardBreak=false;
-	//Search forward for the next line ending.
+	//Search backward for the previous line ending.
 	node = initNode;
 	relative = offset - initBufferStart;
 	bufferStart = initBufferStart;
 	bufferEnd = initBufferEnd;
-	int lineEnd;
+	int lineStart=0;
 	do {
-	possibleBreaks.insert(bufferStart);
-	possibleBreaks.insert(bufferEnd);
 		if(node->length>0&&node->firstChild==NULL) {
-			std::wstring text;
-			lineEnd = bufferEnd;
-			node->getTextInRange(0,node->length,text,false);
-			bool lastWasSpace = false;
-			for (int i = relative; i < node->length; ++i) {
+			const wchar_t* text=static_cast<VBufStorage_textFieldNode_t*>(node)->getTextView().text;
+			lineStart = bufferStart;
+			for (int i = relative - 1; i >= 0; i--) {
 				if ((text[i] == L'\r' && (i + 1 >= node->length || text[i + 1] != L'\n'))
 					|| text[i] == L'\n'
 				) {
-					lineEnd = bufferStart + i + 1;
+					lineStart = bufferStart + i + 1;
 					foundHardBreak=true;
 					break;
 				}
-				if(iswspace(text[i])) {
-					lastWasSpace = true;
-				} else {
-					if(lastWasSpace) {
-						possibleBreaks.insert(bufferStart + i);
-					}
-					lastWasSpace = false;
-				}
 			}
 			if (foundHardBreak) {
 				//A hard line break was found.
 				break;
 			}
 		}
-		//Move on to the next node.
-		node = node->nextNodeInTree(TREEDIRECTION_FORWARD,limitBlockNode,&tempRelativeStart);
+		//Move on to the previous node.
+		node = node->nextNodeInTree(TREEDIRECTION_SYMMETRICAL_BACK,useScreenLayout?limitBlockNode:node->parent,&tempRelativeStart);
 		//If not using screen layout, make sure not to pass in to another control field node
-		if(node&&((!useScreenLayout&&node->firstChild)||node->isBlock)) {
+		if(node&&node->isBlock) {
 			node=NULL;
 		}
 		if(node) {
 			bufferStart+=tempRelativeStart;
 			bufferEnd=bufferStart+node->length;
-			relative = 0;
+			relative = node->length;
 		}
 	} while (node);
-	//Search backward for the previous line ending.
-	node = initNode;
-	relative = offset - initBufferStart;
-	bufferStart = initBufferStart;
-	bufferEnd = initBufferEnd;
-	int lineStart;
+	//Search forward from the start of the line for the next line ending, collecting where the line may be wrapped.
+	//Starting from the start of the line means the same breaks are collected whichever offset in the line was asked for.
+	node = locateTextFieldNodeAtOffset(lineStart,&bufferStart,&bufferEnd);
+	relative = lineStart - bufferStart;
+	vector<int>& possibleBreaks=line.possibleBreaks;
+	possibleBreaks.clear();
+	int lineEnd=0;
 	foundHardBreak=false;
 	do {
-		possibleBreaks.insert(bufferStart);
-		possibleBreaks.insert(bufferEnd);
+		possibleBreaks.push_back(bufferStart);
+		possibleBreaks.push_back(bufferEnd);
 		if(node->length>0&&node->firstChild==NULL) {
-			std::wstring text;
-			lineStart = bufferStart;
-			node->getTextInRange(0,node->length,text,false);
+			const wchar_t* text=static_cast<VBufStorage_textFieldNode_t*>(node)->getTextView().text;
+			lineEnd = bufferEnd;
 			bool lastWasSpace = false;
-			for (int i = relative - 1; i >= 0; i--) {
+			for (int i = relative; i < node->length; ++i) {
 				if ((text[i] == L'\r' && (i + 1 >= node->length || text[i + 1] != L'\n'))
 					|| text[i] == L'\n'
 				) {
-					lineStart = bufferStart + i + 1;
+					lineEnd = bufferStart + i + 1;
 					foundHardBreak=true;
 					break;
 				}
-				if (iswspace(text[i])) {
-					if (!lastWasSpace) {
-						possibleBreaks.insert(bufferStart + i + 1);
-					}
+				if(iswspace(text[i])) {
 					lastWasSpace = true;
 				} else {
+					if(lastWasSpace) {
+						possibleBreaks.push_back(bufferStart + i);
+					}
 					lastWasSpace = false;
 				}
 			}
@@ -1082,41 +1873,138 @@ bool VBufStorage_buffer_t::getLineOffsets(int offset, int maxLineLength, bool us
 				break;
 			}
 		}
-		//Move on to the previous node.
-		node = node->nextNodeInTree(TREEDIRECTION_SYMMETRICAL_BACK,useScreenLayout?limitBlockNode:node->parent,&tempRelativeStart);
+		//Move on to the next node.
+		node = node->nextNodeInTree(TREEDIRECTION_FORWARD,limitBlockNode,&tempRelativeStart);
 		//If not using screen layout, make sure not to pass in to another control field node
-		if(node&&node->isBlock) {
+		if(node&&((!useScreenLayout&&node->firstChild)||node->isBlock)) {
 			node=NULL;
 		}
 		if(node) {
 			bufferStart+=tempRelativeStart;
 			bufferEnd=bufferStart+node->length;
-			relative = node->length;
+			relative = 0;
 		}
 	} while (node);
+	sort(possibleBreaks.begin(),possibleBreaks.end());
+	possibleBreaks.erase(unique(possibleBreaks.begin(),possibleBreaks.end()),possibleBreaks.end());
+	line.end=lineEnd;
 	LOG_DEBUG(L"line offsets after searching back and forth for line feeds and block edges is "<<lineStart<<L" and "<<lineEnd);
+	return lineStart;
+}
+
+/**
+ * Finds where a line being wrapped to a maximum length wraps next: at the last possible break within maxLineLength characters of the previous wrap, or after exactly maxLineLength characters if there is none.
+ * @param possibleBreaks the sorted offsets at which the line may wrap.
+ * @param extraBreak another offset at which the line may wrap, or -1 if there is none.
+ * @param lastWrap the offset of the previous wrap, or the start of the line.
+ * @param maxLineLength the maximum length of a line.
+ * @return the offset of the next wrap.
+ */
+int findNextWrap(const vector<int>& possibleBreaks, int extraBreak, int lastWrap, int maxLineLength) {
+	int limit=lastWrap+maxLineLength;
+	vector<int>::const_iterator possible=upper_bound(possibleBreaks.begin(),possibleBreaks.end(),limit);
+	int wrap=(possible!=possibleBreaks.begin())?*(--possible):lastWrap;
+	if(extraBreak<=limit&&extraBreak>wrap) wrap=extraBreak;
+	return (wrap>lastWrap)?wrap:limit;
+}
+
+bool VBufStorage_buffer_t::getLineOffsets(int offset, int maxLineLength, bool useScreenLayout, int *startOffset, int *endOffset) {
+	if(this->rootNode==NULL||offset>=this->rootNode->length) {
+		LOG_DEBUGWARNING(L"Offset of "<<offset<<L" too big for buffer, returning false");
+		return false;
+	}
+	LOG_DEBUG(L"Calculating line offsets, using offset "<<offset<<L", with max line length of "<<maxLineLength<<L", useing screen layout "<<useScreenLayout);
+	int initBufferStart, initBufferEnd;
+	VBufStorage_textFieldNode_t* initNode=locateTextFieldNodeAtOffset(offset,&initBufferStart,&initBufferEnd);
+	//Lines never cross the edges of blocks, so they are cached for the block they are in, relative to its start.
+	VBufStorage_fieldNode_t* limitBlockNode=NULL;
+	for(limitBlockNode=initNode->parent;limitBlockNode!=NULL&&!limitBlockNode->isBlock;limitBlockNode=limitBlockNode->parent);
+	int blockStart=(limitBlockNode!=NULL)?limitBlockNode->calculateOffsetInTree():0;
+	int relativeOffset=offset-blockStart;
+	const pair<VBufStorage_fieldNode_t*,bool> cacheKey(limitBlockNode,useScreenLayout);
+	//Lines are only looked up and added with cacheLock held, and found or wrapped without it
+	cachedLines_t::value_type* line=NULL;
+	const vector<int>* wrappedBreaks=NULL;
+	this->cacheLock.acquire();
+	map<pair<VBufStorage_fieldNode_t*,bool>,cachedLines_t>::iterator lines=this->lineCache.find(cacheKey);
+	if(lines!=this->lineCache.end()) {
+		cachedLines_t::iterator i=lines->second.upper_bound(relativeOffset);
+		if(i!=lines->second.begin()&&relativeOffset<(--i)->second.end) {
+			LOG_DEBUG(L"Using cached line");
+			line=&*i;
+			map<int,vector<int> >::const_iterator wrapped=i->second.wrappedBreaks.find(maxLineLength);
+			if(wrapped!=i->second.wrappedBreaks.end()) wrappedBreaks=&(wrapped->second);
+		}
+	}
+	this->cacheLock.release();
+	//Holds the line instead of the cache if the cache is full
+	cachedLines_t uncachedLines;
+	if(!line) {
+		cachedLine_t newLine;
+		int lineStart=findLine(offset,useScreenLayout,newLine)-blockStart;
+		newLine.end-=blockStart;
+		for(vector<int>::iterator i=newLine.possibleBreaks.begin();i!=newLine.possibleBreaks.end();++i) {
+			*i-=blockStart;
+		}
+		this->cacheLock.acquire();
+		cachedLines_t& blockLines=this->lineCache[cacheKey];
+		cachedLines_t::iterator i=blockLines.find(lineStart);
+		if(i!=blockLines.end()) {
+			//Another reader found the same line first
+			line=&*i;
+		} else if(this->lineCacheSize<LINECACHE_MAXSIZE) {
+			i=blockLines.insert(make_pair(lineStart,cachedLine_t())).first;
+			i->second.end=newLine.end;
+			i->second.possibleBreaks.swap(newLine.possibleBreaks);
+			++(this->lineCacheSize);
+			line=&*i;
+		}
+		this->cacheLock.release();
+		if(!line) {
+			LOG_DEBUG(L"Line cache full, not caching line");
+			line=&*(uncachedLines.insert(make_pair(lineStart,newLine)).first);
+		}
+	}
+	int lineStart=line->first;
+	int lineEnd=line->second.end;
 	//Finally take maxLineLength in to account
 	if(maxLineLength>0) {
-		set<int> realBreaks;
-		realBreaks.insert(lineStart);
-		realBreaks.insert(lineEnd);
-		for(int i=lineStart,lineCharCounter=0;i<lineEnd;++i,++lineCharCounter) {
-			if(lineCharCounter==maxLineLength) {
-				if(possibleBreaks.size()>0) {
-					set<int>::iterator possible=possibleBreaks.upper_bound(i);
-					if((possible!=possibleBreaks.begin())&&(*(--possible)>(i-maxLineLength))) {
-												i=*possible;
-					}
+		const vector<int>& possibleBreaks=line->second.possibleBreaks;
+		if(!wrappedBreaks) {
+			vector<int> newWrappedBreaks;
+			newWrappedBreaks.push_back(lineStart);
+			for(int wrap=lineStart;wrap+maxLineLength<lineEnd;) {
+				wrap=findNextWrap(possibleBreaks,-1,wrap,maxLineLength);
+				newWrappedBreaks.push_back(wrap);
+			}
+			newWrappedBreaks.push_back(lineEnd);
+			//If another reader wrapped the line first, its wrap is kept. Either way it is never changed once added, so it can be used without the lock
+			this->cacheLock.acquire();
+			pair<map<int,vector<int> >::iterator,bool> wrapped=line->second.wrappedBreaks.insert(make_pair(maxLineLength,vector<int>()));
+			if(wrapped.second) wrapped.first->second.swap(newWrappedBreaks);
+			wrappedBreaks=&(wrapped.first->second);
+			this->cacheLock.release();
+		}
+		vector<int>::const_iterator wrap=upper_bound(wrappedBreaks->begin(),wrappedBreaks->end(),relativeOffset);
+		lineEnd=*wrap;
+		lineStart=*(--wrap);
+		//The line may also wrap at the offset itself if it follows white space.
+		//This only changes where the line wraps from the last wrap at least maxLineLength characters before the offset, so wrap again from there.
+		if(offset>initBufferStart&&iswspace(initNode->getTextView().text[offset-initBufferStart-1])) {
+			int wrapStart=*lower_bound(wrappedBreaks->begin(),wrappedBreaks->end(),relativeOffset-maxLineLength);
+			if(wrapStart<relativeOffset) {
+				int wrapEnd;
+				for(;;wrapStart=wrapEnd) {
+					wrapEnd=(wrapStart+maxLineLength<line->second.end)?findNextWrap(possibleBreaks,relativeOffset,wrapStart,maxLineLength):line->second.end;
+					if(wrapEnd>relativeOffset) break;
 				}
-				realBreaks.insert(i);
-				lineCharCounter=0;
+				lineStart=wrapStart;
+				lineEnd=wrapEnd;
 			}
 		}
-		set<int>::iterator real=realBreaks.upper_bound(offset);
-		lineEnd=*real;
-		lineStart=*(--real);
-		LOG_DEBUG(L"limits after fixing for maxLineLength %: start "<<lineStart<<L" end "<<lineEnd);
 	}
+	lineStart+=blockStart;
+	lineEnd+=blockStart;
 	*startOffset=lineStart;
 	*endOffset=lineEnd;
 	LOG_DEBUG(L"Successfully calculated Line offsets of "<<lineStart<<L", "<<lineEnd<<L", returning true");
@@ -1142,7 +2030,303 @@ bool VBufStorage_buffer_t::isDescendantNode(VBufStorage_fieldNode_t* parent, VBu
 }
 
 bool VBufStorage_buffer_t::isNodeInBuffer(VBufStorage_fieldNode_t* node) {
-	return this->nodes.count(node)?true:false;
+	return node&&node->owner==this;
+}
+
+const VBufStorage_attributeQuery_t* VBufStorage_buffer_t::getAttributeQuery(const std::wstring& attribs, const std::wstring& regexp) {
+	pair<wstring,wstring> key(attribs,regexp);
+	this->cacheLock.acquire();
+	map<pair<wstring,wstring>,VBufStorage_attributeQuery_t>::iterator i=this->attributeQueryCache.find(key);
+	bool found=(i!=this->attributeQueryCache.end());
+	this->cacheLock.release();
+	if(found) return &(i->second);
+	//Compile without holding the lock, as other readers may be searching
+	VBufStorage_attributeQuery_t query;
+	if(!query.compile(attribs,regexp)) return NULL;
+	//Another reader may be using a cached query, so a full cache is only emptied once the buffer changes
+	this->cacheLock.acquire();
+	const VBufStorage_attributeQuery_t* cachedQuery=&(this->attributeQueryCache.insert(make_pair(key,query)).first->second);
+	this->cacheLock.release();
+	return cachedQuery;
+}
+
+const std::wstring* VBufStorage_buffer_t::internAttributeName(const std::wstring& name) {
+	return &*(this->attributeNames.insert(name).first);
+}
+
+bool VBufStorage_buffer_t::isAttributeIndexed(const std::wstring* name) const {
+	return find(this->indexedAttributeNames.begin(),this->indexedAttributeNames.end(),name)!=this->indexedAttributeNames.end();
+}
+
+void VBufStorage_buffer_t::indexAttribute(VBufStorage_fieldNode_t* node, const std::wstring* name, const std::wstring& value) {
+	nhAssert(node&&node->owner==this);
+	if(value.empty()||!this->isAttributeIndexed(name)) return;
+	attributeIndexList_t& nodes=this->attributeIndex[make_pair(name,value)];
+	//Backends mostly add nodes in document order, so usually the node just goes on the end
+	if(nodes.empty()||isNodeBefore(nodes.back(),node)) {
+		nodes.push_back(node);
+		return;
+	}
+	attributeIndexList_t::iterator i=lower_bound(nodes.begin(),nodes.end(),node,isNodeBefore);
+	nhAssert(i==nodes.end()||*i!=node); //node must not be indexed twice
+	nodes.insert(i,node);
+}
+
+void VBufStorage_buffer_t::unindexAttribute(VBufStorage_fieldNode_t* node, const std::wstring* name, const std::wstring& value) {
+	nhAssert(node&&node->owner==this);
+	if(value.empty()||!this->isAttributeIndexed(name)) return;
+	attributeIndex_t::iterator i=this->attributeIndex.find(make_pair(name,value));
+	if(i==this->attributeIndex.end()) {
+		LOG_DEBUGWARNING(L"No index entry for attribute "<<*name<<L" with value "<<value);
+		return;
+	}
+	attributeIndexList_t& nodes=i->second;
+	attributeIndexList_t::iterator j=lower_bound(nodes.begin(),nodes.end(),node,isNodeBefore);
+	if(j==nodes.end()||*j!=node) {
+		LOG_DEBUGWARNING(L"Node at "<<node<<L" not in index for attribute "<<*name<<L" with value "<<value);
+		return;
+	}
+	nodes.erase(j);
+	if(nodes.empty()) this->attributeIndex.erase(i);
+}
+
+void VBufStorage_buffer_t::indexSubtree(VBufStorage_fieldNode_t* subtreeRoot) {
+	nhAssert(subtreeRoot&&subtreeRoot->owner==this);
+	//Gather the subtree's nodes for each list in document order, then insert them at the subtree's position in one go
+	map<attributeIndexList_t*,attributeIndexList_t> pendingNodes;
+	for(VBufStorage_fieldNode_t* node=subtreeRoot;node!=NULL;) {
+		for(vector<VBufStorage_fieldNode_t::attribute_t>::iterator i=node->attributes.begin();i!=node->attributes.end();++i) {
+			if(i->value.empty()||!this->isAttributeIndexed(i->name)) continue;
+			pendingNodes[&(this->attributeIndex[make_pair(i->name,i->value)])].push_back(node);
+		}
+		if(node->firstChild) {
+			node=node->firstChild;
+			continue;
+		}
+		while(node!=subtreeRoot&&node->next==NULL) node=node->parent;
+		node=(node!=subtreeRoot)?node->next:NULL;
+	}
+	for(map<attributeIndexList_t*,attributeIndexList_t>::iterator i=pendingNodes.begin();i!=pendingNodes.end();++i) {
+		attributeIndexList_t& nodes=*(i->first);
+		nodes.insert(lower_bound(nodes.begin(),nodes.end(),subtreeRoot,isNodeBefore),i->second.begin(),i->second.end());
+	}
+}
+
+void VBufStorage_buffer_t::unindexSubtree(VBufStorage_fieldNode_t* subtreeRoot) {
+	nhAssert(subtreeRoot&&subtreeRoot->owner==this);
+	//Count the subtree's nodes in each list. They are next to each other in the list, starting at the subtree's position
+	map<attributeIndexList_t*,pair<attributeIndex_t::iterator,size_t> > removedCounts;
+	for(VBufStorage_fieldNode_t* node=subtreeRoot;node!=NULL;) {
+		for(vector<VBufStorage_fieldNode_t::attribute_t>::iterator i=node->attributes.begin();i!=node->attributes.end();++i) {
+			if(i->value.empty()||!this->isAttributeIndexed(i->name)) continue;
+			attributeIndex_t::iterator entry=this->attributeIndex.find(make_pair(i->name,i->value));
+			if(entry==this->attributeIndex.end()) {
+				LOG_DEBUGWARNING(L"No index entry for attribute "<<*(i->name)<<L" with value "<<i->value);
+				continue;
+			}
+			map<attributeIndexList_t*,pair<attributeIndex_t::iterator,size_t> >::iterator count=removedCounts.find(&(entry->second));
+			if(count==removedCounts.end()) {
+				removedCounts.insert(make_pair(&(entry->second),make_pair(entry,(size_t)1)));
+			} else {
+				++(count->second.second);
+			}
+		}
+		if(node->firstChild) {
+			node=node->firstChild;
+			continue;
+		}
+		while(node!=subtreeRoot&&node->next==NULL) node=node->parent;
+		node=(node!=subtreeRoot)?node->next:NULL;
+	}
+	for(map<attributeIndexList_t*,pair<attributeIndex_t::iterator,size_t> >::iterator i=removedCounts.begin();i!=removedCounts.end();++i) {
+		attributeIndexList_t& nodes=*(i->first);
+		attributeIndexList_t::iterator first=lower_bound(nodes.begin(),nodes.end(),subtreeRoot,isNodeBefore);
+		size_t count=min(i->second.second,(size_t)(nodes.end()-first));
+		nhAssert(count==i->second.second); //all the subtree's nodes must be in the list
+		nodes.erase(first,first+count);
+		if(nodes.empty()) this->attributeIndex.erase(i->second.first);
+	}
+}
+
+bool VBufStorage_buffer_t::getAttributeIndexLists(const VBufStorage_attributeQuery_t& query, std::vector<const attributeIndexList_t*>& lists) {
+	if(this->indexedAttributeNames.empty()||query.isRegexp()) return false;
+	lists.clear();
+	const vector<vector<VBufStorage_attributeQuery_t::condition_t> >& options=query.getOptions();
+	for(vector<vector<VBufStorage_attributeQuery_t::condition_t> >::const_iterator option=options.begin();option!=options.end();++option) {
+		//Use the condition with the fewest candidate nodes.
+		//A condition can only be used if a node without the attribute can not match it, as such nodes are not in the index
+		bool foundCondition=false;
+		size_t bestCount=0;
+		vector<const attributeIndexList_t*> bestLists;
+		vector<const attributeIndexList_t*> conditionLists;
+		for(vector<VBufStorage_attributeQuery_t::condition_t>::const_iterator condition=option->begin();condition!=option->end();++condition) {
+			if(VBufStorage_attributeQuery_t::matchValue(*condition,L"")) continue;
+			VBufStorage_stringTable_t::const_iterator name=this->attributeNames.find(condition->name);
+			if(name==this->attributeNames.end()) {
+				//No node has this attribute, so nothing can match this option
+				foundCondition=true;
+				bestLists.clear();
+				break;
+			}
+			if(!this->isAttributeIndexed(&*name)) continue;
+			conditionLists.clear();
+			size_t count=0;
+			if(condition->type==VBufStorage_attributeMatch_exact) {
+				for(vector<wstring>::const_iterator value=condition->values.begin();value!=condition->values.end();++value) {
+					attributeIndex_t::const_iterator entry=this->attributeIndex.find(make_pair(&*name,*value));
+					if(entry==this->attributeIndex.end()) continue;
+					conditionLists.push_back(&(entry->second));
+					count+=entry->second.size();
+				}
+			} else {
+				for(attributeIndex_t::const_iterator entry=this->attributeIndex.lower_bound(make_pair(&*name,wstring()));entry!=this->attributeIndex.end()&&entry->first.first==&*name;++entry) {
+					if(!VBufStorage_attributeQuery_t::matchValue(*condition,entry->first.second)) continue;
+					conditionLists.push_back(&(entry->second));
+					count+=entry->second.size();
+				}
+			}
+			if(!foundCondition||count<bestCount) {
+				foundCondition=true;
+				bestCount=count;
+				bestLists.swap(conditionLists);
+			}
+		}
+		if(!foundCondition) {
+			LOG_DEBUG(L"Query tests attributes that are not indexed");
+			return false;
+		}
+		lists.insert(lists.end(),bestLists.begin(),bestLists.end());
+	}
+	sort(lists.begin(),lists.end());
+	lists.erase(unique(lists.begin(),lists.end()),lists.end());
+	return true;
+}
+
+VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeInAttributeIndex(VBufStorage_fieldNode_t* startNode, int offset, VBufStorage_findDirection_t direction, const VBufStorage_attributeQuery_t& query, const std::vector<const attributeIndexList_t*>& lists, int* startOffset, int* endOffset) {
+	nhAssert(startNode);
+	VBufStorage_fieldNode_t* node=NULL;
+	int bufferStart=0, bufferEnd=0;
+	if(direction==VBufStorage_findDirection_forward) {
+		//The first matching node after the start node in any list
+		for(vector<const attributeIndexList_t*>::const_iterator i=lists.begin();i!=lists.end();++i) {
+			for(attributeIndexList_t::const_iterator j=upper_bound((*i)->begin(),(*i)->end(),startNode,isNodeBefore);j!=(*i)->end();++j) {
+				if(node&&isNodeBefore(node,*j)) break;
+				if((*j)->length>0&&!((*j)->isHidden)&&query.matches(*j)) {
+					node=*j;
+					break;
+				}
+			}
+		}
+		if(node) {
+			bufferStart=node->calculateOffsetInTree();
+			bufferEnd=bufferStart+node->length;
+		}
+	} else if(direction==VBufStorage_findDirection_back) {
+		//Merge the lists backwards from the start node, so nodes are visited in the same order as walking the tree backwards
+		vector<attributeIndexList_t::const_iterator> positions;
+		for(vector<const attributeIndexList_t*>::const_iterator i=lists.begin();i!=lists.end();++i) {
+			positions.push_back(lower_bound((*i)->begin(),(*i)->end(),startNode,isNodeBefore));
+		}
+		bool skippedFirstMatch=false;
+		for(;;) {
+			VBufStorage_fieldNode_t* candidate=NULL;
+			for(size_t i=0;i<lists.size();++i) {
+				if(positions[i]==lists[i]->begin()) continue;
+				VBufStorage_fieldNode_t* previous=*(positions[i]-1);
+				if(!candidate||isNodeBefore(candidate,previous)) candidate=previous;
+			}
+			if(!candidate) break;
+			for(size_t i=0;i<lists.size();++i) {
+				if(positions[i]!=lists[i]->begin()&&*(positions[i]-1)==candidate) --positions[i];
+			}
+			if(candidate->length>0&&!(candidate->isHidden)&&query.matches(candidate)) {
+				bufferStart=candidate->calculateOffsetInTree();
+				bufferEnd=bufferStart+candidate->length;
+				//Skip first containing parent match or parent match where offset hasn't changed 
+				if((bufferStart==offset)||(!skippedFirstMatch&&bufferStart<offset&&bufferEnd>offset)) {
+					LOG_DEBUG(L"skipping initial parent");
+					skippedFirstMatch=true;
+					continue;
+				}
+				node=candidate;
+				break;
+			}
+		}
+	}
+	if(node==NULL) {
+		LOG_DEBUG(L"Could not find node, returning NULL");
+		return NULL;
+	}
+	if(startOffset) *startOffset=bufferStart;
+	if(endOffset) *endOffset=bufferEnd;
+	LOG_DEBUG(L"returning node at "<<node<<L" with offsets of "<<bufferStart<<L" and "<<bufferEnd);
+	return node;
+}
+
+void VBufStorage_buffer_t::setIndexedAttributes(const std::vector<std::wstring>& names) {
+	this->attributeIndex.clear();
+	this->indexedAttributeNames.clear();
+	for(vector<wstring>::const_iterator i=names.begin();i!=names.end();++i) {
+		const wstring* name=this->internAttributeName(*i);
+		if(!this->isAttributeIndexed(name)) this->indexedAttributeNames.push_back(name);
+	}
+	if(this->rootNode&&!this->indexedAttributeNames.empty()) this->indexSubtree(this->rootNode);
+}
+
+void VBufStorage_buffer_t::releaseNodeHandle(VBufStorage_fieldNode_t* node) {
+	nhAssert(node);
+	if(node->handleSlot<0) return;
+	nodeHandleSlot_t& slot=this->nodeHandleSlots[node->handleSlot];
+	nhAssert(slot.node==node);
+	slot.node=NULL;
+	++(slot.generation);
+	this->freeNodeHandleSlots.push_back(node->handleSlot);
+	node->handleSlot=-1;
+}
+
+VBufStorage_nodeHandle_t VBufStorage_buffer_t::getHandleForNode(VBufStorage_fieldNode_t* node) {
+	if(!isNodeInBuffer(node)) {
+		if(node) {
+			LOG_DEBUGWARNING(L"Node at "<<node<<L" is not in buffer at "<<this<<L". Returnning 0");
+		}
+		return 0;
+	}
+	this->cacheLock.acquire();
+	if(node->handleSlot<0) {
+		if(!this->freeNodeHandleSlots.empty()) {
+			node->handleSlot=this->freeNodeHandleSlots.back();
+			this->freeNodeHandleSlots.pop_back();
+		} else {
+			nodeHandleSlot_t newSlot={NULL,0};
+			node->handleSlot=static_cast<int>(this->nodeHandleSlots.size());
+			this->nodeHandleSlots.push_back(newSlot);
+		}
+		this->nodeHandleSlots[node->handleSlot].node=node;
+	}
+	//The low 32 bits hold the slot index plus 1 so that a valid handle is never 0, the high 32 bits hold the slot's generation.
+	VBufStorage_nodeHandle_t handle=(static_cast<VBufStorage_nodeHandle_t>(this->nodeHandleSlots[node->handleSlot].generation)<<32)|static_cast<VBufStorage_nodeHandle_t>(node->handleSlot+1);
+	this->cacheLock.release();
+	return handle;
+}
+
+VBufStorage_fieldNode_t* VBufStorage_buffer_t::getNodeForHandle(VBufStorage_nodeHandle_t handle) {
+	unsigned int slotIndex=static_cast<unsigned int>(handle&0xffffffff);
+	unsigned int generation=static_cast<unsigned int>(handle>>32);
+	//Another reader may be growing the handle table
+	this->cacheLock.acquire();
+	if(slotIndex==0||slotIndex>this->nodeHandleSlots.size()) {
+		this->cacheLock.release();
+		LOG_DEBUGWARNING(L"Invalid node handle "<<handle);
+		return NULL;
+	}
+	nodeHandleSlot_t slot=this->nodeHandleSlots[slotIndex-1];
+	this->cacheLock.release();
+	if(slot.node==NULL||slot.generation!=generation) {
+		LOG_DEBUGWARNING(L"Stale node handle "<<handle);
+		return NULL;
+	}
+	nhAssert(slot.node->owner==this);
+	return slot.node;
 }
 
 std::wstring VBufStorage_buffer_t::getDebugInfo() const {
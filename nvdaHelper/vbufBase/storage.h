@@ -20,7 +20,16 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include <set>
 #include <list>
 #include <vector>
+#include <atomic>
+#include <unordered_set>
 #include <regex>
+#include <common/lock.h>
+#include "nodePool.h"
+#include "textPool.h"
+#include "textEditList.h"
+#include "controlFieldNodeIndex.h"
+#include "attributeQuery.h"
+#include "textSink.h"
 
 /**
  * values to indicate a direction for searching
@@ -42,7 +51,7 @@ typedef enum {
 
 class VBufStorage_textContainer_t: protected std::wstring {
 	protected:
-	~VBufStorage_textContainer_t();
+	virtual ~VBufStorage_textContainer_t();
 
 	public:
 	VBufStorage_textContainer_t(std::wstring str);
@@ -57,6 +66,30 @@ class VBufStorage_controlFieldNode_t;
 class VBufStorage_textFieldNode_t;
 class VBufStorage_controlFieldNodeIdentifier_t;
 
+/**
+ * A value that can be handed out to identify a node, without giving out the node's address.
+ * It combines a slot in the buffer's handle table with the generation of that slot, so handles to nodes that have since been removed are recognised as invalid.
+ */
+typedef unsigned long long VBufStorage_nodeHandle_t;
+
+/**
+ * A node found by a search, along with its start and end offsets in the buffer.
+ */
+typedef struct {
+	VBufStorage_fieldNode_t* node;
+	int startOffset;
+	int endOffset;
+} VBufStorage_foundNode_t;
+
+/**
+ * A read only view of the text of a text field node, or part of it, which is not copied and not null terminated.
+ * It stays valid until the buffer is next changed, as replacing subtrees may move text in to new memory.
+ */
+typedef struct {
+	const wchar_t* text;
+	int length;
+} VBufStorage_textView_t;
+
 /**
  * a list of control field nodes.
  */
@@ -97,6 +130,11 @@ class VBufStorage_controlFieldNodeIdentifier_t {
  */
 typedef std::map<std::wstring,std::wstring> VBufStorage_attributeMap_t;
 
+/**
+ * A set of strings, used by a buffer to keep a single shared copy of each attribute name used by its nodes.
+ */
+typedef std::unordered_set<std::wstring> VBufStorage_stringTable_t;
+
 /**
  * a node that represents a field in a buffer.
  * Nodes have relationships with other nodes (giving the ability to form a tree structure), they have a length in characters (how many characters they span in the buffer), and they can hold name value attribute paires. Their constructor is protected and their only friend is a buffer, thus they can only be created by a buffer. 
@@ -139,9 +177,150 @@ class VBufStorage_fieldNode_t {
 	int length;
 
 /**
- * a map to hold attributes for this field.
+ * A name,value attribute of a field.
+ * The name points in to the string table of the buffer the node is in, so that all nodes using a particular name share it.
+ */
+	typedef struct {
+		const std::wstring* name;
+		std::wstring value;
+	} attribute_t;
+
+/**
+ * the attributes of this field, sorted by name.
  */
-	VBufStorage_attributeMap_t attributes;
+	std::vector<attribute_t> attributes;
+
+/**
+ * True if the names of this field's attributes were allocated by the field itself, because they were added before the field was in a buffer.
+ * They are interned in a buffer's string table once the field is inserted in to it.
+ */
+	bool ownsAttributeNames;
+
+/**
+ * Orders attributes by name, the same order a map keyed by name would use.
+ */
+	static bool isAttributeNameLess(const attribute_t& attribute, const std::wstring& name);
+
+/**
+ * An entry in a node's child offset index: a child and its start offset relative to the start of its parent.
+ */
+	typedef struct {
+		VBufStorage_fieldNode_t* node;
+		int offset;
+	} childOffsetEntry_t;
+
+/**
+ * The memory of a child offset index, which is never resized once allocated, so that readers can use its entries while another reader extends it.
+ * When more entries are needed a larger block replaces it, and the old block is kept on the new one's retired list until nothing can still be reading it.
+ */
+	typedef struct childOffsetIndexBlock_s {
+		std::vector<childOffsetEntry_t> entries;
+		struct childOffsetIndexBlock_s* retired;
+	} childOffsetIndexBlock_t;
+
+/**
+ * Frees a child offset index block and all the blocks it has retired.
+ */
+	static void freeChildOffsetIndexBlocks(childOffsetIndexBlock_t* block);
+
+/**
+ * A prefix-sum index of this node's children, holding each child's start offset relative to this node, or NULL if none has been built yet.
+ * Only the first childOffsetIndexValidCount entries are known to be correct, the rest are rebuilt lazily the next time they are needed.
+ * Entries are only ever added past the valid ones, and only published once written, so readers use the valid entries without any lock.
+ */
+	mutable std::atomic<childOffsetIndexBlock_t*> childOffsetIndex;
+
+/**
+ * The amount of entries at the start of childOffsetIndex that are known to be correct.
+ */
+	mutable std::atomic<int> childOffsetIndexValidCount;
+
+/**
+ * The position of this node in its parent's childOffsetIndex, if it has been indexed.
+ * It is only trusted if the entry at this position is still valid and points back at this node.
+ */
+	mutable std::atomic<int> indexInParent;
+
+/**
+ * The slab in the buffer's node pool this node's memory came from, or NULL if the node was allocated with new.
+ */
+	VBufStorage_nodeSlab_t* slab;
+
+/**
+ * The buffer this node is currently in, or NULL if it is in no buffer.
+ */
+	VBufStorage_buffer_t* owner;
+
+/**
+ * The slot in the owning buffer's handle table used by this node, or -1 if no handle has been given out for it yet.
+ */
+	int handleSlot;
+
+/**
+ * True if this node is in an invalid subtree list, waiting to be re-rendered.
+ */
+	bool isInvalidated;
+
+/**
+ * The number of this node's descendants that are in an invalid subtree list.
+ */
+	int invalidatedDescendantCount;
+
+/**
+ * Marks the child offset index entries after the given child as out of date.
+ * Must be called whenever children are inserted or removed after the given child, or if the given child's length changes.
+ * As the tree is changing, nothing can be reading the index, so any blocks it has retired are freed.
+ * @param child the last child whose start offset is still correct, or NULL to invalidate the entire index.
+ */
+	void invalidateChildOffsetIndexAfter(VBufStorage_fieldNode_t* child);
+
+/**
+ * Looks up a child in the valid part of the child offset index, without extending it or taking any lock.
+ * @param child one of this node's children.
+ * @return the index of the child, or -1 if it is past the valid part of the index.
+ */
+	int lookUpChildIndex(const VBufStorage_fieldNode_t* child) const;
+
+/**
+ * Extends the child offset index as far as the given child, for a caller already holding the owning buffer's cacheLock, so that only one reader extends it at a time.
+ * @param child one of this node's children.
+ * @return the index of the child.
+ */
+	int extendChildOffsetIndex(const VBufStorage_fieldNode_t* child) const;
+
+/**
+ * Fetches the index of the given child among this node's children, extending the child offset index as far as needed.
+ * @param child one of this node's children.
+ * @return the index of the child.
+ */
+	int getChildIndex(const VBufStorage_fieldNode_t* child) const;
+
+/**
+ * Fetches the amount of children this node has, building the entire child offset index.
+ */
+	int getChildCount() const;
+
+/**
+ * Fetches the start offset of the given child relative to the start of this node, using the child offset index.
+ * @param child one of this node's children.
+ * @return the start offset of the child.
+ */
+	int getChildStartOffset(const VBufStorage_fieldNode_t* child) const;
+
+/**
+ * Locates the child of this node that covers the given offset.
+ * Nodes with only a few children are scanned, wider nodes are searched with a binary search of the child offset index.
+ * @param offset an offset relative to the start of this node.
+ * @param childStartOffset memory where the start offset of the found child relative to this node will be placed.
+ * @return the child at the offset, or NULL if there is none.
+ */
+	VBufStorage_fieldNode_t* locateChildAtOffset(int offset, int* childStartOffset) const;
+
+/**
+ * Makes the names of this field's attributes point in to the given buffer's string table, freeing any names the field allocated itself.
+ * @param buffer the buffer this field now belongs to.
+ */
+	void internAttributeNames(VBufStorage_buffer_t* buffer);
 
 /**
  * moves to the next node, in depth-first order.
@@ -166,33 +345,38 @@ class VBufStorage_fieldNode_t {
  */ 
 	virtual VBufStorage_textFieldNode_t*locateTextFieldNodeAtOffset(int offset, int *relativeOffset);
 
+/**
+ * @return this node if it is a control field node, or NULL if it is a text field node.
+ */
+	virtual VBufStorage_controlFieldNode_t* asControlFieldNode();
+
 /**
  * generates this field's markup tag name
- * @param text where to place the generated name
+ * @param sink where to place the generated name
  */
-	virtual void generateMarkupTagName(std::wstring& text)=0;
+	virtual void generateMarkupTagName(VBufStorage_textSink_t& sink)=0;
 
 /**
  * Generates the attributes within a markup opening tag.
- * @param text where to place the generated text
+ * @param sink where to place the generated text
  * @param the offset within the node where text is being requested from 
  * @param the offset within the node the text is being requested to. 
  */
-	virtual void generateAttributesForMarkupOpeningTag(std::wstring& text, int startOffset, int endOffset);
+	virtual void generateAttributesForMarkupOpeningTag(VBufStorage_textSink_t& sink, int startOffset, int endOffset);
 
 /**
  * generates a markup opening tag for this field.
- * @param text a string to append the tag to.
+ * @param sink where to place the tag.
  * @param the offset within the node where text is being requested from 
  * @param the offset within the node the text is being requested to. 
  */
-	 void generateMarkupOpeningTag(std::wstring& text,int startOffset, int endOffset);
+	 void generateMarkupOpeningTag(VBufStorage_textSink_t& sink,int startOffset, int endOffset);
 
 /**
  * generates a markup closing tag for this field.
- * @param text a string to append the tag to.
+ * @param sink where to place the tag.
  */
-	void generateMarkupClosingTag(std::wstring& text);
+	void generateMarkupClosingTag(VBufStorage_textSink_t& sink);
 
 /**
  * Disassociates this node from its buffer.
@@ -213,6 +397,8 @@ class VBufStorage_fieldNode_t {
 	virtual ~VBufStorage_fieldNode_t();
 
 	friend class VBufStorage_buffer_t;
+	friend class VBufStorage_textRangeIterator_t;
+	friend class VBufStorage_invalidSubtreeList_t;
 
 	public:
 
@@ -238,6 +424,11 @@ class VBufStorage_fieldNode_t {
  */
 	VBufStorage_controlFieldNode_t* updateAncestor;
 
+/**
+ * True if this node, or one of its descendants, was invalidated since it was last rendered, so it can not be reused as it is by a re-render of one of its ancestors.
+ */
+	bool isStale;
+
 /**
  * points to this node's parent control field node.
  * it is garenteed that this node will be one of the parent's children (firstChild [next next...] or lastChild [previous previous...]).
@@ -280,16 +471,40 @@ class VBufStorage_fieldNode_t {
  */
 	std::wstring getAttributesString() const;
 
+/**
+ * Fetches the value of one of this field's attributes.
+ * @param name the name of the attribute.
+ * @return the value of the attribute, or NULL if this field has no attribute with that name.
+ */
+	const std::wstring* getAttributeValue(const std::wstring& name) const;
+
+/**
+ * Compares the position of this node with another node in the same tree, in document order (a node comes before its descendants and after its previous siblings' descendants).
+ * @param other the node to compare with.
+ * @return true if this node comes before the other node, false if it comes after or is the same node.
+ */
+	bool isBefore(const VBufStorage_fieldNode_t* other) const;
+
 /**
  * fetches the text between given offsets in this node and its descendants, with optional markup.
  * @param startOffset the offset to start from.
- * @param endOffset the offset to end at. Use -1 to mean node's end offset. 
+ * @param endOffset the offset to end at.
+ * @param sink where to place the text.
+ * @param useMarkup if true then markup indicating opening and closing of fields will be included.
+ * @param filter: a function that takes the current recursive node and returns true if text should be fetched and false if it should be skipped.
+ */ 
+	virtual void getTextInRange(int startOffset, int endOffset, VBufStorage_textSink_t& sink, bool useMarkup=false,bool(*filter)(VBufStorage_fieldNode_t*)=NULL);
+
+/**
+ * fetches the text between given offsets in this node and its descendants, with optional markup, appending it to a string.
+ * The text is measured first so that the string only grows once.
+ * @param startOffset the offset to start from.
+ * @param endOffset the offset to end at.
  * @param text a string in whish to append the text.
  * @param useMarkup if true then markup indicating opening and closing of fields will be included.
  * @param filter: a function that takes the current recursive node and returns true if text should be fetched and false if it should be skipped.
- * @return true if successfull, false otherwize.
  */ 
-	virtual void getTextInRange(int startOffset, int endOffset, std::wstring& text, bool useMarkup=false,bool(*filter)(VBufStorage_fieldNode_t*)=NULL);
+	void getTextInRange(int startOffset, int endOffset, std::wstring& text, bool useMarkup=false,bool(*filter)(VBufStorage_fieldNode_t*)=NULL);
 
 /**
  * @return a string providing information about this node's type, and its state.
@@ -315,12 +530,14 @@ class VBufStorage_controlFieldNode_t : public VBufStorage_fieldNode_t {
  */
 	VBufStorage_controlFieldNodeIdentifier_t identifier;
 
-	virtual void generateMarkupTagName(std::wstring& text);
+	virtual void generateMarkupTagName(VBufStorage_textSink_t& sink);
 
-	virtual void generateAttributesForMarkupOpeningTag(std::wstring& text, int startOffset, int endOffset);
+	virtual void generateAttributesForMarkupOpeningTag(VBufStorage_textSink_t& sink, int startOffset, int endOffset);
 
 	virtual void disassociateFromBuffer(VBufStorage_buffer_t* buffer);
 
+	virtual VBufStorage_controlFieldNode_t* asControlFieldNode();
+
 /**
  * constructor.
  * @param docHandle the docHandle of the control
@@ -353,29 +570,129 @@ class VBufStorage_textFieldNode_t : public VBufStorage_fieldNode_t {
 
 	virtual VBufStorage_textFieldNode_t*locateTextFieldNodeAtOffset(int offset, int *relativeOffset);
 
-	virtual void generateMarkupTagName(std::wstring& text);
+	virtual void generateMarkupTagName(VBufStorage_textSink_t& sink);
+
+	virtual void getTextInRange(int startOffset, int endOffset, VBufStorage_textSink_t& sink, bool useMarkup=false,bool(*filter)(VBufStorage_fieldNode_t*)=NULL);
+
+	using VBufStorage_fieldNode_t::getTextInRange;
 
-	virtual void getTextInRange(int startOffset, int endOffset, std::wstring& text, bool useMarkup=false,bool(*filter)(VBufStorage_fieldNode_t*)=NULL);
+/**
+ * The text this field contains, which is length characters long and not null terminated.
+ */
+	const wchar_t* text;
+
+/**
+ * The block of a buffer's text pool the text is stored in, to which this node holds a reference, or NULL if the text is empty.
+ */
+	VBufStorage_textBlock_t* textBlock;
 
 /**
  * constructor.
- * @param text the text this field should contain.
+ * @param textArg the text this field should contain, stored in a text pool.
+ * @param lengthArg the length of the text.
+ * @param textBlockArg the block the text is stored in. The node takes over the caller's reference to it.
  */
-	VBufStorage_textFieldNode_t(const std::wstring& text);
+	VBufStorage_textFieldNode_t(const wchar_t* textArg, int lengthArg, VBufStorage_textBlock_t* textBlockArg);
+
+/**
+ * Destructor. Releases the node's reference to its text block.
+ */
+	virtual ~VBufStorage_textFieldNode_t();
 
 	friend class VBufStorage_buffer_t;
 
 	public:
 
-	/**
- * The text this field contains.
+/**
+ * Fetches the text this field contains without copying it.
+ * @return a view of the text.
  */
-	const std::wstring text;
+	inline VBufStorage_textView_t getTextView() const {
+		VBufStorage_textView_t view={text,length};
+		return view;
+	}
 
 	virtual std::wstring getDebugInfo() const;
 
 };
 
+/**
+ * Steps through the text in a range of a subtree one text field node at a time, giving a view of the text in each without copying it.
+ * Text field nodes with no text are skipped.
+ * The subtree must not be changed while iterating over it.
+ * Usage: for(VBufStorage_textRangeIterator_t i(node);i.isValid();i.next()) { ... i.getView() ... }
+ */
+class VBufStorage_textRangeIterator_t {
+	private:
+
+/**
+ * The root of the subtree being iterated over.
+ */
+	VBufStorage_fieldNode_t* subtreeRoot;
+
+/**
+ * The current text field node, or NULL if there is no more text in the range.
+ */
+	VBufStorage_textFieldNode_t* node;
+
+/**
+ * The offset of the current text field node, relative to subtreeRoot.
+ */
+	int nodeStartOffset;
+
+/**
+ * The offset relative to subtreeRoot at which the range ends.
+ */
+	int endOffset;
+
+/**
+ * The part of the current node's text that is in the range, and its offset relative to subtreeRoot.
+ */
+	VBufStorage_textView_t view;
+	int viewStartOffset;
+
+/**
+ * Sets view to the part of the current node's text in the range, starting from the given offset relative to the node.
+ */
+	void updateView(int relativeOffset);
+
+	public:
+
+/**
+ * constructor.
+ * @param subtreeRootArg the node whose text to iterate over.
+ * @param startOffset the offset relative to the node at which to start.
+ * @param endOffsetArg the offset relative to the node at which to end, or -1 for the end of the node.
+ */
+	VBufStorage_textRangeIterator_t(VBufStorage_fieldNode_t* subtreeRootArg, int startOffset=0, int endOffsetArg=-1);
+
+/**
+ * @return true if there is text at the current position, false if the end of the range has been reached.
+ */
+	inline bool isValid() const { return node!=NULL; }
+
+/**
+ * Moves to the text in the next text field node in the range.
+ */
+	void next();
+
+/**
+ * @return the current text field node.
+ */
+	inline VBufStorage_textFieldNode_t* getNode() const { return node; }
+
+/**
+ * @return a view of the current text, limited to the range.
+ */
+	inline const VBufStorage_textView_t& getView() const { return view; }
+
+/**
+ * @return the offset of the current text relative to the root of the subtree.
+ */
+	inline int getStartOffset() const { return viewStartOffset; }
+
+};
+
 /**
  * a buffer that can store text with overlaying fields.
  * it stores the text and fields in an internal tree of nodes.
@@ -389,14 +706,203 @@ class VBufStorage_buffer_t {
 	VBufStorage_fieldNode_t* rootNode;
 
 /**
- * Holds pointers to all nodes in the buffer
+ * A slot in the handle table, holding the node currently using the slot, if any, and a generation that is increased each time the slot is freed.
+ */
+	typedef struct {
+		VBufStorage_fieldNode_t* node;
+		unsigned int generation;
+	} nodeHandleSlot_t;
+
+/**
+ * The table of slots for nodes that have had handles handed out.
  */
-	std::set<VBufStorage_fieldNode_t*> nodes;
+	std::vector<nodeHandleSlot_t> nodeHandleSlots;
+
+/**
+ * Indexes of slots in nodeHandleSlots that are currently free.
+ */
+	std::vector<int> freeNodeHandleSlots;
+
+/**
+ * Frees the given node's slot in the handle table, if it has one, so that any handles to it become invalid.
+ * @param node the node whose handle should be released.
+ */
+	void releaseNodeHandle(VBufStorage_fieldNode_t* node);
 
 /**
  * holds pointers to all control field nodes in this buffer, searchable by  the control's unique identifier.
  */
-	std::map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*> controlFieldNodesByIdentifier;
+	VBufStorage_controlFieldNodeIndex_t controlFieldNodesByIdentifier;
+
+/**
+ * The names of the attributes of the nodes in this buffer. Each distinct name is stored once and shared by all nodes that use it.
+ */
+	VBufStorage_stringTable_t attributeNames;
+
+/**
+ * Fetches this buffer's shared copy of the given attribute name, adding it to attributeNames if it is not there yet.
+ * @param name the attribute name.
+ * @return the shared copy, which lives as long as this buffer, or until the buffer is cleared.
+ */
+	const std::wstring* internAttributeName(const std::wstring& name);
+
+/**
+ * Queries compiled from the attribs and regexp strings given to findNodeByAttributes, so that repeated searches do not compile them again.
+ */
+	std::map<std::pair<std::wstring,std::wstring>,VBufStorage_attributeQuery_t> attributeQueryCache;
+
+/**
+ * Guards the caches that reads fill in lazily: extending child offset indexes, lineCache, attributeQueryCache and the handle table.
+ * Reads may then run on several threads at once, as long as nothing changes the tree while they run.
+ * It is only held to look up or add entries, never while the entries are being computed.
+ */
+	LockableObject cacheLock;
+
+/**
+ * Fetches the compiled query for the given attribs and regexp strings, compiling it and adding it to attributeQueryCache if needed.
+ * The cache is only emptied when the buffer changes, so the query stays valid until then.
+ * @return the query, or NULL if the regular expression is invalid.
+ */
+	const VBufStorage_attributeQuery_t* getAttributeQuery(const std::wstring& attribs, const std::wstring& regexp);
+
+/**
+ * A list of nodes, kept in document order.
+ */
+	typedef std::vector<VBufStorage_fieldNode_t*> attributeIndexList_t;
+
+/**
+ * Maps an attribute name (interned in attributeNames) and a value to the list of nodes that have that attribute value.
+ */
+	typedef std::map<std::pair<const std::wstring*,std::wstring>,attributeIndexList_t> attributeIndex_t;
+
+/**
+ * The names of the attributes kept in attributeIndex, interned in attributeNames. Empty if there is no index.
+ */
+	std::vector<const std::wstring*> indexedAttributeNames;
+
+/**
+ * An inverted index of the attributes named in indexedAttributeNames, so that findNodeByAttributes can jump straight to nodes with particular attribute values.
+ * Attributes with empty values are not indexed.
+ */
+	attributeIndex_t attributeIndex;
+
+/**
+ * @return true if attributes with the given interned name are kept in attributeIndex.
+ */
+	bool isAttributeIndexed(const std::wstring* name) const;
+
+/**
+ * Adds a node to the list for an attribute value in attributeIndex, if the attribute is indexed.
+ * @param node a node in this buffer.
+ * @param name the attribute name, interned in attributeNames.
+ * @param value the attribute value.
+ */
+	void indexAttribute(VBufStorage_fieldNode_t* node, const std::wstring* name, const std::wstring& value);
+
+/**
+ * Removes a node from the list for an attribute value in attributeIndex, if the attribute is indexed.
+ * @param node a node in this buffer.
+ * @param name the attribute name, interned in attributeNames.
+ * @param value the attribute value.
+ */
+	void unindexAttribute(VBufStorage_fieldNode_t* node, const std::wstring* name, const std::wstring& value);
+
+/**
+ * Adds all the indexed attributes of a subtree to attributeIndex.
+ * The nodes of a subtree are next to each other in document order, so they are inserted in to each list in one go.
+ * @param subtreeRoot the root of a subtree in this buffer none of whose nodes are indexed yet.
+ */
+	void indexSubtree(VBufStorage_fieldNode_t* subtreeRoot);
+
+/**
+ * Removes all the nodes of a subtree from attributeIndex, removing a range from each list rather than each node individually.
+ * @param subtreeRoot the root of a subtree in this buffer.
+ */
+	void unindexSubtree(VBufStorage_fieldNode_t* subtreeRoot);
+
+/**
+ * Collects the lists in attributeIndex which together hold every node that could match a query.
+ * @param query the query.
+ * @param lists memory where the lists will be placed.
+ * @return true if the lists were collected, false if the query tests any option only with attributes that are not indexed, in which case the tree must be searched instead.
+ */
+	bool getAttributeIndexLists(const VBufStorage_attributeQuery_t& query, std::vector<const attributeIndexList_t*>& lists);
+
+/**
+ * Finds the next or previous node matching a query using attributeIndex, with the same results as walking the tree.
+ * @param startNode the node at which the search starts.
+ * @param offset the offset the search started from.
+ * @param direction either VBufStorage_findDirection_forward or VBufStorage_findDirection_back.
+ * @param query the query.
+ * @param lists the lists returned by getAttributeIndexLists for the query.
+ * @param startOffset memory where the start offset of the found node will be placed.
+ * @param endOffset memory where the end offset of the found node will be placed.
+ * @return the found node, or NULL if there is none.
+ */
+	VBufStorage_fieldNode_t* findNodeInAttributeIndex(VBufStorage_fieldNode_t* startNode, int offset, VBufStorage_findDirection_t direction, const VBufStorage_attributeQuery_t& query, const std::vector<const attributeIndexList_t*>& lists, int* startOffset, int* endOffset);
+
+/**
+ * A line found by getLineOffsets, ending at line feeds or the edges of blocks, before it is wrapped to a maximum length.
+ * Offsets are relative to the start of the block the line is in, so that they stay valid when content outside the block changes.
+ */
+	typedef struct {
+		int end;
+		/**
+		 * The sorted offsets at which the line may be wrapped: the edges of fields, and the starts of words.
+		 */
+		std::vector<int> possibleBreaks;
+		/**
+		 * For each maximum line length the line has been wrapped to, the sorted offsets at which it was wrapped, starting with the line's start and ending with its end.
+		 */
+		std::map<int,std::vector<int> > wrappedBreaks;
+	} cachedLine_t;
+
+/**
+ * The lines cached for a block, by their start offset.
+ */
+	typedef std::map<int,cachedLine_t> cachedLines_t;
+
+/**
+ * Lines already found by getLineOffsets, by the block they are in (NULL if they are in no block) and whether screen layout was used.
+ * Lines of a block are forgotten whenever a node in that block is inserted or removed.
+ * Readers only ever add lines, so a cached line stays where it is until the buffer changes.
+ */
+	std::map<std::pair<VBufStorage_fieldNode_t*,bool>,cachedLines_t> lineCache;
+
+/**
+ * The amount of lines in lineCache.
+ */
+	int lineCacheSize;
+
+/**
+ * Forgets the lines cached for a node and, unless told otherwise, for all its ancestors, as the text or layout within them is changing.
+ * If the cache is full it is emptied, as nothing can be reading it while the buffer changes.
+ * @param node the node being changed, or NULL to only forget lines in no block.
+ * @param includeAncestors false to only forget the lines cached for the node itself, such as when it is being deleted.
+ */
+	void forgetCachedLines(VBufStorage_fieldNode_t* node, bool includeAncestors=true);
+
+/**
+ * Finds the line at an offset in the same way as getLineOffsets, ignoring maxLineLength, and collects where it may be wrapped.
+ * @param offset the offset.
+ * @param useScreenLayout as for getLineOffsets.
+ * @param line memory where the line's end and possible breaks will be placed, with offsets relative to the start of the buffer.
+ * @return the start offset of the line.
+ */
+	int findLine(int offset, bool useScreenLayout, cachedLine_t& line);
+
+/**
+ * Pools that own the memory of the control and text field nodes this buffer creates.
+ * When a buffer is merged in to this one by replaceSubtrees, its pools' slabs are adopted by these pools.
+ */
+	VBufStorage_nodePool_t controlFieldNodePool;
+	VBufStorage_nodePool_t textFieldNodePool;
+
+/**
+ * Stores the text of the text field nodes in this buffer.
+ * When a buffer is merged in to this one by replaceSubtrees, its text blocks are adopted by this pool.
+ */
+	VBufStorage_textPool_t textPool;
 
 /**
  * the offset at where the current selection starts.
@@ -408,6 +914,11 @@ class VBufStorage_buffer_t {
  */
 	int selectionLength;
 
+/**
+ * Increased each time the content of the buffer changes.
+ */
+	unsigned int version;
+
 /**
  * removes the controlFieldNode from the buffer's controlFieldNodesByIdentifier set.
  */
@@ -433,6 +944,78 @@ class VBufStorage_buffer_t {
  */
 	void deleteNode(VBufStorage_fieldNode_t* node);
 
+/**
+ * Makes all the nodes of a subtree moved in to this buffer from another buffer belong to this buffer, and indexes them.
+ * Handles given out by the other buffer are not valid in this one.
+ * @param subtreeRoot the root of the subtree, already inserted in to this buffer.
+ * @param buffer the buffer the subtree came from.
+ * @param copyText true if the text of the subtree should be copied in to this buffer's text pool, so that the other buffer's text blocks need not be kept alive for it.
+ */
+	void claimSubtree(VBufStorage_fieldNode_t* subtreeRoot, VBufStorage_buffer_t* buffer, bool copyText=false);
+
+/**
+ * Moves the text of a text field node in to the current block of this buffer's text pool.
+ * @param textFieldNode the node.
+ * @return true if successful, false if no memory could be allocated, in which case the text stays where it is.
+ */
+	bool moveTextToPool(VBufStorage_textFieldNode_t* textFieldNode);
+
+/**
+ * Translates a node's update ancestor when the node is moved in to this buffer from another buffer whose content is being reconciled with this one.
+ * @param ancestor the update ancestor, which may be a node of the other buffer that was matched with a node already in this buffer.
+ * @param buffer the buffer the node came from.
+ * @return the node in this buffer to use as the update ancestor.
+ */
+	VBufStorage_controlFieldNode_t* translateUpdateAncestor(VBufStorage_controlFieldNode_t* ancestor, VBufStorage_buffer_t* buffer);
+
+/**
+ * Checks whether two nodes, possibly in different buffers, have the same attributes.
+ */
+	static bool hasSameAttributes(const VBufStorage_fieldNode_t* node, const VBufStorage_fieldNode_t* otherNode);
+
+/**
+ * Checks whether two nodes, possibly in different buffers, are both text field nodes with the same text and attributes.
+ */
+	static bool isSameTextFieldNode(VBufStorage_fieldNode_t* node, VBufStorage_fieldNode_t* otherNode);
+
+/**
+ * Gives a node in this buffer the attributes and other properties of a node of new content it was matched with.
+ * @param node the node in this buffer.
+ * @param newNode the node of the new content.
+ * @param buffer the buffer holding the new content.
+ * @return true if anything that is part of the node's text or markup changed.
+ */
+	bool takeNodeProperties(VBufStorage_fieldNode_t* node, VBufStorage_fieldNode_t* newNode, VBufStorage_buffer_t* buffer);
+
+/**
+ * Updates a subtree in this buffer to match newly rendered content, keeping the nodes that did not change.
+ * Children that are control fields are matched by identifier, and the text field nodes at either end of the runs of children between them are kept if their text is the same.
+ * The runs of children that still differ are replaced by the new content's children, which are moved in to this buffer.
+ * @param node the root of the subtree in this buffer.
+ * @param newNode the root of the new content, which must have the same identifier as node.
+ * @param buffer the buffer holding the new content. Whatever is left of it afterwards was matched with nodes in this buffer, and can be deleted.
+ * @param edits where the edits made to the text are added, as they are made.
+ * @return true if successful, false if the subtree could only partly be updated.
+ */
+	bool reconcileSubtree(VBufStorage_controlFieldNode_t* node, VBufStorage_controlFieldNode_t* newNode, VBufStorage_buffer_t* buffer, VBufStorage_textEditList_t& edits);
+
+/**
+ * Clears isStale on the ancestors of a subtree that has just been rendered again, up to the first one that still has a stale child.
+ * @param node the root of the subtree.
+ */
+	void clearStaleAncestors(VBufStorage_fieldNode_t* node);
+
+/**
+ * Moves the text of all the text field nodes in this buffer in to new blocks, in document order, so that blocks holding mostly text of deleted nodes can be freed.
+ */
+	void compactText();
+
+/**
+ * Destroys the given node and frees its memory, either by giving it back to its node pool slab, or with delete if it was not allocated from a pool.
+ * @param node the node to free.
+ */
+	void freeNode(VBufStorage_fieldNode_t* node);
+
 	friend class VBufStorage_fieldNode_t;
 	friend class VBufStorage_controlFieldNode_t;
 	friend class VBufStorage_textFieldNode_t;
@@ -447,7 +1030,7 @@ class VBufStorage_buffer_t {
 /**
  * Destructor
  */
-	~VBufStorage_buffer_t();
+	virtual ~VBufStorage_buffer_t();
 
 /**
  * Adds a control field in to the buffer.
@@ -473,18 +1056,45 @@ class VBufStorage_buffer_t {
 
 	VBufStorage_textFieldNode_t* addTextFieldNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, VBufStorage_textFieldNode_t* node);
 
+/**
+ * Adds a copy of a subtree of another buffer in to this buffer, so that a re-render can reuse content that has not changed without fetching it again.
+ * The fields are copied with their attributes and text, and the subtree being copied is left as it is.
+ * A control field whose identifier is already in this buffer is left out along with its descendants.
+ * @param parent the control field which should be the copy's parent, note that if also specifying previous, parent can be NULL.
+ * @param previous the field which the copy should come directly after.
+ * @param node the root of the subtree to copy, which must not be in this buffer.
+ * @return the copy of node, or NULL if it could not be added.
+ */
+	VBufStorage_fieldNode_t* copySubtree(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, VBufStorage_fieldNode_t* node);
+
 /**
  * finds out if the given node exists in this buffer.
- * @param node the node you wish to check.
+ * @param node the node you wish to check, which must either be NULL or point to a node that has not been deleted.
  * @return true if it is in the buffer, false otherwise.
  */
 	virtual bool isNodeInBuffer(VBufStorage_fieldNode_t* node);
 
+/**
+ * Fetches a handle that identifies the given node, which can be safely handed out and later validated with getNodeForHandle.
+ * @param node the node to get a handle for.
+ * @return the handle, or 0 if the node is NULL or not in this buffer.
+ */
+	virtual VBufStorage_nodeHandle_t getHandleForNode(VBufStorage_fieldNode_t* node);
+
+/**
+ * Fetches the node identified by the given handle.
+ * @param handle a handle previously returned by getHandleForNode.
+ * @return the node, or NULL if the handle is invalid or the node has since been removed from this buffer.
+ */
+	virtual VBufStorage_fieldNode_t* getNodeForHandle(VBufStorage_nodeHandle_t handle);
+
 /**
  * Removes the given nodes from the buffer and then merges the content of the new buffers in the removed node's position. It also tries to keep the selection relative to the control field it was in before the replacement.
  * @param m the map of nodes to buffers 
+ * @param reconcile if true, each control field node is reconciled with the new content rather than replaced, if the new content's root has the same identifier. Nodes that did not change are kept, along with any handles given out for them, and only the runs of nodes that differ are replaced.
+ * @param edits an optional list the edits made to the text are added to, in the order they are made. Edits that only change the fields around some text span that text, without changing its length.
  */
-	bool replaceSubtrees(std::map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>& m);
+	bool replaceSubtrees(std::map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>& m, bool reconcile=false, VBufStorage_textEditList_t* edits=NULL);
 
 /**
  * disassociates from this buffer, and deletes, the given field and its descendants.
@@ -499,6 +1109,13 @@ class VBufStorage_buffer_t {
  */
 	void clearBuffer();
 
+/**
+ * Sets which attributes this buffer keeps an index of, so that findNodeByAttributes can find nodes with these attributes without walking the whole tree.
+ * The index is built for the nodes already in the buffer, and kept up to date as nodes are added and removed.
+ * @param names the names of the attributes to index, or an empty list to not keep an index.
+ */
+	void setIndexedAttributes(const std::vector<std::wstring>& names);
+
 /**
  * Calculates the start and end character offsets of the given node in the buffer.
  * @param node the node you want the offsets of.
@@ -565,6 +1182,35 @@ class VBufStorage_buffer_t {
  */
 	virtual VBufStorage_fieldNode_t* findNodeByAttributes(int offset, VBufStorage_findDirection_t  direction, const std::wstring &attribs, const std::wstring &regexp, int *startOffset, int *endOffset);
 
+/**
+ * Finds a field node that matches an attribute query.
+ * @param offset offset in the buffer to start searching from, if -1 then starts at the root of the buffer.
+ * @param direction which direction to search
+ * @param query the query the node must match
+ * @param startOffset memory where the start offset of the found node can be placed
+ * @param endOffset memory where the end offset of the found node will be placed
+ * @return the found field node
+ */
+	virtual VBufStorage_fieldNode_t* findNodeByAttributes(int offset, VBufStorage_findDirection_t  direction, const VBufStorage_attributeQuery_t& query, int *startOffset, int *endOffset);
+
+/**
+ * Finds all the field nodes in the buffer that contain particular attributes, in one pass over the buffer.
+ * Nodes are tested the same way as by findNodeByAttributes, but nested matches and matches starting at the same offset are all included.
+ * @param attribs the attributes to search
+ * @param regexp regular expression the requested attributes must match
+ * @param foundNodes memory where the found nodes and their offsets will be placed, in document order.
+ * @return true if successful, false if the regular expression is invalid.
+ */
+	virtual bool findAllNodesByAttributes(const std::wstring& attribs, const std::wstring& regexp, std::vector<VBufStorage_foundNode_t>& foundNodes);
+
+/**
+ * Finds all the field nodes in the buffer that match an attribute query, in one pass over the buffer.
+ * @param query the query the nodes must match
+ * @param foundNodes memory where the found nodes and their offsets will be placed, in document order.
+ * @return true if successful, false otherwise.
+ */
+	virtual bool findAllNodesByAttributes(const VBufStorage_attributeQuery_t& query, std::vector<VBufStorage_foundNode_t>& foundNodes);
+
 /**
  * Retreaves the current selection offsets for the buffer
  * @param startOffset memory where the start offset of the selection will be placed
@@ -587,6 +1233,13 @@ class VBufStorage_buffer_t {
  */
 	virtual int getTextLength() const;
 
+/**
+ * Fetches the version of the buffer's content, which changes each time nodes are added, removed or replaced, or their attributes change.
+ * Text or offsets fetched while the version stayed the same all agree with each other.
+ * @return the version.
+ */
+	inline unsigned int getVersion() const { return version; }
+
 /**
  * Retreaves the text in the buffer between given offsets, optionally containing markup.
  * @param startOffset the offset to start from
@@ -597,6 +1250,17 @@ class VBufStorage_buffer_t {
  */
 	virtual VBufStorage_textContainer_t*  getTextInRange(int startOffset, int endOffset, bool useMarkup=false);
 
+/**
+ * Writes the text in the buffer between given offsets, optionally containing markup, in to a sink.
+ * To fetch the text with a single allocation, first pass a sink that only measures, then allocate that much memory and pass a sink that writes to it, without changing the buffer in between.
+ * @param startOffset the offset to start from
+ * @param endOffset the offset to end at.
+ * @param sink where to place the text.
+ * @param useMarkup if true then markup is included in the text denoting field starts and ends.
+ * @return true if successfull, false if the offsets are not valid.
+ */
+	virtual bool getTextInRange(int startOffset, int endOffset, VBufStorage_textSink_t& sink, bool useMarkup=false);
+
 /**
  * Expands the given offset to the start and end offsets of the containing line.
  * @param offset the offset to expand.
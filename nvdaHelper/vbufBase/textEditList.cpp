@@ -0,0 +1,89 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+
+#include <common/log.h>
+#include "textEditList.h"
+
+using namespace std;
+
+VBufStorage_textEditList_t::VBufStorage_textEditList_t(): edits() {
+}
+
+void VBufStorage_textEditList_t::add(int start, int end, int newLength) {
+	nhAssert(start>=0&&start<=end&&newLength>=0);
+	//The change in length made by the spans before the one being looked at, which moves current offsets away from original ones
+	int delta=0;
+	vector<VBufStorage_textEdit_t>::iterator first=edits.begin();
+	while(first!=edits.end()&&first->oldStart+delta+first->newLength<start) {
+		delta+=first->newLength-(first->oldEnd-first->oldStart);
+		++first;
+	}
+	VBufStorage_textEdit_t merged;
+	merged.oldStart=start-delta;
+	merged.oldEnd=end-delta;
+	//The current offsets spanned by the edit together with the spans it overlaps or touches
+	int mergedStart=start, mergedEnd=end;
+	vector<VBufStorage_textEdit_t>::iterator last=first;
+	for(;last!=edits.end()&&last->oldStart+delta<=end;++last) {
+		int currentStart=last->oldStart+delta;
+		int currentEnd=currentStart+last->newLength;
+		if(currentStart<=mergedStart) {
+			mergedStart=currentStart;
+			merged.oldStart=last->oldStart;
+		}
+		delta+=last->newLength-(last->oldEnd-last->oldStart);
+		if(currentEnd>=mergedEnd) {
+			mergedEnd=currentEnd;
+			merged.oldEnd=last->oldEnd;
+		} else {
+			//Text after this span up to the end of the edit was not changed before, so it is where it was apart from the spans before it
+			merged.oldEnd=end-delta;
+		}
+	}
+	merged.newLength=(mergedEnd-mergedStart)-(end-start)+newLength;
+	if(first==last) {
+		edits.insert(first,merged);
+	} else {
+		*first=merged;
+		edits.erase(first+1,last);
+	}
+	if(edits.size()>maxEdits) {
+		//The text between the spans is counted as replaced by itself
+		int totalDelta=0;
+		for(vector<VBufStorage_textEdit_t>::const_iterator i=edits.begin();i!=edits.end();++i) {
+			totalDelta+=i->newLength-(i->oldEnd-i->oldStart);
+		}
+		VBufStorage_textEdit_t whole=edits.front();
+		whole.oldEnd=edits.back().oldEnd;
+		whole.newLength=whole.oldEnd-whole.oldStart+totalDelta;
+		edits.assign(1,whole);
+	}
+}
+
+void VBufStorage_textEditList_t::add(const VBufStorage_textEditList_t& other) {
+	nhAssert(&other!=this);
+	//Adding the spans from the end backwards means the offsets of the spans still to be added are not moved by the ones already added
+	for(vector<VBufStorage_textEdit_t>::const_reverse_iterator i=other.edits.rbegin();i!=other.edits.rend();++i) {
+		this->add(i->oldStart,i->oldEnd,i->newLength);
+	}
+}
+
+void VBufStorage_textEditList_t::clear() {
+	edits.clear();
+}
+
+void VBufStorage_textEditList_t::swap(VBufStorage_textEditList_t& other) {
+	edits.swap(other.edits);
+}
@@ -0,0 +1,103 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+
+#ifndef VIRTUALBUFFER_TEXTEDITLIST_H
+#define VIRTUALBUFFER_TEXTEDITLIST_H
+
+#include <vector>
+
+/**
+ * A span of a buffer's text that was replaced.
+ */
+typedef struct {
+	/**
+	 * The offset in the text before the edit where the replaced text started.
+	 */
+	int oldStart;
+	/**
+	 * The offset in the text before the edit where the replaced text ended.
+	 */
+	int oldEnd;
+	/**
+	 * The length of the text that replaced it.
+	 */
+	int newLength;
+} VBufStorage_textEdit_t;
+
+/**
+ * Collects the edits made to a buffer's text one after another, as the smallest set of spans of the original text that were replaced.
+ * Each edit is given in offsets of the text as it is at that moment, after all the edits added before it.
+ * Edits that overlap or touch are merged, so that the spans never overlap and are always in order.
+ * A client holding offsets in to the original text can move any offset outside the spans by the change in length of the spans before it.
+ * So that a list nobody collects stays small, once it has more than maxEdits spans they are merged in to one covering all of them.
+ */
+class VBufStorage_textEditList_t {
+	private:
+
+/**
+ * The most spans a list keeps before merging them in to one.
+ */
+	static const size_t maxEdits=256;
+
+/**
+ * The spans, in order, in offsets of the original text.
+ */
+	std::vector<VBufStorage_textEdit_t> edits;
+
+	public:
+
+/**
+ * constructor.
+ */
+	VBufStorage_textEditList_t();
+
+/**
+ * Adds an edit.
+ * An edit with no length that inserts nothing still marks a change at that offset, for instance to the fields around it.
+ * @param start the offset in the current text where the replaced text starts.
+ * @param end the offset in the current text where the replaced text ends.
+ * @param newLength the length of the text that replaced it.
+ */
+	void add(int start, int end, int newLength);
+
+/**
+ * Adds the edits of a list whose original text is the current text of this list, so that this list covers both.
+ * @param other the list whose edits should be added.
+ */
+	void add(const VBufStorage_textEditList_t& other);
+
+/**
+ * @return the spans of the original text that were replaced, in order.
+ */
+	inline const std::vector<VBufStorage_textEdit_t>& getEdits() const { return edits; }
+
+/**
+ * @return true if no edits have been added.
+ */
+	inline bool empty() const { return edits.empty(); }
+
+/**
+ * Forgets all edits, so that the current text becomes the original text.
+ */
+	void clear();
+
+/**
+ * Exchanges the edits of this list with those of another.
+ */
+	void swap(VBufStorage_textEditList_t& other);
+
+};
+
+#endif
@@ -0,0 +1,173 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include <cstdlib>
+#include <cwchar>
+#include <common/log.h>
+#include "textPool.h"
+
+/**
+ * The amount of characters in the first block of a pool.
+ */
+#define TEXTPOOL_MINBLOCKCAPACITY 256
+
+/**
+ * The most characters a block that is shared between nodes can have.
+ * Text longer than a quarter of this is given a block of its own, so that it does not waste the rest of the current block.
+ */
+#define TEXTPOOL_MAXBLOCKCAPACITY 32768
+
+/**
+ * The longest text that is only stored once per block.
+ */
+#define TEXTPOOL_MAXSHAREDLENGTH 16
+
+/**
+ * How many characters of a pool may be unused before it needs compacting, on top of as many characters as are used.
+ * This is more than compacting itself can leave unused, so that a pool is never compacted over and over again.
+ */
+#define TEXTPOOL_COMPACTSLACK (2*TEXTPOOL_MAXBLOCKCAPACITY)
+
+/**
+ * The empty text, which needs no block.
+ */
+const wchar_t emptyText[]=L"";
+
+void VBufStorage_textBlock_t::release() {
+	nhAssert(refCount>0);
+	if(--refCount>0) return;
+	if(pool) pool->unlinkBlock(this);
+	LOG_DEBUG(L"Freeing text block of "<<capacity<<L" characters");
+	free(this);
+}
+
+VBufStorage_textPool_t::VBufStorage_textPool_t(): firstBlock(NULL), currentBlock(NULL), nextBlockCapacity(TEXTPOOL_MINBLOCKCAPACITY), capacity(0), sharedStrings() {
+}
+
+VBufStorage_textPool_t::~VBufStorage_textPool_t() {
+	this->retireCurrentBlock();
+	//Any remaining blocks are freed by the nodes still using them
+	while(this->firstBlock) {
+		VBufStorage_textBlock_t* block=this->firstBlock;
+		this->unlinkBlock(block);
+		block->pool=NULL;
+	}
+}
+
+void VBufStorage_textPool_t::linkBlock(VBufStorage_textBlock_t* block) {
+	block->pool=this;
+	block->previous=NULL;
+	block->next=this->firstBlock;
+	if(this->firstBlock) this->firstBlock->previous=block;
+	this->firstBlock=block;
+	this->capacity+=block->capacity;
+}
+
+void VBufStorage_textPool_t::unlinkBlock(VBufStorage_textBlock_t* block) {
+	nhAssert(block->pool==this);
+	if(block->previous) block->previous->next=block->next; else this->firstBlock=block->next;
+	if(block->next) block->next->previous=block->previous;
+	block->previous=block->next=NULL;
+	this->capacity-=block->capacity;
+}
+
+VBufStorage_textBlock_t* VBufStorage_textPool_t::allocateBlock(size_t blockCapacity) {
+	VBufStorage_textBlock_t* block=static_cast<VBufStorage_textBlock_t*>(malloc(sizeof(VBufStorage_textBlock_t)+blockCapacity*sizeof(wchar_t)));
+	if(!block) {
+		LOG_ERROR(L"Could not allocate text block of "<<blockCapacity<<L" characters");
+		return NULL;
+	}
+	block->refCount=1;
+	block->capacity=blockCapacity;
+	block->used=0;
+	this->linkBlock(block);
+	return block;
+}
+
+void VBufStorage_textPool_t::retireCurrentBlock() {
+	this->sharedStrings.clear();
+	if(this->currentBlock) {
+		VBufStorage_textBlock_t* block=this->currentBlock;
+		this->currentBlock=NULL;
+		block->release();
+	}
+}
+
+const wchar_t* VBufStorage_textPool_t::add(const wchar_t* text, size_t length, VBufStorage_textBlock_t** block) {
+	nhAssert(block);
+	if(length==0) {
+		*block=NULL;
+		return emptyText;
+	}
+	bool shared=(length<=TEXTPOOL_MAXSHAREDLENGTH);
+	std::wstring sharedKey;
+	if(shared) {
+		sharedKey.assign(text,length);
+		if(this->currentBlock) {
+			std::unordered_map<std::wstring,const wchar_t*>::const_iterator i=this->sharedStrings.find(sharedKey);
+			if(i!=this->sharedStrings.end()) {
+				this->currentBlock->addRef();
+				*block=this->currentBlock;
+				return i->second;
+			}
+		}
+	}
+	if(length>TEXTPOOL_MAXBLOCKCAPACITY/4) {
+		//Long text gets a block of its own, which is freed as soon as its node is
+		VBufStorage_textBlock_t* ownBlock=this->allocateBlock(length);
+		if(!ownBlock) return NULL;
+		wmemcpy(ownBlock->getChars(),text,length);
+		ownBlock->used=length;
+		*block=ownBlock;
+		return ownBlock->getChars();
+	}
+	if(!this->currentBlock||this->currentBlock->capacity-this->currentBlock->used<length) {
+		this->retireCurrentBlock();
+		size_t blockCapacity=this->nextBlockCapacity;
+		while(blockCapacity<length) blockCapacity*=2;
+		//The block's first reference is the pool's, for as long as it is the current block
+		this->currentBlock=this->allocateBlock(blockCapacity);
+		if(!this->currentBlock) return NULL;
+		if(blockCapacity*2<=TEXTPOOL_MAXBLOCKCAPACITY) this->nextBlockCapacity=blockCapacity*2;
+		LOG_DEBUG(L"Allocated new text block of "<<blockCapacity<<L" characters");
+	}
+	wchar_t* chars=this->currentBlock->getChars()+this->currentBlock->used;
+	wmemcpy(chars,text,length);
+	this->currentBlock->used+=length;
+	this->currentBlock->addRef();
+	if(shared) this->sharedStrings.insert(std::make_pair(sharedKey,chars));
+	*block=this->currentBlock;
+	return chars;
+}
+
+void VBufStorage_textPool_t::adopt(VBufStorage_textPool_t& other) {
+	if(&other==this) return;
+	other.retireCurrentBlock();
+	while(other.firstBlock) {
+		VBufStorage_textBlock_t* block=other.firstBlock;
+		other.unlinkBlock(block);
+		this->linkBlock(block);
+	}
+	other.nextBlockCapacity=TEXTPOOL_MINBLOCKCAPACITY;
+}
+
+void VBufStorage_textPool_t::reset(size_t expectedLength) {
+	this->retireCurrentBlock();
+	this->nextBlockCapacity=TEXTPOOL_MINBLOCKCAPACITY;
+	while(this->nextBlockCapacity<expectedLength&&this->nextBlockCapacity*2<=TEXTPOOL_MAXBLOCKCAPACITY) this->nextBlockCapacity*=2;
+}
+
+bool VBufStorage_textPool_t::needsCompacting(size_t usedLength) const {
+	return this->capacity>2*usedLength+TEXTPOOL_COMPACTSLACK;
+}
@@ -0,0 +1,184 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef VIRTUALBUFFER_TEXTPOOL_H
+#define VIRTUALBUFFER_TEXTPOOL_H
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+
+class VBufStorage_textPool_t;
+
+/**
+ * A block of memory holding the text of many text field nodes one after another.
+ * Text in a block never changes once added.
+ * A block counts the references to it and frees itself once the last one is released.
+ * A block belongs to one pool, but can be handed over to another pool without moving the text it holds.
+ */
+class VBufStorage_textBlock_t {
+	private:
+
+/**
+ * The pool this block currently belongs to, or NULL if the pool has been destroyed.
+ */
+	VBufStorage_textPool_t* pool;
+
+/**
+ * The blocks before and after this one in its pool's list of blocks.
+ */
+	VBufStorage_textBlock_t* previous;
+	VBufStorage_textBlock_t* next;
+
+/**
+ * The amount of references to this block: one for each text field node whose text is in it, and one for the pool while it is still adding text to it.
+ */
+	size_t refCount;
+
+/**
+ * The amount of characters that fit in this block.
+ */
+	size_t capacity;
+
+/**
+ * The amount of characters at the start of this block that hold text.
+ */
+	size_t used;
+
+/**
+ * @return the address of the first character in this block.
+ */
+	inline wchar_t* getChars() { return reinterpret_cast<wchar_t*>(this+1); }
+
+	friend class VBufStorage_textPool_t;
+
+	public:
+
+/**
+ * Adds a reference to this block.
+ */
+	inline void addRef() { ++refCount; }
+
+/**
+ * Releases a reference to this block, freeing it if that was the last one.
+ */
+	void release();
+
+};
+
+/**
+ * Stores the text of a buffer's text field nodes in large blocks, rather than making a separate heap allocation for each node's text.
+ * Text is added to the end of the current block, so the text of nodes added one after another is also next to each other in memory.
+ * Short strings are only stored once per block, as backends add the same spaces, bullets and labels over and over again.
+ * Blocks grow geometrically, so small buffers stay small while large buffers need only a few allocations.
+ * A block is only freed once all the text in it is unused, so a buffer whose content keeps changing should compact its text once needsCompacting says so.
+ */
+class VBufStorage_textPool_t {
+	private:
+
+/**
+ * The list of blocks in this pool.
+ */
+	VBufStorage_textBlock_t* firstBlock;
+
+/**
+ * The block text is currently being added to, or NULL if there is none.
+ */
+	VBufStorage_textBlock_t* currentBlock;
+
+/**
+ * The amount of characters the next new block will have.
+ */
+	size_t nextBlockCapacity;
+
+/**
+ * The total amount of characters that fit in all the blocks of this pool.
+ */
+	size_t capacity;
+
+/**
+ * The short strings already in currentBlock, so they can be shared rather than added again.
+ */
+	std::unordered_map<std::wstring,const wchar_t*> sharedStrings;
+
+/**
+ * Allocates an empty block in this pool.
+ * @param blockCapacity the amount of characters the block should hold.
+ * @return the block, holding a single reference for the caller, or NULL if no memory could be allocated.
+ */
+	VBufStorage_textBlock_t* allocateBlock(size_t blockCapacity);
+
+	void linkBlock(VBufStorage_textBlock_t* block);
+
+	void unlinkBlock(VBufStorage_textBlock_t* block);
+
+/**
+ * Stops adding text to the current block, releasing the pool's reference to it.
+ */
+	void retireCurrentBlock();
+
+	VBufStorage_textPool_t(const VBufStorage_textPool_t&);
+	VBufStorage_textPool_t& operator=(const VBufStorage_textPool_t&);
+
+	friend class VBufStorage_textBlock_t;
+
+	public:
+
+/**
+ * constructor.
+ */
+	VBufStorage_textPool_t();
+
+/**
+ * Destructor. Blocks still holding the text of existing nodes live on until those nodes are destroyed.
+ */
+	~VBufStorage_textPool_t();
+
+/**
+ * Stores text in the pool.
+ * @param text the text to store.
+ * @param length the length of the text.
+ * @param block memory where the block holding the stored text will be placed, or NULL if the text is empty. The caller owns a reference to this block, which must be released once the text is no longer needed.
+ * @return the stored text, which is not null terminated, or NULL if no memory could be allocated.
+ */
+	const wchar_t* add(const wchar_t* text, size_t length, VBufStorage_textBlock_t** block);
+
+/**
+ * Takes over all the blocks of another pool, leaving the other pool empty.
+ * Text in the adopted blocks stays where it is.
+ * @param other the pool to take the blocks from.
+ */
+	void adopt(VBufStorage_textPool_t& other);
+
+/**
+ * Stops adding text to the current block, so that following text goes in to new blocks.
+ * @param expectedLength the amount of text expected to be added next, so that blocks of a suitable size are allocated, or 0 to start again with small blocks.
+ */
+	void reset(size_t expectedLength=0);
+
+/**
+ * Checks whether so much of the memory in this pool is unused that the text still in use should be moved in to new blocks.
+ * @param usedLength the amount of text still in use.
+ * @return true if the text should be compacted.
+ */
+	bool needsCompacting(size_t usedLength) const;
+
+/**
+ * @return the total amount of characters that fit in all the blocks of this pool.
+ */
+	inline size_t getCapacity() const { return capacity; }
+
+};
+
+#endif
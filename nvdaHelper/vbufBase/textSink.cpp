@@ -0,0 +1,74 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include "textSink.h"
+
+/**
+ * @return true if the character can be written to XML as is.
+ */
+inline bool isPlainXMLChar(wchar_t c) {
+	if(c>=0x20) {
+		return c!=L'"'&&c!=L'<'&&c!=L'>'&&c!=L'&'&&(c<=0xD7FF||(c>=0xE000&&c<=0xFFFD));
+	}
+	return c==0x9||c==0xA||c==0xD;
+}
+
+void VBufStorage_textSink_t::appendNumber(int value) {
+	//Enough for the sign and digits of any int
+	wchar_t digits[24];
+	wchar_t* end=digits+(sizeof(digits)/sizeof(wchar_t));
+	wchar_t* start=end;
+	//Work with the negative value, as the smallest int can not be negated
+	int remaining=(value<0)?value:-value;
+	do {
+		*(--start)=static_cast<wchar_t>(L'0'-(remaining%10));
+		remaining/=10;
+	} while(remaining!=0);
+	if(value<0) *(--start)=L'-';
+	append(start,end-start);
+}
+
+void VBufStorage_textSink_t::appendEscaped(const wchar_t* text, size_t count, bool isAttribute) {
+	const wchar_t* end=text+count;
+	while(text<end) {
+		const wchar_t* run=text;
+		while(text<end&&isPlainXMLChar(*text)) ++text;
+		if(text>run) append(run,text-run);
+		if(text==end) break;
+		switch(*text) {
+			case L'"':
+			append(L"&quot;");
+			break;
+			case L'<':
+			append(L"&lt;");
+			break;
+			case L'>':
+			append(L"&gt;");
+			break;
+			case L'&':
+			append(L"&amp;");
+			break;
+			default:
+			// Invalid XML character.
+			if(isAttribute) {
+				append(static_cast<wchar_t>(0xfffd)); // Unicode replacement character
+			} else {
+				append(L"<unich value=\"");
+				appendNumber(static_cast<unsigned short>(*text));
+				append(L"\" />");
+			}
+		}
+		++text;
+	}
+}
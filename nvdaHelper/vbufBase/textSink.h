@@ -0,0 +1,111 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef VIRTUALBUFFER_TEXTSINK_H
+#define VIRTUALBUFFER_TEXTSINK_H
+
+#include <cstddef>
+#include <cwchar>
+#include <string>
+
+/**
+ * Receives the text generated by getTextInRange.
+ * A sink either only measures the text, or writes it in to memory provided by the caller.
+ * Text is generated once to measure it, and then again to write it in to memory of exactly the right size, so that no intermediate strings are built.
+ * A sink never writes past the memory it was given, but still counts the text it could not write, so a short write can be detected by comparing getLength with the capacity.
+ */
+class VBufStorage_textSink_t {
+	private:
+
+/**
+ * The memory the text is written in to, or NULL if only measuring.
+ */
+	wchar_t* buffer;
+
+/**
+ * The amount of characters that fit in buffer.
+ */
+	size_t capacity;
+
+/**
+ * The amount of characters appended so far, whether or not they fit in buffer.
+ */
+	size_t length;
+
+	public:
+
+/**
+ * constructor. Creates a sink that only measures the text appended to it.
+ */
+	VBufStorage_textSink_t(): buffer(NULL), capacity(0), length(0) {}
+
+/**
+ * constructor. Creates a sink that writes the text appended to it in to the given memory. No null terminator is written.
+ * @param bufferArg the memory to write to.
+ * @param capacityArg the amount of characters that fit in bufferArg.
+ */
+	VBufStorage_textSink_t(wchar_t* bufferArg, size_t capacityArg): buffer(bufferArg), capacity(capacityArg), length(0) {}
+
+/**
+ * @return the amount of characters appended so far.
+ */
+	inline size_t getLength() const { return length; }
+
+/**
+ * Appends characters.
+ * @param text the characters.
+ * @param count the amount of characters.
+ */
+	inline void append(const wchar_t* text, size_t count) {
+		if(length<capacity) wmemcpy(buffer+length,text,(count<capacity-length)?count:capacity-length);
+		length+=count;
+	}
+
+/**
+ * Appends a string literal, whose length is known when compiling.
+ */
+	template<size_t size> inline void append(const wchar_t (&text)[size]) {
+		append(text,size-1);
+	}
+
+	inline void append(const std::wstring& text) {
+		append(text.data(),text.length());
+	}
+
+	inline void append(wchar_t c) {
+		if(length<capacity) buffer[length]=c;
+		++length;
+	}
+
+/**
+ * Appends a number in decimal.
+ */
+	void appendNumber(int value);
+
+/**
+ * Appends text escaped for XML, producing the same output as appendCharToXML for each character.
+ * Runs of characters that need no escaping are appended in one go.
+ * @param text the characters.
+ * @param count the amount of characters.
+ * @param isAttribute true if the text is an attribute value, in which case invalid characters are replaced rather than written as unich tags.
+ */
+	void appendEscaped(const wchar_t* text, size_t count, bool isAttribute=false);
+
+	inline void appendEscaped(const std::wstring& text, bool isAttribute=false) {
+		appendEscaped(text.data(),text.length(),isAttribute);
+	}
+
+};
+
+#endif
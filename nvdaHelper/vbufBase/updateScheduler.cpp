@@ -0,0 +1,65 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include "updateScheduler.h"
+
+VBufBackend_updateScheduler_t::VBufBackend_updateScheduler_t(VBufBackend_clock_t* clockArg): clock(clockArg), pending(false), firstInvalidationTime(0), dueTime(0), hasUrgentDeadline(false), urgentDeadline(0), hasUpdated(false), lastUpdateTime(0), backoffLevel(0), firstDelay(30), maxDelay(400), maxLatency(500), urgentDelay(30), quietPeriod(500) {
+}
+
+int VBufBackend_updateScheduler_t::getCurrentDelay() const {
+	int delay=firstDelay;
+	for(int i=0;i<backoffLevel&&delay<maxDelay;++i) delay*=2;
+	return (delay<maxDelay)?delay:maxDelay;
+}
+
+void VBufBackend_updateScheduler_t::invalidated(bool urgent) {
+	unsigned int now=clock->getTime();
+	if(!pending) {
+		pending=true;
+		firstInvalidationTime=now;
+		if(hasUpdated&&static_cast<int>(now-lastUpdateTime)<quietPeriod) {
+			//Invalidations are still arriving, so wait longer to coalesce more of them
+			if(getCurrentDelay()<maxDelay) ++backoffLevel;
+		} else {
+			backoffLevel=0;
+		}
+	}
+	if(urgent&&!hasUrgentDeadline) {
+		hasUrgentDeadline=true;
+		urgentDeadline=now+urgentDelay;
+	}
+	//Push the update back by the current delay, but never past the deadline of the first invalidation, or of the first urgent one
+	unsigned int deadline=firstInvalidationTime+maxLatency;
+	dueTime=now+getCurrentDelay();
+	if(static_cast<int>(dueTime-deadline)>0) dueTime=deadline;
+	if(hasUrgentDeadline&&static_cast<int>(dueTime-urgentDeadline)>0) dueTime=urgentDeadline;
+}
+
+int VBufBackend_updateScheduler_t::getDelay() const {
+	if(!pending) return -1;
+	int delay=static_cast<int>(dueTime-clock->getTime());
+	return (delay>0)?delay:0;
+}
+
+void VBufBackend_updateScheduler_t::updated() {
+	pending=false;
+	hasUrgentDeadline=false;
+	hasUpdated=true;
+	lastUpdateTime=clock->getTime();
+}
+
+void VBufBackend_updateScheduler_t::cancel() {
+	pending=false;
+	hasUrgentDeadline=false;
+}
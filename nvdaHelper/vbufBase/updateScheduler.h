@@ -0,0 +1,155 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef VIRTUALBUFFER_UPDATESCHEDULER_H
+#define VIRTUALBUFFER_UPDATESCHEDULER_H
+
+/**
+ * A source of the current time for an update scheduler.
+ */
+class VBufBackend_clock_t {
+	public:
+
+	virtual ~VBufBackend_clock_t() {}
+
+/**
+ * @return the current time in milliseconds. The time may wrap around, so only the difference between two times is meaningful.
+ */
+	virtual unsigned int getTime()=0;
+
+};
+
+/**
+ * Decides when a backend should update after its subtrees are invalidated, so that a stream of invalidations is coalesced in to few updates without delaying a single change for long.
+ * The first invalidation after a quiet period is updated after a short delay.
+ * Each further invalidation before the update pushes it back by the current delay, and if invalidations keep arriving soon after updates, the delay is doubled up to a maximum.
+ * No invalidation waits longer than the maximum latency, and an urgent invalidation, such as one of the subtree containing the caret, is never delayed by the backoff.
+ * The scheduler only does the arithmetic: the backend arms a timer for getDelay after each invalidation, and calls updated when it updates.
+ */
+class VBufBackend_updateScheduler_t {
+	private:
+
+/**
+ * The clock times are taken from.
+ */
+	VBufBackend_clock_t* clock;
+
+/**
+ * True if there are invalidations that have not yet been updated.
+ */
+	bool pending;
+
+/**
+ * The time of the first invalidation that has not yet been updated.
+ */
+	unsigned int firstInvalidationTime;
+
+/**
+ * The time the pending update is due.
+ */
+	unsigned int dueTime;
+
+/**
+ * True if an urgent invalidation has not yet been updated.
+ */
+	bool hasUrgentDeadline;
+
+/**
+ * The time the first urgent invalidation that has not yet been updated must be updated by, however many invalidations follow it.
+ */
+	unsigned int urgentDeadline;
+
+/**
+ * True if updated has been called at least once.
+ */
+	bool hasUpdated;
+
+/**
+ * The time of the last update.
+ */
+	unsigned int lastUpdateTime;
+
+/**
+ * The number of times the first delay has been doubled because invalidations keep arriving.
+ */
+	int backoffLevel;
+
+/**
+ * @return the delay, after the last invalidation, before an update that is not urgent.
+ */
+	int getCurrentDelay() const;
+
+	public:
+
+/**
+ * The delay in milliseconds before updating an invalidation that follows a quiet period.
+ */
+	int firstDelay;
+
+/**
+ * The longest delay in milliseconds the backoff may grow to.
+ */
+	int maxDelay;
+
+/**
+ * The longest time in milliseconds an invalidation may wait for an update.
+ */
+	int maxLatency;
+
+/**
+ * The delay in milliseconds before updating an urgent invalidation.
+ */
+	int urgentDelay;
+
+/**
+ * If the first invalidation after an update arrives within this many milliseconds of it, the delay is backed off, otherwise it goes back to the first delay.
+ */
+	int quietPeriod;
+
+/**
+ * constructor.
+ * @param clockArg the clock times are taken from, which must outlive the scheduler.
+ */
+	VBufBackend_updateScheduler_t(VBufBackend_clock_t* clockArg);
+
+/**
+ * Notes that a subtree has been invalidated and moves the pending update accordingly.
+ * @param urgent true if the update should not be delayed by the backoff, such as when the subtree contains the caret.
+ */
+	void invalidated(bool urgent=false);
+
+/**
+ * @return true if there are invalidations that have not yet been updated.
+ */
+	inline bool isPending() const { return pending; }
+
+/**
+ * @return the number of milliseconds until the pending update is due, 0 if it is due now, or -1 if there is no pending update.
+ */
+	int getDelay() const;
+
+/**
+ * Notes that the backend is updating, so that all invalidations so far are taken care of.
+ * This should be called before the update starts, so that invalidations which arrive during it schedule another.
+ */
+	void updated();
+
+/**
+ * Forgets the pending update without counting it as an update, for instance when the backend is updated by other means or terminated.
+ */
+	void cancel();
+
+};
+
+#endif
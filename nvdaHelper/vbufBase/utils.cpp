@@ -14,6 +14,7 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 
 #include <cwctype>
 #include <string>
+#include <algorithm>
 #include <map>
 #include "utils.h"
 
@@ -28,7 +29,7 @@ wstring getNameForURL(const wstring &url) {
 	if (colonPos != wstring::npos && url.compare(colonPos, 3, L"://") != 0) {
 		// This URL specifies a protocol, but it is not a path-based protocol; e.g. it is a javascript: or mailto: URL.
 		wstring imgCheck = url.substr(0, 11);
-		transform(imgCheck.begin(), imgCheck.end(), imgCheck.begin(), tolower);
+		transform(imgCheck.begin(), imgCheck.end(), imgCheck.begin(), ::towlower);
 		if (imgCheck.compare(0, 11, L"data:image/") == 0)
 			return L""; // This URL is not useful.
 		// Return the URL as is with the protocol stripped.
@@ -58,12 +59,12 @@ wstring getNameForURL(const wstring &url) {
 		pathEnd = anchorStart;
 	else
 		pathEnd = url.length();
-	// wstring::npos for pathEnd means no path.
-	pathEnd = (pathEnd >= 0) ? (pathEnd - 1) : wstring::npos;
+	// wstring::npos for pathEnd means no path, which going back from 0 gives.
+	pathEnd = pathEnd - 1;
 
 	if (pathEnd != wstring::npos && url[pathEnd] == L'/') {
 		// The path ends with a '/', so go back one, as an empty path component is useless.
-		pathEnd = (pathEnd >= 0) ? (pathEnd - 1) : wstring::npos;
+		pathEnd = pathEnd - 1;
 		// This path component is not a filename, so don't strip the extension.
 		stripExten = false;
 	}
@@ -151,11 +152,12 @@ bool nodeHasUsefulContent(VBufStorage_fieldNode_t* node) {
 		return false;
 	if (length > 3)
 		return true;
-	wstring content;
-	node->getTextInRange(0, length, content, false);
-	for(wstring::iterator i=content.begin();i!=content.end();++i) {
-		if(!iswspace(*i)&&!isPrivateCharacter(*i)) {
-			return true;
+	for(VBufStorage_textRangeIterator_t i(node);i.isValid();i.next()) {
+		const VBufStorage_textView_t& view=i.getView();
+		for(int j=0;j<view.length;++j) {
+			if(!iswspace(view.text[j])&&!isPrivateCharacter(view.text[j])) {
+				return true;
+			}
 		}
 	}
 	return false;
@@ -0,0 +1,147 @@
+/**
+ * tests/backend/parallelRender.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007, 2008 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+#include <iostream>
+#include <string>
+#include <sstream>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <remote/nvdaHelperRemote.h>
+#include <remote/nvdaControllerInternal.h>
+#include <vbufBase/backend.h>
+#include <vbufBase/renderExecutor.h>
+
+using namespace std;
+
+#define SECTIONCOUNT 64
+#define PARAGRAPHSPERSECTION 20
+#define RENDERDELAY 5
+#define RENDERTHREADCOUNT 8
+#define DOCHANDLE 1
+#define ROOTID 1
+
+//The backend is not injected in to an application here, so the calls it makes to NVDA and the hooks it sets do nothing
+bool registerWinEventHook(WINEVENTPROC hookProc) { return true; }
+bool unregisterWinEventHook(WINEVENTPROC hookProc) { return true; }
+bool registerWindowsHook(int hookType, HOOKPROC hookProc) { return true; }
+bool unregisterWindowsHook(int hookType, HOOKPROC hookProc) { return true; }
+error_status_t __stdcall nvdaControllerInternal_vbufEditsNotify(const int rootDocHandle, const int rootID, const int editCount, const int* edits) { return 0; }
+
+/**
+ * Rendering mostly waits, so the time is measured by the clock rather than by the processor time used.
+ */
+DWORD elapsedMS(DWORD start) {
+	return GetTickCount()-start;
+}
+
+int sectionID(int section) {
+	return 2+section*(PARAGRAPHSPERSECTION+1);
+}
+
+/**
+ * A backend rendering a document of sections, each of which has a version that changes its text.
+ * Rendering a section waits a little, like a real backend fetching content from an application.
+ * Its render method can be called on any thread, so it can render with an executor.
+ * As rendering mostly waits for the application, the executor uses more threads than there may be processors.
+ */
+class mockBackend_t: public VBufBackend_t {
+	private:
+
+	VBufBackend_threadRenderExecutor_t executor;
+
+	volatile long activeRenderCount;
+
+	void renderSection(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int section) {
+		long activeCount=InterlockedIncrement(&activeRenderCount);
+		//Raise the maximum, trying again if another thread changes it first
+		for(long maxCount=maxActiveRenderCount;activeCount>maxCount;maxCount=maxActiveRenderCount) {
+			InterlockedCompareExchange(&maxActiveRenderCount,activeCount,maxCount);
+		}
+		Sleep(RENDERDELAY);
+		VBufStorage_controlFieldNode_t* sectionNode=buffer->addControlFieldNode(parent,previous,DOCHANDLE,sectionID(section),true);
+		sectionNode->addAttribute(L"role",L"section");
+		VBufStorage_fieldNode_t* previousParagraph=NULL;
+		for(int i=0;i<PARAGRAPHSPERSECTION;++i) {
+			VBufStorage_controlFieldNode_t* paragraph=buffer->addControlFieldNode(sectionNode,previousParagraph,DOCHANDLE,sectionID(section)+1+i,true);
+			wostringstream s;
+			s<<L"section "<<section<<L" paragraph "<<i<<L" version "<<versions[section]<<L" ";
+			buffer->addTextFieldNode(paragraph,NULL,s.str());
+			previousParagraph=paragraph;
+		}
+		InterlockedDecrement(&activeRenderCount);
+	}
+
+	protected:
+
+	virtual void render(VBufStorage_buffer_t* buffer, int docHandle, int ID, VBufStorage_controlFieldNode_t* oldNode=NULL) {
+		if(ID!=ROOTID) {
+			renderSection(buffer,NULL,NULL,(ID-sectionID(0))/(PARAGRAPHSPERSECTION+1));
+			return;
+		}
+		VBufStorage_controlFieldNode_t* document=buffer->addControlFieldNode(NULL,NULL,DOCHANDLE,ROOTID,true);
+		document->addAttribute(L"role",L"document");
+		for(int i=0;i<SECTIONCOUNT;++i) {
+			renderSection(buffer,document,document->getLastChild(),i);
+		}
+	}
+
+	public:
+
+	int versions[SECTIONCOUNT];
+
+	volatile long maxActiveRenderCount;
+
+	mockBackend_t(bool useExecutor): VBufBackend_t(DOCHANDLE,ROOTID), executor(RENDERTHREADCOUNT), activeRenderCount(0), maxActiveRenderCount(0) {
+		for(int i=0;i<SECTIONCOUNT;++i) versions[i]=0;
+		if(useExecutor) this->renderExecutor=&executor;
+	}
+
+	void changeSection(int section) {
+		++versions[section];
+		this->invalidateSubtree(this->getControlFieldNodeWithIdentifier(DOCHANDLE,sectionID(section)));
+	}
+
+};
+
+int main(int argc, char* argv[]) {
+	int failCount=0;
+	mockBackend_t* backends[2]={new mockBackend_t(false),new mockBackend_t(true)};
+	wstring texts[2];
+	for(int i=0;i<2;++i) {
+		mockBackend_t* backend=backends[i];
+		backend->forceUpdate();
+		backend->maxActiveRenderCount=0;
+		//Change every other section, in a different order each time
+		DWORD start=GetTickCount();
+		for(int j=0;j<SECTIONCOUNT;j+=2) backend->changeSection(j);
+		for(int j=SECTIONCOUNT-1;j>=0;j-=4) backend->changeSection(j);
+		backend->forceUpdate();
+		wcout<<((i==0)?L"render thread":L"executor")<<L": updated "<<(SECTIONCOUNT/2+SECTIONCOUNT/4)<<L" sections in "<<elapsedMS(start)<<L" ms, at most "<<backend->maxActiveRenderCount<<L" at once"<<endl;
+		VBufStorage_textContainer_t* text=backend->getTextInRange(0,backend->getTextLength(),true);
+		if(text) {
+			texts[i]=text->getString();
+			text->destroy();
+		}
+	}
+	if(texts[0]!=texts[1]) {
+		wcerr<<L"fail: rendering with an executor gave different content"<<endl;
+		++failCount;
+	}
+	if(texts[0].find(L"section 0 paragraph 0 version 1 ")==wstring::npos||texts[0].find(L"section 3 paragraph 0 version 1 ")==wstring::npos||texts[0].find(L"section 1 paragraph 0 version 0 ")==wstring::npos) {
+		wcerr<<L"fail: changed sections not updated"<<endl;
+		++failCount;
+	}
+	for(int i=0;i<2;++i) {
+		backends[i]->clearBuffer();
+		backends[i]->destroy();
+	}
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
@@ -0,0 +1,337 @@
+/**
+ * tests/benchmark/benchmark.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007, 2008 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+/**
+ * Times the operations of the virtual buffer storage on synthetic documents of several shapes.
+ * Results are written to stdout as comma separated values, one line per shape and operation, so that they can be compared between releases.
+ * The best time of several rounds is given for each operation, to keep out noise from the rest of the system.
+ * The heap a document takes up once it is built is given with each shape, or -1 where the C runtime cannot say.
+ * Usage: test_benchmark [scale], where scale multiplies the amount of items in each document (1 by default).
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <iomanip>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <cstdlib>
+#include <ctime>
+#include <chrono>
+#include <thread>
+#if defined(_WIN32)||defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include <common/lock.h>
+#include <vbufBase/storage.h>
+#include <vbufBase/invalidSubtreeList.h>
+#include "treeGenerators.h"
+
+using namespace std;
+
+#define ROUNDCOUNT 3
+#define QUERYCOUNT 5000
+#define UPDATECOUNT 200
+#define SMALLRANGELENGTH 200
+#define MAXLINELENGTH 100
+#define READERCOUNT 4
+
+//Queries as NVDA makes them for quick navigation, with the colons in attribute names escaped
+#define HEADINGORLINKREGEXP L"IAccessible\\\\:\\\\:role:(?:1044;|30;)"
+#define CONTAINERREGEXP L"IAccessible\\\\:\\\\:role:(?:1054;|34;|29;|1060;)"
+
+/**
+ * The time taken by one operation on one shape, over however many iterations it was done.
+ */
+typedef struct {
+	wstring operation;
+	long long iterations;
+	double totalMs;
+} timing_t;
+
+double elapsedMS(clock_t start) {
+	return (clock()-start)*1000.0/CLOCKS_PER_SEC;
+}
+
+/**
+ * The wall clock time since start, as clock gives the processor time of all threads on some systems.
+ */
+double elapsedWallMS(chrono::steady_clock::time_point start) {
+	return chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+}
+
+/**
+ * Records the time of an operation, keeping only the best of the rounds it was done in.
+ */
+void record(vector<timing_t>& timings, const wstring& operation, long long iterations, double ms) {
+	for(vector<timing_t>::iterator i=timings.begin();i!=timings.end();++i) {
+		if(i->operation==operation) {
+			if(ms<i->totalMs) {
+				i->iterations=iterations;
+				i->totalMs=ms;
+			}
+			return;
+		}
+	}
+	timing_t timing={operation,iterations,ms};
+	timings.push_back(timing);
+}
+
+/**
+ * @return the bytes of heap in use, or -1 if the C runtime cannot say.
+ */
+long long heapInUse() {
+#if defined(_WIN32)
+	long long used=0;
+	_HEAPINFO info;
+	info._pentry=NULL;
+	while(_heapwalk(&info)==_HEAPOK) {
+		if(info._useflag==_USEDENTRY) used+=info._size;
+	}
+	return used;
+#elif defined(__GLIBC__)&&(__GLIBC__>2||(__GLIBC__==2&&__GLIBC_MINOR__>=33))
+	return static_cast<long long>(mallinfo2().uordblks);
+#elif defined(__GLIBC__)
+	return static_cast<unsigned int>(mallinfo().uordblks);
+#else
+	return -1;
+#endif
+}
+
+int randomOffset(int textLength) {
+	return static_cast<int>(((unsigned long long)rand()*(RAND_MAX+1ULL)+rand())%textLength);
+}
+
+/**
+ * Makes the reads NVDA makes when the caret moves, each with shared access to the buffer, as the remote vbuf functions take it.
+ * @return the amount of failed checks.
+ */
+int readAtOffsets(VBufStorage_buffer_t* buffer, SharedLockableObject* lock, const vector<int>* offsets, size_t first, size_t step) {
+	int failCount=0;
+	for(size_t i=first;i<offsets->size();i+=step) {
+		int offset=(*offsets)[i];
+		lock->acquireShared();
+		int lineStart=0, lineEnd=0;
+		if(!buffer->getLineOffsets(offset,(i%2)?0:MAXLINELENGTH,false,&lineStart,&lineEnd)||offset<lineStart||offset>=lineEnd) ++failCount;
+		int nodeStart=0, nodeEnd=0, docHandle=0, ID=0;
+		VBufStorage_controlFieldNode_t* node=buffer->locateControlFieldNodeAtOffset(offset,&nodeStart,&nodeEnd,&docHandle,&ID);
+		if(!node||!buffer->getFieldNodeOffsets(node,&nodeStart,&nodeEnd)||offset<nodeStart||offset>=nodeEnd) ++failCount;
+		lock->releaseShared();
+	}
+	return failCount;
+}
+
+/**
+ * Builds a document of the given shape, times each operation on it and then clears it.
+ * @return the amount of failed checks.
+ */
+int runRound(const treeShape_t& shape, int itemCount, vector<timing_t>& timings, int* nodeCount, int* textLength, long long* heapBytes) {
+	int failCount=0;
+	long long heapBefore=heapInUse();
+	VBufStorage_buffer_t* buffer=new VBufStorage_buffer_t();
+	buffer->setIndexedAttributes(vector<wstring>(indexedAttributeNames,indexedAttributeNames+indexedAttributeNameCount));
+	clock_t start=clock();
+	*nodeCount=generateTree(buffer,shape,itemCount);
+	record(timings,L"addFieldNodes",*nodeCount,elapsedMS(start));
+	*heapBytes=(heapBefore<0)?-1:heapInUse()-heapBefore;
+	*textLength=buffer->getTextLength();
+	vector<int> offsets;
+	for(int i=0;i<QUERYCOUNT;++i) {
+		offsets.push_back(randomOffset(*textLength));
+	}
+	//Fetch the whole text, as is done for say all or when searching
+	for(int useMarkup=0;useMarkup<2;++useMarkup) {
+		start=clock();
+		VBufStorage_textSink_t measuringSink;
+		if(!buffer->getTextInRange(0,*textLength,measuringSink,useMarkup!=0)) ++failCount;
+		wstring text(measuringSink.getLength(),L'\0');
+		VBufStorage_textSink_t sink(&text[0],text.length());
+		if(!buffer->getTextInRange(0,*textLength,sink,useMarkup!=0)) ++failCount;
+		record(timings,useMarkup?L"getTextInRange markup whole":L"getTextInRange plain whole",*textLength,elapsedMS(start));
+		if(!useMarkup&&static_cast<int>(text.length())!=*textLength) {
+			wcerr<<L"fail: "<<shape.name<<L" text is "<<text.length()<<L" characters rather than "<<*textLength<<endl;
+			++failCount;
+		}
+	}
+	//Fetch small ranges with markup, as is done when moving by line or reading the focus
+	start=clock();
+	for(vector<int>::iterator i=offsets.begin();i!=offsets.end();++i) {
+		VBufStorage_textSink_t measuringSink;
+		if(!buffer->getTextInRange(*i,min(*i+SMALLRANGELENGTH,*textLength),measuringSink,true)) ++failCount;
+	}
+	record(timings,L"getTextInRange markup small",QUERYCOUNT,elapsedMS(start));
+	//Move through the document by line twice, the second time with the lines already cached
+	for(int pass=0;pass<2;++pass) {
+		start=clock();
+		long long lineCount=0;
+		for(int offset=0;offset<*textLength;++lineCount) {
+			int lineStart, lineEnd;
+			if(!buffer->getLineOffsets(offset,MAXLINELENGTH,false,&lineStart,&lineEnd)||lineEnd<=offset) {
+				wcerr<<L"fail: "<<shape.name<<L" has no line at offset "<<offset<<endl;
+				++failCount;
+				break;
+			}
+			offset=lineEnd;
+		}
+		record(timings,pass?L"getLineOffsets cached":L"getLineOffsets cold",lineCount,elapsedMS(start));
+	}
+	//Quick navigation to the next or previous heading or link, and to the container of the caret
+	const VBufStorage_findDirection_t directions[]={VBufStorage_findDirection_forward,VBufStorage_findDirection_back,VBufStorage_findDirection_up};
+	const wchar_t* directionNames[]={L"findNodeByAttributes forward",L"findNodeByAttributes back",L"findNodeByAttributes up"};
+	for(int d=0;d<3;++d) {
+		start=clock();
+		for(vector<int>::iterator i=offsets.begin();i!=offsets.end();++i) {
+			int foundStart=0, foundEnd=0;
+			VBufStorage_fieldNode_t* node=buffer->findNodeByAttributes(*i,directions[d],L"IAccessible::role",(directions[d]==VBufStorage_findDirection_up)?CONTAINERREGEXP:HEADINGORLINKREGEXP,&foundStart,&foundEnd);
+			if(node&&((directions[d]==VBufStorage_findDirection_forward&&foundStart<=*i)||(directions[d]==VBufStorage_findDirection_back&&foundStart>=*i)||(directions[d]==VBufStorage_findDirection_up&&(foundStart>*i||foundEnd<=*i)))) {
+				wcerr<<L"fail: "<<shape.name<<L" "<<directionNames[d]<<L" from "<<*i<<L" found "<<foundStart<<L" to "<<foundEnd<<endl;
+				++failCount;
+			}
+		}
+		record(timings,directionNames[d],QUERYCOUNT,elapsedMS(start));
+	}
+	//Look up items by identifier, as a backend does for every object it renders and every object that changes
+	vector<int> items;
+	for(int i=0;i<QUERYCOUNT;++i) {
+		items.push_back(rand()%itemCount);
+	}
+	start=clock();
+	for(vector<int>::iterator i=items.begin();i!=items.end();++i) {
+		if(!buffer->getControlFieldNodeWithIdentifier(DOCHANDLE,itemID(*i))) {
+			wcerr<<L"fail: "<<shape.name<<L" has no item "<<*i<<endl;
+			++failCount;
+			break;
+		}
+	}
+	record(timings,L"getControlFieldNodeWithIdentifier",QUERYCOUNT,elapsedMS(start));
+	//Find where nodes are, as is done for the caret and for every node quick navigation finds, then again once an insert has made part of the child offset indexes stale
+	vector<VBufStorage_fieldNode_t*> nodes;
+	for(vector<int>::iterator i=offsets.begin();i!=offsets.end();++i) {
+		int nodeStart=0, nodeEnd=0;
+		nodes.push_back(buffer->locateTextFieldNodeAtOffset(*i,&nodeStart,&nodeEnd));
+	}
+	for(int pass=0;pass<2;++pass) {
+		VBufStorage_textFieldNode_t* inserted=NULL;
+		if(pass==1) {
+			VBufStorage_fieldNode_t* middleItem=buffer->getControlFieldNodeWithIdentifier(DOCHANDLE,itemID(itemCount/2));
+			inserted=buffer->addTextFieldNode(middleItem->getParent(),middleItem,L"inserted");
+		}
+		start=clock();
+		for(size_t i=0;i<nodes.size();++i) {
+			int nodeStart=0, nodeEnd=0;
+			if(!nodes[i]||!buffer->getFieldNodeOffsets(nodes[i],&nodeStart,&nodeEnd)||nodeStart>offsets[i]+((pass==1)?8:0)||nodeEnd<=offsets[i]) {
+				wcerr<<L"fail: "<<shape.name<<L" has no node at offset "<<offsets[i]<<endl;
+				++failCount;
+				break;
+			}
+		}
+		record(timings,pass?L"getFieldNodeOffsets after insert":L"getFieldNodeOffsets",QUERYCOUNT,elapsedMS(start));
+		if(inserted) buffer->removeFieldNode(inserted);
+	}
+	//Make the same reads from one thread and then from several at once, which only gains if readers do not wait for each other
+	SharedLockableObject lock;
+	const int readerCounts[]={1,READERCOUNT};
+	for(int r=0;r<2;++r) {
+		int readerCount=readerCounts[r];
+		//Reads of different lines each time, so that the line cache does not answer them all
+		vector<int> readOffsets;
+		for(int i=0;i<QUERYCOUNT;++i) {
+			readOffsets.push_back(randomOffset(*textLength));
+		}
+		vector<thread> readers;
+		vector<int> readerFailCounts(readerCount,0);
+		chrono::steady_clock::time_point wallStart=chrono::steady_clock::now();
+		for(int i=0;i<readerCount;++i) {
+			readers.push_back(thread([&,i]() {
+				readerFailCounts[i]=readAtOffsets(buffer,&lock,&readOffsets,i,readerCount);
+			}));
+		}
+		for(vector<thread>::iterator i=readers.begin();i!=readers.end();++i) {
+			i->join();
+		}
+		wostringstream operation;
+		operation<<L"concurrent reads x"<<readerCount;
+		record(timings,operation.str(),QUERYCOUNT,elapsedWallMS(wallStart));
+		for(int i=0;i<readerCount;++i) {
+			if(readerFailCounts[i]>0) {
+				wcerr<<L"fail: "<<shape.name<<L" had "<<readerFailCounts[i]<<L" bad reads"<<endl;
+				failCount+=readerFailCounts[i];
+			}
+		}
+	}
+	//Invalidate the nodes around those offsets, as a burst of changes does, and then the whole document, which takes the place of all of them
+	start=clock();
+	VBufStorage_invalidSubtreeList_t invalidSubtreeList;
+	for(vector<VBufStorage_fieldNode_t*>::iterator i=nodes.begin();i!=nodes.end();++i) {
+		if(*i) invalidSubtreeList.add((*i)->getParent());
+	}
+	invalidSubtreeList.add(buffer->getControlFieldNodeWithIdentifier(DOCHANDLE,ROOTID));
+	VBufStorage_controlFieldNodeList_t invalidSubtrees;
+	invalidSubtreeList.take(invalidSubtrees);
+	record(timings,L"invalidSubtreeList add",QUERYCOUNT+1,elapsedMS(start));
+	if(invalidSubtrees.size()!=1) {
+		wcerr<<L"fail: "<<shape.name<<L" has "<<invalidSubtrees.size()<<L" invalid subtrees once the root is invalid"<<endl;
+		++failCount;
+	}
+	//Replace items, as an update does when content changes, with and without reconciling the old and new text
+	for(int reconcile=0;reconcile<2;++reconcile) {
+		start=clock();
+		for(int i=0;i<UPDATECOUNT;++i) {
+			int item=rand()%itemCount;
+			VBufStorage_fieldNode_t* node=buffer->getControlFieldNodeWithIdentifier(DOCHANDLE,itemID(item));
+			if(!node) {
+				wcerr<<L"fail: "<<shape.name<<L" has no item "<<item<<endl;
+				++failCount;
+				continue;
+			}
+			VBufStorage_buffer_t* tempBuffer=new VBufStorage_buffer_t();
+			shape.renderItem(tempBuffer,NULL,NULL,item,i+1);
+			map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> m;
+			m[node]=tempBuffer;
+			if(!buffer->replaceSubtrees(m,reconcile!=0)) {
+				wcerr<<L"fail: "<<shape.name<<L" could not replace item "<<item<<endl;
+				++failCount;
+			}
+		}
+		record(timings,reconcile?L"replaceSubtrees reconcile":L"replaceSubtrees",UPDATECOUNT,elapsedMS(start));
+	}
+	start=clock();
+	buffer->clearBuffer();
+	record(timings,L"clearBuffer",*nodeCount,elapsedMS(start));
+	delete buffer;
+	return failCount;
+}
+
+int main(int argc, char* argv[]) {
+	int failCount=0;
+	double scale=(argc>1)?atof(argv[1]):1.0;
+	if(scale<=0) {
+		wcerr<<L"usage: "<<argv[0]<<L" [scale]"<<endl;
+		return 1;
+	}
+	srand(1);
+	wcout<<L"shape,nodes,textLength,heapBytes,operation,iterations,totalMs,microsecondsPerOperation"<<endl;
+	for(int s=0;s<treeShapeCount;++s) {
+		const treeShape_t& shape=treeShapes[s];
+		int itemCount=max(1,static_cast<int>(shape.itemCount*scale));
+		vector<timing_t> timings;
+		int nodeCount=0, textLength=0;
+		long long heapBytes=-1;
+		for(int round=0;round<ROUNDCOUNT;++round) {
+			failCount+=runRound(shape,itemCount,timings,&nodeCount,&textLength,&heapBytes);
+		}
+		for(vector<timing_t>::iterator i=timings.begin();i!=timings.end();++i) {
+			wcout<<shape.name<<L","<<nodeCount<<L","<<textLength<<L","<<heapBytes<<L","<<i->operation<<L","<<i->iterations<<L","<<fixed<<setprecision(3)<<i->totalMs<<L","<<((i->iterations>0)?(i->totalMs*1000.0/i->iterations):0.0)<<endl;
+		}
+	}
+	if(failCount>0) {
+		wcerr<<L"number of failed checks: "<<failCount<<endl;
+	}
+	return failCount;
+}
@@ -0,0 +1,209 @@
+/**
+ * tests/benchmark/treeGenerators.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007, 2008 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+#include <sstream>
+#include <string>
+#include "treeGenerators.h"
+
+using namespace std;
+
+/**
+ * The IDs given to the nodes of each item, which must be more than the amount of nodes any item has.
+ */
+#define ITEMIDSTRIDE 1000
+
+#define DEEPLISTDEPTH 30
+#define TABLECOLUMNCOUNT 8
+
+//Roles as given by IAccessible and IAccessible2
+#define ROLE_TABLE L"24"
+#define ROLE_ROW L"28"
+#define ROLE_CELL L"29"
+#define ROLE_LINK L"30"
+#define ROLE_LIST L"33"
+#define ROLE_LISTITEM L"34"
+#define ROLE_DOCUMENT L"15"
+#define ROLE_HEADING L"1044"
+#define ROLE_PARAGRAPH L"1054"
+#define ROLE_SECTION L"1060"
+#define ROLE_TEXTFRAME L"1065"
+
+const wchar_t* indexedAttributeNames[]={
+	L"IAccessible::role",
+	L"IAccessible2::attribute_level",
+	L"IAccessible2::attribute_xml-roles",
+	L"IAccessible2::attribute_tag"
+};
+
+const int indexedAttributeNameCount=sizeof(indexedAttributeNames)/sizeof(indexedAttributeNames[0]);
+
+/**
+ * The amount of nodes rendered since generateTree started.
+ */
+int renderedNodeCount=0;
+
+/**
+ * Words to build text from, so that text varies in length like real text does.
+ */
+const wchar_t* words[]={L"the",L"virtual",L"buffer",L"renders",L"documents",L"for",L"a",L"screen",L"reader",L"and",L"keeps",L"them",L"up",L"to",L"date",L"as",L"content",L"changes"};
+
+wstring makeText(int seed, int wordCount) {
+	wostringstream s;
+	for(int i=0;i<wordCount;++i) {
+		if(i>0) s<<L" ";
+		s<<words[(seed*7+i*13)%(sizeof(words)/sizeof(words[0]))];
+	}
+	return s.str();
+}
+
+int itemID(int item) {
+	return ROOTID+1+item*ITEMIDSTRIDE;
+}
+
+/**
+ * Adds a control field node with the attributes the gecko backend gives nearly every node.
+ */
+VBufStorage_controlFieldNode_t* addControl(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int ID, bool isBlock, const wchar_t* role, const wchar_t* tag) {
+	VBufStorage_controlFieldNode_t* node=buffer->addControlFieldNode(parent,previous,DOCHANDLE,ID,isBlock);
+	node->addAttribute(L"IAccessible::role",role);
+	node->addAttribute(L"IAccessible2::attribute_tag",tag);
+	node->addAttribute(L"IAccessible2::attribute_display",isBlock?L"block":L"inline");
+	node->addAttribute(L"IAccessible::state_1048576",L"1");
+	++renderedNodeCount;
+	return node;
+}
+
+VBufStorage_textFieldNode_t* addText(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, const wstring& text) {
+	VBufStorage_textFieldNode_t* node=buffer->addTextFieldNode(parent,previous,text);
+	node->addAttribute(L"language",L"en");
+	++renderedNodeCount;
+	return node;
+}
+
+VBufStorage_controlFieldNode_t* addLink(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int ID, const wstring& text) {
+	VBufStorage_controlFieldNode_t* link=addControl(buffer,parent,previous,ID,false,ROLE_LINK,L"a");
+	link->addAttribute(L"IAccessible::state_4194304",L"1");
+	link->addAttribute(L"name",text);
+	addText(buffer,link,NULL,text);
+	return link;
+}
+
+VBufStorage_controlFieldNode_t* renderDocument(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int /*item*/, int /*version*/) {
+	VBufStorage_controlFieldNode_t* document=addControl(buffer,parent,previous,ROOTID,true,ROLE_DOCUMENT,L"body");
+	document->addAttribute(L"name",L"Benchmark");
+	return document;
+}
+
+VBufStorage_controlFieldNode_t* renderParagraph(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int item, int version) {
+	int ID=itemID(item);
+	if(item%10==0) {
+		VBufStorage_controlFieldNode_t* heading=addControl(buffer,parent,previous,ID,true,ROLE_HEADING,L"h2");
+		heading->addAttribute(L"IAccessible2::attribute_level",L"2");
+		addText(buffer,heading,NULL,makeText(item+version,4));
+		return heading;
+	}
+	VBufStorage_controlFieldNode_t* paragraph=addControl(buffer,parent,previous,ID++,true,ROLE_PARAGRAPH,L"p");
+	VBufStorage_fieldNode_t* node=addText(buffer,paragraph,NULL,makeText(item+version,12));
+	if(item%3==0) {
+		node=addLink(buffer,paragraph,node,ID++,makeText(item,2));
+	} else {
+		VBufStorage_controlFieldNode_t* emphasis=addControl(buffer,paragraph,node,ID++,false,ROLE_TEXTFRAME,L"em");
+		addText(buffer,emphasis,NULL,makeText(item,3));
+		node=emphasis;
+	}
+	addText(buffer,paragraph,node,makeText(item+version+1,10));
+	return paragraph;
+}
+
+VBufStorage_controlFieldNode_t* renderNestedList(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int item, int version) {
+	int ID=itemID(item);
+	VBufStorage_controlFieldNode_t* outerList=addControl(buffer,parent,previous,ID++,true,ROLE_LIST,L"ul");
+	VBufStorage_controlFieldNode_t* list=outerList;
+	for(int depth=0;depth<DEEPLISTDEPTH;++depth) {
+		VBufStorage_controlFieldNode_t* listItem=addControl(buffer,list,NULL,ID++,true,ROLE_LISTITEM,L"li");
+		listItem->addAttribute(L"IAccessible2::attribute_level",wstring(1,static_cast<wchar_t>(L'1'+depth%9)));
+		VBufStorage_fieldNode_t* node=addText(buffer,listItem,NULL,makeText(item+depth+version,3));
+		if(depth%5==4) addLink(buffer,listItem,node,ID++,makeText(depth,2));
+		list=addControl(buffer,listItem,listItem->getLastChild(),ID++,true,ROLE_LIST,L"ul");
+	}
+	addText(buffer,list,NULL,makeText(item+version,5));
+	return outerList;
+}
+
+VBufStorage_controlFieldNode_t* renderTable(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int /*item*/, int /*version*/) {
+	VBufStorage_controlFieldNode_t* table=addControl(buffer,parent,previous,ROOTID,true,ROLE_TABLE,L"table");
+	table->addAttribute(L"table-id",L"1");
+	table->addAttribute(L"table-columncount",L"8");
+	return table;
+}
+
+VBufStorage_controlFieldNode_t* renderTableRow(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int item, int version) {
+	int ID=itemID(item);
+	wostringstream rowNumber;
+	rowNumber<<(item+1);
+	VBufStorage_controlFieldNode_t* row=addControl(buffer,parent,previous,ID++,true,ROLE_ROW,L"tr");
+	VBufStorage_fieldNode_t* previousCell=NULL;
+	for(int column=0;column<TABLECOLUMNCOUNT;++column) {
+		VBufStorage_controlFieldNode_t* cell=addControl(buffer,row,previousCell,ID++,true,ROLE_CELL,L"td");
+		wostringstream columnNumber;
+		columnNumber<<(column+1);
+		cell->addAttribute(L"table-id",L"1");
+		cell->addAttribute(L"table-rownumber",rowNumber.str());
+		cell->addAttribute(L"table-columnnumber",columnNumber.str());
+		if(column==0) {
+			addLink(buffer,cell,NULL,ID++,makeText(item,2));
+		} else {
+			addText(buffer,cell,NULL,makeText(item+column+version,(column%3)+1));
+		}
+		previousCell=cell;
+	}
+	return row;
+}
+
+VBufStorage_controlFieldNode_t* renderLog(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int /*item*/, int /*version*/) {
+	VBufStorage_controlFieldNode_t* log=addControl(buffer,parent,previous,ROOTID,true,ROLE_LIST,L"ul");
+	log->addAttribute(L"IAccessible2::attribute_xml-roles",L"log");
+	log->addAttribute(L"IAccessible2::attribute_live",L"polite");
+	return log;
+}
+
+VBufStorage_controlFieldNode_t* renderChatMessage(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int item, int version) {
+	int ID=itemID(item);
+	VBufStorage_controlFieldNode_t* message=addControl(buffer,parent,previous,ID++,true,ROLE_LISTITEM,L"li");
+	message->addAttribute(L"IAccessible2::attribute_live",L"polite");
+	VBufStorage_controlFieldNode_t* author=addControl(buffer,message,NULL,ID++,false,ROLE_TEXTFRAME,L"strong");
+	wostringstream authorName;
+	authorName<<L"user"<<(item%7);
+	addText(buffer,author,NULL,authorName.str());
+	wostringstream time;
+	time<<L" "<<(10+(item/60)%14)<<L":"<<(10+item%50)<<L" ";
+	VBufStorage_fieldNode_t* node=addText(buffer,message,author,time.str());
+	VBufStorage_controlFieldNode_t* body=addControl(buffer,message,node,ID++,true,ROLE_SECTION,L"div");
+	node=addText(buffer,body,NULL,makeText(item+version,(item%9)+1));
+	if(item%4==0) addLink(buffer,body,node,ID++,makeText(item,1));
+	return message;
+}
+
+const treeShape_t treeShapes[]={
+	{L"flat",10000,renderDocument,renderParagraph},
+	{L"deep",500,renderDocument,renderNestedList},
+	{L"table",2500,renderTable,renderTableRow},
+	{L"chatLog",6000,renderLog,renderChatMessage},
+};
+
+const int treeShapeCount=sizeof(treeShapes)/sizeof(treeShapes[0]);
+
+int generateTree(VBufStorage_buffer_t* buffer, const treeShape_t& shape, int itemCount) {
+	renderedNodeCount=0;
+	VBufStorage_controlFieldNode_t* root=shape.renderRoot(buffer,NULL,NULL,0,0);
+	VBufStorage_fieldNode_t* previous=NULL;
+	for(int i=0;i<itemCount;++i) {
+		previous=shape.renderItem(buffer,root,previous,i,0);
+	}
+	return renderedNodeCount;
+}
@@ -0,0 +1,64 @@
+/**
+ * tests/benchmark/treeGenerators.h
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007, 2008 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+#ifndef VBUFTESTS_TREEGENERATORS_H
+#define VBUFTESTS_TREEGENERATORS_H
+
+#include <vbufBase/storage.h>
+
+#define DOCHANDLE 1
+#define ROOTID 1
+
+/**
+ * Renders one item of a synthetic document, such as a paragraph or a table row, with the given version of its text.
+ * @return the item's node.
+ */
+typedef VBufStorage_controlFieldNode_t*(*renderItemProc_t)(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int item, int version);
+
+/**
+ * The shape of a synthetic document: a root holding a list of items, each rendered with the nodes and attributes a backend gives part of a real document.
+ * Items can be rendered again on their own, so that updates can replace them.
+ */
+typedef struct {
+	const wchar_t* name;
+	int itemCount;
+	renderItemProc_t renderRoot;
+	renderItemProc_t renderItem;
+} treeShape_t;
+
+/**
+ * The shapes of document to benchmark:
+ * flat: paragraphs with inline links and emphasis, and every so often a heading.
+ * deep: lists nested many levels deep.
+ * table: a large table with a link in some of its cells.
+ * chatLog: a live region of many short messages, each with an author and a time.
+ */
+extern const treeShape_t treeShapes[];
+
+extern const int treeShapeCount;
+
+/**
+ * The names of the attributes a buffer should index, as the gecko backend does.
+ */
+extern const wchar_t* indexedAttributeNames[];
+
+extern const int indexedAttributeNameCount;
+
+/**
+ * @return the ID of the node of the given item.
+ */
+int itemID(int item);
+
+/**
+ * Renders a whole document of the given shape.
+ * @param itemCount the amount of items the document has.
+ * @return the amount of nodes rendered.
+ */
+int generateTree(VBufStorage_buffer_t* buffer, const treeShape_t& shape, int itemCount);
+
+#endif
@@ -0,0 +1,552 @@
+/**
+ * tests/geckoReplay/test_geckoReplay.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007, 2008 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <chrono>
+#include <vbufBase/storage.h>
+#include <vbufBase/textEditList.h>
+#include <vbufBackends/gecko_ia2/recording.h>
+#include <vbufBackends/gecko_ia2/renderer.h>
+#include <vbufBackends/gecko_ia2/replay.h>
+
+using namespace std;
+
+/**
+ * A recording of a document with a heading and a paragraph holding a link, as the gecko backend would save it.
+ */
+const char SAMPLE[]=
+	"IA2Tree\t1\n"
+	"node\t0\n"
+	"docHandle\t1\n"
+	"ID\t1\n"
+	"IA2Role\t0\n"
+	"role\t15\t\n"
+	"states\t0\n"
+	"IA2States\t0\n"
+	"attributes\ttag\tbody\n"
+	"location\t0\t0\t800\t600\n"
+	"text\t\\ufffc\\ufffc\n"
+	"hypertext\n"
+	"embeddedObject\t0\t1\n"
+	"embeddedObject\t1\t2\n"
+	"childCount\t2\n"
+	"toolkit\tGecko\t20.0\n"
+	"node\t1\n"
+	"docHandle\t1\n"
+	"ID\t-2\n"
+	"IA2Role\t1044\n"
+	"states\t0\n"
+	"IA2States\t0\n"
+	"attributes\tlevel\t1\ttag\th1\n"
+	"location\t0\t0\t800\t40\n"
+	"text\tTitle\n"
+	"hypertext\n"
+	"childCount\t1\n"
+	"node\t2\n"
+	"docHandle\t1\n"
+	"ID\t-3\n"
+	"IA2Role\t1054\n"
+	"states\t0\n"
+	"IA2States\t0\n"
+	"attributes\ttag\tp\n"
+	"location\t0\t40\t800\t20\n"
+	"text\tCaf\\u00e9 \\ufffc!\n"
+	"textAttributes\t0\t0\t7\tfont-weight\t700\n"
+	"hypertext\n"
+	"embeddedObject\t5\t3\n"
+	"childCount\t2\n"
+	"node\t3\n"
+	"docHandle\t1\n"
+	"ID\t-4\n"
+	"IA2Role\t0\n"
+	"role\t30\t\n"
+	"states\t5242880\n"
+	"IA2States\t0\n"
+	"attributes\ttag\ta\n"
+	"name\tworld\n"
+	"value\thttp://example.com/\n"
+	"location\t40\t40\t40\t20\n"
+	"text\tworld\n"
+	"hypertext\n"
+	"childCount\t1\n"
+	"actionNames\tjump\n";
+
+#define DOCHANDLE 1
+#define LINKID -4
+/**
+ * The calls a render of the sample asks of the application when each question is asked separately.
+ * A change to this is a change to how many calls rendering makes for each object.
+ */
+#define EXPECTEDCALLCOUNT 82
+
+wstring getText(VBufStorage_buffer_t& buffer, bool useMarkup) {
+	VBufStorage_textContainer_t* container=buffer.getTextInRange(0,buffer.getTextLength(),useMarkup);
+	if(!container) return wstring();
+	wstring text=container->getString();
+	container->destroy();
+	return text;
+}
+
+bool loadRecording(GeckoVBuf_recordedTree_t& tree, const string& recording) {
+	istringstream stream(recording);
+	return tree.load(stream);
+}
+
+string saveRecording(const GeckoVBuf_recordedTree_t& tree) {
+	ostringstream stream;
+	tree.save(stream);
+	return stream.str();
+}
+
+int testLoadSave() {
+	int failCount=0;
+	GeckoVBuf_recordedTree_t tree;
+	if(!loadRecording(tree,SAMPLE)||tree.getNodeCount()!=4) {
+		wcerr<<L"fail: sample recording did not load"<<endl;
+		return 1;
+	}
+	if(saveRecording(tree)!=SAMPLE) {
+		wcerr<<L"fail: saving the sample recording did not give it back"<<endl;
+		++failCount;
+	}
+	string windowsSample=SAMPLE;
+	for(size_t i=windowsSample.find('\n');i!=string::npos;i=windowsSample.find('\n',i+2)) windowsSample.insert(i,1,'\r');
+	if(!loadRecording(tree,windowsSample)||saveRecording(tree)!=SAMPLE) {
+		wcerr<<L"fail: sample recording with Windows line endings did not load"<<endl;
+		++failCount;
+	}
+	const char* badRecordings[]={
+		"",
+		"IA2Tree\t2\n",
+		"IA2Tree\t1\nID\t1\n",
+		"IA2Tree\t1\nnode\t-1\n",
+		"IA2Tree\t1\nnode\t0\nID\tone\n",
+		"IA2Tree\t1\nnode\t0\nlocation\t0\t0\n",
+		"IA2Tree\t1\nnode\t2000000000\n",
+		"IA2Tree\t1\nnode\t0\nchildren\t1\t2000000000\nnode\t1\n",
+		"IA2Tree\t1\nnode\t0\ncellTable\t3\nnode\t1\n",
+	};
+	for(size_t i=0;i<sizeof(badRecordings)/sizeof(badRecordings[0]);++i) {
+		if(loadRecording(tree,badRecordings[i])||tree.getNodeCount()!=0) {
+			wcerr<<L"fail: bad recording "<<i<<L" loaded"<<endl;
+			++failCount;
+		}
+	}
+	return failCount;
+}
+
+int testReplay() {
+	int failCount=0;
+	GeckoVBuf_recordedTree_t tree;
+	loadRecording(tree,SAMPLE);
+	GeckoVBufReplayBackend_t backend(&tree);
+	backend.update();
+	wstring text=getText(backend,false);
+	if(text!=L"TitleCaf\u00e9 world!") {
+		wcerr<<L"fail: replayed text is "<<text.length()<<L" characters long"<<endl;
+		++failCount;
+	}
+	VBufStorage_textEditList_t edits;
+	backend.getEdits(edits);
+	if(edits.getEdits().size()!=1||edits.getEdits()[0].newLength!=backend.getTextLength()) {
+		wcerr<<L"fail: initial render did not report its text as inserted"<<endl;
+		++failCount;
+	}
+	vector<VBufStorage_foundNode_t> foundNodes;
+	if(!backend.findAllNodesByAttributes(L"IAccessible::role",L"IAccessible\\\\:\\\\:role:(?:1044;|30;)",foundNodes)||foundNodes.size()!=2) {
+		wcerr<<L"fail: heading and link not found by their roles"<<endl;
+		++failCount;
+	} else if(foundNodes[0].node!=backend.getControlFieldNodeWithIdentifier(DOCHANDLE,-2)||foundNodes[1].startOffset!=10||foundNodes[1].endOffset!=15) {
+		wcerr<<L"fail: heading and link found at the wrong nodes or offsets"<<endl;
+		++failCount;
+	}
+	wstring markup=getText(backend,true);
+	if(markup.find(L"IAccessible2::attribute_level=\"1\"")==wstring::npos||markup.find(L"font-weight=\"700\"")==wstring::npos||markup.find(L"IAccessibleAction_jump=\"0\"")==wstring::npos) {
+		wcerr<<L"fail: replayed markup is missing object, text or action attributes"<<endl;
+		++failCount;
+	}
+	return failCount;
+}
+
+int testRecord() {
+	int failCount=0;
+	GeckoVBuf_recordedTree_t tree;
+	loadRecording(tree,SAMPLE);
+	//Record a render of the replayed document, as the gecko backend records a render of a live one
+	GeckoVBuf_recordedTree_t recording;
+	VBufStorage_buffer_t buffer;
+	GeckoVBufRenderer_t renderer(1,&buffer);
+	GeckoVBuf_accessible_t* acc=new GeckoVBuf_recordingAccessible_t(tree.getRoot(),recording.addNode(),&recording);
+	renderer.versionSpecificInit(acc);
+	renderer.fillVBuf(acc,&buffer,NULL,NULL);
+	acc->release();
+	//The sample holds exactly the answers a render needs, so recording its replay gives it back
+	string saved=saveRecording(recording);
+	if(saved!=SAMPLE) {
+		wcerr<<L"fail: recording of the replayed sample differs from the sample"<<endl;
+		++failCount;
+	}
+	GeckoVBuf_recordedTree_t loaded;
+	if(!loadRecording(loaded,saved)||saveRecording(loaded)!=saved) {
+		wcerr<<L"fail: recording did not load as it was saved"<<endl;
+		++failCount;
+	}
+	GeckoVBufReplayBackend_t backend(&loaded);
+	backend.update();
+	if(getText(backend,true)!=getText(buffer,true)) {
+		wcerr<<L"fail: replay of the recording does not match the recorded render"<<endl;
+		++failCount;
+	}
+	buffer.clearBuffer();
+	return failCount;
+}
+
+int testUpdate() {
+	int failCount=0;
+	GeckoVBuf_recordedTree_t tree;
+	loadRecording(tree,SAMPLE);
+	GeckoVBufReplayBackend_t backend(&tree);
+	backend.update();
+	VBufStorage_textEditList_t edits;
+	backend.getEdits(edits);
+	VBufStorage_controlFieldNode_t* heading=backend.getControlFieldNodeWithIdentifier(DOCHANDLE,-2);
+	//The link text changes in the application
+	string changed=SAMPLE;
+	for(size_t i=changed.find("world");i!=string::npos;i=changed.find("world",i)) changed.replace(i,5,"there");
+	loadRecording(tree,changed);
+	if(!backend.invalidateSubtree(backend.getControlFieldNodeWithIdentifier(DOCHANDLE,LINKID))) {
+		wcerr<<L"fail: could not invalidate link"<<endl;
+		++failCount;
+	}
+	backend.update();
+	if(getText(backend,false)!=L"TitleCaf\u00e9 there!") {
+		wcerr<<L"fail: update did not change the link text"<<endl;
+		++failCount;
+	}
+	backend.getEdits(edits);
+	if(edits.getEdits().size()!=1||edits.getEdits()[0].oldStart!=10||edits.getEdits()[0].oldEnd!=15||edits.getEdits()[0].newLength!=5) {
+		wcerr<<L"fail: update did not report the link text as replaced"<<endl;
+		++failCount;
+	}
+	if(backend.getControlFieldNodeWithIdentifier(DOCHANDLE,-2)!=heading) {
+		wcerr<<L"fail: heading was not kept by the update"<<endl;
+		++failCount;
+	}
+	return failCount;
+}
+
+/**
+ * The calls made on the objects of a counting provider.
+ */
+struct callCounts_t {
+	bool supportsBulkFetch;
+	int total;
+	map<string,int> byQuestion;
+	map<pair<int,string>,int> byObjectAndQuestion;
+};
+
+/**
+ * A mock provider which answers from the objects of a loaded recording, counting each question asked of each object as a call on the application.
+ * If it supports fetching in bulk, it fetches a subtree by recording a render of the objects it wraps, which stands in for one call fetching everything.
+ */
+class countingAccessible_t: public GeckoVBuf_accessible_t {
+	private:
+
+	GeckoVBuf_accessible_t* const acc;
+	callCounts_t& counts;
+
+/**
+ * Counts a call.
+ * @param question the question asked.
+ * @param argument what the question is about, such as an offset in the text, for questions that can be asked more than once of an object.
+ */
+	void count(const char* question, long argument=0) {
+		int ID=0;
+		acc->getID(&ID);
+		++counts.total;
+		++counts.byQuestion[question];
+		ostringstream s;
+		s<<question<<" "<<argument;
+		++counts.byObjectAndQuestion[make_pair(ID,s.str())];
+	}
+
+	GeckoVBuf_accessible_t* wrap(GeckoVBuf_accessible_t* child) {
+		return child?new countingAccessible_t(child,counts):NULL;
+	}
+
+	virtual ~countingAccessible_t() {
+		acc->release();
+	}
+
+	public:
+
+	countingAccessible_t(GeckoVBuf_accessible_t* accArg, callCounts_t& countsArg): acc(accArg), counts(countsArg) {}
+
+	virtual void release() { delete this; }
+	virtual bool getDocHandle(int* docHandle) { count("docHandle"); return acc->getDocHandle(docHandle); }
+	virtual bool getID(int* ID) { count("ID"); return acc->getID(ID); }
+	virtual bool getIA2Role(long* role) { count("IA2Role"); return acc->getIA2Role(role); }
+	virtual bool getRole(long* role, wstring& roleString) { count("role"); return acc->getRole(role,roleString); }
+	virtual bool getStates(int* states) { count("states"); return acc->getStates(states); }
+	virtual bool getIA2States(int* states) { count("IA2States"); return acc->getIA2States(states); }
+	virtual bool getKeyboardShortcut(wstring& keyboardShortcut) { count("keyboardShortcut"); return acc->getKeyboardShortcut(keyboardShortcut); }
+	virtual bool getAttributes(map<wstring,wstring>& attribs) { count("attributes"); return acc->getAttributes(attribs); }
+	virtual bool getName(wstring& name) { count("name"); return acc->getName(name); }
+	virtual bool getDescription(wstring& description) { count("description"); return acc->getDescription(description); }
+	virtual bool getValue(wstring& value) { count("value"); return acc->getValue(value); }
+	virtual bool getLocale(wstring& locale) { count("locale"); return acc->getLocale(locale); }
+	virtual bool getLocation(long* left, long* top, long* width, long* height) { count("location"); return acc->getLocation(left,top,width,height); }
+	virtual bool isLabelVisible() { count("labelVisible"); return acc->isLabelVisible(); }
+	virtual bool getText(wstring& text) { count("text"); return acc->getText(text); }
+	virtual bool getTextAttributes(long offset, long* startOffset, long* endOffset, map<wstring,wstring>& attribs) { count("textAttributes",offset); return acc->getTextAttributes(offset,startOffset,endOffset,attribs); }
+	virtual bool hasHypertext() { count("hypertext"); return acc->hasHypertext(); }
+	virtual GeckoVBuf_accessible_t* getEmbeddedObject(long offset) { count("embeddedObject",offset); return wrap(acc->getEmbeddedObject(offset)); }
+	virtual bool getChildCount(long* childCount) { count("childCount"); return acc->getChildCount(childCount); }
+	virtual void getActionNames(vector<wstring>& actionNames) { count("actionNames"); acc->getActionNames(actionNames); }
+	virtual int getTableVersion() { count("tableVersion"); return acc->getTableVersion(); }
+	virtual bool getRowCount(long* rowCount) { count("rowCount"); return acc->getRowCount(rowCount); }
+	virtual bool getColumnCount(long* columnCount) { count("columnCount"); return acc->getColumnCount(columnCount); }
+	virtual bool getCellExtentsAtIndex(long index, long* row, long* column, long* rowExtents, long* columnExtents) { count("cellExtentsAtIndex",index); return acc->getCellExtentsAtIndex(index,row,column,rowExtents,columnExtents); }
+	virtual bool isTableCell() { count("tableCell"); return acc->isTableCell(); }
+	virtual bool getCellExtents(long* row, long* column, long* rowExtents, long* columnExtents) { count("cellExtents"); return acc->getCellExtents(row,column,rowExtents,columnExtents); }
+	virtual bool getHeaderCells(bool columnHeaders, wstring& headerCells) { count("headerCells",columnHeaders); return acc->getHeaderCells(columnHeaders,headerCells); }
+	virtual GeckoVBuf_accessible_t* getCellTable() { count("cellTable"); return wrap(acc->getCellTable()); }
+	virtual bool getToolkit(wstring& name, wstring& version) { count("toolkit"); return acc->getToolkit(name,version); }
+
+	virtual void getChildren(vector<GeckoVBuf_accessible_t*>& children) {
+		count("children");
+		vector<GeckoVBuf_accessible_t*> innerChildren;
+		acc->getChildren(innerChildren);
+		for(vector<GeckoVBuf_accessible_t*>::iterator i=innerChildren.begin();i!=innerChildren.end();++i) children.push_back(wrap(*i));
+	}
+
+	virtual bool fetchSubtree(GeckoVBuf_recordedTree_t& tree) {
+		if(!counts.supportsBulkFetch) return false;
+		count("fetchSubtree");
+		VBufStorage_buffer_t buffer;
+		GeckoVBufRenderer_t renderer(0,&buffer);
+		GeckoVBuf_accessible_t* recordingAcc=new GeckoVBuf_recordingAccessible_t(acc,tree.addNode(),&tree);
+		renderer.versionSpecificInit(recordingAcc);
+		renderer.fillVBuf(recordingAcc,&buffer,NULL,NULL);
+		//The wrapped objects belong to their recording, so releasing them along with the recording accessible leaves them usable
+		recordingAcc->release();
+		buffer.clearBuffer();
+		return true;
+	}
+
+};
+
+/**
+ * Renders the sample through a counting provider.
+ * @return the markup of the render.
+ */
+wstring renderCounted(callCounts_t& counts) {
+	GeckoVBuf_recordedTree_t tree;
+	loadRecording(tree,SAMPLE);
+	VBufStorage_buffer_t buffer;
+	GeckoVBufRenderer_t renderer(1,&buffer);
+	GeckoVBuf_accessible_t* acc=new countingAccessible_t(tree.getRoot(),counts);
+	renderer.render(acc,&buffer,NULL);
+	acc->release();
+	wstring markup=getText(buffer,true);
+	buffer.clearBuffer();
+	return markup;
+}
+
+int testFetchCounts() {
+	int failCount=0;
+	GeckoVBuf_recordedTree_t tree;
+	loadRecording(tree,SAMPLE);
+	GeckoVBufReplayBackend_t backend(&tree);
+	backend.update();
+	wstring expectedMarkup=getText(backend,true);
+	//Without bulk fetching, each question is asked of each object as it is rendered, and no more than once
+	callCounts_t counts=callCounts_t();
+	if(renderCounted(counts)!=expectedMarkup) {
+		wcerr<<L"fail: render through counting provider differs from replay"<<endl;
+		++failCount;
+	}
+	for(map<pair<int,string>,int>::const_iterator i=counts.byObjectAndQuestion.begin();i!=counts.byObjectAndQuestion.end();++i) {
+		if(i->second>1) {
+			wcerr<<L"fail: "<<i->first.second.c_str()<<L" asked "<<i->second<<L" times of object "<<i->first.first<<endl;
+			++failCount;
+		}
+	}
+	if(counts.total!=EXPECTEDCALLCOUNT||counts.byQuestion["fetchSubtree"]!=0) {
+		wcerr<<L"fail: render made "<<counts.total<<L" calls, expected "<<EXPECTEDCALLCOUNT<<endl;
+		++failCount;
+	}
+	//With bulk fetching, the whole document is fetched with one call
+	callCounts_t bulkCounts=callCounts_t();
+	bulkCounts.supportsBulkFetch=true;
+	if(renderCounted(bulkCounts)!=expectedMarkup) {
+		wcerr<<L"fail: render of bulk fetched document differs from replay"<<endl;
+		++failCount;
+	}
+	if(bulkCounts.total!=1||bulkCounts.byQuestion["fetchSubtree"]!=1) {
+		wcerr<<L"fail: render of bulk fetched document made "<<bulkCounts.total<<L" calls"<<endl;
+		++failCount;
+	}
+	//A re-rendered subtree is fetched with one call as well
+	bulkCounts.total=0;
+	VBufStorage_buffer_t tempBuffer;
+	GeckoVBufRenderer_t renderer(1,&backend);
+	GeckoVBuf_accessible_t* paragraph=new countingAccessible_t(tree.getNodeWithIdentifier(DOCHANDLE,-3),bulkCounts);
+	renderer.render(paragraph,&tempBuffer,backend.getControlFieldNodeWithIdentifier(DOCHANDLE,-3));
+	paragraph->release();
+	if(bulkCounts.total!=1||tempBuffer.getTextLength()!=11) {
+		wcerr<<L"fail: bulk fetched paragraph made "<<bulkCounts.total<<L" calls and rendered "<<tempBuffer.getTextLength()<<L" characters"<<endl;
+		++failCount;
+	}
+	tempBuffer.clearBuffer();
+	return failCount;
+}
+
+/**
+ * @return the calls made on the object with the given ID.
+ */
+int countCallsOn(const callCounts_t& counts, int ID) {
+	int total=0;
+	for(map<pair<int,string>,int>::const_iterator i=counts.byObjectAndQuestion.begin();i!=counts.byObjectAndQuestion.end();++i) {
+		if(i->first.first==ID) total+=i->second;
+	}
+	return total;
+}
+
+/**
+ * Renders the root of a replayed document again through a counting provider, as an update of the invalid root would.
+ * @return the markup of the render.
+ */
+wstring rerenderRootCounted(GeckoVBufReplayBackend_t& backend, GeckoVBuf_recordedTree_t& tree, callCounts_t& counts) {
+	VBufStorage_buffer_t tempBuffer;
+	GeckoVBufRenderer_t renderer(1,&backend);
+	GeckoVBuf_accessible_t* acc=new countingAccessible_t(tree.getRoot(),counts);
+	renderer.render(acc,&tempBuffer,backend.getControlFieldNodeWithIdentifier(DOCHANDLE,1));
+	acc->release();
+	wstring markup=getText(tempBuffer,true);
+	tempBuffer.clearBuffer();
+	return markup;
+}
+
+int testReuse() {
+	int failCount=0;
+	GeckoVBuf_recordedTree_t tree;
+	loadRecording(tree,SAMPLE);
+	GeckoVBufReplayBackend_t backend(&tree);
+	backend.update();
+	wstring expectedMarkup=getText(backend,true);
+	//A copied subtree has the same content as the original
+	VBufStorage_buffer_t copyBuffer;
+	if(!copyBuffer.copySubtree(NULL,NULL,backend.getControlFieldNodeWithIdentifier(DOCHANDLE,1))||getText(copyBuffer,true)!=expectedMarkup||!copyBuffer.getControlFieldNodeWithIdentifier(DOCHANDLE,LINKID)) {
+		wcerr<<L"fail: copy of the document differs from the document"<<endl;
+		++failCount;
+	}
+	copyBuffer.clearBuffer();
+	//Children that did not change are reused, without asking more than who they are and what states they have
+	callCounts_t counts=callCounts_t();
+	if(rerenderRootCounted(backend,tree,counts)!=expectedMarkup) {
+		wcerr<<L"fail: re-render reusing unchanged children differs from render"<<endl;
+		++failCount;
+	}
+	if(countCallsOn(counts,-2)!=4||countCallsOn(counts,-3)!=4||countCallsOn(counts,LINKID)!=0||counts.total>=EXPECTEDCALLCOUNT/2) {
+		wcerr<<L"fail: re-render reusing unchanged children made "<<counts.total<<L" calls"<<endl;
+		++failCount;
+	}
+	//An invalidated descendant, and the ancestors it is in, are fetched again
+	backend.invalidateSubtree(backend.getControlFieldNodeWithIdentifier(DOCHANDLE,LINKID));
+	callCounts_t staleCounts=callCounts_t();
+	rerenderRootCounted(backend,tree,staleCounts);
+	if(countCallsOn(staleCounts,-2)!=4||countCallsOn(staleCounts,-3)<=4||countCallsOn(staleCounts,LINKID)<=4) {
+		wcerr<<L"fail: re-render reused an invalidated descendant"<<endl;
+		++failCount;
+	}
+	//The link text and the heading states change in the application, but only the link and the document are invalidated
+	string changed=SAMPLE;
+	for(size_t i=changed.find("world");i!=string::npos;i=changed.find("world",i)) changed.replace(i,5,"there");
+	changed.replace(changed.find("states\t0\n",changed.find("ID\t-2\n")),10,"states\t64\n");
+	loadRecording(tree,changed);
+	VBufStorage_controlFieldNode_t* paragraph=backend.getControlFieldNodeWithIdentifier(DOCHANDLE,-3);
+	backend.invalidateSubtree(backend.getControlFieldNodeWithIdentifier(DOCHANDLE,1));
+	backend.update();
+	if(getText(backend,false)!=L"TitleCaf\u00e9 there!") {
+		wcerr<<L"fail: update did not render the invalidated link again"<<endl;
+		++failCount;
+	}
+	const wstring* headingState=backend.getControlFieldNodeWithIdentifier(DOCHANDLE,-2)->getAttributeValue(L"IAccessible::state_64");
+	if(!headingState||*headingState!=L"1") {
+		wcerr<<L"fail: update reused a heading whose states changed"<<endl;
+		++failCount;
+	}
+	if(backend.getControlFieldNodeWithIdentifier(DOCHANDLE,-3)!=paragraph||paragraph->isStale||backend.getControlFieldNodeWithIdentifier(DOCHANDLE,1)->isStale) {
+		wcerr<<L"fail: nodes kept by the update are still stale"<<endl;
+		++failCount;
+	}
+	//Once a changed node is rendered again, its ancestors can be reused again
+	backend.invalidateSubtree(backend.getControlFieldNodeWithIdentifier(DOCHANDLE,LINKID));
+	backend.update();
+	if(paragraph->isStale||backend.getControlFieldNodeWithIdentifier(DOCHANDLE,1)->isStale) {
+		wcerr<<L"fail: ancestors of an updated node are still stale"<<endl;
+		++failCount;
+	}
+	return failCount;
+}
+
+double elapsedMS(chrono::steady_clock::time_point start) {
+	return chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+}
+
+/**
+ * Times the render and a full update of saved recordings, writing the results as comma separated values.
+ */
+int timeRecordings(int argc, char* argv[]) {
+	int failCount=0;
+	cout<<"recording,objects,textLength,renderMs,updateMs"<<endl;
+	for(int i=1;i<argc;++i) {
+		GeckoVBuf_recordedTree_t tree;
+		ifstream file(argv[i],ios::in|ios::binary);
+		if(!tree.load(file)) {
+			cerr<<"fail: could not load "<<argv[i]<<endl;
+			++failCount;
+			continue;
+		}
+		GeckoVBufReplayBackend_t backend(&tree);
+		chrono::steady_clock::time_point start=chrono::steady_clock::now();
+		backend.update();
+		double renderMS=elapsedMS(start);
+		start=chrono::steady_clock::now();
+		backend.invalidateSubtree(backend.getControlFieldNodeWithIdentifier(backend.rootDocHandle,backend.rootID));
+		backend.update();
+		double updateMS=elapsedMS(start);
+		cout<<argv[i]<<","<<tree.getNodeCount()<<","<<backend.getTextLength()<<","<<renderMS<<","<<updateMS<<endl;
+		backend.clearBuffer();
+	}
+	return failCount;
+}
+
+int main(int argc, char* argv[]) {
+	if(argc>1) {
+		return timeRecordings(argc,argv);
+	}
+	int failCount=0;
+	failCount+=testLoadSave();
+	failCount+=testReplay();
+	failCount+=testRecord();
+	failCount+=testUpdate();
+	failCount+=testFetchCounts();
+	failCount+=testReuse();
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
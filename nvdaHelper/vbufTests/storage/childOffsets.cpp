@@ -0,0 +1,90 @@
+#include <iostream>
+#include <vector>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+//More than are scanned without the child offset index
+#define SIBLINGCOUNT 2000
+#define TESTSTRING L"test "
+
+int failCount=0;
+
+/**
+ * Calculates a node's offset by walking all previous siblings of the node and each of its ancestors, which is how offsets were calculated before nodes kept a child offset index.
+ */
+int naiveOffset(VBufStorage_fieldNode_t* node) {
+	int offset=0;
+	for(;node!=NULL;node=node->getParent()) {
+		for(VBufStorage_fieldNode_t* previous=node->getPrevious();previous!=NULL;previous=previous->getPrevious()) {
+			offset+=previous->getLength();
+		}
+	}
+	return offset;
+}
+
+/**
+ * Checks the offsets of every node against a sibling walk, and that the text at each offset is found, after the given change to the buffer.
+ */
+void checkOffsets(VBufStorage_buffer_t* buffer, const vector<VBufStorage_fieldNode_t*>& siblings, const wchar_t* change) {
+	int badCount=0;
+	for(vector<VBufStorage_fieldNode_t*>::const_iterator i=siblings.begin();i!=siblings.end();++i) {
+		int expectedStart=naiveOffset(*i);
+		int startOffset=-1, endOffset=-1;
+		if(!buffer->getFieldNodeOffsets(*i,&startOffset,&endOffset)||startOffset!=expectedStart||endOffset!=expectedStart+(*i)->getLength()) {
+			++badCount;
+			continue;
+		}
+		int textStart=-1, textEnd=-1;
+		VBufStorage_textFieldNode_t* text=buffer->locateTextFieldNodeAtOffset(startOffset,&textStart,&textEnd);
+		if(!text||textStart!=startOffset||(text!=*i&&text->getParent()!=*i)) ++badCount;
+	}
+	if(badCount>0) {
+		wcerr<<L"fail: "<<badCount<<L" nodes with wrong offsets "<<change<<endl;
+		++failCount;
+	}
+}
+
+int main() {
+	VBufStorage_buffer_t* buffer=new VBufStorage_buffer_t();
+	VBufStorage_controlFieldNode_t* rootNode=buffer->addControlFieldNode(NULL,NULL,1,1,true);
+	if(rootNode==NULL) {
+		return 1;
+	}
+	vector<VBufStorage_fieldNode_t*> siblings;
+	VBufStorage_fieldNode_t* previous=NULL;
+	for(int i=0;i<SIBLINGCOUNT;++i) {
+		//Alternate between text fields and small control fields, like a long chat log or table.
+		if(i%2==0) {
+			previous=buffer->addTextFieldNode(rootNode,previous,TESTSTRING);
+		} else {
+			VBufStorage_controlFieldNode_t* controlNode=buffer->addControlFieldNode(rootNode,previous,1,i+2,false);
+			if(controlNode) buffer->addTextFieldNode(controlNode,NULL,TESTSTRING);
+			previous=controlNode;
+		}
+		if(previous==NULL) {
+			wcerr<<L"Error adding node "<<i<<endl;
+			return 1;
+		}
+		siblings.push_back(previous);
+	}
+	checkOffsets(buffer,siblings,L"once built");
+	//Inserting a node in the middle makes the index after it stale
+	VBufStorage_textFieldNode_t* inserted=buffer->addTextFieldNode(rootNode,siblings[SIBLINGCOUNT/2],L"inserted ");
+	siblings.insert(siblings.begin()+SIBLINGCOUNT/2+1,inserted);
+	checkOffsets(buffer,siblings,L"after an insert");
+	buffer->removeFieldNode(inserted);
+	siblings.erase(siblings.begin()+SIBLINGCOUNT/2+1);
+	checkOffsets(buffer,siblings,L"after a removal");
+	buffer->removeFieldNode(siblings.front());
+	siblings.erase(siblings.begin());
+	checkOffsets(buffer,siblings,L"after removing the first child");
+	//Appending after the index was built only extends it
+	siblings.push_back(buffer->addTextFieldNode(rootNode,siblings.back(),TESTSTRING));
+	checkOffsets(buffer,siblings,L"after an append");
+	delete buffer;
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
@@ -0,0 +1,161 @@
+/**
+ * tests/storage/concurrentReads.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007, 2008 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <map>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+#include <common/lock.h>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+#define SECTIONCOUNT 64
+#define PARAGRAPHSPERSECTION 20
+#define READERCOUNT 4
+#define READSPERREADER 4000
+#define WRITECOUNT 200
+#define TEXTREADLENGTH 2000
+#define DOCHANDLE 1
+#define ROOTID 1
+
+int sectionID(int section) {
+	return 2+section*(PARAGRAPHSPERSECTION+1);
+}
+
+/**
+ * Renders a section of headings and paragraphs, whose text depends on its version.
+ */
+void renderSection(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int section, int version) {
+	VBufStorage_controlFieldNode_t* sectionNode=buffer->addControlFieldNode(parent,previous,DOCHANDLE,sectionID(section),true);
+	sectionNode->addAttribute(L"role",L"section");
+	VBufStorage_fieldNode_t* previousParagraph=NULL;
+	for(int i=0;i<PARAGRAPHSPERSECTION;++i) {
+		VBufStorage_controlFieldNode_t* paragraph=buffer->addControlFieldNode(sectionNode,previousParagraph,DOCHANDLE,sectionID(section)+1+i,true);
+		paragraph->addAttribute(L"role",(i%5==0)?L"heading":L"paragraph");
+		wostringstream s;
+		s<<L"section "<<section<<L" paragraph "<<i<<L" version "<<version<<L"\n";
+		for(int j=0;j<=version%4;++j) s<<L"more text for lines to wrap ";
+		buffer->addTextFieldNode(paragraph,NULL,s.str());
+		previousParagraph=paragraph;
+	}
+}
+
+wstring readText(VBufStorage_buffer_t& buffer, int startOffset, int endOffset) {
+	if(startOffset>=endOffset) return wstring();
+	wstring text(endOffset-startOffset,L'\0');
+	VBufStorage_textSink_t sink(&text[0],text.length());
+	buffer.getTextInRange(startOffset,endOffset,sink,false);
+	return text;
+}
+
+/**
+ * The buffer shared by the readers and the writer, and the lock they share it with, like a backend and its lock.
+ */
+struct sharedBuffer_t {
+	VBufStorage_buffer_t buffer;
+	SharedLockableObject lock;
+	volatile long failCount;
+	volatile long readCount;
+};
+
+/**
+ * Reads the buffer with shared access, using all the reads that fill in caches, and checks that their results agree.
+ */
+void readerThreadProc(sharedBuffer_t* shared) {
+	unsigned int seed=static_cast<unsigned int>(reinterpret_cast<size_t>(&seed));
+	for(int i=0;i<READSPERREADER;++i) {
+		seed=seed*1103515245+12345;
+		shared->lock.acquireShared();
+		VBufStorage_buffer_t& buffer=shared->buffer;
+		int offset=static_cast<int>((seed>>8)%static_cast<unsigned int>(buffer.getTextLength()));
+		bool failed=false;
+		int lineStart=0, lineEnd=0;
+		if(!buffer.getLineOffsets(offset,(i%2)?0:30,false,&lineStart,&lineEnd)||offset<lineStart||offset>=lineEnd) failed=true;
+		int nodeStart=0, nodeEnd=0, docHandle=0, ID=0;
+		VBufStorage_controlFieldNode_t* node=buffer.locateControlFieldNodeAtOffset(offset,&nodeStart,&nodeEnd,&docHandle,&ID);
+		int fieldStart=0, fieldEnd=0;
+		if(!node||!buffer.getFieldNodeOffsets(node,&fieldStart,&fieldEnd)||fieldStart!=nodeStart||fieldEnd!=nodeEnd) failed=true;
+		if(node&&buffer.getNodeForHandle(buffer.getHandleForNode(node))!=node) failed=true;
+		if(node&&buffer.getControlFieldNodeWithIdentifier(docHandle,ID)!=node) failed=true;
+		int foundStart=0, foundEnd=0;
+		//Vary the queries so that the attribute query cache fills up
+		wostringstream regexp;
+		regexp<<L"role:("<<((i%3==0)?L"heading":L"paragraph")<<L"|unused"<<(i%100)<<L");";
+		VBufStorage_fieldNode_t* found=buffer.findNodeByAttributes(offset,VBufStorage_findDirection_forward,L"role",regexp.str(),&foundStart,&foundEnd);
+		if(found&&(foundStart<=offset||!buffer.getFieldNodeOffsets(found,&fieldStart,&fieldEnd)||fieldStart!=foundStart)) failed=true;
+		//Read text in two pieces, dropping shared access in between, which must match reading it at once if the version stayed the same
+		unsigned int version=buffer.getVersion();
+		int textEnd=min(offset+TEXTREADLENGTH,buffer.getTextLength());
+		int textMiddle=(offset+textEnd)/2;
+		wstring firstPiece=readText(buffer,offset,textMiddle);
+		shared->lock.releaseShared();
+		shared->lock.acquireShared();
+		if(buffer.getVersion()==version) {
+			wstring text=firstPiece+readText(buffer,textMiddle,textEnd);
+			if(text!=readText(buffer,offset,textEnd)) failed=true;
+		}
+		shared->lock.releaseShared();
+		if(failed) {
+			wcerr<<L"fail: reads at offset "<<offset<<L" disagree"<<endl;
+			lockedIncrement(&shared->failCount);
+		}
+		lockedIncrement(&shared->readCount);
+	}
+}
+
+int main() {
+	int failCount=0;
+	sharedBuffer_t* shared=new sharedBuffer_t();
+	shared->failCount=0;
+	shared->readCount=0;
+	VBufStorage_buffer_t& buffer=shared->buffer;
+	VBufStorage_controlFieldNode_t* document=buffer.addControlFieldNode(NULL,NULL,DOCHANDLE,ROOTID,true);
+	for(int i=0;i<SECTIONCOUNT;++i) {
+		renderSection(&buffer,document,document->getLastChild(),i,0);
+	}
+	buffer.setIndexedAttributes(vector<wstring>(1,L"role"));
+	vector<thread> threads;
+	for(int i=0;i<READERCOUNT;++i) {
+		threads.push_back(thread(readerThreadProc,shared));
+	}
+	//Replace sections with exclusive access while the readers run
+	for(int i=0;i<WRITECOUNT;++i) {
+		int section=rand()%SECTIONCOUNT;
+		VBufStorage_buffer_t* tempBuffer=new VBufStorage_buffer_t();
+		renderSection(tempBuffer,NULL,NULL,section,i+1);
+		shared->lock.acquire();
+		unsigned int version=buffer.getVersion();
+		map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> m;
+		m[buffer.getControlFieldNodeWithIdentifier(DOCHANDLE,sectionID(section))]=tempBuffer;
+		if(!buffer.replaceSubtrees(m,(i%2)!=0)) {
+			wcerr<<L"fail: could not replace section "<<section<<endl;
+			++failCount;
+		}
+		if(buffer.getVersion()==version) {
+			wcerr<<L"fail: version did not change when section "<<section<<L" was replaced"<<endl;
+			++failCount;
+		}
+		shared->lock.release();
+	}
+	for(vector<thread>::iterator i=threads.begin();i!=threads.end();++i) {
+		i->join();
+	}
+	failCount+=shared->failCount;
+	wcout<<READERCOUNT<<L" readers made "<<shared->readCount<<L" reads while "<<WRITECOUNT<<L" sections were replaced"<<endl;
+	buffer.clearBuffer();
+	delete shared;
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
@@ -1,30 +1,31 @@
 #include <iostream>
-#include <base/debug.h>
-#include <base/storage.h>
+#include <vbufBase/storage.h>
 
 using namespace std;
 
 #define TESTSIZE 8
 #define TESTSTRING L"test"
 
+int nextID=1;
+
 bool fillBuffer(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parentNode, int depth) {
 	VBufStorage_controlFieldNode_t* controlNode=NULL;
 	VBufStorage_textFieldNode_t* textNode=NULL;
 	depth++;
 	for(int i=0;i<depth;i++) {
 		if(depth<TESTSIZE) {
-			if((controlNode=buffer->addControlFieldNode(parentNode,controlNode,(int)parentNode,(int)controlNode,true))==NULL) {
-				DEBUG_MSG(L"Error adding control node to buffer");
+			if((controlNode=buffer->addControlFieldNode(parentNode,controlNode,1,nextID++,true))==NULL) {
+				wcerr<<L"Error adding control node to buffer"<<endl;
 				return false;
 			}
 			controlNode->addAttribute(L"control name",L"test");
 			if(!fillBuffer(buffer,controlNode,depth)) {
-				DEBUG_MSG(L"Error in recursion");
+				wcerr<<L"Error in recursion"<<endl;
 				return false;
 			}
 		} else {
 			if((textNode=buffer->addTextFieldNode(parentNode,textNode,TESTSTRING))==NULL) {
-				DEBUG_MSG(L"Error adding text node to buffer");
+				wcerr<<L"Error adding text node to buffer"<<endl;
 				return false;
 			}
 			textNode->addAttribute(L"text name",L"test");
@@ -32,8 +33,8 @@ bool fillBuffer(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* pa
 	}
 	return true;
 }
- 
-int main(int argc, char* argv[]) {
+
+int main() {
 	VBufStorage_buffer_t* buffer=new VBufStorage_buffer_t();
 	if(buffer==NULL) {
 		return 1;
@@ -0,0 +1,115 @@
+#include <iostream>
+#include <vector>
+#include <map>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+#define SECTIONCOUNT 500
+#define PARAGRAPHSPERSECTION 12
+#define RERENDERCOUNT 200
+#define DOCHANDLE 1
+#define TESTSTRING L"test "
+
+/**
+ * IDs are handed out so that re-rendering a section gives its nodes the same IDs again, like a backend re-rendering an invalidated subtree.
+ * Each paragraph uses two IDs, one for the paragraph and one for the link inside it.
+ */
+#define SECTIONIDSTRIDE (1+PARAGRAPHSPERSECTION*2)
+
+int failCount=0;
+
+int sectionID(int section) {
+	return 2+section*SECTIONIDSTRIDE;
+}
+
+/**
+ * Renders a section: a control field holding paragraphs, each with some text, a link and some more text.
+ * @return the section's node, or NULL on error.
+ */
+VBufStorage_controlFieldNode_t* renderSection(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int section) {
+	int ID=sectionID(section);
+	VBufStorage_controlFieldNode_t* sectionNode=buffer->addControlFieldNode(parent,previous,DOCHANDLE,ID++,true);
+	if(!sectionNode) return NULL;
+	VBufStorage_fieldNode_t* previousParagraph=NULL;
+	for(int i=0;i<PARAGRAPHSPERSECTION;++i) {
+		VBufStorage_controlFieldNode_t* paragraph=buffer->addControlFieldNode(sectionNode,previousParagraph,DOCHANDLE,ID++,true);
+		if(!paragraph) return NULL;
+		VBufStorage_textFieldNode_t* text=buffer->addTextFieldNode(paragraph,NULL,TESTSTRING);
+		VBufStorage_controlFieldNode_t* link=buffer->addControlFieldNode(paragraph,text,DOCHANDLE,ID++,false);
+		if(!text||!link) return NULL;
+		if(!buffer->addTextFieldNode(link,NULL,TESTSTRING)||!buffer->addTextFieldNode(paragraph,link,TESTSTRING)) return NULL;
+		previousParagraph=paragraph;
+	}
+	return sectionNode;
+}
+
+/**
+ * Checks that every identifier in the buffer finds the node it was given to, and that identifiers never given find nothing.
+ */
+void checkIdentifiers(VBufStorage_buffer_t* buffer, int maxID, const wchar_t* when) {
+	int badCount=0;
+	for(int ID=1;ID<maxID;++ID) {
+		VBufStorage_controlFieldNode_t* node=buffer->getControlFieldNodeWithIdentifier(DOCHANDLE,ID);
+		int docHandle=0, foundID=0;
+		if(!node||!node->getIdentifier(&docHandle,&foundID)||docHandle!=DOCHANDLE||foundID!=ID) ++badCount;
+	}
+	if(buffer->getControlFieldNodeWithIdentifier(DOCHANDLE,maxID)||buffer->getControlFieldNodeWithIdentifier(DOCHANDLE+1,1)) ++badCount;
+	if(badCount>0) {
+		wcerr<<L"fail: "<<badCount<<L" identifiers found the wrong node "<<when<<endl;
+		++failCount;
+	}
+}
+
+int main() {
+	VBufStorage_buffer_t* buffer=new VBufStorage_buffer_t();
+	VBufStorage_controlFieldNode_t* rootNode=buffer->addControlFieldNode(NULL,NULL,DOCHANDLE,1,true);
+	if(rootNode==NULL) {
+		return 1;
+	}
+	VBufStorage_fieldNode_t* previous=NULL;
+	for(int i=0;i<SECTIONCOUNT;++i) {
+		previous=renderSection(buffer,rootNode,previous,i);
+		if(previous==NULL) {
+			wcerr<<L"Error rendering section "<<i<<endl;
+			return 1;
+		}
+	}
+	int maxID=sectionID(SECTIONCOUNT);
+	checkIdentifiers(buffer,maxID,L"once rendered");
+	//Re-render sections, each in to a temporary buffer which then replaces the old section, so that the same identifiers are removed and added again
+	for(int i=0;i<RERENDERCOUNT;++i) {
+		int section=(i*7)%SECTIONCOUNT;
+		VBufStorage_controlFieldNode_t* oldNode=buffer->getControlFieldNodeWithIdentifier(DOCHANDLE,sectionID(section));
+		VBufStorage_buffer_t* tempBuffer=new VBufStorage_buffer_t();
+		if(!oldNode||!renderSection(tempBuffer,NULL,NULL,section)) {
+			wcerr<<L"fail: could not re-render section "<<section<<endl;
+			++failCount;
+			delete tempBuffer;
+			continue;
+		}
+		map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> replacements;
+		replacements[oldNode]=tempBuffer;
+		if(!buffer->replaceSubtrees(replacements)) {
+			wcerr<<L"fail: could not replace section "<<section<<endl;
+			++failCount;
+		}
+	}
+	checkIdentifiers(buffer,maxID,L"after re-rendering");
+	//Removing a section removes its identifiers
+	VBufStorage_controlFieldNode_t* removed=buffer->getControlFieldNodeWithIdentifier(DOCHANDLE,sectionID(SECTIONCOUNT/2));
+	buffer->removeFieldNode(removed);
+	int foundCount=0;
+	for(int ID=sectionID(SECTIONCOUNT/2);ID<sectionID(SECTIONCOUNT/2+1);++ID) {
+		if(buffer->getControlFieldNodeWithIdentifier(DOCHANDLE,ID)) ++foundCount;
+	}
+	if(foundCount>0) {
+		wcerr<<L"fail: "<<foundCount<<L" identifiers of a removed section still found"<<endl;
+		++failCount;
+	}
+	delete buffer;
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
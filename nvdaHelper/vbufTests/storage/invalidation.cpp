@@ -0,0 +1,113 @@
+#include <iostream>
+#include <vector>
+#include <list>
+#include <set>
+#include <cstdlib>
+#include <algorithm>
+#include <vbufBase/storage.h>
+#include <vbufBase/invalidSubtreeList.h>
+
+using namespace std;
+
+#define BRANCHCOUNT 20
+#define BRANCHDEPTH 20
+#define DOCHANDLE 1
+#define TESTSTRING L"test "
+
+/**
+ * @return true if descendant is a descendant of ancestor.
+ */
+bool isDescendant(VBufStorage_fieldNode_t* ancestor, VBufStorage_fieldNode_t* descendant) {
+	for(VBufStorage_fieldNode_t* node=descendant->getParent();node!=NULL;node=node->getParent()) {
+		if(node==ancestor) return true;
+	}
+	return false;
+}
+
+/**
+ * Adds a node to a list the way invalidateSubtree used to, comparing it with every listed node.
+ */
+void addByComparing(VBufStorage_controlFieldNodeList_t& list, VBufStorage_controlFieldNode_t* node) {
+	bool needsInsert=true;
+	for(VBufStorage_controlFieldNodeList_t::iterator i=list.begin();i!=list.end();) {
+		if(node==*i||isDescendant(*i,node)) {
+			return;
+		} else if(isDescendant(node,*i)) {
+			list.erase(i++);
+			if(needsInsert) {
+				list.insert(i,node);
+				needsInsert=false;
+			}
+		} else {
+			++i;
+		}
+	}
+	if(needsInsert) list.push_back(node);
+}
+
+int main() {
+	int failCount=0;
+	VBufStorage_buffer_t* buffer=new VBufStorage_buffer_t();
+	VBufStorage_controlFieldNode_t* rootNode=buffer->addControlFieldNode(NULL,NULL,DOCHANDLE,1,true);
+	if(rootNode==NULL) {
+		return 1;
+	}
+	//Branches of nested sections, each level with some text, like deeply nested lists or tables
+	vector<VBufStorage_controlFieldNode_t*> nodes;
+	int ID=2;
+	VBufStorage_fieldNode_t* previousBranch=NULL;
+	for(int i=0;i<BRANCHCOUNT;++i) {
+		VBufStorage_controlFieldNode_t* parent=rootNode;
+		VBufStorage_fieldNode_t* previous=previousBranch;
+		for(int j=0;j<BRANCHDEPTH;++j) {
+			VBufStorage_controlFieldNode_t* node=buffer->addControlFieldNode(parent,previous,DOCHANDLE,ID++,true);
+			if(!node||!buffer->addTextFieldNode(node,NULL,TESTSTRING)) {
+				wcerr<<L"fail: could not build buffer"<<endl;
+				return 1;
+			}
+			if(j==0) previousBranch=node;
+			nodes.push_back(node);
+			parent=node;
+			previous=node->getFirstChild();
+		}
+	}
+	//Invalidate every node once in a random order, and then the root, which takes the place of everything
+	srand(1);
+	vector<VBufStorage_controlFieldNode_t*> invalidations(nodes);
+	random_shuffle(invalidations.begin(),invalidations.end());
+	invalidations.push_back(rootNode);
+	for(int pass=0;pass<2;++pass) {
+		size_t count=(pass==0)?invalidations.size()-1:invalidations.size();
+		VBufStorage_controlFieldNodeList_t compared;
+		for(size_t i=0;i<count;++i) addByComparing(compared,invalidations[i]);
+		VBufStorage_invalidSubtreeList_t marked;
+		VBufStorage_controlFieldNodeList_t taken;
+		for(size_t i=0;i<count;++i) marked.add(invalidations[i]);
+		marked.take(taken);
+		if(set<VBufStorage_controlFieldNode_t*>(compared.begin(),compared.end())!=set<VBufStorage_controlFieldNode_t*>(taken.begin(),taken.end())||compared.size()!=taken.size()) {
+			wcerr<<L"fail: marking and comparing gave different subtrees"<<endl;
+			++failCount;
+		}
+		if(!marked.empty()) {
+			wcerr<<L"fail: list not empty after being taken"<<endl;
+			++failCount;
+		}
+	}
+	//Once taken, every node can be invalidated again
+	VBufStorage_invalidSubtreeList_t marked;
+	VBufStorage_controlFieldNodeList_t taken;
+	for(vector<VBufStorage_controlFieldNode_t*>::iterator i=nodes.begin();i!=nodes.end();++i) {
+		if((*i)->getParent()==rootNode) marked.add(*i);
+	}
+	marked.take(taken);
+	if(taken.size()!=BRANCHCOUNT) {
+		wcerr<<L"fail: "<<taken.size()<<L" branches taken after invalidating "<<BRANCHCOUNT<<endl;
+		++failCount;
+	}
+	buffer->clearBuffer();
+	delete buffer;
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
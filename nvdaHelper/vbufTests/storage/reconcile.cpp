@@ -0,0 +1,131 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <cstdlib>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+#define ROWCOUNT 100
+#define COLUMNCOUNT 10
+#define RERENDERCOUNT 50
+#define DOCHANDLE 1
+//Longer than the text of any cell
+#define MAXCELLLENGTH 32
+
+int cellID(int row, int column) {
+	return 3+row*(COLUMNCOUNT+1)+1+column;
+}
+
+/**
+ * Renders a table whose cells each hold a text node. The text of the cell numbered changedCell says how many times it has been changed.
+ * @return the table node, or NULL on error.
+ */
+VBufStorage_controlFieldNode_t* renderTable(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, int changedCell, int changeCount) {
+	VBufStorage_controlFieldNode_t* table=buffer->addControlFieldNode(parent,NULL,DOCHANDLE,2,true);
+	if(!table) return NULL;
+	table->addAttribute(L"role",L"table");
+	VBufStorage_controlFieldNode_t* row=NULL;
+	for(int r=0;r<ROWCOUNT;++r) {
+		row=buffer->addControlFieldNode(table,row,DOCHANDLE,cellID(r,0)-1,true);
+		if(!row) return NULL;
+		row->addAttribute(L"role",L"row");
+		VBufStorage_controlFieldNode_t* cell=NULL;
+		for(int c=0;c<COLUMNCOUNT;++c) {
+			cell=buffer->addControlFieldNode(row,cell,DOCHANDLE,cellID(r,c),false);
+			if(!cell) return NULL;
+			cell->addAttribute(L"role",L"cell");
+			wostringstream s;
+			s<<L"cell "<<r<<L","<<c;
+			if(r*COLUMNCOUNT+c==changedCell) s<<L" changed "<<changeCount;
+			s<<L" ";
+			if(!buffer->addTextFieldNode(cell,NULL,s.str())) return NULL;
+		}
+	}
+	return table;
+}
+
+/**
+ * Re-renders the table with a random cell changed each time, replacing or reconciling the old table.
+ * @return the number of failed checks.
+ */
+int rerenderTable(VBufStorage_buffer_t* buffer, bool reconcile) {
+	int failCount=0;
+	srand(1);
+	//Handles NVDA would hold, such as the one for the table and for the cell with the caret
+	VBufStorage_nodeHandle_t tableHandle=buffer->getHandleForNode(buffer->getControlFieldNodeWithIdentifier(DOCHANDLE,2));
+	VBufStorage_nodeHandle_t cellHandle=buffer->getHandleForNode(buffer->getControlFieldNodeWithIdentifier(DOCHANDLE,cellID(0,0)));
+	for(int i=0;i<RERENDERCOUNT;++i) {
+		int changedCell=1+rand()%(ROWCOUNT*COLUMNCOUNT-1);
+		VBufStorage_fieldNode_t* oldNode=buffer->getControlFieldNodeWithIdentifier(DOCHANDLE,2);
+		VBufStorage_buffer_t* tempBuffer=new VBufStorage_buffer_t();
+		if(!oldNode||!renderTable(tempBuffer,NULL,changedCell,i)) {
+			wcerr<<L"fail: could not re-render table"<<endl;
+			++failCount;
+			delete tempBuffer;
+			continue;
+		}
+		map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> replacements;
+		replacements[oldNode]=tempBuffer;
+		VBufStorage_textEditList_t edits;
+		if(!buffer->replaceSubtrees(replacements,reconcile,&edits)) {
+			wcerr<<L"fail: could not replace table"<<endl;
+			++failCount;
+			continue;
+		}
+		//The cell changed by the previous re-render changes back, so up to two cells change
+		int cellStart=0, cellEnd=0;
+		buffer->getFieldNodeOffsets(buffer->getControlFieldNodeWithIdentifier(DOCHANDLE,cellID(changedCell/COLUMNCOUNT,changedCell%COLUMNCOUNT)),&cellStart,&cellEnd);
+		bool covered=false, onlyCells=true;
+		//How far the edits before the one being looked at moved the text after them
+		int delta=0;
+		for(vector<VBufStorage_textEdit_t>::const_iterator j=edits.getEdits().begin();j!=edits.getEdits().end();++j) {
+			int newStart=j->oldStart+delta;
+			if(newStart<=cellStart&&newStart+j->newLength>=cellEnd) covered=true;
+			if(j->newLength>MAXCELLLENGTH||j->oldEnd-j->oldStart>MAXCELLLENGTH) onlyCells=false;
+			delta+=j->newLength-(j->oldEnd-j->oldStart);
+		}
+		if(!covered) {
+			wcerr<<L"fail: edits do not cover the changed cell"<<endl;
+			++failCount;
+		} else if(reconcile&&(edits.getEdits().size()>2||!onlyCells)) {
+			wcerr<<L"fail: reconciling changed more than the changed cells"<<endl;
+			++failCount;
+		}
+	}
+	bool handlesValid=buffer->getNodeForHandle(tableHandle)&&buffer->getNodeForHandle(cellHandle);
+	if(handlesValid!=reconcile) {
+		wcerr<<L"fail: handles "<<(handlesValid?L"kept":L"lost")<<(reconcile?L" when reconciling":L" when replacing")<<endl;
+		++failCount;
+	}
+	return failCount;
+}
+
+int main() {
+	int failCount=0;
+	VBufStorage_buffer_t* replaceBuffer=new VBufStorage_buffer_t();
+	VBufStorage_buffer_t* reconcileBuffer=new VBufStorage_buffer_t();
+	VBufStorage_controlFieldNode_t* replaceRoot=replaceBuffer->addControlFieldNode(NULL,NULL,DOCHANDLE,1,true);
+	VBufStorage_controlFieldNode_t* reconcileRoot=reconcileBuffer->addControlFieldNode(NULL,NULL,DOCHANDLE,1,true);
+	if(!replaceRoot||!reconcileRoot||!renderTable(replaceBuffer,replaceRoot,-1,0)||!renderTable(reconcileBuffer,reconcileRoot,-1,0)) {
+		wcerr<<L"Error rendering table"<<endl;
+		return 1;
+	}
+	failCount+=rerenderTable(replaceBuffer,false);
+	failCount+=rerenderTable(reconcileBuffer,true);
+	VBufStorage_textContainer_t* replaceText=replaceBuffer->getTextInRange(0,replaceBuffer->getTextLength(),true);
+	VBufStorage_textContainer_t* reconcileText=reconcileBuffer->getTextInRange(0,reconcileBuffer->getTextLength(),true);
+	if(!replaceText||!reconcileText||replaceText->getString()!=reconcileText->getString()) {
+		wcerr<<L"fail: reconciled buffer differs from replaced buffer"<<endl;
+		++failCount;
+	}
+	if(replaceText) replaceText->destroy();
+	if(reconcileText) reconcileText->destroy();
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	delete replaceBuffer;
+	delete reconcileBuffer;
+	return failCount;
+}
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <vbufBase/textEditList.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define testNoIO(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+unsigned int seed=1;
+
+/**
+ * A repeatable pseudo random number, so that every run makes the same edits.
+ */
+int randomNumber(int limit) {
+	seed=seed*1103515245+12345;
+	return static_cast<int>((seed>>16)%static_cast<unsigned int>(limit));
+}
+
+/**
+ * Rebuilds the new text from the old one using only the spans of a list, taking the text of each span from the new text.
+ * @return true if the text outside the spans is the same in both, and the result is the new text.
+ */
+bool applyEdits(const VBufStorage_textEditList_t& edits, const wstring& oldText, const wstring& newText) {
+	wstring result;
+	int oldPos=0;
+	int newPos=0;
+	const vector<VBufStorage_textEdit_t>& spans=edits.getEdits();
+	for(vector<VBufStorage_textEdit_t>::const_iterator i=spans.begin();i!=spans.end();++i) {
+		if(i->oldStart<oldPos||i->oldEnd<i->oldStart||i->oldEnd>static_cast<int>(oldText.length())) return false;
+		result.append(oldText,oldPos,i->oldStart-oldPos);
+		newPos+=i->oldStart-oldPos;
+		if(newPos+i->newLength>static_cast<int>(newText.length())) return false;
+		result.append(newText,newPos,i->newLength);
+		newPos+=i->newLength;
+		oldPos=i->oldEnd;
+	}
+	result.append(oldText,oldPos,wstring::npos);
+	return result==newText;
+}
+
+/**
+ * Makes random edits to a text, adding each to a list as it is made.
+ */
+void makeEdits(wstring& text, VBufStorage_textEditList_t& edits, int count) {
+	for(int i=0;i<count;++i) {
+		int start=randomNumber(static_cast<int>(text.length())+1);
+		int end=start+randomNumber(min(8,static_cast<int>(text.length())-start)+1);
+		int newLength=randomNumber(8);
+		wstring replacement;
+		for(int j=0;j<newLength;++j) replacement+=static_cast<wchar_t>(L'a'+randomNumber(26));
+		text.replace(start,end-start,replacement);
+		edits.add(start,end,newLength);
+	}
+}
+
+void testSequential() {
+	for(int run=0;run<200;++run) {
+		wstring oldText(static_cast<size_t>(randomNumber(64)),L'x');
+		for(size_t i=0;i<oldText.length();++i) oldText[i]=static_cast<wchar_t>(L'A'+randomNumber(26));
+		wstring newText=oldText;
+		VBufStorage_textEditList_t edits;
+		makeEdits(newText,edits,1+randomNumber(10));
+		testNoIO(applyEdits(edits,oldText,newText),L"sequential edits of run "<<run<<L" do not give the new text");
+	}
+}
+
+void testAddList() {
+	for(int run=0;run<200;++run) {
+		wstring firstText(static_cast<size_t>(randomNumber(64)),L'x');
+		for(size_t i=0;i<firstText.length();++i) firstText[i]=static_cast<wchar_t>(L'A'+randomNumber(26));
+		wstring secondText=firstText;
+		VBufStorage_textEditList_t firstEdits;
+		makeEdits(secondText,firstEdits,1+randomNumber(10));
+		wstring thirdText=secondText;
+		VBufStorage_textEditList_t secondEdits;
+		makeEdits(thirdText,secondEdits,1+randomNumber(10));
+		firstEdits.add(secondEdits);
+		testNoIO(applyEdits(firstEdits,firstText,thirdText),L"added list of run "<<run<<L" does not give the new text");
+	}
+}
+
+void testManyEdits() {
+	wstring oldText(4000,L'x');
+	wstring newText=oldText;
+	VBufStorage_textEditList_t edits;
+	//Edits far apart that never merge with each other
+	for(int i=0;i<1000;++i) {
+		int start=static_cast<int>(newText.length())-4*i-2;
+		newText.replace(start,1,L"yy");
+		edits.add(start,start+1,2);
+	}
+	testNoIO(edits.getEdits().size()<=256,L"list kept "<<edits.getEdits().size()<<L" spans");
+	testNoIO(applyEdits(edits,oldText,newText),L"merged spans do not give the new text");
+}
+
+int main() {
+	testSequential();
+	testAddList();
+	testManyEdits();
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
@@ -7,7 +7,7 @@
  */
 
 #include <iostream>
-#include <base/utils.h>
+#include <vbufBase/utils.h>
 
 using namespace std;
 
@@ -139,7 +139,7 @@ void test_multiValueAttribsStringToMap() {
 	m.clear();
 }
 
-int main(int argc, char *argv[]) {
+int main() {
 	test_getNameForURL();
 	test_multiValueAttribsStringToMap();
 	if(failCount>0) {
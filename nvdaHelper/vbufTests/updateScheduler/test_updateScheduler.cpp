@@ -0,0 +1,243 @@
+/**
+ * tests/updateScheduler/test_updateScheduler.cpp
+ * Part of the NV  Virtual Buffer Library
+ * This library is copyright 2007, 2008 NV Virtual Buffer Library Contributors
+ * This library is licensed under the GNU Lesser General Public Licence. See license.txt which is included with this library, or see
+ * http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
+ */
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <vbufBase/storage.h>
+#include <vbufBase/invalidSubtreeList.h>
+#include <vbufBase/updateScheduler.h>
+
+using namespace std;
+
+int failCount=0;
+
+#define testNoIO(expr, msg) if (!(expr)) { wcerr << L"fail: " << msg << endl; failCount++;}
+
+/**
+ * A clock that only moves when told to, so that runs are repeatable.
+ */
+class simulatedClock_t: public VBufBackend_clock_t {
+	public:
+	unsigned int time;
+	simulatedClock_t(): time(0) {}
+	unsigned int getTime() { return time; }
+};
+
+/**
+ * A burst of invalidations at a fixed interval.
+ */
+typedef struct {
+	unsigned int start;
+	int count;
+	int interval;
+} burst_t;
+
+/**
+ * The results of a run.
+ */
+typedef struct {
+	int updateCount;
+	int maxLatency;
+	int urgentLatency;
+} runResult_t;
+
+/**
+ * A backend with a document of lines, which invalidates and updates as VBufBackend_t does, but with a simulated timer so that runs are repeatable.
+ * invalidateSubtree lists the node and finds out whether it holds the caret with the same code as VBufBackend_t::invalidateSubtree, then arms the timer as requestUpdate does.
+ */
+class simulatedBackend_t: public VBufStorage_buffer_t {
+	private:
+
+	simulatedClock_t& clock;
+	VBufBackend_updateScheduler_t scheduler;
+	VBufStorage_invalidSubtreeList_t invalidSubtreeList;
+	bool useScheduler;
+	bool timerArmed;
+	unsigned int timerTime;
+
+	public:
+
+/**
+ * The lines of the document. The caret is in the last one.
+ */
+	vector<VBufStorage_controlFieldNode_t*> lines;
+
+/**
+ * @param clockArg the clock the scheduler takes times from.
+ * @param useSchedulerArg if false, the backend's old fixed 100 ms timer is used instead, for comparison.
+ * @param lineCount the number of lines in the document.
+ */
+	simulatedBackend_t(simulatedClock_t& clockArg, bool useSchedulerArg, int lineCount): VBufStorage_buffer_t(), clock(clockArg), scheduler(&clockArg), invalidSubtreeList(), useScheduler(useSchedulerArg), timerArmed(false), timerTime(0), lines() {
+		VBufStorage_controlFieldNode_t* root=addControlFieldNode(NULL,NULL,1,1,true);
+		VBufStorage_fieldNode_t* previous=NULL;
+		for(int i=0;i<lineCount;++i) {
+			VBufStorage_controlFieldNode_t* line=addControlFieldNode(root,previous,1,i+2,true);
+			addTextFieldNode(line,NULL,L"line");
+			lines.push_back(line);
+			previous=line;
+		}
+		int caretOffset=getTextLength()-1;
+		setSelectionOffsets(caretOffset,caretOffset);
+	}
+
+	bool invalidateSubtree(VBufStorage_controlFieldNode_t* node) {
+		bool containsCaret=false;
+		if(!invalidSubtreeList.invalidate(this,node,&containsCaret)) return false;
+		if(useScheduler) {
+			scheduler.invalidated(containsCaret);
+			//Setting an existing timer again replaces its timeout
+			timerArmed=true;
+			timerTime=clock.time+scheduler.getDelay();
+		} else if(!timerArmed) {
+			timerArmed=true;
+			timerTime=clock.time+100;
+		}
+		return true;
+	}
+
+/**
+ * Fires the timer if it is due, updating if the scheduler says the update is due or waiting for the rest of the delay, as the backend's timer does.
+ * @return true if the backend updated.
+ */
+	bool tick() {
+		if(!timerArmed||clock.time!=timerTime) return false;
+		timerArmed=false;
+		if(useScheduler) {
+			int delay=scheduler.getDelay();
+			if(delay>0) {
+				timerArmed=true;
+				timerTime=clock.time+delay;
+				return false;
+			}
+			scheduler.updated();
+		}
+		VBufStorage_controlFieldNodeList_t invalidNodes;
+		invalidSubtreeList.take(invalidNodes);
+		return true;
+	}
+
+};
+
+/**
+ * Drives a simulated backend's invalidateSubtree and timer, a millisecond at a time.
+ * The invalidations of the bursts are of lines away from the caret.
+ * @param bursts the invalidations to make.
+ * @param urgentTime the time of an invalidation of the line with the caret, or -1 for none.
+ * @param useScheduler if false, the backend's old fixed 100 ms timer is used instead, for comparison.
+ */
+runResult_t run(const vector<burst_t>& bursts, int urgentTime, bool useScheduler) {
+	simulatedClock_t clock;
+	simulatedBackend_t backend(clock,useScheduler,4);
+	runResult_t result={0,0,-1};
+	vector<unsigned int> invalidationTimes;
+	for(vector<burst_t>::const_iterator i=bursts.begin();i!=bursts.end();++i) {
+		for(int j=0;j<i->count;++j) invalidationTimes.push_back(i->start+j*i->interval);
+	}
+	sort(invalidationTimes.begin(),invalidationTimes.end());
+	unsigned int endTime=invalidationTimes.empty()?0:invalidationTimes.back()+2000;
+	//Times of the invalidations that have not been updated yet
+	vector<unsigned int> waiting;
+	bool urgentWaiting=false;
+	size_t next=0;
+	for(clock.time=0;clock.time<=endTime;++clock.time) {
+		if(urgentTime>=0&&clock.time==static_cast<unsigned int>(urgentTime)) {
+			testNoIO(backend.invalidateSubtree(backend.lines.back()),L"caret line not invalidated");
+			urgentWaiting=true;
+			waiting.push_back(clock.time);
+		}
+		for(;next<invalidationTimes.size()&&invalidationTimes[next]==clock.time;++next) {
+			testNoIO(backend.invalidateSubtree(backend.lines[next%(backend.lines.size()-1)]),L"line not invalidated");
+			waiting.push_back(clock.time);
+		}
+		if(!backend.tick()) continue;
+		++result.updateCount;
+		for(vector<unsigned int>::iterator i=waiting.begin();i!=waiting.end();++i) {
+			int latency=static_cast<int>(clock.time-*i);
+			if(latency>result.maxLatency) result.maxLatency=latency;
+		}
+		if(urgentWaiting) {
+			result.urgentLatency=static_cast<int>(clock.time-urgentTime);
+			urgentWaiting=false;
+		}
+		waiting.clear();
+	}
+	testNoIO(waiting.empty(),L"invalidations left without an update");
+	backend.clearBuffer();
+	return result;
+}
+
+void report(const wchar_t* name, const vector<burst_t>& bursts, runResult_t& result, runResult_t& oldResult) {
+	int invalidationCount=0;
+	for(vector<burst_t>::const_iterator i=bursts.begin();i!=bursts.end();++i) invalidationCount+=i->count;
+	wcout<<name<<L": "<<invalidationCount<<L" invalidations, "<<result.updateCount<<L" updates (fixed timer "<<oldResult.updateCount<<L"), max latency "<<result.maxLatency<<L" ms (fixed timer "<<oldResult.maxLatency<<L" ms)"<<endl;
+}
+
+int main() {
+	simulatedClock_t clock;
+	VBufBackend_updateScheduler_t defaults(&clock);
+	vector<burst_t> bursts;
+	runResult_t result, oldResult;
+
+	//A single change should be updated after the first delay, sooner than the fixed timer
+	burst_t single={0,1,0};
+	bursts.assign(1,single);
+	result=run(bursts,-1,true);
+	oldResult=run(bursts,-1,false);
+	report(L"single change",bursts,result,oldResult);
+	testNoIO(result.updateCount==1&&result.maxLatency==defaults.firstDelay,L"single change latency "<<result.maxLatency);
+
+	//A steady stream should be coalesced in to updates at the maximum latency
+	burst_t stream={0,500,10};
+	bursts.assign(1,stream);
+	result=run(bursts,-1,true);
+	oldResult=run(bursts,-1,false);
+	report(L"stream every 10 ms",bursts,result,oldResult);
+	testNoIO(result.maxLatency<=defaults.maxLatency,L"stream latency "<<result.maxLatency);
+	testNoIO(result.updateCount<oldResult.updateCount,L"stream not coalesced");
+
+	//Separate bursts should each be updated once, shortly after they end
+	bursts.clear();
+	for(int i=0;i<5;++i) {
+		burst_t burst={i*2000u,20,5};
+		bursts.push_back(burst);
+	}
+	result=run(bursts,-1,true);
+	oldResult=run(bursts,-1,false);
+	report(L"bursts",bursts,result,oldResult);
+	testNoIO(result.updateCount==5,L"bursts gave "<<result.updateCount<<L" updates");
+	testNoIO(result.maxLatency<=19*5+defaults.firstDelay,L"burst latency "<<result.maxLatency);
+
+	//A slow ticker should be backed off, but still within the maximum latency
+	burst_t ticker={0,50,200};
+	bursts.assign(1,ticker);
+	result=run(bursts,-1,true);
+	oldResult=run(bursts,-1,false);
+	report(L"ticker every 200 ms",bursts,result,oldResult);
+	testNoIO(result.maxLatency<=defaults.maxLatency,L"ticker latency "<<result.maxLatency);
+	testNoIO(result.updateCount<oldResult.updateCount,L"ticker not backed off");
+
+	//A change at the caret in the middle of a stream should not wait for the backoff
+	bursts.assign(1,stream);
+	result=run(bursts,2005,true);
+	wcout<<L"caret change during stream: latency "<<result.urgentLatency<<L" ms"<<endl;
+	testNoIO(result.urgentLatency>=0&&result.urgentLatency<=defaults.urgentDelay,L"caret latency "<<result.urgentLatency);
+
+	//A change at the caret while backed off should not be pushed back by the changes that follow it
+	bursts.assign(1,ticker);
+	burst_t afterCaret={4005,5,5};
+	bursts.push_back(afterCaret);
+	result=run(bursts,4000,true);
+	wcout<<L"caret change followed by others while backed off: latency "<<result.urgentLatency<<L" ms"<<endl;
+	testNoIO(result.urgentLatency>=0&&result.urgentLatency<=defaults.urgentDelay,L"caret latency "<<result.urgentLatency);
+
+	if(failCount>0) {
+		wcerr<<L"number of failed tests: "<<failCount<<endl;
+	}
+	return failCount;
+}
@@ -367,6 +367,13 @@ def nvdaControllerInternal_vbufChangeNotify(rootDocHandle, rootID):
 	virtualBuffers.VirtualBuffer.changeNotify(rootDocHandle, rootID)
 	return 0
 
+@WINFUNCTYPE(c_long, c_int, c_int, c_int, POINTER(c_int))
+def nvdaControllerInternal_vbufEditsNotify(rootDocHandle, rootID, editCount, edits):
+	import virtualBuffers
+	edits=[(edits[i*3],edits[i*3+1],edits[i*3+2]) for i in xrange(editCount)]
+	virtualBuffers.VirtualBuffer.changeNotify(rootDocHandle, rootID, edits=edits)
+	return 0
+
 @WINFUNCTYPE(c_long, c_wchar_p)
 def nvdaControllerInternal_installAddonPackageFromPath(addonPath):
 	import wx
@@ -432,6 +439,7 @@ def initialize():
 		("nvdaControllerInternal_IMEOpenStatusUpdate",nvdaControllerInternal_IMEOpenStatusUpdate),
 		("nvdaControllerInternal_inputConversionModeUpdate",nvdaControllerInternal_inputConversionModeUpdate),
 		("nvdaControllerInternal_vbufChangeNotify",nvdaControllerInternal_vbufChangeNotify),
+		("nvdaControllerInternal_vbufEditsNotify",nvdaControllerInternal_vbufEditsNotify),
 		("nvdaControllerInternal_installAddonPackageFromPath",nvdaControllerInternal_installAddonPackageFromPath),
 		("nvdaControllerInternal_drawFocusRectNotify",nvdaControllerInternal_drawFocusRectNotify),
 	]:
@@ -662,14 +662,16 @@ class VirtualBuffer(browseMode.BrowseModeDocumentTreeInterceptor):
 		return self.makeTextInfo(textInfos.offsets.Offsets(*offsets))
 
 	@classmethod
-	def changeNotify(cls, rootDocHandle, rootID):
+	def changeNotify(cls, rootDocHandle, rootID, edits=None):
 		try:
-			queueHandler.queueFunction(queueHandler.eventQueue, cls.rootIdentifiers[rootDocHandle, rootID]._handleUpdate)
+			queueHandler.queueFunction(queueHandler.eventQueue, cls.rootIdentifiers[rootDocHandle, rootID]._handleUpdate, edits=edits)
 		except KeyError:
 			pass
 
-	def _handleUpdate(self):
+	def _handleUpdate(self, edits=None):
 		"""Handle an update to this buffer.
+		@param edits: the edits made to the text, if known, in order of offset, each as a tuple of the start and end offsets of the replaced text in the old text and the length of the text that replaced it.
+		@type edits: list of (int, int, int)
 		"""
 		braille.handler.handleUpdate(self)
 